@@ -47,13 +47,17 @@ static void reflect_initialise(void)
 {
     int i;
 
-    bugle_hash_init(&function_id_map, NULL);
+    /* The names are in static tables, so there is no need to copy them */
+    bugle_hash_init_nocopy(&function_id_map, NULL);
+    bugle_hash_reserve(&function_id_map, _budgie_function_count);
     for (i = 0; i < _budgie_function_count; i++)
         bugle_hash_set(&function_id_map, _budgie_function_table[i].name,
                        (void *) (size_t) (i + 1));
 
-    bugle_hash_init(&type_id_map, NULL);
-    bugle_hash_init(&type_id_nomangle_map, NULL);
+    bugle_hash_init_nocopy(&type_id_map, NULL);
+    bugle_hash_init_nocopy(&type_id_nomangle_map, NULL);
+    bugle_hash_reserve(&type_id_map, _budgie_type_count);
+    bugle_hash_reserve(&type_id_nomangle_map, _budgie_type_count);
     for (i = 0; i < _budgie_type_count; i++)
     {
         bugle_hash_set(&type_id_map, _budgie_type_table[i].name,
@@ -26,103 +26,132 @@
 #include <bugle/memory.h>
 #include <bugle/string.h>
 #include <bugle/hashtable.h>
-#include "platform/threads.h"
 
-/* Primes are used for hash table sizes */
-static size_t primes[sizeof(size_t) * 8];
+/* Both tables use open addressing with linear probing. The size is always
+ * a power of 2 (or 0 for an empty table), and the table is grown to keep
+ * the load factor at most 3/4. Removal shifts later entries in the probe
+ * sequence backwards to fill the hole, so there are no tombstones and
+ * lookups never need to skip over deleted entries.
+ */
 
-static bugle_bool is_prime(int x)
-{
-    int i;
+#define HASH_MIN_SIZE 8
 
-    for (i = 2; i * i <= x; i++)
-        if (x % i == 0) return BUGLE_FALSE;
-    return BUGLE_TRUE;
+/* Mixes the bits of h so that every input bit affects the low-order bits,
+ * which are the only ones used to select a slot. The multipliers are from
+ * the MurmurHash3 finaliser. The first step folds the upper half of a
+ * 64-bit size_t into the lower half.
+ */
+static inline size_t hash_mix(size_t h)
+{
+    h ^= h >> (sizeof(size_t) * 4);
+    h ^= h >> 16;
+    h *= (size_t) 0x85ebca6bUL;
+    h ^= h >> 13;
+    h *= (size_t) 0xc2b2ae35UL;
+    h ^= h >> 16;
+    return h;
 }
 
-static bugle_thread_once_t hash_once = BUGLE_THREAD_ONCE_INIT;
-
-static void hash_initialise(void)
+/* FNV-1a, followed by a final mix */
+static inline size_t hash(const char *str)
 {
-    int i;
+    size_t h = (size_t) 2166136261UL;
+    const unsigned char *ch;
 
-    primes[0] = 0;
-    primes[1] = 5;
-    i = 1;
-    while (primes[i] < ((size_t) -1) / 2)
+    for (ch = (const unsigned char *) str; *ch; ch++)
     {
-        primes[i + 1] = primes[i] * 2 + 1;
-        i++;
-        while (!is_prime(primes[i])) primes[i] += 2;
+        h ^= *ch;
+        h *= (size_t) 16777619UL;
     }
-    primes[i + 1] = (size_t) -1;
+    return hash_mix(h);
 }
 
-static inline size_t hash(const char *str)
+static inline size_t hashptr(const void *ptr)
+{
+    return hash_mix((const char *) ptr - (const char *) NULL);
+}
+
+/* Returns the smallest table size that can hold count entries */
+static size_t hash_size_for(size_t count)
 {
-    size_t h = 0;
-    const char *ch;
+    size_t size = HASH_MIN_SIZE;
 
-    for (ch = str; *ch; ch++)
-        h = (h + *ch) * 29;
-    return h;
+    while (size - size / 4 < count)
+        size *= 2;
+    return size;
 }
 
 void bugle_hash_init(hash_table *table, void (*destructor)(void *))
 {
     table->size = table->count = 0;
-    table->size_index = 0;
-    table->entries = 0;
+    table->entries = NULL;
+    table->copy_keys = BUGLE_TRUE;
     table->destructor = destructor;
 }
 
-/* Does not
- * - resize the table
- * - update the count
- * - copy the memory for the key
- * - check for duplicate keys
- * It should only be used for rehashing
+void bugle_hash_init_nocopy(hash_table *table, void (*destructor)(void *))
+{
+    bugle_hash_init(table, destructor);
+    table->copy_keys = BUGLE_FALSE;
+}
+
+/* Returns the slot containing key, or the empty slot where it belongs.
+ * full must be hash(key). The table must not be empty.
  */
-static void hash_set_fast(hash_table *table, char *key, void *value)
+static size_t hash_find(const hash_table *table, const char *key, size_t full)
 {
+    size_t mask = table->size - 1;
     size_t h;
 
-    h = hash(key) % table->size;
-    while (table->entries[h].key)
-        if (++h == table->size) h = 0;
-    table->entries[h].key = key;
-    table->entries[h].value = value;
+    h = full & mask;
+    while (table->entries[h].key
+           && (table->entries[h].hash != full
+               || strcmp(key, table->entries[h].key) != 0))
+        h = (h + 1) & mask;
+    return h;
+}
+
+static void hash_resize(hash_table *table, size_t size)
+{
+    hash_table_entry *old;
+    size_t old_size, i, h, mask;
+
+    old = table->entries;
+    old_size = table->size;
+    table->entries = BUGLE_CALLOC(size, hash_table_entry);
+    table->size = size;
+    mask = size - 1;
+    for (i = 0; i < old_size; i++)
+        if (old[i].key)
+        {
+            h = old[i].hash & mask;
+            while (table->entries[h].key)
+                h = (h + 1) & mask;
+            table->entries[h] = old[i];
+        }
+    if (old) bugle_free(old);
+}
+
+void bugle_hash_reserve(hash_table *table, size_t count)
+{
+    size_t size = hash_size_for(count);
+    if (size > table->size)
+        hash_resize(table, size);
 }
 
 void bugle_hash_set(hash_table *table, const char *key, void *value)
 {
-    hash_table big;
-    size_t i;
-    size_t h;
+    size_t h, full;
 
-    if (table->count >= table->size / 2
-        && table->size < (size_t) -1)
-    {
-        bugle_thread_once(&hash_once, hash_initialise);
-        big.size_index = table->size_index + 1;
-        big.size = primes[big.size_index];
-        big.entries = BUGLE_CALLOC(big.size, hash_table_entry);
-        big.count = 0;
-        big.destructor = table->destructor;
-        for (i = 0; i < table->size; i++)
-            if (table->entries[i].key)
-                hash_set_fast(&big, table->entries[i].key,
-                                    table->entries[i].value);
-        if (table->entries) bugle_free(table->entries);
-        *table = big;
-    }
+    if (table->count + 1 > table->size - table->size / 4)
+        hash_resize(table, table->size ? table->size * 2 : HASH_MIN_SIZE);
 
-    h = hash(key) % table->size;
-    while (table->entries[h].key && strcmp(key, table->entries[h].key) != 0)
-        if (++h == table->size) h = 0;
+    full = hash(key);
+    h = hash_find(table, key, full);
     if (!table->entries[h].key)
     {
-        table->entries[h].key = bugle_strdup(key);
+        table->entries[h].key = table->copy_keys ? bugle_strdup(key) : (char *) key;
+        table->entries[h].hash = full;
         table->count++;
     }
     else if (table->destructor)
@@ -132,25 +161,46 @@ void bugle_hash_set(hash_table *table, const char *key, void *value)
 
 bugle_bool bugle_hash_count(const hash_table *table, const char *key)
 {
-    size_t h;
-
-    if (!table->entries) return BUGLE_FALSE;
-    h = hash(key) % table->size;
-    while (table->entries[h].key && strcmp(key, table->entries[h].key) != 0)
-        if (++h == table->size) h = 0;
-    return table->entries[h].key != NULL;
+    if (!table->count) return BUGLE_FALSE;
+    return table->entries[hash_find(table, key, hash(key))].key != NULL;
 }
 
 void *bugle_hash_get(const hash_table *table, const char *key)
 {
-    size_t h;
+    if (!table->count) return NULL;
+    return table->entries[hash_find(table, key, hash(key))].value;
+}
 
-    if (!table->entries) return NULL;
-    h = hash(key) % table->size;
-    while (table->entries[h].key && strcmp(key, table->entries[h].key) != 0)
-        if (++h == table->size) h = 0;
-    if (table->entries[h].key) return table->entries[h].value;
-    else return NULL;
+void bugle_hash_remove(hash_table *table, const char *key)
+{
+    size_t i, j, home, mask;
+
+    if (!table->count) return;
+    i = hash_find(table, key, hash(key));
+    if (!table->entries[i].key) return;
+
+    if (table->copy_keys)
+        bugle_free(table->entries[i].key);
+    if (table->destructor)
+        table->destructor(table->entries[i].value);
+    table->count--;
+
+    /* Shift back any following entries that probed past the hole */
+    mask = table->size - 1;
+    j = i;
+    for (;;)
+    {
+        j = (j + 1) & mask;
+        if (!table->entries[j].key) break;
+        home = table->entries[j].hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask))
+        {
+            table->entries[i] = table->entries[j];
+            i = j;
+        }
+    }
+    table->entries[i].key = NULL;
+    table->entries[i].value = NULL;
 }
 
 void bugle_hash_clear(hash_table *table)
@@ -162,7 +212,8 @@ void bugle_hash_clear(hash_table *table)
         for (i = 0; i < table->size; i++)
             if (table->entries[i].key)
             {
-                bugle_free(table->entries[i].key);
+                if (table->copy_keys)
+                    bugle_free(table->entries[i].key);
                 if (table->destructor)
                     table->destructor(table->entries[i].value);
             }
@@ -170,7 +221,6 @@ void bugle_hash_clear(hash_table *table)
     }
     table->entries = NULL;
     table->size = table->count = 0;
-    table->size_index = 0;
 }
 
 const hash_table_entry *bugle_hash_next(hash_table *table, const hash_table_entry *e)
@@ -191,69 +241,64 @@ const hash_table_entry *bugle_hash_begin(hash_table *table)
     else return bugle_hash_next(table, table->entries);
 }
 
-/* void * based hashing */
-/* FIXME: a lot of this code should be unified with the regular hash code;
- * either using actually shared code, or hacks with #includes or inlines
- * to maintain efficiency but still cut down maintainence
+/* void * based hashing. This mirrors the string version, but is kept
+ * separate so that the hash and comparison can be inlined.
  */
 
-static inline size_t hashptr(const void *str)
-{
-    return (const char *) str - (const char *) NULL;
-}
-
 void bugle_hashptr_init(hashptr_table *table, void (*destructor)(void *))
 {
     table->size = table->count = 0;
-    table->size_index = 0;
-    table->entries = 0;
+    table->entries = NULL;
     table->destructor = destructor;
 }
 
-/* Does not
- * - resize the table
- * - update the count
- * - copy the memory for the key
- * - check for duplicate keys
- * It should only be used for rehashing
- */
-static void hashptr_set_fast(hashptr_table *table, const void *key, void *value)
+static size_t hashptr_find(const hashptr_table *table, const void *key)
 {
+    size_t mask = table->size - 1;
     size_t h;
 
-    h = hashptr(key) % table->size;
-    while (table->entries[h].key)
-        if (++h == table->size) h = 0;
-    table->entries[h].key = key;
-    table->entries[h].value = value;
+    h = hashptr(key) & mask;
+    while (table->entries[h].key && table->entries[h].key != key)
+        h = (h + 1) & mask;
+    return h;
+}
+
+static void hashptr_resize(hashptr_table *table, size_t size)
+{
+    hashptr_table_entry *old;
+    size_t old_size, i, h, mask;
+
+    old = table->entries;
+    old_size = table->size;
+    table->entries = BUGLE_CALLOC(size, hashptr_table_entry);
+    table->size = size;
+    mask = size - 1;
+    for (i = 0; i < old_size; i++)
+        if (old[i].key)
+        {
+            h = hashptr(old[i].key) & mask;
+            while (table->entries[h].key)
+                h = (h + 1) & mask;
+            table->entries[h] = old[i];
+        }
+    if (old) bugle_free(old);
+}
+
+void bugle_hashptr_reserve(hashptr_table *table, size_t count)
+{
+    size_t size = hash_size_for(count);
+    if (size > table->size)
+        hashptr_resize(table, size);
 }
 
 void bugle_hashptr_set(hashptr_table *table, const void *key, void *value)
 {
-    hashptr_table big;
-    size_t i;
     size_t h;
 
-    if (table->count >= table->size / 2
-        && table->size < (size_t) -1)
-    {
-        bugle_thread_once(&hash_once, hash_initialise);
-        big.size_index = table->size_index + 1;
-        big.size = primes[big.size_index];
-        big.entries = BUGLE_CALLOC(big.size, hashptr_table_entry);
-        big.count = 0;
-        big.destructor = table->destructor;
-        for (i = 0; i < table->size; i++)
-            if (table->entries[i].key)
-                hashptr_set_fast(&big, table->entries[i].key,
-                                 table->entries[i].value);
-        if (table->entries) bugle_free(table->entries);
-        *table = big;
-    }
+    if (table->count + 1 > table->size - table->size / 4)
+        hashptr_resize(table, table->size ? table->size * 2 : HASH_MIN_SIZE);
 
-    h = hashptr(key) % table->size;
-    while (table->entries[h].key && key != table->entries[h].key)
-        if (++h == table->size) h = 0;
+    h = hashptr_find(table, key);
     if (!table->entries[h].key)
     {
         table->entries[h].key = key;
@@ -266,25 +311,44 @@ void bugle_hashptr_set(hashptr_table *table, const void *key, void *value)
 
 bugle_bool bugle_hashptr_count(const hashptr_table *table, const void *key)
 {
-    size_t h;
-
-    if (!table->entries) return BUGLE_FALSE;
-    h = hashptr(key) % table->size;
-    while (table->entries[h].key && table->entries[h].key != key)
-        if (++h == table->size) h = 0;
-    return table->entries[h].key != NULL;
+    if (!table->count) return BUGLE_FALSE;
+    return table->entries[hashptr_find(table, key)].key != NULL;
 }
 
 void *bugle_hashptr_get(const hashptr_table *table, const void *key)
 {
-    size_t h;
+    if (!table->count) return NULL;
+    return table->entries[hashptr_find(table, key)].value;
+}
 
-    if (!table->entries) return NULL;
-    h = hashptr(key) % table->size;
-    while (table->entries[h].key && table->entries[h].key != key)
-        if (++h == table->size) h = 0;
-    if (table->entries[h].key) return table->entries[h].value;
-    else return NULL;
+void bugle_hashptr_remove(hashptr_table *table, const void *key)
+{
+    size_t i, j, home, mask;
+
+    if (!table->count) return;
+    i = hashptr_find(table, key);
+    if (!table->entries[i].key) return;
+
+    if (table->destructor)
+        table->destructor(table->entries[i].value);
+    table->count--;
+
+    /* Shift back any following entries that probed past the hole */
+    mask = table->size - 1;
+    j = i;
+    for (;;)
+    {
+        j = (j + 1) & mask;
+        if (!table->entries[j].key) break;
+        home = hashptr(table->entries[j].key) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask))
+        {
+            table->entries[i] = table->entries[j];
+            i = j;
+        }
+    }
+    table->entries[i].key = NULL;
+    table->entries[i].value = NULL;
 }
 
 void bugle_hashptr_clear(hashptr_table *table)
@@ -303,7 +367,6 @@ void bugle_hashptr_clear(hashptr_table *table)
     }
     table->entries = NULL;
     table->size = table->count = 0;
-    table->size_index = 0;
 }
 
 const hashptr_table_entry *bugle_hashptr_next(hashptr_table *table, const hashptr_table_entry *e)
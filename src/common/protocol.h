@@ -1,5 +1,5 @@
 /*  BuGLe: an OpenGL debugging tool
- *  Copyright (C) 2004-2009  Bruce Merry
+ *  Copyright (C) 2004-2009, 2014  Bruce Merry
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -43,6 +43,8 @@
 #define RESP_STATE_NODE_BEGIN_RAW_OLD  0xabcd000bUL  /* Obsolete */
 #define RESP_STATE_NODE_END_RAW        0xabcd000cUL
 #define RESP_STATE_NODE_BEGIN_RAW      0xabcd000dUL
+#define RESP_PREVIEW                   0xabcd000eUL
+#define RESP_DATA_SHM                  0xabcd000fUL  /* RESP_DATA with the payload in shared memory */
 
 #define REQ_RUN                        0xdcba0000UL
 #define REQ_CONT                       0xdcba0001UL
@@ -60,6 +62,7 @@
 #define REQ_STATE_TREE_RAW_OLD         0xdcba000dUL  /* Obsolete */
 #define REQ_STATE_TREE_RAW             0xdcba000eUL
 #define REQ_BREAK_EVENT                0xdcba000fUL
+#define REQ_PREVIEW                    0xdcba0010UL
 
 #define REQ_DATA_TEXTURE               0xedbc0000UL
 #define REQ_DATA_SHADER                0xedbc0001UL
@@ -0,0 +1,117 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#include <string.h>
+#include "common/qoi.h"
+
+static void qoi_put_uint32(unsigned char *out, unsigned long v)
+{
+    out[0] = (v >> 24) & 0xff;
+    out[1] = (v >> 16) & 0xff;
+    out[2] = (v >> 8) & 0xff;
+    out[3] = v & 0xff;
+}
+
+size_t bugle_qoi_encode(const unsigned char *pixels, int width, int height,
+                        unsigned char *out)
+{
+    unsigned long index[64];
+    unsigned long px, prev;
+    const unsigned char *in;
+    size_t pos = 0, i, n;
+    int run = 0, r, g, b, pr, pg, pb, vr, vg, vb, vg_r, vg_b, h;
+
+    memcpy(out, "qoif", 4);
+    qoi_put_uint32(out + 4, width);
+    qoi_put_uint32(out + 8, height);
+    out[12] = 3;       /* channels */
+    out[13] = 0;       /* sRGB with linear alpha */
+    pos = 14;
+
+    /* Pixels include the (opaque) alpha, so that none matches an unused
+     * index entry.
+     */
+    memset(index, 0, sizeof(index));
+    prev = 0xff000000UL;
+    n = (size_t) width * height;
+    in = pixels;
+    for (i = 0; i < n; i++, in += 3)
+    {
+        r = in[0];
+        g = in[1];
+        b = in[2];
+        px = 0xff000000UL | ((unsigned long) r << 16) | ((unsigned long) g << 8) | b;
+        if (px == prev)
+        {
+            run++;
+            if (run == 62 || i == n - 1)
+            {
+                out[pos++] = 0xc0 | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0)
+        {
+            out[pos++] = 0xc0 | (run - 1);
+            run = 0;
+        }
+
+        h = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+        if (index[h] == px)
+            out[pos++] = h;
+        else
+        {
+            index[h] = px;
+            pr = (prev >> 16) & 0xff;
+            pg = (prev >> 8) & 0xff;
+            pb = prev & 0xff;
+            /* Differences wrap around */
+            vr = ((r - pr + 128) & 0xff) - 128;
+            vg = ((g - pg + 128) & 0xff) - 128;
+            vb = ((b - pb + 128) & 0xff) - 128;
+            vg_r = vr - vg;
+            vg_b = vb - vg;
+            if (vr >= -2 && vr <= 1 && vg >= -2 && vg <= 1 && vb >= -2 && vb <= 1)
+                out[pos++] = 0x40 | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2);
+            else if (vg >= -32 && vg <= 31
+                     && vg_r >= -8 && vg_r <= 7
+                     && vg_b >= -8 && vg_b <= 7)
+            {
+                out[pos++] = 0x80 | (vg + 32);
+                out[pos++] = ((vg_r + 8) << 4) | (vg_b + 8);
+            }
+            else
+            {
+                out[pos++] = 0xfe;
+                out[pos++] = r;
+                out[pos++] = g;
+                out[pos++] = b;
+            }
+        }
+        prev = px;
+    }
+
+    /* End marker */
+    memset(out + pos, 0, 7);
+    out[pos + 7] = 1;
+    return pos + 8;
+}
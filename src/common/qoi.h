@@ -0,0 +1,41 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Encoder for the Quite OK Image format, which compresses screenshots well
+ * and is much cheaper than PNG. It is used for the still images written by
+ * the screenshot filter-set.
+ */
+
+#ifndef BUGLE_COMMON_QOI_H
+#define BUGLE_COMMON_QOI_H
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#include <bugle/export.h>
+
+/* Upper bound on the encoded size of an image */
+#define BUGLE_QOI_MAX_SIZE(width, height) ((size_t) (width) * (height) * 4 + 22)
+
+/* Encodes a tightly packed, top-down RGB image. Returns the encoded size;
+ * out must hold at least BUGLE_QOI_MAX_SIZE(width, height) bytes.
+ */
+BUGLE_EXPORT_PRE size_t bugle_qoi_encode(const unsigned char *pixels, int width, int height,
+                                         unsigned char *out) BUGLE_EXPORT_POST;
+
+#endif /* !BUGLE_COMMON_QOI_H */
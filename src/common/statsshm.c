@@ -0,0 +1,93 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#include <bugle/bool.h>
+#include "common/statsshm.h"
+#include "platform/threads.h"
+
+/* A reader only needs to retry when it overlaps an update, which takes a
+ * few hundred nanoseconds. The count restarts whenever the writer makes
+ * progress, so running out of attempts means the writer is not running.
+ */
+#define STATSSHM_READ_ATTEMPTS 100000
+
+bugle_bool bugle_statsshm_valid(const void *segment, size_t size)
+{
+    const bugle_statsshm_header *header;
+    const volatile bugle_uint32_t *magic;
+
+    if (size < sizeof(bugle_statsshm_header))
+        return BUGLE_FALSE;
+    header = (const bugle_statsshm_header *) segment;
+    magic = &header->magic;
+    if (*magic != BUGLE_STATSSHM_MAGIC)
+        return BUGLE_FALSE;
+    /* The magic number is set last, so the rest is now safe to look at */
+    bugle_atomic_barrier();
+    return header->version == BUGLE_STATSSHM_VERSION
+        && header->size <= size
+        && header->statistics_offset + (size_t) header->count * sizeof(bugle_statsshm_statistic) <= header->size
+        && header->values_offset + (size_t) header->count * sizeof(double) <= header->size;
+}
+
+void bugle_statsshm_write_begin(bugle_statsshm_header *header)
+{
+    header->seq++;
+    bugle_atomic_barrier();
+}
+
+void bugle_statsshm_write_end(bugle_statsshm_header *header)
+{
+    bugle_atomic_barrier();
+    header->seq++;
+}
+
+bugle_bool bugle_statsshm_read(const bugle_statsshm_header *header,
+                               bugle_statsshm_snapshot *snapshot)
+{
+    const volatile double *values;
+    bugle_uint32_t seq, last_seq;
+    bugle_uint32_t i;
+    long attempt;
+
+    values = (const volatile double *) ((const char *) header + header->values_offset);
+    last_seq = header->seq;
+    for (attempt = 0; attempt < STATSSHM_READ_ATTEMPTS; attempt++)
+    {
+        seq = header->seq;
+        if (seq != last_seq)
+        {
+            last_seq = seq;
+            attempt = 0;
+        }
+        if (seq & 1)
+            continue;
+        bugle_atomic_barrier();
+        snapshot->frame = header->frame;
+        snapshot->time = header->time;
+        for (i = 0; i < header->count; i++)
+            snapshot->values[i] = values[i];
+        bugle_atomic_barrier();
+        if (header->seq == seq)
+            return BUGLE_TRUE;
+    }
+    return BUGLE_FALSE;
+}
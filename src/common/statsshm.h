@@ -0,0 +1,102 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Layout of the shared memory segment written by the shmstats filter-set
+ * and read by bugle-statsmon. The segment describes itself, so a reader
+ * does not need the statistics configuration of the target.
+ *
+ * The segment starts with a bugle_statsshm_header, followed by an array of
+ * bugle_statsshm_statistic descriptors, the NUL-terminated strings they
+ * refer to, and finally an array of doubles with the current values. All
+ * offsets are in bytes from the start of the segment. Everything except
+ * the seq, state, frame, time and values fields is written once, before
+ * the magic number is set.
+ *
+ * The values are protected by a sequence lock: the writer makes seq odd
+ * while updating them and even again afterwards, and a reader retries if
+ * seq was odd or changed while it was copying. The writer thus never waits
+ * for readers and does not need any system calls.
+ */
+
+#ifndef BUGLE_COMMON_STATSSHM_H
+#define BUGLE_COMMON_STATSSHM_H
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#include <bugle/bool.h>
+#include <bugle/export.h>
+#include "platform/types.h"
+
+#define BUGLE_STATSSHM_MAGIC      0x42475353UL   /* "SSGB" in little-endian dumps */
+#define BUGLE_STATSSHM_VERSION    1
+
+#define BUGLE_STATSSHM_RUNNING    1
+#define BUGLE_STATSSHM_FINISHED   2
+
+typedef struct
+{
+    bugle_uint32_t magic;
+    bugle_uint32_t version;
+    bugle_uint32_t size;                /* size of the whole segment */
+    bugle_uint32_t count;               /* number of statistics */
+    bugle_uint32_t statistics_offset;   /* bugle_statsshm_statistic[count] */
+    bugle_uint32_t values_offset;       /* double[count] */
+    bugle_uint32_t pid;                 /* process that is writing */
+    volatile bugle_uint32_t state;      /* BUGLE_STATSSHM_RUNNING or _FINISHED */
+    volatile bugle_uint32_t seq;        /* odd while the values are changing */
+    bugle_uint32_t reserved;
+    volatile bugle_uint64_t frame;      /* frames completed */
+    volatile double time;               /* seconds since the first frame */
+} bugle_statsshm_header;
+
+typedef struct
+{
+    bugle_uint32_t name_offset;
+    bugle_uint32_t label_offset;        /* 0 if there is no label */
+    bugle_int32_t precision;
+    bugle_uint32_t reserved;
+} bugle_statsshm_statistic;
+
+/* A consistent copy of the changing fields */
+typedef struct
+{
+    bugle_uint64_t frame;
+    double time;
+    double *values;                     /* caller-allocated, count entries */
+} bugle_statsshm_snapshot;
+
+/* Checks that a mapped segment of the given size is complete and of a
+ * version that this code understands.
+ */
+BUGLE_EXPORT_PRE bugle_bool bugle_statsshm_valid(const void *segment, size_t size) BUGLE_EXPORT_POST;
+
+/* Writer side: brackets an update of frame, time and the values */
+BUGLE_EXPORT_PRE void bugle_statsshm_write_begin(bugle_statsshm_header *header) BUGLE_EXPORT_POST;
+BUGLE_EXPORT_PRE void bugle_statsshm_write_end(bugle_statsshm_header *header) BUGLE_EXPORT_POST;
+
+/* Reader side: copies out a consistent snapshot, retrying while the writer
+ * is in the middle of an update. Returns BUGLE_FALSE if no consistent copy
+ * could be made after a number of attempts, which happens if the writer
+ * was descheduled or died during an update; the caller should try again
+ * later.
+ */
+BUGLE_EXPORT_PRE bugle_bool bugle_statsshm_read(const bugle_statsshm_header *header,
+                                                bugle_statsshm_snapshot *snapshot) BUGLE_EXPORT_POST;
+
+#endif /* !BUGLE_COMMON_STATSSHM_H */
@@ -0,0 +1,172 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#include <stdio.h>
+#include <bugle/bool.h>
+#include "common/tilecapture.h"
+
+static void tilecapture_put32(unsigned char *out, bugle_uint32_t v)
+{
+    out[0] = v & 0xff;
+    out[1] = (v >> 8) & 0xff;
+    out[2] = (v >> 16) & 0xff;
+    out[3] = (v >> 24) & 0xff;
+}
+
+static bugle_uint32_t tilecapture_get32(const unsigned char *in)
+{
+    return (bugle_uint32_t) in[0]
+        | ((bugle_uint32_t) in[1] << 8)
+        | ((bugle_uint32_t) in[2] << 16)
+        | ((bugle_uint32_t) in[3] << 24);
+}
+
+size_t bugle_tilecapture_tiles(const bugle_tilecapture_header *header)
+{
+    size_t across, down;
+
+    across = (header->width + header->tile_size - 1) / header->tile_size;
+    down = (header->height + header->tile_size - 1) / header->tile_size;
+    return across * down;
+}
+
+void bugle_tilecapture_tile_rect(const bugle_tilecapture_header *header,
+                                 size_t index,
+                                 int *x, int *y, int *width, int *height)
+{
+    size_t across;
+
+    across = (header->width + header->tile_size - 1) / header->tile_size;
+    *x = (index % across) * header->tile_size;
+    *y = (index / across) * header->tile_size;
+    *width = header->width - *x;
+    if (*width > (int) header->tile_size)
+        *width = header->tile_size;
+    *height = header->height - *y;
+    if (*height > (int) header->tile_size)
+        *height = header->tile_size;
+}
+
+bugle_bool bugle_tilecapture_write_header(FILE *out,
+                                          const bugle_tilecapture_header *header)
+{
+    unsigned char buffer[20];
+
+    tilecapture_put32(buffer, BUGLE_TILECAPTURE_MAGIC);
+    tilecapture_put32(buffer + 4, BUGLE_TILECAPTURE_VERSION);
+    tilecapture_put32(buffer + 8, header->width);
+    tilecapture_put32(buffer + 12, header->height);
+    tilecapture_put32(buffer + 16, header->tile_size);
+    return fwrite(buffer, sizeof(buffer), 1, out) == 1;
+}
+
+bugle_bool bugle_tilecapture_write_frame(FILE *out,
+                                         const bugle_tilecapture_frame *frame)
+{
+    unsigned char buffer[16];
+
+    tilecapture_put32(buffer, frame->flags);
+    tilecapture_put32(buffer + 4, frame->count);
+    tilecapture_put32(buffer + 8, (bugle_uint32_t) (frame->time & 0xffffffffUL));
+    tilecapture_put32(buffer + 12, (bugle_uint32_t) (frame->time >> 32));
+    return fwrite(buffer, sizeof(buffer), 1, out) == 1;
+}
+
+bugle_bool bugle_tilecapture_write_tile(FILE *out,
+                                        const bugle_tilecapture_header *header,
+                                        size_t index,
+                                        const unsigned char *image)
+{
+    unsigned char buffer[4];
+    const unsigned char *src;
+    size_t stride, row;
+    int x, y, width, height, i;
+
+    bugle_tilecapture_tile_rect(header, index, &x, &y, &width, &height);
+    tilecapture_put32(buffer, index);
+    if (fwrite(buffer, sizeof(buffer), 1, out) != 1)
+        return BUGLE_FALSE;
+
+    stride = (size_t) header->width * 3;
+    row = (size_t) width * 3;
+    src = image + y * stride + x * 3;
+    for (i = 0; i < height; i++, src += stride)
+        if (fwrite(src, 1, row, out) != row)
+            return BUGLE_FALSE;
+    return BUGLE_TRUE;
+}
+
+bugle_bool bugle_tilecapture_read_header(FILE *in,
+                                         bugle_tilecapture_header *header)
+{
+    unsigned char buffer[20];
+
+    if (fread(buffer, sizeof(buffer), 1, in) != 1)
+        return BUGLE_FALSE;
+    if (tilecapture_get32(buffer) != BUGLE_TILECAPTURE_MAGIC
+        || tilecapture_get32(buffer + 4) != BUGLE_TILECAPTURE_VERSION)
+        return BUGLE_FALSE;
+    header->width = tilecapture_get32(buffer + 8);
+    header->height = tilecapture_get32(buffer + 12);
+    header->tile_size = tilecapture_get32(buffer + 16);
+    return header->width > 0 && header->width <= BUGLE_TILECAPTURE_MAX_DIMENSION
+        && header->height > 0 && header->height <= BUGLE_TILECAPTURE_MAX_DIMENSION
+        && header->tile_size > 0 && header->tile_size <= BUGLE_TILECAPTURE_MAX_DIMENSION;
+}
+
+bugle_bool bugle_tilecapture_read_frame(FILE *in,
+                                        const bugle_tilecapture_header *header,
+                                        bugle_tilecapture_frame *frame,
+                                        unsigned char *image)
+{
+    unsigned char buffer[16];
+    unsigned char *dst;
+    size_t tiles, index, stride, row;
+    bugle_uint32_t i;
+    int x, y, width, height, j;
+
+    if (fread(buffer, sizeof(buffer), 1, in) != 1)
+        return BUGLE_FALSE;
+    frame->flags = tilecapture_get32(buffer);
+    frame->count = tilecapture_get32(buffer + 4);
+    frame->time = tilecapture_get32(buffer + 8)
+        | ((bugle_uint64_t) tilecapture_get32(buffer + 12) << 32);
+
+    tiles = bugle_tilecapture_tiles(header);
+    if (frame->count > tiles)
+        return BUGLE_FALSE;
+    stride = (size_t) header->width * 3;
+    for (i = 0; i < frame->count; i++)
+    {
+        if (fread(buffer, 4, 1, in) != 1)
+            return BUGLE_FALSE;
+        index = tilecapture_get32(buffer);
+        if (index >= tiles)
+            return BUGLE_FALSE;
+        bugle_tilecapture_tile_rect(header, index, &x, &y, &width, &height);
+        row = (size_t) width * 3;
+        dst = image + y * stride + x * 3;
+        for (j = 0; j < height; j++, dst += stride)
+            if (fread(dst, 1, row, in) != row)
+                return BUGLE_FALSE;
+    }
+    return BUGLE_TRUE;
+}
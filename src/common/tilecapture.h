@@ -0,0 +1,100 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Format of the files written by the tiles writer of the screenshot
+ * filter-set and read by bugle-untile. Each frame is divided into square
+ * tiles, numbered in rows from the top left, and only the tiles that
+ * differ from the previous frame are stored.
+ *
+ * The file starts with a header, which is followed by the frames. Each
+ * frame has a frame header followed by count tiles, and each tile is its
+ * index followed by its pixels as tightly packed, top-down RGB. Tiles on
+ * the right and bottom edges are clipped to the image. A keyframe holds
+ * every tile, so decoding can start from it. All integers are stored
+ * little-endian, regardless of the machine that wrote them.
+ */
+
+#ifndef BUGLE_COMMON_TILECAPTURE_H
+#define BUGLE_COMMON_TILECAPTURE_H
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#include <stdio.h>
+#include <bugle/bool.h>
+#include <bugle/export.h>
+#include "platform/types.h"
+
+#define BUGLE_TILECAPTURE_MAGIC      0x4C544742UL   /* "BGTL" */
+#define BUGLE_TILECAPTURE_VERSION    1
+
+#define BUGLE_TILECAPTURE_KEYFRAME   1              /* frame flag */
+
+/* Readers refuse larger images and tiles, so that sizes cannot overflow */
+#define BUGLE_TILECAPTURE_MAX_DIMENSION 32768
+
+typedef struct
+{
+    bugle_uint32_t width;
+    bugle_uint32_t height;
+    bugle_uint32_t tile_size;
+} bugle_tilecapture_header;
+
+typedef struct
+{
+    bugle_uint32_t flags;
+    bugle_uint32_t count;               /* number of tiles that follow */
+    bugle_uint64_t time;                /* microseconds since the first frame */
+} bugle_tilecapture_frame;
+
+/* Number of tiles in each frame */
+BUGLE_EXPORT_PRE size_t bugle_tilecapture_tiles(const bugle_tilecapture_header *header) BUGLE_EXPORT_POST;
+
+/* Position and size of a tile, in pixels from the top left */
+BUGLE_EXPORT_PRE void bugle_tilecapture_tile_rect(const bugle_tilecapture_header *header,
+                                                  size_t index,
+                                                  int *x, int *y, int *width, int *height) BUGLE_EXPORT_POST;
+
+/* Writer side. The image passed to bugle_tilecapture_write_tile is the
+ * whole frame, as tightly packed, top-down RGB. All return BUGLE_FALSE
+ * on a write error.
+ */
+BUGLE_EXPORT_PRE bugle_bool bugle_tilecapture_write_header(FILE *out,
+                                                           const bugle_tilecapture_header *header) BUGLE_EXPORT_POST;
+BUGLE_EXPORT_PRE bugle_bool bugle_tilecapture_write_frame(FILE *out,
+                                                          const bugle_tilecapture_frame *frame) BUGLE_EXPORT_POST;
+BUGLE_EXPORT_PRE bugle_bool bugle_tilecapture_write_tile(FILE *out,
+                                                         const bugle_tilecapture_header *header,
+                                                         size_t index,
+                                                         const unsigned char *image) BUGLE_EXPORT_POST;
+
+/* Reader side. bugle_tilecapture_read_header checks the magic number and
+ * version. bugle_tilecapture_read_frame reads a whole frame and applies
+ * its tiles to image, which holds the previous frame in the same layout
+ * as for bugle_tilecapture_write_tile. Both return BUGLE_FALSE at the end
+ * of the file or if the data are invalid; a frame that is cut short may
+ * have been partly applied.
+ */
+BUGLE_EXPORT_PRE bugle_bool bugle_tilecapture_read_header(FILE *in,
+                                                          bugle_tilecapture_header *header) BUGLE_EXPORT_POST;
+BUGLE_EXPORT_PRE bugle_bool bugle_tilecapture_read_frame(FILE *in,
+                                                         const bugle_tilecapture_header *header,
+                                                         bugle_tilecapture_frame *frame,
+                                                         unsigned char *image) BUGLE_EXPORT_POST;
+
+#endif /* !BUGLE_COMMON_TILECAPTURE_H */
@@ -0,0 +1,117 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#include "common/yuv.h"
+
+static const char * const yuv_vertex_source =
+    "void main()\n"
+    "{\n"
+    "    gl_Position = gl_Vertex;\n"
+    "}\n";
+
+static const char * const yuv_fragment_source =
+    "uniform sampler2D src;\n"
+    "uniform vec2 size;\n"
+    "uniform vec4 coeff;\n"
+    "uniform float scale;\n"
+    "\n"
+    "float convert(float x, float y)\n"
+    "{\n"
+    "    vec2 pos = vec2(scale * (x + 0.5), size.y - scale * (y + 0.5));\n"
+    "    return dot(coeff.rgb, texture2D(src, pos / size).rgb) + coeff.a;\n"
+    "}\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    float x = floor(gl_FragCoord.x) * 4.0;\n"
+    "    float y = floor(gl_FragCoord.y);\n"
+    "    gl_FragColor = vec4(convert(x, y), convert(x + 1.0, y),\n"
+    "                        convert(x + 2.0, y), convert(x + 3.0, y));\n"
+    "}\n";
+
+/* Coefficients and offset for each plane */
+static const float yuv_coefficients[3][4] =
+{
+    { 0.257f, 0.504f, 0.098f, 16.0f / 255.0f },
+    { -0.148f, -0.291f, 0.439f, 128.0f / 255.0f },
+    { 0.439f, -0.368f, -0.071f, 128.0f / 255.0f }
+};
+
+void bugle_yuv_convert(const unsigned char *pixels, int width, int height,
+                       size_t stride, unsigned char *out)
+{
+    /* The same coefficients in fixed point, scaled by 2^16 */
+    static const int coeff[3][3] =
+    {
+        { 16843, 33030, 6423 },
+        { -9699, -19071, 28770 },
+        { 28770, -24117, -4653 }
+    };
+    int cw, ch, x, y, dx, dy, i, n, sum[3];
+    const unsigned char *p;
+    unsigned char *plane[3];
+
+    cw = (width + 1) / 2;
+    ch = (height + 1) / 2;
+    plane[0] = out;
+    plane[1] = out + width * height;
+    plane[2] = plane[1] + cw * ch;
+    for (y = 0; y < height; y++)
+    {
+        p = pixels + stride * (height - 1 - y);
+        for (x = 0; x < width; x++, p += 3)
+            *plane[0]++ = (unsigned char) ((coeff[0][0] * p[0] + coeff[0][1] * p[1] + coeff[0][2] * p[2]
+                                            + 16 * 65536 + 32768) >> 16);
+    }
+    for (y = 0; y < ch; y++)
+        for (x = 0; x < cw; x++)
+        {
+            sum[0] = sum[1] = sum[2] = 0;
+            n = 0;
+            for (dy = 2 * y; dy < 2 * y + 2 && dy < height; dy++)
+                for (dx = 2 * x; dx < 2 * x + 2 && dx < width; dx++)
+                {
+                    p = pixels + stride * (height - 1 - dy) + 3 * dx;
+                    for (i = 0; i < 3; i++)
+                        sum[i] += p[i];
+                    n++;
+                }
+            /* The offset keeps the numerator positive, so that division rounds */
+            for (i = 1; i < 3; i++)
+                *plane[i]++ = (unsigned char) ((coeff[i][0] * sum[0] + coeff[i][1] * sum[1] + coeff[i][2] * sum[2]
+                                                + n * (128 * 65536 + 32768)) / (n * 65536));
+        }
+}
+
+const char *bugle_yuv_vertex_source(void)
+{
+    return yuv_vertex_source;
+}
+
+const char *bugle_yuv_fragment_source(void)
+{
+    return yuv_fragment_source;
+}
+
+const float *bugle_yuv_coefficients(int plane)
+{
+    return yuv_coefficients[plane];
+}
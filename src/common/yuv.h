@@ -0,0 +1,58 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Conversion of captured frames from RGB to YUV 4:2:0 (BT.601, limited
+ * range, as libswscale does). The screenshot filter-set does it in a
+ * shader when it can, and on the CPU otherwise; both use the formulae
+ * here, so that the two give the same results.
+ */
+
+#ifndef BUGLE_COMMON_YUV_H
+#define BUGLE_COMMON_YUV_H
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#include <bugle/export.h>
+
+/* Size of the Y, U and V planes of an image, one after another */
+#define BUGLE_YUV_SIZE(width, height) \
+    ((size_t) (width) * (height) + 2 * (size_t) (((width) + 1) / 2) * (((height) + 1) / 2))
+
+/* Converts bottom-up RGB, with stride bytes between rows, to top-down
+ * planes. Chroma is the average of each 2x2 block.
+ */
+BUGLE_EXPORT_PRE void bugle_yuv_convert(const unsigned char *pixels, int width, int height,
+                                        size_t stride, unsigned char *out) BUGLE_EXPORT_POST;
+
+/* GLSL shaders that render one plane into an RGBA8 target in which every
+ * texel packs four consecutive samples of a row. The fragment shader
+ * reads the bottom-up image from the sampler src, whose size in pixels
+ * is in size. The uniform coeff holds the coefficients for the plane and
+ * scale is 1 for luma and 2 for chroma. The vertex shader passes
+ * gl_Vertex through, so a quad covering clip space produces the plane.
+ */
+BUGLE_EXPORT_PRE const char *bugle_yuv_vertex_source(void) BUGLE_EXPORT_POST;
+BUGLE_EXPORT_PRE const char *bugle_yuv_fragment_source(void) BUGLE_EXPORT_POST;
+
+/* Coefficients of R, G and B and the offset for a plane (0 to 2), scaled
+ * for colours in the range [0, 1].
+ */
+BUGLE_EXPORT_PRE const float *bugle_yuv_coefficients(int plane) BUGLE_EXPORT_POST;
+
+#endif /* !BUGLE_COMMON_YUV_H */
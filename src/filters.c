@@ -1,5 +1,5 @@
 /*  BuGLe: an OpenGL debugging tool
- *  Copyright (C) 2004-2007, 2009-2010  Bruce Merry
+ *  Copyright (C) 2004-2007, 2009-2010, 2014  Bruce Merry
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -28,6 +28,7 @@
 #include <bugle/memory.h>
 #include <bugle/string.h>
 #include <bugle/math.h>
+#include <bugle/time.h>
 #include <bugle/input.h>
 #include <bugle/filters.h>
 #include <bugle/log.h>
@@ -52,6 +53,11 @@ struct filter_set_s
     const filter_set_variable_info *variables;
     bugle_dl_module dl_handle;
 
+    /* Options that every filter-set accepts, to limit its log messages */
+    long log_rate;
+    bugle_bool log_collapse;
+    filter_set_variable_info log_variables[3];
+
     bugle_bool added;         /* Is listed in the config file or is depended upon */
     bugle_bool loaded;        /* Initialisation has been called */
     bugle_bool active;        /* Is actively intercepting events */
@@ -71,6 +77,16 @@ typedef struct
     bugle_bool active;        /* BUGLE_TRUE for an activation, BUGLE_FALSE for a deactivation */
 } filter_set_activation;
 
+/* Template for filter_set::log_variables, which is completed with pointers
+ * to the values in the filter-set.
+ */
+static const filter_set_variable_info filter_set_log_variables[3] =
+{
+    { "log_rate", "maximum messages per second for each event, 0 for no limit [0]", FILTER_SET_VARIABLE_UINT, NULL, NULL },
+    { "log_collapse", "replace repeated identical messages with a count [no]", FILTER_SET_VARIABLE_BOOL, NULL, NULL },
+    { NULL, NULL, 0, NULL, NULL }
+};
+
 static linked_list filter_sets;
 static linked_list added_filter_sets; /* Those specified in the config, plus dependents */
 
@@ -111,6 +127,11 @@ static bugle_dl_module current_dl_handle = NULL;
 
 static object_class *bugle_call_class;
 
+/* Set while a filter-set is profiling the callbacks. It only changes
+ * during initialisation and shutdown, so it is not locked.
+ */
+static filter_profiler active_profiler = NULL;
+
 /* Forward declarations */
 static void filter_set_deactivate_nolock(filter_set *handle);
 static void compute_active_callbacks(void);
@@ -347,6 +368,19 @@ void filters_initialise(void)
     atexit(filters_shutdown);
 }
 
+static const filter_set_variable_info *filter_set_find_variable(filter_set *handle, const char *name)
+{
+    const filter_set_variable_info *v;
+
+    for (v = handle->variables; v && v->name; v++)
+        if (strcmp(name, v->name) == 0)
+            return v;
+    for (v = handle->log_variables; v->name; v++)
+        if (strcmp(name, v->name) == 0)
+            return v;
+    return NULL;
+}
+
 bugle_bool filter_set_variable(filter_set *handle, const char *name, const char *value)
 {
     const filter_set_variable_info *v;
@@ -358,138 +392,137 @@ bugle_bool filter_set_variable(filter_set *handle, const char *name, const char
     bugle_input_key key_value;
     void *value_ptr = NULL;
 
-    for (v = handle->variables; v && v->name; v++)
+    v = filter_set_find_variable(handle, name);
+    if (!v)
     {
-        if (strcmp(name, v->name) == 0)
+        bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
+                         "Unknown variable %s in filter-set %s",
+                         name, handle->name);
+        return BUGLE_FALSE;
+    }
+
+    switch (v->type)
+    {
+    case FILTER_SET_VARIABLE_BOOL:
+        if (strcmp(value, "1") == 0
+            || strcmp(value, "yes") == 0
+            || strcmp(value, "true") == 0)
+            bool_value = BUGLE_TRUE;
+        else if (strcmp(value, "0") == 0
+                 || strcmp(value, "no") == 0
+                 || strcmp(value, "false") == 0)
+            bool_value = BUGLE_FALSE;
+        else
+        {
+            bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
+                             "Expected 1|0|yes|no|true|false for %s in filter-set %s",
+                             name, handle->name);
+            return BUGLE_FALSE;
+        }
+        value_ptr = &bool_value;
+        break;
+    case FILTER_SET_VARIABLE_INT:
+    case FILTER_SET_VARIABLE_UINT:
+    case FILTER_SET_VARIABLE_POSITIVE_INT:
+        errno = 0;
+        int_value = strtol(value, &end, 0);
+        if (errno || !*value || *end)
+        {
+            bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
+                             "Expected an integer for %s in filter-set %s",
+                             name, handle->name);
+            return BUGLE_FALSE;
+        }
+        if (v->type == FILTER_SET_VARIABLE_UINT && int_value < 0)
+        {
+            bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
+                             "Expected a non-negative integer for %s in filter-set %s",
+                             name, handle->name);
+            return BUGLE_FALSE;
+        }
+        else if (v->type == FILTER_SET_VARIABLE_POSITIVE_INT && int_value <= 0)
+        {
+            bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
+                             "Expected a positive integer for %s in filter-set %s",
+                             name, handle->name);
+            return BUGLE_FALSE;
+        }
+        value_ptr = &int_value;
+        break;
+    case FILTER_SET_VARIABLE_FLOAT:
+        errno = 0;
+        float_value = (float) strtod(value, &end);
+        if (errno || !*value || *end)
+        {
+            bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
+                             "Expected a real number for %s in filter-set %s",
+                             name, handle->name);
+            return BUGLE_FALSE;
+        }
+
+        if (!bugle_isfinite(float_value))
+        {
+            bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
+                             "Expected a finite real number for %s in filter-set %s",
+                             name, handle->name);
+            return BUGLE_FALSE;
+        }
+        value_ptr = &float_value;
+        break;
+    case FILTER_SET_VARIABLE_STRING:
+        string_value = bugle_strdup(value);
+        value_ptr = &string_value;
+        break;
+    case FILTER_SET_VARIABLE_KEY:
+        if (!bugle_input_key_lookup(value, &key_value))
+        {
+            bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
+                             "Unknown key %s for %s in filter-set %s", value, name, handle->name);
+            return BUGLE_FALSE;
+        }
+        value_ptr = &key_value;
+        break;
+    case FILTER_SET_VARIABLE_CUSTOM:
+        value_ptr = v->value;
+        break;
+    }
+    if (v->callback && !(*v->callback)(v, value, value_ptr))
+    {
+        if (v->type == FILTER_SET_VARIABLE_STRING)
+            bugle_free(string_value);
+        return BUGLE_FALSE;
+    }
+    else
+    {
+        if (v->value)
         {
             switch (v->type)
             {
             case FILTER_SET_VARIABLE_BOOL:
-                if (strcmp(value, "1") == 0
-                    || strcmp(value, "yes") == 0
-                    || strcmp(value, "true") == 0)
-                    bool_value = BUGLE_TRUE;
-                else if (strcmp(value, "0") == 0
-                         || strcmp(value, "no") == 0
-                         || strcmp(value, "false") == 0)
-                    bool_value = BUGLE_FALSE;
-                else
-                {
-                    bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
-                                     "Expected 1|0|yes|no|true|false for %s in filter-set %s",
-                                     name, handle->name);
-                    return BUGLE_FALSE;
-                }
-                value_ptr = &bool_value;
+                *(bugle_bool *) v->value = bool_value;
                 break;
             case FILTER_SET_VARIABLE_INT:
             case FILTER_SET_VARIABLE_UINT:
             case FILTER_SET_VARIABLE_POSITIVE_INT:
-                errno = 0;
-                int_value = strtol(value, &end, 0);
-                if (errno || !*value || *end)
-                {
-                    bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
-                                     "Expected an integer for %s in filter-set %s",
-                                     name, handle->name);
-                    return BUGLE_FALSE;
-                }
-                if (v->type == FILTER_SET_VARIABLE_UINT && int_value < 0)
-                {
-                    bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
-                                     "Expected a non-negative integer for %s in filter-set %s",
-                                     name, handle->name);
-                    return BUGLE_FALSE;
-                }
-                else if (v->type == FILTER_SET_VARIABLE_POSITIVE_INT && int_value <= 0)
-                {
-                    bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
-                                     "Expected a positive integer for %s in filter-set %s",
-                                     name, handle->name);
-                    return BUGLE_FALSE;
-                }
-                value_ptr = &int_value;
+                *(long *) v->value = int_value;
                 break;
             case FILTER_SET_VARIABLE_FLOAT:
-                errno = 0;
-                float_value = (float) strtod(value, &end);
-                if (errno || !*value || *end)
-                {
-                    bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
-                                     "Expected a real number for %s in filter-set %s",
-                                     name, handle->name);
-                    return BUGLE_FALSE;
-                }
-
-                if (!bugle_isfinite(float_value))
-                {
-                    bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
-                                     "Expected a finite real number for %s in filter-set %s",
-                                     name, handle->name);
-                    return BUGLE_FALSE;
-                }
-                value_ptr = &float_value;
+                *(float *) v->value = float_value;
                 break;
             case FILTER_SET_VARIABLE_STRING:
-                string_value = bugle_strdup(value);
-                value_ptr = &string_value;
+                if (*(char **) v->value)
+                    bugle_free(*(char **) v->value);
+                *(char **) v->value = string_value;
                 break;
             case FILTER_SET_VARIABLE_KEY:
-                if (!bugle_input_key_lookup(value, &key_value))
-                {
-                    bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
-                                     "Unknown key %s for %s in filter-set %s", value, name, handle->name);
-                    return BUGLE_FALSE;
-                }
-                value_ptr = &key_value;
+                *(bugle_input_key *) v->value = key_value;
                 break;
             case FILTER_SET_VARIABLE_CUSTOM:
-                value_ptr = v->value;
                 break;
             }
-            if (v->callback && !(*v->callback)(v, value, value_ptr))
-            {
-                if (v->type == FILTER_SET_VARIABLE_STRING)
-                    bugle_free(string_value);
-                return BUGLE_FALSE;
-            }
-            else
-            {
-                if (v->value)
-                {
-                    switch (v->type)
-                    {
-                    case FILTER_SET_VARIABLE_BOOL:
-                        *(bugle_bool *) v->value = bool_value;
-                        break;
-                    case FILTER_SET_VARIABLE_INT:
-                    case FILTER_SET_VARIABLE_UINT:
-                    case FILTER_SET_VARIABLE_POSITIVE_INT:
-                        *(long *) v->value = int_value;
-                        break;
-                    case FILTER_SET_VARIABLE_FLOAT:
-                        *(float *) v->value = float_value;
-                        break;
-                    case FILTER_SET_VARIABLE_STRING:
-                        if (*(char **) v->value)
-                            bugle_free(*(char **) v->value);
-                        *(char **) v->value = string_value;
-                        break;
-                    case FILTER_SET_VARIABLE_KEY:
-                        *(bugle_input_key *) v->value = key_value;
-                        break;
-                    case FILTER_SET_VARIABLE_CUSTOM:
-                        break;
-                    }
-                }
-                return BUGLE_TRUE;
-            }
         }
+        return BUGLE_TRUE;
     }
-    bugle_log_printf(handle->name, "initialise", BUGLE_LOG_ERROR,
-                     "Unknown variable %s in filter-set %s",
-                     name, handle->name);
-    return BUGLE_FALSE;
 }
 
 /* Every function that calls this one must hold active_callbacks_rwlock
@@ -564,6 +597,7 @@ static void load_filter_sets(void)
     for (i = bugle_list_head(&added_filter_sets); i; i = bugle_list_next(i))
     {
         handle = (filter_set *) bugle_list_data(i);
+        bugle_log_limit(handle->name, handle->log_rate, handle->log_collapse);
         if (handle->load && !(*handle->load)(handle))
         {
             bugle_log_printf(handle->name, "load", BUGLE_LOG_ERROR,
@@ -706,20 +740,52 @@ void filters_finalise(void)
     compute_active_callbacks();
 }
 
+/* The same as the loop in filters_run, but reports the time taken by each
+ * callback to the profiler. It is kept separate so that the unprofiled
+ * path does not pay for the timing. The profiler is passed in rather than
+ * read from active_profiler, which may be cleared by another thread.
+ */
+static void filters_run_profiled(function_call *call, callback_data *data,
+                                 filter_profiler profiler)
+{
+    linked_list_node *i;
+    filter_catcher *cur;
+    bugle_timespec start, end;
+    bugle_bool more;
+
+    for (i = bugle_list_head(&active_callbacks[call->generic.id]); i; i = bugle_list_next(i))
+    {
+        cur = (filter_catcher *) bugle_list_data(i);
+        data->filter_set_handle = cur->parent->parent;
+        bugle_gettime_fast(&start);
+        more = (*cur->callback)(call, data);
+        bugle_gettime_fast(&end);
+        (*profiler)(cur->parent, (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec));
+        if (!more) break;
+    }
+}
+
 void filters_run(function_call *call)
 {
     linked_list_node *i;
     filter_catcher *cur;
     callback_data data;
+    filter_profiler profiler;
 
     bugle_thread_rwlock_rdlock(&active_callbacks_rwlock);
 
     data.call_object = bugle_object_new(bugle_call_class, NULL, BUGLE_TRUE);
-    for (i = bugle_list_head(&active_callbacks[call->generic.id]); i; i = bugle_list_next(i))
+    profiler = active_profiler;
+    if (profiler)
+        filters_run_profiled(call, &data, profiler);
+    else
     {
-        cur = (filter_catcher *) bugle_list_data(i);
-        data.filter_set_handle = cur->parent->parent;
-        if (!(*cur->callback)(call, &data)) break;
+        for (i = bugle_list_head(&active_callbacks[call->generic.id]); i; i = bugle_list_next(i))
+        {
+            cur = (filter_catcher *) bugle_list_data(i);
+            data.filter_set_handle = cur->parent->parent;
+            if (!(*cur->callback)(call, &data)) break;
+        }
     }
     bugle_object_free(data.call_object);
 
@@ -755,6 +821,11 @@ filter_set *bugle_filter_set_new(const filter_set_info *info)
     s->activate = info->activate;
     s->deactivate = info->deactivate;
     s->variables = info->variables;
+    s->log_rate = 0;
+    s->log_collapse = BUGLE_FALSE;
+    memcpy(s->log_variables, filter_set_log_variables, sizeof(filter_set_log_variables));
+    s->log_variables[0].value = &s->log_rate;
+    s->log_variables[1].value = &s->log_collapse;
     s->loaded = BUGLE_FALSE;
     s->active = BUGLE_FALSE;
     s->added = BUGLE_FALSE;
@@ -866,6 +937,24 @@ void bugle_filter_set_order(const char *before, const char *after)
     register_order(&filter_set_orders, before, after);
 }
 
+void bugle_filters_set_profiler(filter_profiler profiler)
+{
+    active_profiler = profiler;
+}
+
+const char *bugle_filter_set_get_name(const filter_set *handle)
+{
+    return handle->name;
+}
+
+void bugle_filter_set_foreach(void (*callback)(filter_set *handle, void *arg), void *arg)
+{
+    linked_list_node *i;
+
+    for (i = bugle_list_head(&filter_sets); i; i = bugle_list_next(i))
+        (*callback)((filter_set *) bugle_list_data(i), arg);
+}
+
 bugle_bool bugle_filter_set_is_loaded(const filter_set *handle)
 {
     assert(handle);
@@ -904,10 +993,45 @@ object_class *bugle_get_call_class(void)
     return bugle_call_class;
 }
 
+/* Prints the help for each variable in a NULL-terminated array */
+static void filters_help_variables(const filter_set_variable_info *variables)
+{
+    const filter_set_variable_info *j;
+
+    for (j = variables; j && j->name; j++)
+        if (j->help)
+        {
+            const char *type_str = NULL;
+            switch (j->type)
+            {
+            case FILTER_SET_VARIABLE_INT:
+            case FILTER_SET_VARIABLE_UINT:
+            case FILTER_SET_VARIABLE_POSITIVE_INT:
+                type_str = " (int)";
+                break;
+            case FILTER_SET_VARIABLE_FLOAT:
+                type_str = " (float)";
+                break;
+            case FILTER_SET_VARIABLE_BOOL:
+                type_str = " (bugle_bool)";
+                break;
+            case FILTER_SET_VARIABLE_STRING:
+                type_str = " (string)";
+                break;
+            case FILTER_SET_VARIABLE_KEY:
+                type_str = " (key)";
+            case FILTER_SET_VARIABLE_CUSTOM:
+                type_str = "";
+                break;
+            }
+            fprintf(stderr, "    %s%s: %s\n",
+                    j->name, type_str, j->help);
+        }
+}
+
 void filters_help(void)
 {
     linked_list_node *i;
-    const filter_set_variable_info *j;
     filter_set *cur;
 
     bugle_flockfile(stderr);
@@ -922,36 +1046,9 @@ void filters_help(void)
         cur = (filter_set *) bugle_list_data(i);
         if (cur->help)
             fprintf(stderr, "  %s: %s\n", cur->name, cur->help);
-        j = cur->variables;
-        for (j = cur->variables; j && j->name; j++)
-            if (j->help)
-            {
-                const char *type_str = NULL;
-                switch (j->type)
-                {
-                case FILTER_SET_VARIABLE_INT:
-                case FILTER_SET_VARIABLE_UINT:
-                case FILTER_SET_VARIABLE_POSITIVE_INT:
-                    type_str = " (int)";
-                    break;
-                case FILTER_SET_VARIABLE_FLOAT:
-                    type_str = " (float)";
-                    break;
-                case FILTER_SET_VARIABLE_BOOL:
-                    type_str = " (bugle_bool)";
-                    break;
-                case FILTER_SET_VARIABLE_STRING:
-                    type_str = " (string)";
-                    break;
-                case FILTER_SET_VARIABLE_KEY:
-                    type_str = " (key)";
-                case FILTER_SET_VARIABLE_CUSTOM:
-                    type_str = "";
-                    break;
-                }
-                fprintf(stderr, "    %s%s: %s\n",
-                        j->name, type_str, j->help);
-            }
+        filters_help_variables(cur->variables);
     }
+    fprintf(stderr, "All filter-sets also accept:\n");
+    filters_help_variables(filter_set_log_variables);
     bugle_funlockfile(stderr);
 }
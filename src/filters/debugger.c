@@ -1,5 +1,5 @@
 /*  BuGLe: an OpenGL debugging tool
- *  Copyright (C) 2004-2012  Bruce Merry
+ *  Copyright (C) 2004-2012, 2014  Bruce Merry
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <assert.h>
 #include <bugle/gl/glheaders.h>
 #include <bugle/glwin/glwin.h>
@@ -49,9 +50,19 @@
 #include "platform/threads.h"
 #include "platform/types.h"
 #include "platform/io.h"
+#include "platform/shm.h"
 
 #define REQUEST_QUEUE_SIZE 64
 
+/* Smaller payloads are not worth the cost of setting up a segment */
+#define PAYLOAD_SHM_THRESHOLD (64 * 1024)
+
+#if BUGLE_GLTYPE_GL && defined(GL_EXT_framebuffer_object) && defined(GL_EXT_framebuffer_blit) && defined(GL_EXT_pixel_buffer_object)
+# define DEBUGGER_PREVIEW 1
+#else
+# define DEBUGGER_PREVIEW 0
+#endif
+
 typedef struct
 {
     bugle_uint32_t length;
@@ -89,6 +100,14 @@ typedef struct
     gldb_binary_string name;
 } gldb_request_activate_filterset;
 
+typedef struct
+{
+    gldb_request_header header;
+    bugle_uint32_t interval;
+    bugle_uint32_t max_width;
+    bugle_uint32_t max_height;
+} gldb_request_preview;
+
 typedef struct
 {
     gldb_request_header header;
@@ -147,6 +166,63 @@ static bugle_uint32_t start_id = 0;
 static bugle_thread_id debug_thread;
 static bugle_workqueue *request_queue;
 
+/* Set when gldb runs on the same machine and can map shared memory */
+static bugle_bool payload_shm_enabled = BUGLE_FALSE;
+static unsigned long payload_shm_count = 0;
+
+/* Bulk data for a RESP_DATA response. Large payloads are placed directly
+ * in a shared memory segment when possible, and only the name of the
+ * segment is sent down the pipe. gldb removes the name once it has mapped
+ * the segment.
+ */
+typedef struct
+{
+    char *data;
+    size_t length;
+    bugle_shm *shm;
+    char *name;
+} payload;
+
+#if DEBUGGER_PREVIEW
+/* Live preview subscription. The readback for one preview is started at a
+ * swap and only collected when the next preview is due, by which time it
+ * has normally finished, so the application never waits for it.
+ */
+static struct
+{
+    bugle_uint32_t id;            /* request that subscribed, used for the frames */
+    bugle_uint32_t interval;      /* frames between previews, or 0 if unsubscribed */
+    bugle_uint32_t max_width, max_height;
+    bugle_uint32_t countdown;
+    bugle_uint32_t frame;         /* number of swaps seen */
+} preview;
+
+/* Objects used for the readback, which live in the aux context of each
+ * application context. Aux contexts are never destroyed (see
+ * trackcontext), so the objects are deleted explicitly when the
+ * application context is destroyed.
+ */
+typedef struct
+{
+    glwin_display dpy;            /* where the objects were created, if pbo is set */
+    glwin_drawable drawable;
+    glwin_context aux;
+    GLuint fbo, renderbuffer, pbo;
+    int fbo_width, fbo_height;
+    size_t pbo_size;
+#ifdef GL_ARB_sync
+    GLsync fence;
+#endif
+    bugle_bool pending;           /* a readback is in the PBO */
+    bugle_uint32_t pending_id;    /* subscription it was made for */
+    bugle_uint32_t pending_frame;
+    int pending_width, pending_height;
+} preview_context;
+
+static object_view preview_view;
+static bugle_bool preview_exiting = BUGLE_FALSE;
+#endif
+
 static bugle_bool stoppable(void)
 {
     return stop_in_begin_end || !bugle_gl_in_begin_end();
@@ -332,6 +408,65 @@ static void pixel_pack_restore(const pixel_state *old)
 #endif
 }
 
+static char *payload_shm_name(unsigned long index)
+{
+    return bugle_asprintf("/bugle-gldb-%lu-%lu",
+                          (unsigned long) bugle_getpid(), index);
+}
+
+static void payload_alloc(payload *p, size_t length)
+{
+    p->length = length;
+    p->shm = NULL;
+    p->name = NULL;
+    if (payload_shm_enabled && length >= PAYLOAD_SHM_THRESHOLD)
+    {
+        p->name = payload_shm_name(payload_shm_count);
+        p->shm = bugle_shm_create_private(p->name, length);
+        if (p->shm)
+        {
+            payload_shm_count++;
+            p->data = (char *) bugle_shm_data(p->shm);
+            return;
+        }
+        bugle_log_printf("debugger", "shm", BUGLE_LOG_WARNING,
+                         "failed to create %s: %s; sending data over the pipe",
+                         p->name, strerror(errno));
+        bugle_free(p->name);
+        p->name = NULL;
+    }
+    p->data = bugle_malloc(length);
+}
+
+/* Sends the start of the response, up to and including the payload. Any
+ * fields specific to the subtype follow.
+ */
+static void payload_send(const payload *p, bugle_uint32_t id, bugle_uint32_t subtype)
+{
+    gldb_protocol_send_code(out_pipe, p->shm ? RESP_DATA_SHM : RESP_DATA);
+    gldb_protocol_send_code(out_pipe, id);
+    gldb_protocol_send_code(out_pipe, subtype);
+    if (p->shm)
+    {
+        gldb_protocol_send_string(out_pipe, p->name);
+        gldb_protocol_send_code(out_pipe, p->length);
+    }
+    else
+        gldb_protocol_send_binary_string(out_pipe, p->length, p->data);
+}
+
+static void payload_free(payload *p)
+{
+    if (p->shm)
+    {
+        /* The name now belongs to gldb */
+        bugle_shm_release(p->shm);
+        bugle_free(p->name);
+    }
+    else
+        bugle_free(p->data);
+}
+
 #ifdef GL_VERSION_1_1
 /* Wherever possible we use the aux context. However, default textures
  * are not shared between contexts, so we sometimes have to take our
@@ -342,7 +477,7 @@ static bugle_bool send_data_texture(bugle_uint32_t id, GLuint texid, GLenum targ
                                     GLenum face, GLint level,
                                     GLenum format, GLenum type)
 {
-    char *data;
+    payload data;
     size_t length;
     GLint width = 1, height = 1, depth = 1;
     GLint old_tex;
@@ -400,9 +535,9 @@ static bugle_bool send_data_texture(bugle_uint32_t id, GLuint texid, GLenum targ
 
     length = bugle_gl_type_to_size(type) * bugle_gl_format_to_count(format, type)
         * width * height * depth;
-    data = bugle_malloc(length);
+    payload_alloc(&data, length);
 
-    CALL(glGetTexImage)(face, level, format, type, data);
+    CALL(glGetTexImage)(face, level, format, type, data.data);
 
     if (aux && texid)
     {
@@ -419,15 +554,12 @@ static bugle_bool send_data_texture(bugle_uint32_t id, GLuint texid, GLenum targ
         pixel_pack_restore(&old_pack);
     }
 
-    gldb_protocol_send_code(out_pipe, RESP_DATA);
-    gldb_protocol_send_code(out_pipe, id);
-    gldb_protocol_send_code(out_pipe, REQ_DATA_TEXTURE);
-    gldb_protocol_send_binary_string(out_pipe, length, data);
+    payload_send(&data, id, REQ_DATA_TEXTURE);
     gldb_protocol_send_code(out_pipe, width);
     gldb_protocol_send_code(out_pipe, height);
     gldb_protocol_send_code(out_pipe, depth);
     bugle_gl_end_internal_render("send_data_texture", BUGLE_TRUE);
-    bugle_free(data);
+    payload_free(&data);
     return BUGLE_TRUE;
 }
 #endif /* GL */
@@ -534,7 +666,7 @@ static bugle_bool send_data_framebuffer(bugle_uint32_t id, GLuint fbo,
     GLint width = 0, height = 0;
     size_t length;
     GLuint fbo_target = 0;
-    char *data;
+    payload data;
     bugle_bool illegal = BUGLE_FALSE;
 
     if (!bugle_gl_begin_internal_render())
@@ -581,8 +713,8 @@ static bugle_bool send_data_framebuffer(bugle_uint32_t id, GLuint fbo,
     get_framebuffer_size(fbo, fbo_target, buffer, &width, &height);
     length = bugle_gl_type_to_size(type) * bugle_gl_format_to_count(format, type)
         * width * height;
-    data = bugle_malloc(length);
-    CALL(glReadPixels)(0, 0, width, height, format, type, data);
+    payload_alloc(&data, length);
+    CALL(glReadPixels)(0, 0, width, height, format, type, data.data);
 
     /* Restore the old state. */
 #if BUGLE_GLTYPE_GL
@@ -593,14 +725,11 @@ static bugle_bool send_data_framebuffer(bugle_uint32_t id, GLuint fbo,
         bugle_gl_bind_read_framebuffer(old_fbo);
     pixel_pack_restore(&old_pack);
 
-    gldb_protocol_send_code(out_pipe, RESP_DATA);
-    gldb_protocol_send_code(out_pipe, id);
-    gldb_protocol_send_code(out_pipe, REQ_DATA_FRAMEBUFFER);
-    gldb_protocol_send_binary_string(out_pipe, length, data);
+    payload_send(&data, id, REQ_DATA_FRAMEBUFFER);
     gldb_protocol_send_code(out_pipe, width);
     gldb_protocol_send_code(out_pipe, height);
     bugle_gl_end_internal_render("send_data_framebuffer", BUGLE_TRUE);
-    bugle_free(data);
+    payload_free(&data);
     return BUGLE_TRUE;
 }
 
@@ -747,7 +876,7 @@ static bugle_bool send_data_buffer(bugle_uint32_t id, GLuint object_id)
 {
     GLint old_binding;
     GLint size;
-    void *data;
+    payload data;
 
     glwin_display dpy = NULL;
     glwin_context aux = NULL, real = NULL;
@@ -796,8 +925,8 @@ static bugle_bool send_data_buffer(bugle_uint32_t id, GLuint object_id)
 
     CALL(glBindBuffer)(GL_ARRAY_BUFFER_ARB, object_id);
     CALL(glGetBufferParameterivARB)(GL_ARRAY_BUFFER_ARB, GL_BUFFER_SIZE_ARB, &size);
-    data = bugle_malloc(size);
-    CALL(glGetBufferSubDataARB)(GL_ARRAY_BUFFER_ARB, 0, size, data);
+    payload_alloc(&data, size);
+    CALL(glGetBufferSubDataARB)(GL_ARRAY_BUFFER_ARB, 0, size, data.data);
     CALL(glBindBuffer)(GL_ARRAY_BUFFER_ARB, old_binding);
 
     if (aux)
@@ -809,17 +938,232 @@ static bugle_bool send_data_buffer(bugle_uint32_t id, GLuint object_id)
         bugle_glwin_make_context_current(dpy, old_write, old_read, real);
     }
 
-    gldb_protocol_send_code(out_pipe, RESP_DATA);
-    gldb_protocol_send_code(out_pipe, id);
-    gldb_protocol_send_code(out_pipe, REQ_DATA_BUFFER);
-    gldb_protocol_send_binary_string(out_pipe, size, data);
+    payload_send(&data, id, REQ_DATA_BUFFER);
 
-    bugle_free(data);
+    payload_free(&data);
     bugle_gl_end_internal_render("send_data_buffer", BUGLE_TRUE);
     return BUGLE_TRUE;
 }
 #endif
 
+#if DEBUGGER_PREVIEW
+/* Ends the subscription, telling gldb why */
+static void preview_fail(const char *reason)
+{
+    gldb_protocol_send_code(out_pipe, RESP_ERROR);
+    gldb_protocol_send_code(out_pipe, preview.id);
+    gldb_protocol_send_code(out_pipe, 0);
+    gldb_protocol_send_string(out_pipe, reason);
+    preview.interval = 0;
+}
+
+/* Returns BUGLE_TRUE if the readback in the PBO has finished, so that
+ * mapping it will not stall. Without sync objects, it is assumed to have
+ * finished by the time the next preview is due.
+ */
+static bugle_bool preview_ready(preview_context *pc)
+{
+#ifdef GL_ARB_sync
+    if (pc->fence)
+    {
+        if (CALL(glClientWaitSync)(pc->fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            return BUGLE_FALSE;
+        CALL(glDeleteSync)(pc->fence);
+        pc->fence = NULL;
+    }
+#endif
+    return BUGLE_TRUE;
+}
+
+static void preview_send(preview_context *pc)
+{
+    const char *data;
+
+    CALL(glBindBufferARB)(GL_PIXEL_PACK_BUFFER_EXT, pc->pbo);
+    data = (const char *) CALL(glMapBufferARB)(GL_PIXEL_PACK_BUFFER_EXT, GL_READ_ONLY_ARB);
+    if (data)
+    {
+        gldb_protocol_send_code(out_pipe, RESP_PREVIEW);
+        gldb_protocol_send_code(out_pipe, pc->pending_id);
+        gldb_protocol_send_code(out_pipe, pc->pending_frame);
+        gldb_protocol_send_code(out_pipe, pc->pending_width);
+        gldb_protocol_send_code(out_pipe, pc->pending_height);
+        gldb_protocol_send_binary_string(out_pipe,
+                                         pc->pending_width * pc->pending_height * 3,
+                                         data);
+        CALL(glUnmapBufferARB)(GL_PIXEL_PACK_BUFFER_EXT);
+    }
+    CALL(glBindBufferARB)(GL_PIXEL_PACK_BUFFER_EXT, 0);
+    pc->pending = BUGLE_FALSE;
+}
+
+/* Starts an asynchronous readback of the back buffer into the PBO,
+ * shrinking it on the GPU to fit the requested size.
+ */
+static void preview_read(preview_context *pc, glwin_display dpy, glwin_drawable drawable)
+{
+    int width, height, out_width, out_height;
+    double scale;
+    size_t size;
+
+    bugle_glwin_get_drawable_dimensions(dpy, drawable, &width, &height);
+    if (width <= 0 || height <= 0)
+        return;
+    scale = 1.0;
+    if ((double) preview.max_width / width < scale)
+        scale = (double) preview.max_width / width;
+    if ((double) preview.max_height / height < scale)
+        scale = (double) preview.max_height / height;
+    out_width = (int) (width * scale + 0.5);
+    out_height = (int) (height * scale + 0.5);
+    if (out_width < 1) out_width = 1;
+    if (out_height < 1) out_height = 1;
+
+    pc->drawable = drawable;
+    if (!pc->pbo)
+    {
+        pc->dpy = dpy;
+        pc->aux = bugle_glwin_get_current_context();
+        CALL(glGenFramebuffersEXT)(1, &pc->fbo);
+        CALL(glGenRenderbuffersEXT)(1, &pc->renderbuffer);
+        CALL(glGenBuffersARB)(1, &pc->pbo);
+    }
+    if (out_width != width || out_height != height)
+    {
+        CALL(glBindFramebufferEXT)(GL_FRAMEBUFFER_EXT, pc->fbo);
+        if (pc->fbo_width != out_width || pc->fbo_height != out_height)
+        {
+            CALL(glBindRenderbufferEXT)(GL_RENDERBUFFER_EXT, pc->renderbuffer);
+            CALL(glRenderbufferStorageEXT)(GL_RENDERBUFFER_EXT, GL_RGBA8, out_width, out_height);
+            CALL(glBindRenderbufferEXT)(GL_RENDERBUFFER_EXT, 0);
+            CALL(glFramebufferRenderbufferEXT)(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT,
+                                               GL_RENDERBUFFER_EXT, pc->renderbuffer);
+            pc->fbo_width = out_width;
+            pc->fbo_height = out_height;
+        }
+        if (CALL(glCheckFramebufferStatusEXT)(GL_FRAMEBUFFER_EXT) != GL_FRAMEBUFFER_COMPLETE_EXT)
+        {
+            CALL(glBindFramebufferEXT)(GL_FRAMEBUFFER_EXT, 0);
+            preview_fail("Could not create a framebuffer for the live preview");
+            return;
+        }
+        /* The aux context has its own state, so the scissor test is off */
+        CALL(glBindFramebufferEXT)(GL_READ_FRAMEBUFFER_EXT, 0);
+        CALL(glBlitFramebufferEXT)(0, 0, width, height, 0, 0, out_width, out_height,
+                                   GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        CALL(glBindFramebufferEXT)(GL_FRAMEBUFFER_EXT, pc->fbo);
+    }
+
+    size = (size_t) out_width * out_height * 3;
+    CALL(glBindBufferARB)(GL_PIXEL_PACK_BUFFER_EXT, pc->pbo);
+    if (size > pc->pbo_size)
+    {
+        CALL(glBufferDataARB)(GL_PIXEL_PACK_BUFFER_EXT, size, NULL, GL_STREAM_READ_ARB);
+        pc->pbo_size = size;
+    }
+    CALL(glPixelStorei)(GL_PACK_ALIGNMENT, 1);
+    CALL(glReadPixels)(0, 0, out_width, out_height, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    CALL(glBindBufferARB)(GL_PIXEL_PACK_BUFFER_EXT, 0);
+    CALL(glBindFramebufferEXT)(GL_FRAMEBUFFER_EXT, 0);
+#ifdef GL_ARB_sync
+    if (BUGLE_GL_HAS_EXTENSION_GROUP(GL_ARB_sync))
+        pc->fence = CALL(glFenceSync)(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+    CALL(glFlush)();
+
+    pc->pending = BUGLE_TRUE;
+    pc->pending_id = preview.id;
+    pc->pending_frame = preview.frame;
+    pc->pending_width = out_width;
+    pc->pending_height = out_height;
+}
+
+/* Deletes the readback objects when the application context is destroyed.
+ * The aux context is made current on the drawable it last read from, which
+ * the application has normally not destroyed yet. Nothing is deleted at
+ * exit, since the window system may already have shut down by then and the
+ * objects go away with the process anyway.
+ */
+static void preview_context_destroy(void *data)
+{
+    preview_context *pc;
+    glwin_context old_context;
+    glwin_drawable old_read, old_write;
+    glwin_display old_dpy;
+
+    pc = (preview_context *) data;
+    if (!pc->pbo || preview_exiting)
+        return;
+
+    old_context = bugle_glwin_get_current_context();
+    old_write = bugle_glwin_get_current_drawable();
+    old_read = bugle_glwin_get_current_read_drawable();
+    old_dpy = bugle_glwin_get_current_display();
+    if (!bugle_glwin_make_context_current(pc->dpy, pc->drawable, pc->drawable, pc->aux))
+    {
+        bugle_log("debugger", "preview", BUGLE_LOG_WARNING,
+                  "could not delete the live preview objects of a destroyed context");
+        return;
+    }
+#ifdef GL_ARB_sync
+    if (pc->fence)
+        CALL(glDeleteSync)(pc->fence);
+#endif
+    CALL(glDeleteBuffersARB)(1, &pc->pbo);
+    CALL(glDeleteRenderbuffersEXT)(1, &pc->renderbuffer);
+    CALL(glDeleteFramebuffersEXT)(1, &pc->fbo);
+    bugle_gl_end_internal_render("debugger_preview", BUGLE_TRUE);
+    if (old_context)
+        bugle_glwin_make_context_current(old_dpy, old_write, old_read, old_context);
+    else
+        bugle_glwin_make_context_current(pc->dpy, old_write, old_read, NULL);
+}
+
+/* Called at a swap when a preview is due, in the application's context */
+static void preview_capture(void)
+{
+    preview_context *pc;
+    glwin_context old_context, aux;
+    glwin_drawable old_read, old_write;
+    glwin_display dpy;
+
+    if (bugle_gl_in_begin_end())
+        return;
+    if (!BUGLE_GL_HAS_EXTENSION_GROUP(GL_EXT_framebuffer_object)
+        || !BUGLE_GL_HAS_EXTENSION_GROUP(GL_EXT_framebuffer_blit)
+        || !BUGLE_GL_HAS_EXTENSION_GROUP(GL_EXT_pixel_buffer_object))
+    {
+        preview_fail("Live preview requires GL_EXT_framebuffer_blit and GL_EXT_pixel_buffer_object");
+        return;
+    }
+    pc = (preview_context *) bugle_object_get_current_data(bugle_get_context_class(), preview_view);
+    aux = bugle_get_aux_context(BUGLE_FALSE);
+    if (!pc || !aux)
+        return;
+
+    old_context = bugle_glwin_get_current_context();
+    old_write = bugle_glwin_get_current_drawable();
+    old_read = bugle_glwin_get_current_read_drawable();
+    dpy = bugle_glwin_get_current_display();
+    bugle_glwin_make_context_current(dpy, old_write, old_write, aux);
+    if (bugle_gl_begin_internal_render())
+    {
+        if (pc->pending && preview_ready(pc))
+        {
+            /* Drop readbacks made for an earlier subscription */
+            if (pc->pending_id == preview.id)
+                preview_send(pc);
+            pc->pending = BUGLE_FALSE;
+        }
+        /* If the last readback is still running, leave it for next time */
+        if (!pc->pending && preview.interval)
+            preview_read(pc, dpy, old_write);
+        bugle_gl_end_internal_render("debugger_preview", BUGLE_TRUE);
+    }
+    bugle_glwin_make_context_current(dpy, old_write, old_read, old_context);
+}
+#endif /* DEBUGGER_PREVIEW */
+
 /* Reads a binary string into a structure. Returns true on success */
 static bugle_bool read_binary_string(bugle_io_reader *in_pipe, gldb_binary_string *s)
 {
@@ -985,6 +1329,43 @@ static void process_single_command(function_call *call, gldb_request_header *req
             gldb_protocol_send_string(out_pipe, "In glBegin/glEnd; no state available");
         }
         break;
+    case REQ_PREVIEW:
+        {
+            gldb_request_preview *req2 = (gldb_request_preview *) req;
+#if DEBUGGER_PREVIEW
+            if (req2->interval && (req2->max_width == 0 || req2->max_height == 0))
+            {
+                gldb_protocol_send_code(out_pipe, RESP_ERROR);
+                gldb_protocol_send_code(out_pipe, req->request_id);
+                gldb_protocol_send_code(out_pipe, 0);
+                gldb_protocol_send_string(out_pipe, "Preview size must be positive");
+                break;
+            }
+            preview.id = req->request_id;
+            preview.interval = req2->interval;
+            preview.max_width = req2->max_width;
+            preview.max_height = req2->max_height;
+            preview.countdown = 1;   /* start at the next swap */
+            gldb_protocol_send_code(out_pipe, RESP_ANS);
+            gldb_protocol_send_code(out_pipe, req->request_id);
+            gldb_protocol_send_code(out_pipe, 0);
+#else
+            if (req2->interval)
+            {
+                gldb_protocol_send_code(out_pipe, RESP_ERROR);
+                gldb_protocol_send_code(out_pipe, req->request_id);
+                gldb_protocol_send_code(out_pipe, 0);
+                gldb_protocol_send_string(out_pipe, "Live preview is not supported for this API");
+            }
+            else
+            {
+                gldb_protocol_send_code(out_pipe, RESP_ANS);
+                gldb_protocol_send_code(out_pipe, req->request_id);
+                gldb_protocol_send_code(out_pipe, 0);
+            }
+#endif
+        }
+        break;
     case REQ_SCREENSHOT:
         gldb_protocol_send_code(out_pipe, RESP_ERROR);
         gldb_protocol_send_code(out_pipe, req->request_id);
@@ -1152,6 +1533,23 @@ static bugle_bool debugger_callback(function_call *call, const callback_data *da
     return BUGLE_TRUE;
 }
 
+#if DEBUGGER_PREVIEW
+static bugle_bool debugger_swap_buffers(function_call *call, const callback_data *data)
+{
+    bugle_thread_once(&debugger_init_thread_once, debugger_init_thread);
+    if (!bugle_thread_equal(debug_thread, bugle_thread_self()))
+        return BUGLE_TRUE;
+
+    preview.frame++;
+    if (preview.interval && --preview.countdown == 0)
+    {
+        preview.countdown = preview.interval;
+        preview_capture();
+    }
+    return BUGLE_TRUE;
+}
+#endif
+
 static bugle_bool debugger_error_callback(function_call *call, const callback_data *data)
 {
     GLenum error;
@@ -1263,6 +1661,21 @@ static bugle_bool read_request(bugle_workqueue *queue, void *user_data, void **i
             return BUGLE_TRUE;
         }
         break;
+    case REQ_PREVIEW:
+        {
+            gldb_request_preview *req = BUGLE_MALLOC(gldb_request_preview);
+            req->header = header;
+            if (!gldb_protocol_recv_code(in_pipe, &req->interval)
+                || !gldb_protocol_recv_code(in_pipe, &req->max_width)
+                || !gldb_protocol_recv_code(in_pipe, &req->max_height))
+            {
+                bugle_free(req);
+                return BUGLE_FALSE;
+            }
+            *out = &req->header;
+            return BUGLE_TRUE;
+        }
+        break;
     case REQ_ACTIVATE_FILTERSET:
     case REQ_DEACTIVATE_FILTERSET:
         {
@@ -1507,6 +1920,8 @@ static bugle_bool debugger_initialise(filter_set *handle)
         return BUGLE_FALSE;
     }
 
+    payload_shm_enabled = getenv("BUGLE_DEBUGGER_SHM") != NULL;
+
     request_queue = bugle_workqueue_new(read_request, in_pipe);
     if (request_queue == NULL)
     {
@@ -1524,6 +1939,15 @@ static bugle_bool debugger_initialise(filter_set *handle)
     bugle_filter_catches_all(f, BUGLE_FALSE, debugger_callback);
     f = bugle_filter_new(handle, "debugger_error");
     bugle_filter_catches_all(f, BUGLE_FALSE, debugger_error_callback);
+#if DEBUGGER_PREVIEW
+    preview_view = bugle_object_view_new(bugle_get_context_class(),
+                                         NULL,
+                                         preview_context_destroy,
+                                         sizeof(preview_context));
+    f = bugle_filter_new(handle, "debugger_preview");
+    bugle_glwin_filter_catches_swap_buffers(f, BUGLE_FALSE, debugger_swap_buffers);
+    bugle_filter_order("debugger_preview", "invoke");
+#endif
     bugle_filter_order("debugger", "invoke");
     bugle_filter_order("invoke", "debugger_error");
     bugle_filter_order("error", "debugger_error");
@@ -1536,10 +1960,24 @@ static bugle_bool debugger_initialise(filter_set *handle)
 
 static void debugger_shutdown(filter_set *handle)
 {
+    unsigned long i;
+
     /* TODO: this will leak the resources associated with the reader thread,
      * but we don't have a portable way to interrupt it if it is blocked on
      * I/O from the pipe.
      */
+
+#if DEBUGGER_PREVIEW
+    preview_exiting = BUGLE_TRUE;
+#endif
+
+    /* Remove any segments that gldb never picked up */
+    for (i = 0; i < payload_shm_count; i++)
+    {
+        char *name = payload_shm_name(i);
+        bugle_shm_unlink(name);
+        bugle_free(name);
+    }
     bugle_free(break_on);
 }
 
@@ -0,0 +1,436 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <bugle/bool.h>
+#include <bugle/string.h>
+#include <bugle/time.h>
+#include <bugle/glwin/glwin.h>
+#include <bugle/linkedlist.h>
+#include <bugle/stats.h>
+#include <bugle/math.h>
+#include <bugle/memory.h>
+#include <bugle/filters.h>
+#include <bugle/log.h>
+#include "platform/threads.h"
+
+/* Statistics are evaluated on the thread that swaps buffers, once per
+ * window, and the resulting row of numbers is put in a queue. A writer
+ * thread takes rows off the queue, formats them and writes them out, so
+ * that the application never waits for the disk. If the writer falls so
+ * far behind that the queue is full, rows are dropped and counted.
+ *
+ * Each row covers a window of frames, and each statistic is computed over
+ * the whole window (so d() is the change across the window), which keeps
+ * files from long runs to a manageable size without losing averages.
+ */
+
+typedef enum
+{
+    EXPORTSTATS_CSV,
+    EXPORTSTATS_JSON
+} exportstats_format;
+
+static linked_list exportstats_show;            /* actual stats */
+static linked_list exportstats_show_requested;  /* names in config file */
+static size_t exportstats_count;                /* length of exportstats_show */
+static char **exportstats_keys;                 /* column names, escaped for the format */
+
+static char *exportstats_filename = NULL;
+static exportstats_format exportstats_fmt = EXPORTSTATS_CSV;
+static long exportstats_interval = 1;
+static float exportstats_time = 0.0f;
+static long exportstats_buffer = 1024;
+
+static FILE *exportstats_file;
+static stats_signal_values exportstats_start, exportstats_cur;
+static bugle_timespec exportstats_origin;
+static unsigned long exportstats_frame;         /* frames seen so far */
+static unsigned long exportstats_window;        /* frames in the current window */
+
+/* Queue of rows, each holding exportstats_count values */
+static bugle_thread_lock_t exportstats_queue_lock;
+static bugle_thread_sem_t exportstats_queue_ready;  /* posted for each row, and to stop */
+static bugle_thread_handle exportstats_writer_thread;
+static bugle_bool exportstats_writer_running = BUGLE_FALSE;
+static double *exportstats_values;
+static unsigned long *exportstats_frames;
+static double *exportstats_times;
+static size_t exportstats_head, exportstats_size;
+static unsigned long exportstats_dropped;
+
+/* Callback to assign the "show" pseudo-variable */
+static bugle_bool exportstats_show_set(const struct filter_set_variable_info_s *var,
+                                       const char *text, const void *value)
+{
+    bugle_list_append(&exportstats_show_requested, bugle_strdup(text));
+    return BUGLE_TRUE;
+}
+
+static bugle_bool exportstats_format_set(const struct filter_set_variable_info_s *var,
+                                         const char *text, const void *value)
+{
+    if (strcmp(text, "csv") == 0)
+        exportstats_fmt = EXPORTSTATS_CSV;
+    else if (strcmp(text, "json") == 0)
+        exportstats_fmt = EXPORTSTATS_JSON;
+    else
+    {
+        bugle_log_printf("exportstats", "initialise", BUGLE_LOG_ERROR,
+                         "format must be csv or json");
+        return BUGLE_FALSE;
+    }
+    return BUGLE_TRUE;
+}
+
+static double time_elapsed(const bugle_timespec *old, const bugle_timespec *now)
+{
+    return (now->tv_sec - old->tv_sec) + 1e-9 * (now->tv_nsec - old->tv_nsec);
+}
+
+/* Quotes a statistic name as a CSV field or a JSON string */
+static char *exportstats_escape(const char *name)
+{
+    char *out, *p;
+    const char *s;
+
+    /* Worst case is a JSON \u escape for every character */
+    out = BUGLE_NMALLOC(strlen(name) * 6 + 3, char);
+    p = out;
+    *p++ = '"';
+    for (s = name; *s; s++)
+    {
+        unsigned char c = (unsigned char) *s;
+        if (exportstats_fmt == EXPORTSTATS_CSV)
+        {
+            if (c == '"')
+                *p++ = '"';
+            *p++ = c;
+        }
+        else if (c == '"' || c == '\\')
+        {
+            *p++ = '\\';
+            *p++ = c;
+        }
+        else if (c < 0x20)
+        {
+            sprintf(p, "\\u%04x", (unsigned int) c);
+            p += 6;
+        }
+        else
+            *p++ = c;
+    }
+    *p++ = '"';
+    *p = '\0';
+    return out;
+}
+
+static void exportstats_write_value(double v)
+{
+    if (bugle_isfinite(v))
+        fprintf(exportstats_file, "%.10g", v);
+    else if (exportstats_fmt == EXPORTSTATS_JSON)
+        fputs("null", exportstats_file);
+    /* CSV leaves the field empty */
+}
+
+static void exportstats_write_row(unsigned long frame, double time, const double *values)
+{
+    size_t i;
+
+    if (exportstats_fmt == EXPORTSTATS_CSV)
+    {
+        fprintf(exportstats_file, "%lu,%.6f", frame, time);
+        for (i = 0; i < exportstats_count; i++)
+        {
+            fputc(',', exportstats_file);
+            exportstats_write_value(values[i]);
+        }
+    }
+    else
+    {
+        fprintf(exportstats_file, "{\"frame\":%lu,\"time\":%.6f", frame, time);
+        for (i = 0; i < exportstats_count; i++)
+        {
+            fprintf(exportstats_file, ",%s:", exportstats_keys[i]);
+            exportstats_write_value(values[i]);
+        }
+        fputc('}', exportstats_file);
+    }
+    fputc('\n', exportstats_file);
+}
+
+static unsigned int exportstats_writer(void *arg)
+{
+    double *values;
+    unsigned long frame;
+    double time;
+
+    values = BUGLE_NMALLOC(exportstats_count + 1, double);
+    for (;;)
+    {
+        bugle_thread_sem_wait(&exportstats_queue_ready);
+        bugle_thread_lock_lock(&exportstats_queue_lock);
+        if (exportstats_size == 0)
+        {
+            /* Each row posts once, so an empty queue means we were stopped */
+            bugle_thread_lock_unlock(&exportstats_queue_lock);
+            break;
+        }
+        frame = exportstats_frames[exportstats_head];
+        time = exportstats_times[exportstats_head];
+        memcpy(values, exportstats_values + exportstats_head * exportstats_count,
+               exportstats_count * sizeof(double));
+        exportstats_head = (exportstats_head + 1) % exportstats_buffer;
+        exportstats_size--;
+        bugle_thread_lock_unlock(&exportstats_queue_lock);
+
+        exportstats_write_row(frame, time, values);
+    }
+    bugle_free(values);
+    return 0;
+}
+
+static void exportstats_queue_push(unsigned long frame, double time)
+{
+    linked_list_node *i;
+    double *values;
+    size_t pos;
+
+    bugle_thread_lock_lock(&exportstats_queue_lock);
+    if (exportstats_size == (size_t) exportstats_buffer)
+    {
+        exportstats_dropped++;
+        bugle_thread_lock_unlock(&exportstats_queue_lock);
+        return;
+    }
+    pos = (exportstats_head + exportstats_size) % exportstats_buffer;
+    exportstats_frames[pos] = frame;
+    exportstats_times[pos] = time;
+    values = exportstats_values + pos * exportstats_count;
+    for (i = bugle_list_head(&exportstats_show); i; i = bugle_list_next(i))
+    {
+        stats_statistic *st = (stats_statistic *) bugle_list_data(i);
+        *values++ = bugle_stats_expression_evaluate(st->value, &exportstats_start, &exportstats_cur);
+    }
+    exportstats_size++;
+    bugle_thread_lock_unlock(&exportstats_queue_lock);
+    bugle_thread_sem_post(&exportstats_queue_ready);
+}
+
+static bugle_bool exportstats_swap_buffers(function_call *call, const callback_data *data)
+{
+    stats_signal_values tmp;
+
+    if (!exportstats_start.allocated)
+    {
+        bugle_stats_signal_values_gather(&exportstats_start);
+        exportstats_origin = exportstats_start.last_updated;
+        return BUGLE_TRUE;
+    }
+
+    exportstats_frame++;
+    exportstats_window++;
+    if (exportstats_window < (unsigned long) exportstats_interval)
+        return BUGLE_TRUE;
+    if (exportstats_time > 0.0)
+    {
+        bugle_timespec now;
+
+        bugle_gettime_fast(&now);
+        if (time_elapsed(&exportstats_start.last_updated, &now) < exportstats_time)
+            return BUGLE_TRUE;
+    }
+
+    bugle_stats_signal_values_gather(&exportstats_cur);
+    exportstats_queue_push(exportstats_frame,
+                           time_elapsed(&exportstats_origin, &exportstats_cur.last_updated));
+    tmp = exportstats_start;
+    exportstats_start = exportstats_cur;
+    exportstats_cur = tmp;
+    exportstats_window = 0;
+    return BUGLE_TRUE;
+}
+
+static bugle_bool exportstats_initialise(filter_set *handle)
+{
+    filter *f;
+    linked_list_node *i, *j;
+    stats_statistic *st;
+    size_t k;
+
+    f = bugle_filter_new(handle, "exportstats");
+    bugle_glwin_filter_catches_swap_buffers(f, BUGLE_FALSE, exportstats_swap_buffers);
+
+    bugle_list_clear(&exportstats_show);
+    for (i = bugle_list_head(&exportstats_show_requested); i; i = bugle_list_next(i))
+    {
+        char *name;
+        name = (char *) bugle_list_data(i);
+        j = bugle_stats_statistic_find(name);
+        if (!j)
+        {
+            bugle_log_printf("exportstats", "initialise", BUGLE_LOG_ERROR,
+                             "statistic '%s' not found.", name);
+            bugle_stats_statistic_list();
+            return BUGLE_FALSE;
+        }
+        for (; j; j = bugle_list_next(j))
+        {
+            st = (stats_statistic *) bugle_list_data(j);
+            if (bugle_stats_expression_activate_signals(st->value))
+                bugle_list_append(&exportstats_show, st);
+            else
+            {
+                bugle_log_printf("exportstats", "initialise", BUGLE_LOG_ERROR,
+                                 "could not initialise statistic '%s'",
+                                 st->name);
+                return BUGLE_FALSE;
+            }
+            if (st->last) break;
+        }
+    }
+    bugle_list_clear(&exportstats_show_requested);
+
+    exportstats_file = fopen(exportstats_filename, "w");
+    if (!exportstats_file)
+    {
+        bugle_log_printf("exportstats", "initialise", BUGLE_LOG_ERROR,
+                         "cannot open %s for writing: %s", exportstats_filename, strerror(errno));
+        return BUGLE_FALSE;
+    }
+
+    /* The columns are fixed for the whole run, so the header is written now */
+    exportstats_count = 0;
+    for (i = bugle_list_head(&exportstats_show); i; i = bugle_list_next(i))
+        exportstats_count++;
+    exportstats_keys = BUGLE_NMALLOC(exportstats_count, char *);
+    k = 0;
+    for (i = bugle_list_head(&exportstats_show); i; i = bugle_list_next(i))
+    {
+        st = (stats_statistic *) bugle_list_data(i);
+        exportstats_keys[k++] = exportstats_escape(st->name);
+    }
+    if (exportstats_fmt == EXPORTSTATS_CSV)
+    {
+        fputs("frame,time", exportstats_file);
+        for (k = 0; k < exportstats_count; k++)
+            fprintf(exportstats_file, ",%s", exportstats_keys[k]);
+        fputc('\n', exportstats_file);
+    }
+
+    bugle_stats_signal_values_init(&exportstats_start);
+    bugle_stats_signal_values_init(&exportstats_cur);
+    exportstats_frame = 0;
+    exportstats_window = 0;
+
+    exportstats_values = BUGLE_NMALLOC(exportstats_buffer * exportstats_count + 1, double);
+    exportstats_frames = BUGLE_NMALLOC(exportstats_buffer, unsigned long);
+    exportstats_times = BUGLE_NMALLOC(exportstats_buffer, double);
+    exportstats_head = 0;
+    exportstats_size = 0;
+    exportstats_dropped = 0;
+    bugle_thread_lock_init(&exportstats_queue_lock);
+    bugle_thread_sem_init(&exportstats_queue_ready, 0);
+    if (bugle_thread_create(&exportstats_writer_thread, exportstats_writer, NULL) != 0)
+    {
+        bugle_log_printf("exportstats", "initialise", BUGLE_LOG_ERROR,
+                         "failed to start the writer thread");
+        return BUGLE_FALSE;
+    }
+    exportstats_writer_running = BUGLE_TRUE;
+    return BUGLE_TRUE;
+}
+
+static void exportstats_shutdown(filter_set *handle)
+{
+    size_t k;
+
+    if (exportstats_writer_running)
+    {
+        /* The writer drains the queue before it sees the extra post */
+        bugle_thread_sem_post(&exportstats_queue_ready);
+        bugle_thread_join(exportstats_writer_thread, NULL);
+        exportstats_writer_running = BUGLE_FALSE;
+        if (exportstats_dropped)
+            bugle_log_printf("exportstats", "shutdown", BUGLE_LOG_WARNING,
+                             "%lu rows were dropped because the writer fell behind (try a larger buffer)",
+                             exportstats_dropped);
+        bugle_thread_sem_destroy(&exportstats_queue_ready);
+        bugle_thread_lock_destroy(&exportstats_queue_lock);
+    }
+    if (exportstats_file)
+    {
+        fclose(exportstats_file);
+        exportstats_file = NULL;
+    }
+    if (exportstats_keys)
+    {
+        for (k = 0; k < exportstats_count; k++)
+            bugle_free(exportstats_keys[k]);
+        bugle_free(exportstats_keys);
+        exportstats_keys = NULL;
+    }
+    bugle_free(exportstats_values);
+    bugle_free(exportstats_frames);
+    bugle_free(exportstats_times);
+    exportstats_values = NULL;
+    exportstats_frames = NULL;
+    exportstats_times = NULL;
+    bugle_free(exportstats_filename);
+    exportstats_filename = NULL;
+    bugle_stats_signal_values_clear(&exportstats_start);
+    bugle_stats_signal_values_clear(&exportstats_cur);
+    bugle_list_clear(&exportstats_show);
+}
+
+void bugle_initialise_filter_library(void)
+{
+    static const filter_set_variable_info exportstats_variables[] =
+    {
+        { "show", "repeat with each item to export", FILTER_SET_VARIABLE_CUSTOM, NULL, exportstats_show_set },
+        { "filename", "file to write to [bugle-stats.csv]", FILTER_SET_VARIABLE_STRING, &exportstats_filename, NULL },
+        { "format", "csv or json (one object per line) [csv]", FILTER_SET_VARIABLE_CUSTOM, NULL, exportstats_format_set },
+        { "interval", "minimum number of frames per row [1]", FILTER_SET_VARIABLE_POSITIVE_INT, &exportstats_interval, NULL },
+        { "time", "minimum time in seconds per row [0]", FILTER_SET_VARIABLE_FLOAT, &exportstats_time, NULL },
+        { "buffer", "number of rows that may wait for the writer [1024]", FILTER_SET_VARIABLE_POSITIVE_INT, &exportstats_buffer, NULL },
+        { NULL, NULL, 0, NULL, NULL }
+    };
+
+    static const filter_set_info exportstats_info =
+    {
+        "exportstats",
+        exportstats_initialise,
+        exportstats_shutdown,
+        NULL,
+        NULL,
+        exportstats_variables,
+        "writes statistics to a CSV or JSON file"
+    };
+
+    bugle_filter_set_new(&exportstats_info);
+    bugle_filter_set_stats_logger("exportstats");
+    bugle_list_init(&exportstats_show_requested, bugle_free);
+    bugle_list_init(&exportstats_show, NULL);
+    exportstats_filename = bugle_strdup("bugle-stats.csv");
+}
@@ -1,5 +1,5 @@
 /*  BuGLe: an OpenGL debugging tool
- *  Copyright (C) 2004-2008, 2010-2011  Bruce Merry
+ *  Copyright (C) 2004-2008, 2010-2011, 2014  Bruce Merry
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -25,7 +25,7 @@
 #if HAVE_CONFIG_H
 # include <config.h>
 #endif
-#define _XOPEN_SOURCE 500
+#define _XOPEN_SOURCE 600
 #include <bugle/bool.h>
 #include <stdio.h>
 #include <string.h>
@@ -48,6 +48,19 @@
 #include <bugle/time.h>
 #include <budgie/addresses.h>
 #include <budgie/reflect.h>
+#include "platform/threads.h"
+#include "platform/types.h"
+#include "common/qoi.h"
+#include "common/tilecapture.h"
+#include "common/yuv.h"
+#if defined(BUGLE_PLATFORM_POSIX)
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/uio.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <limits.h>
+#endif
 
 #if HAVE_LAVC
 # include <inttypes.h>
@@ -72,6 +85,15 @@
 # define CAPTURE_GL_FMT GL_RGB
 #endif
 #define CAPTURE_GL_ELEMENTS 3
+/* Converting to YUV in a shader needs GLSL, FBOs and the immediate mode
+ * that is used to draw the full-screen quad.
+ */
+#if BUGLE_GLTYPE_GL && defined(GL_VERSION_2_0) && defined(GL_EXT_framebuffer_object)
+# define CAPTURE_GPU_YUV 1
+#endif
+#if BUGLE_GLTYPE_GL && defined(GL_EXT_framebuffer_object) && defined(GL_EXT_framebuffer_blit)
+# define CAPTURE_GPU_SCALE 1
+#endif
 
 typedef struct
 {
@@ -80,9 +102,35 @@ typedef struct
     GLubyte *pixels;
     GLuint pbo;
     bugle_bool pbo_mapped;       /* BUGLE_TRUE during glMapBuffer/glUnmapBuffer */
+    bugle_bool yuv;        /* holds top-down YUV 4:2:0 planes rather than RGB */
     int multiplicity;      /* number of times to write to video stream */
+    int frame;             /* frame number, for still images */
+    double time;           /* capture time, for the native video writers */
 } screenshot_data;
 
+typedef enum
+{
+    VIDEO_ENCODER,         /* libavcodec, or a pipe to ffmpeg without it */
+    VIDEO_Y4M,
+    VIDEO_RAW,
+    VIDEO_TILES            /* changed tiles only, on an encoder thread */
+} video_writer_type;
+
+typedef enum
+{
+    SCREENSHOT_PPM,
+    SCREENSHOT_QOI
+} screenshot_format;
+
+/* A frame waiting to be encoded and written by a worker thread */
+typedef struct
+{
+    int frame;
+    double time;
+    int width, height;
+    GLubyte *pixels;       /* top-down, tightly packed RGB */
+} screenshot_job;
+
 /* Data that must be kept while in screenshot code, to allow restoration.
  * It is not directly related to an OpenGL context.
  */
@@ -95,13 +143,24 @@ typedef struct
 /* General settings */
 static bugle_bool video = BUGLE_FALSE;
 static char *video_filename = NULL;
+static int capture_crop[4] = { 0, 0, 0, 0 };  /* x, y from top left, width, height */
+static float capture_scale = 1.0f;
 /* Still settings */
 static bugle_input_key key_screenshot = { BUGLE_INPUT_NOSYMBOL, 0, BUGLE_TRUE };
+static screenshot_format still_format = SCREENSHOT_PPM;
+static bugle_bool still_sequence = BUGLE_FALSE;
+static long encode_threads = 2;
+static long encode_queue = 8;
 /* Video settings */
 static char *video_codec = NULL;
 static bugle_bool video_sample_all = BUGLE_FALSE;
 static long video_bitrate = 7500000;
 static long video_lag = 1;     /* latency between readpixels and encoding */
+static bugle_bool video_gpu_yuv = BUGLE_FALSE;
+static video_writer_type video_writer = VIDEO_ENCODER;
+static char *video_timestamps_filename = NULL;
+static long tiles_size = 32;
+static long tiles_keyframe = 60;
 
 /* General data */
 static int video_cur;  /* index of the next circular queue index to capture into */
@@ -109,8 +168,27 @@ static bugle_bool video_first;
 static screenshot_data *video_data;
 /* Still data */
 static bugle_bool keypress_screenshot = BUGLE_FALSE;
+/* Encoder thread data, used for still images and the tiles writer */
+static bugle_thread_lock_t encode_lock;
+static bugle_thread_sem_t encode_ready;  /* posted for each job, and to stop */
+static bugle_thread_handle *encode_workers;
+static long encode_workers_running = 0;
+static screenshot_job *encode_jobs;
+static size_t encode_head, encode_size;
+static unsigned long encode_dropped, encode_written;
 /* Video data */
 static FILE *video_pipe = NULL;  /* Used for ppmtoy4m */
+static int video_fd = -1;        /* Used by the native writers */
+static FILE *video_timestamps = NULL;
+static double video_start_time;
+static unsigned long video_frames_written;
+static GLubyte *video_scratch = NULL;    /* for converting on the CPU */
+static FILE *tiles_file = NULL;          /* Used by the tiles writer */
+static bugle_tilecapture_header tiles_header;
+static bugle_uint64_t *tiles_hashes = NULL;  /* of the last frame written */
+static size_t *tiles_changed;
+static long tiles_since_keyframe;
+static double tiles_start_time;
 static bugle_bool video_done = BUGLE_FALSE;
 static double video_frame_time = 0.0;
 static double video_frame_step = 1.0 / 30.0; /* FIXME: depends on frame rate */
@@ -125,23 +203,92 @@ static char *interpolate_filename(const char *pattern, int frame)
         return bugle_strdup(pattern);
 }
 
+static bugle_bool screenshot_crop_set(const struct filter_set_variable_info_s *var,
+                                      const char *text, const void *value)
+{
+    int x, y, w, h;
+    char dummy;
+
+    if (sscanf(text, "%d %d %d %d %c", &x, &y, &w, &h, &dummy) != 4
+        || x < 0 || y < 0 || w <= 0 || h <= 0)
+    {
+        bugle_log_printf("screenshot", "initialise", BUGLE_LOG_ERROR,
+                         "crop must be \"x y width height\", with a positive width and height");
+        return BUGLE_FALSE;
+    }
+    capture_crop[0] = x;
+    capture_crop[1] = y;
+    capture_crop[2] = w;
+    capture_crop[3] = h;
+    return BUGLE_TRUE;
+}
+
+static bugle_bool screenshot_writer_set(const struct filter_set_variable_info_s *var,
+                                        const char *text, const void *value)
+{
+    if (strcmp(text, "encoder") == 0)
+        video_writer = VIDEO_ENCODER;
+    else if (strcmp(text, "y4m") == 0)
+        video_writer = VIDEO_Y4M;
+    else if (strcmp(text, "raw") == 0)
+        video_writer = VIDEO_RAW;
+    else if (strcmp(text, "tiles") == 0)
+        video_writer = VIDEO_TILES;
+    else
+    {
+        bugle_log_printf("screenshot", "initialise", BUGLE_LOG_ERROR,
+                         "writer must be encoder, y4m, raw or tiles");
+        return BUGLE_FALSE;
+    }
+    return BUGLE_TRUE;
+}
+
+static bugle_bool screenshot_format_set(const struct filter_set_variable_info_s *var,
+                                        const char *text, const void *value)
+{
+    if (strcmp(text, "ppm") == 0)
+        still_format = SCREENSHOT_PPM;
+    else if (strcmp(text, "qoi") == 0)
+        still_format = SCREENSHOT_QOI;
+    else
+    {
+        bugle_log_printf("screenshot", "initialise", BUGLE_LOG_ERROR,
+                         "format must be ppm or qoi");
+        return BUGLE_FALSE;
+    }
+    return BUGLE_TRUE;
+}
+
 /* If data->pixels == NULL and pbo = 0,
  * or if data->width and data->height do not match the current frame,
  * new memory is allocated. Otherwise the existing memory is reused.
+ * If yuv is true, the memory is sized for YUV 4:2:0 planes, in which case
+ * the stride is that of the Y plane.
  * This function must be called from the aux context.
  */
 static void prepare_screenshot_data(screenshot_data *data,
                                     int width, int height,
-                                    int align, bugle_bool use_pbo)
+                                    int align, bugle_bool use_pbo,
+                                    bugle_bool yuv)
 {
-    size_t stride;
+    size_t stride, size;
 
-    stride = width * CAPTURE_GL_ELEMENTS;
-    stride = (stride + align - 1) & ~(align - 1);
+    if (yuv)
+    {
+        stride = width;
+        size = BUGLE_YUV_SIZE(width, height);
+    }
+    else
+    {
+        stride = width * CAPTURE_GL_ELEMENTS;
+        stride = (stride + align - 1) & ~(align - 1);
+        size = stride * height;
+    }
     if ((!data->pixels && !data->pbo)
         || data->width != width
         || data->height != height
-        || data->stride != stride)
+        || data->stride != stride
+        || data->yuv != yuv)
     {
         if (data->pixels) bugle_free(data->pixels);
 #ifdef GL_EXT_pixel_buffer_object
@@ -150,12 +297,13 @@ static void prepare_screenshot_data(screenshot_data *data,
         data->width = width;
         data->height = height;
         data->stride = stride;
+        data->yuv = yuv;
 #ifdef GL_EXT_pixel_buffer_object
         if (use_pbo && BUGLE_GL_HAS_EXTENSION(GL_EXT_pixel_buffer_object))
         {
             CALL(glGenBuffersARB)(1, &data->pbo);
             CALL(glBindBufferARB)(GL_PIXEL_PACK_BUFFER_EXT, data->pbo);
-            CALL(glBufferDataARB)(GL_PIXEL_PACK_BUFFER_EXT, stride * height,
+            CALL(glBufferDataARB)(GL_PIXEL_PACK_BUFFER_EXT, size,
                                  NULL, GL_DYNAMIC_READ_ARB);
             CALL(glBindBufferARB)(GL_PIXEL_PACK_BUFFER_EXT, 0);
             data->pixels = NULL;
@@ -163,12 +311,118 @@ static void prepare_screenshot_data(screenshot_data *data,
         else
 #endif
         {
-            data->pixels = bugle_malloc(stride * height);
+            data->pixels = bugle_malloc(size);
             data->pbo = 0;
         }
     }
 }
 
+#if CAPTURE_GPU_SCALE
+/* Downscaled captures are blitted into a renderbuffer in the aux context,
+ * and read back from there.
+ */
+static struct
+{
+    bugle_bool initialised;
+    bugle_bool failed;
+    GLuint fbo, renderbuffer;
+    int width, height;
+} scale_target;
+
+static bugle_bool scale_available(void)
+{
+    if (!scale_target.failed
+        && (!BUGLE_GL_HAS_EXTENSION_GROUP(GL_EXT_framebuffer_object)
+            || !BUGLE_GL_HAS_EXTENSION_GROUP(GL_EXT_framebuffer_blit)))
+    {
+        bugle_log("screenshot", "grab", BUGLE_LOG_WARNING,
+                  "GL_EXT_framebuffer_blit is not available; capturing at full size");
+        scale_target.failed = BUGLE_TRUE;
+    }
+    return !scale_target.failed;
+}
+
+/* Blits the given region of the back buffer to the scale target, and
+ * leaves the scale target bound for reading. Must be called from the aux
+ * context, inside bugle_gl_begin_internal_render.
+ */
+static bugle_bool scale_blit(int x, int y, int width, int height,
+                             int out_width, int out_height)
+{
+    if (!scale_target.initialised)
+    {
+        CALL(glGenFramebuffersEXT)(1, &scale_target.fbo);
+        CALL(glGenRenderbuffersEXT)(1, &scale_target.renderbuffer);
+        scale_target.initialised = BUGLE_TRUE;
+    }
+    CALL(glBindFramebufferEXT)(GL_FRAMEBUFFER_EXT, scale_target.fbo);
+    if (scale_target.width != out_width || scale_target.height != out_height)
+    {
+        CALL(glBindRenderbufferEXT)(GL_RENDERBUFFER_EXT, scale_target.renderbuffer);
+        CALL(glRenderbufferStorageEXT)(GL_RENDERBUFFER_EXT, GL_RGBA8, out_width, out_height);
+        CALL(glBindRenderbufferEXT)(GL_RENDERBUFFER_EXT, 0);
+        CALL(glFramebufferRenderbufferEXT)(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT,
+                                           GL_RENDERBUFFER_EXT, scale_target.renderbuffer);
+        scale_target.width = out_width;
+        scale_target.height = out_height;
+    }
+    if (CALL(glCheckFramebufferStatusEXT)(GL_FRAMEBUFFER_EXT) != GL_FRAMEBUFFER_COMPLETE_EXT)
+    {
+        bugle_log("screenshot", "grab", BUGLE_LOG_WARNING,
+                  "could not create a framebuffer for scaling; capturing at full size");
+        scale_target.failed = BUGLE_TRUE;
+        CALL(glBindFramebufferEXT)(GL_FRAMEBUFFER_EXT, 0);
+        return BUGLE_FALSE;
+    }
+
+    CALL(glBindFramebufferEXT)(GL_READ_FRAMEBUFFER_EXT, 0);
+    CALL(glPushAttrib)(GL_ENABLE_BIT);
+    CALL(glDisable)(GL_SCISSOR_TEST);
+    CALL(glBlitFramebufferEXT)(x, y, x + width, y + height,
+                               0, 0, out_width, out_height,
+                               GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    CALL(glPopAttrib)();
+    CALL(glBindFramebufferEXT)(GL_FRAMEBUFFER_EXT, scale_target.fbo);
+    return BUGLE_TRUE;
+}
+#endif /* CAPTURE_GPU_SCALE */
+
+/* Computes the region of the drawable to capture, in GL window coordinates
+ * (from the bottom left), and the size of the image it produces. Must be
+ * called from the aux context.
+ */
+static void capture_region(int width, int height,
+                           int *x, int *y, int *w, int *h,
+                           int *out_width, int *out_height)
+{
+    int top;
+
+    *x = 0;
+    *y = 0;
+    *w = width;
+    *h = height;
+    if (capture_crop[2] > 0 && width > 0 && height > 0)
+    {
+        /* Clamp to the drawable, but keep at least one pixel */
+        *x = capture_crop[0] < width ? capture_crop[0] : width - 1;
+        top = capture_crop[1] < height ? capture_crop[1] : height - 1;
+        *w = capture_crop[2] < width - *x ? capture_crop[2] : width - *x;
+        *h = capture_crop[3] < height - top ? capture_crop[3] : height - top;
+        *y = height - top - *h;
+    }
+    *out_width = *w;
+    *out_height = *h;
+#if CAPTURE_GPU_SCALE
+    if (capture_scale < 1.0 && scale_available())
+    {
+        *out_width = (int) (*w * capture_scale + 0.5);
+        *out_height = (int) (*h * capture_scale + 0.5);
+        if (*out_width < 1) *out_width = 1;
+        if (*out_height < 1) *out_height = 1;
+    }
+#endif
+}
+
 /* These two functions should bracket all screenshot-using code. They are
  * responsible for checking for in begin/end and switching to the aux
  * context. If screenshot_start returns BUGLE_FALSE, do not continue.
@@ -214,6 +468,211 @@ static void free_screenshot_data(screenshot_data *data)
     if (data->pixels) bugle_free(data->pixels);
 }
 
+#if CAPTURE_GPU_YUV
+/* Converts the back buffer to YUV 4:2:0 (BT.601, limited range, as
+ * libswscale does) in the aux context, so that only half as many bytes are
+ * read back and no CPU conversion is needed. Each plane is rendered into an
+ * RGBA8 texture in which every texel packs four consecutive samples of a
+ * row, so reading the planes back one after another gives exactly the
+ * layout of a PIX_FMT_YUV420P picture. The image is flipped to top-down
+ * order by the shader. Chroma is subsampled by sampling at the centre of
+ * each 2x2 block with bilinear filtering.
+ *
+ * Like the rest of this file, this assumes a single aux context.
+ */
+typedef struct
+{
+    bugle_bool initialised;
+    bugle_bool failed;     /* set if the GL cannot do it, to stop retrying */
+    GLuint program;
+    GLint src_location, size_location, coeff_location, scale_location;
+    GLuint source;         /* copy of the back buffer */
+    GLuint planes[3];
+    GLuint fbo;
+    int width, height;
+} screenshot_yuv;
+
+static screenshot_yuv yuv_converter;
+
+static GLuint yuv_compile(GLenum type, const char *source)
+{
+    GLuint shader;
+    GLint status;
+
+    shader = CALL(glCreateShader)(type);
+    CALL(glShaderSource)(shader, 1, &source, NULL);
+    CALL(glCompileShader)(shader);
+    CALL(glGetShaderiv)(shader, GL_COMPILE_STATUS, &status);
+    if (!status)
+    {
+        CALL(glDeleteShader)(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static bugle_bool yuv_initialise(void)
+{
+    GLuint vs, fs;
+    GLint status;
+
+    vs = yuv_compile(GL_VERTEX_SHADER, bugle_yuv_vertex_source());
+    fs = yuv_compile(GL_FRAGMENT_SHADER, bugle_yuv_fragment_source());
+    if (!vs || !fs)
+    {
+        if (vs) CALL(glDeleteShader)(vs);
+        if (fs) CALL(glDeleteShader)(fs);
+        return BUGLE_FALSE;
+    }
+
+    yuv_converter.program = CALL(glCreateProgram)();
+    CALL(glAttachShader)(yuv_converter.program, vs);
+    CALL(glAttachShader)(yuv_converter.program, fs);
+    CALL(glLinkProgram)(yuv_converter.program);
+    /* Flagged for deletion when the program goes */
+    CALL(glDeleteShader)(vs);
+    CALL(glDeleteShader)(fs);
+    CALL(glGetProgramiv)(yuv_converter.program, GL_LINK_STATUS, &status);
+    if (!status)
+    {
+        CALL(glDeleteProgram)(yuv_converter.program);
+        yuv_converter.program = 0;
+        return BUGLE_FALSE;
+    }
+    yuv_converter.src_location = CALL(glGetUniformLocation)(yuv_converter.program, "src");
+    yuv_converter.size_location = CALL(glGetUniformLocation)(yuv_converter.program, "size");
+    yuv_converter.coeff_location = CALL(glGetUniformLocation)(yuv_converter.program, "coeff");
+    yuv_converter.scale_location = CALL(glGetUniformLocation)(yuv_converter.program, "scale");
+
+    CALL(glGenTextures)(1, &yuv_converter.source);
+    CALL(glGenTextures)(3, yuv_converter.planes);
+    CALL(glGenFramebuffersEXT)(1, &yuv_converter.fbo);
+    return BUGLE_TRUE;
+}
+
+static void yuv_texture(GLuint texture, GLenum internal_format, int width, int height, GLenum filter)
+{
+    CALL(glBindTexture)(GL_TEXTURE_2D, texture);
+    CALL(glTexImage2D)(GL_TEXTURE_2D, 0, internal_format, width, height, 0,
+                       GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    CALL(glTexParameteri)(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    CALL(glTexParameteri)(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    CALL(glTexParameteri)(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    CALL(glTexParameteri)(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+/* Returns BUGLE_TRUE if a frame of the given size can be converted on the
+ * GPU, creating the objects on first use. Must be called from the aux
+ * context, inside bugle_gl_begin_internal_render.
+ */
+static bugle_bool yuv_prepare(int width, int height)
+{
+    if (yuv_converter.failed)
+        return BUGLE_FALSE;
+    /* Each texel packs four chroma samples, which cover 8 pixels */
+    if (width % 8 != 0 || height % 2 != 0)
+        return BUGLE_FALSE;
+
+    if (!yuv_converter.initialised)
+    {
+        yuv_converter.initialised = BUGLE_TRUE;
+        if (!BUGLE_GL_HAS_EXTENSION_GROUP(GL_VERSION_2_0)
+            || !BUGLE_GL_HAS_EXTENSION_GROUP(GL_EXT_framebuffer_object)
+            || !yuv_initialise())
+        {
+            bugle_log("screenshot", "video", BUGLE_LOG_WARNING,
+                      "GPU colour conversion is not available; converting on the CPU");
+            yuv_converter.failed = BUGLE_TRUE;
+            return BUGLE_FALSE;
+        }
+    }
+
+    if (yuv_converter.width != width || yuv_converter.height != height)
+    {
+        CALL(glPushAttrib)(GL_TEXTURE_BIT);
+        yuv_texture(yuv_converter.source, GL_RGB8, width, height, GL_LINEAR);
+        yuv_texture(yuv_converter.planes[0], GL_RGBA8, width / 4, height, GL_NEAREST);
+        yuv_texture(yuv_converter.planes[1], GL_RGBA8, width / 8, height / 2, GL_NEAREST);
+        yuv_texture(yuv_converter.planes[2], GL_RGBA8, width / 8, height / 2, GL_NEAREST);
+        CALL(glPopAttrib)();
+        yuv_converter.width = width;
+        yuv_converter.height = height;
+    }
+    return BUGLE_TRUE;
+}
+
+/* Converts the region of the current read framebuffer with its lower left
+ * corner at (x, y) into data, which must already have been prepared for
+ * YUV. Returns BUGLE_FALSE if the framebuffer could not be set up, in which
+ * case nothing is read back.
+ */
+static bugle_bool yuv_read(screenshot_data *data, int x, int y)
+{
+    int width, height, i;
+    GLubyte *offset;
+    bugle_bool ret = BUGLE_TRUE;
+
+    width = data->width;
+    height = data->height;
+    CALL(glPushAttrib)(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_VIEWPORT_BIT);
+    CALL(glDisable)(GL_BLEND);
+    CALL(glDisable)(GL_DEPTH_TEST);
+    CALL(glDisable)(GL_SCISSOR_TEST);
+    CALL(glDisable)(GL_STENCIL_TEST);
+    CALL(glDisable)(GL_CULL_FACE);
+    CALL(glActiveTexture)(GL_TEXTURE0);
+    CALL(glBindTexture)(GL_TEXTURE_2D, yuv_converter.source);
+    CALL(glCopyTexSubImage2D)(GL_TEXTURE_2D, 0, 0, 0, x, y, width, height);
+
+    CALL(glUseProgram)(yuv_converter.program);
+    CALL(glUniform1i)(yuv_converter.src_location, 0);
+    CALL(glUniform2f)(yuv_converter.size_location, (GLfloat) width, (GLfloat) height);
+    CALL(glBindFramebufferEXT)(GL_FRAMEBUFFER_EXT, yuv_converter.fbo);
+#ifdef GL_EXT_pixel_buffer_object
+    if (data->pbo)
+        CALL(glBindBufferARB)(GL_PIXEL_PACK_BUFFER_EXT, data->pbo);
+#endif
+    offset = data->pbo ? NULL : data->pixels;
+    for (i = 0; i < 3; i++)
+    {
+        int pw, ph;
+
+        pw = i ? width / 8 : width / 4;
+        ph = i ? height / 2 : height;
+        CALL(glFramebufferTexture2DEXT)(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT,
+                                        GL_TEXTURE_2D, yuv_converter.planes[i], 0);
+        if (CALL(glCheckFramebufferStatusEXT)(GL_FRAMEBUFFER_EXT) != GL_FRAMEBUFFER_COMPLETE_EXT)
+        {
+            bugle_log("screenshot", "video", BUGLE_LOG_WARNING,
+                      "GPU colour conversion is not available; converting on the CPU");
+            yuv_converter.failed = BUGLE_TRUE;
+            ret = BUGLE_FALSE;
+            break;
+        }
+        CALL(glViewport)(0, 0, pw, ph);
+        CALL(glUniform4fv)(yuv_converter.coeff_location, 1, bugle_yuv_coefficients(i));
+        CALL(glUniform1f)(yuv_converter.scale_location, i ? 2.0f : 1.0f);
+        CALL(glBegin)(GL_QUADS);
+        CALL(glVertex2f)(-1.0f, -1.0f);
+        CALL(glVertex2f)(1.0f, -1.0f);
+        CALL(glVertex2f)(1.0f, 1.0f);
+        CALL(glVertex2f)(-1.0f, 1.0f);
+        CALL(glEnd)();
+        CALL(glReadPixels)(0, 0, pw, ph, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+        offset += pw * ph * 4;
+    }
+
+#ifdef GL_EXT_pixel_buffer_object
+    if (data->pbo)
+        CALL(glBindBufferARB)(GL_PIXEL_PACK_BUFFER_EXT, 0);
+#endif
+    CALL(glBindFramebufferEXT)(GL_FRAMEBUFFER_EXT, 0);
+    CALL(glUseProgram)(0);
+    CALL(glPopAttrib)();
+    return ret;
+}
+#endif /* CAPTURE_GPU_YUV */
+
 #if HAVE_LAVC
 static AVFormatContext *video_context = NULL;
 static AVStream *video_stream;
@@ -452,13 +911,21 @@ static bugle_bool unmap_screenshot(screenshot_data *data)
     }
 }
 
+/* If yuv is true, the frame is converted to YUV 4:2:0 on the GPU if
+ * possible; check the yuv field of the returned data to find out what it
+ * holds.
+ */
 static bugle_bool do_screenshot(GLenum format, int test_width, int test_height,
-                          screenshot_data **data)
+                                bugle_bool yuv, screenshot_data **data)
 {
     glwin_drawable drawable;
     glwin_display dpy;
     screenshot_data *cur;
     int width, height;
+    int x, y, w, h;
+#if CAPTURE_GPU_SCALE
+    bugle_bool scaled = BUGLE_FALSE;
+#endif
 
     *data = &video_data[(video_cur + video_lag - 1) % video_lag];
     cur = &video_data[video_cur];
@@ -467,6 +934,7 @@ static bugle_bool do_screenshot(GLenum format, int test_width, int test_height,
     drawable = bugle_glwin_get_current_drawable();
     dpy = bugle_glwin_get_current_display();
     bugle_glwin_get_drawable_dimensions(dpy, drawable, &width, &height);
+    capture_region(width, height, &x, &y, &w, &h, &width, &height);
     if (test_width != -1 || test_height != -1)
         if (width != test_width || height != test_height)
         {
@@ -476,18 +944,47 @@ static bugle_bool do_screenshot(GLenum format, int test_width, int test_height,
             return BUGLE_FALSE;
         }
 
-    prepare_screenshot_data(cur, width, height, 4, BUGLE_TRUE);
-
     if (!bugle_gl_begin_internal_render()) return BUGLE_FALSE;
+#if CAPTURE_GPU_SCALE
+    if (width != w || height != h)
+    {
+        scaled = scale_blit(x, y, w, h, width, height);
+        if (scaled)
+            x = y = 0;
+        else
+        {
+            width = w;
+            height = h;
+        }
+    }
+#endif
+#if CAPTURE_GPU_YUV
+    if (yuv && yuv_prepare(width, height))
+    {
+        prepare_screenshot_data(cur, width, height, 4, BUGLE_TRUE, BUGLE_TRUE);
+        if (yuv_read(cur, x, y))
+        {
+            /* yuv_read leaves the window-system framebuffer bound */
+            bugle_gl_end_internal_render("do_screenshot", BUGLE_TRUE);
+            return BUGLE_TRUE;
+        }
+    }
+#endif
+    prepare_screenshot_data(cur, width, height, 4, BUGLE_TRUE, BUGLE_FALSE);
+
 #ifdef GL_EXT_pixel_buffer_object
     if (cur->pbo)
         CALL(glBindBufferARB)(GL_PIXEL_PACK_BUFFER_EXT, cur->pbo);
 #endif
-    CALL(glReadPixels)(0, 0, width, height, format,
+    CALL(glReadPixels)(x, y, width, height, format,
                       GL_UNSIGNED_BYTE, cur->pbo ? NULL : cur->pixels);
 #ifdef GL_EXT_pixel_buffer_object
     if (cur->pbo)
         CALL(glBindBufferARB)(GL_PIXEL_PACK_BUFFER_EXT, 0);
+#endif
+#if CAPTURE_GPU_SCALE
+    if (scaled)
+        CALL(glBindFramebufferEXT)(GL_FRAMEBUFFER_EXT, 0);
 #endif
     bugle_gl_end_internal_render("do_screenshot", BUGLE_TRUE);
 
@@ -503,9 +1000,9 @@ static bugle_bool screenshot_stream(FILE *out, bugle_bool check_size)
     int i;
 
     if (check_size && !video_first)
-        video_done = !do_screenshot(GL_RGB, video_data[0].width, video_data[0].height, &fetch);
+        video_done = !do_screenshot(GL_RGB, video_data[0].width, video_data[0].height, BUGLE_FALSE, &fetch);
     else
-        do_screenshot(GL_RGB, -1, -1, &fetch);
+        do_screenshot(GL_RGB, -1, -1, BUGLE_FALSE, &fetch);
     video_first = BUGLE_FALSE;
 
     if (fetch->width > 0)
@@ -531,25 +1028,294 @@ static bugle_bool screenshot_stream(FILE *out, bugle_bool check_size)
     return ret;
 }
 
-#if HAVE_LAVC
-static void screenshot_video(void)
+/*** Still images ***/
+
+/* Still images are read back on the GL thread, copied into a job and
+ * queued. A small pool of worker threads encodes and writes them, so
+ * that the application does not wait for the encoder or the disk. If the
+ * queue is full, the frame is dropped (before it is read back) and counted.
+ */
+
+static void screenshot_write_job(const screenshot_job *job)
+{
+    char *fname;
+    FILE *out;
+    GLubyte *encoded;
+    size_t size, count;
+
+    fname = interpolate_filename(video_filename, job->frame);
+    out = fopen(fname, "wb");
+    if (!out)
+    {
+        bugle_log_printf("screenshot", "write", BUGLE_LOG_ERROR,
+                         "failed to open %s: %s", fname, strerror(errno));
+        bugle_free(fname);
+        return;
+    }
+
+    switch (still_format)
+    {
+    case SCREENSHOT_QOI:
+        encoded = bugle_malloc(BUGLE_QOI_MAX_SIZE(job->width, job->height));
+        size = bugle_qoi_encode(job->pixels, job->width, job->height, encoded);
+        count = fwrite(encoded, 1, size, out);
+        bugle_free(encoded);
+        break;
+    default:
+        fprintf(out, "P6\n%d %d\n255\n", job->width, job->height);
+        size = (size_t) job->width * job->height * 3;
+        count = fwrite(job->pixels, 1, size, out);
+        break;
+    }
+    if (fclose(out) != 0 || count != size)
+        bugle_log_printf("screenshot", "write", BUGLE_LOG_ERROR,
+                         "failed to write %s", fname);
+    bugle_free(fname);
+}
+
+/* FNV-1a, which is quick and good enough to spot a changed tile. A
+ * collision leaves a stale tile only until the next keyframe.
+ */
+static bugle_uint64_t tiles_hash(const screenshot_job *job, size_t index)
 {
+    bugle_uint64_t hash, prime;
+    const GLubyte *src;
+    size_t stride, row, i;
+    int x, y, width, height, j;
+
+    hash = ((bugle_uint64_t) 0xcbf29ce4UL << 32) | 0x84222325UL;
+    prime = ((bugle_uint64_t) 1 << 40) | 0x1b3;
+    bugle_tilecapture_tile_rect(&tiles_header, index, &x, &y, &width, &height);
+    stride = (size_t) job->width * 3;
+    row = (size_t) width * 3;
+    src = job->pixels + y * stride + x * 3;
+    for (j = 0; j < height; j++, src += stride)
+        for (i = 0; i < row; i++)
+        {
+            hash ^= src[i];
+            hash *= prime;
+        }
+    return hash;
+}
+
+/* Called only from the single encoder thread used by the tiles writer */
+static void tiles_write_job(const screenshot_job *job)
+{
+    bugle_tilecapture_frame frame;
+    bugle_uint64_t hash;
+    size_t tiles, i;
+    bugle_bool ok;
+
+    if (!tiles_file)
+        return;   /* a write has already failed */
+    if (!tiles_hashes)
+    {
+        tiles_header.width = job->width;
+        tiles_header.height = job->height;
+        tiles_header.tile_size = tiles_size;
+        tiles = bugle_tilecapture_tiles(&tiles_header);
+        tiles_hashes = BUGLE_NMALLOC(tiles, bugle_uint64_t);
+        tiles_changed = BUGLE_NMALLOC(tiles, size_t);
+        tiles_since_keyframe = 0;
+        tiles_start_time = job->time;
+        if (!bugle_tilecapture_write_header(tiles_file, &tiles_header))
+            goto fail;
+    }
+    else if ((bugle_uint32_t) job->width != tiles_header.width
+             || (bugle_uint32_t) job->height != tiles_header.height)
+        return;   /* the capture stops when the window is resized */
+
+    tiles = bugle_tilecapture_tiles(&tiles_header);
+    frame.flags = tiles_since_keyframe == 0 ? BUGLE_TILECAPTURE_KEYFRAME : 0;
+    frame.count = 0;
+    frame.time = (bugle_uint64_t) ((job->time - tiles_start_time) * 1e6 + 0.5);
+    for (i = 0; i < tiles; i++)
+    {
+        hash = tiles_hash(job, i);
+        if (frame.flags || hash != tiles_hashes[i])
+            tiles_changed[frame.count++] = i;
+        tiles_hashes[i] = hash;
+    }
+    if (++tiles_since_keyframe >= tiles_keyframe)
+        tiles_since_keyframe = 0;
+
+    ok = bugle_tilecapture_write_frame(tiles_file, &frame);
+    for (i = 0; ok && i < frame.count; i++)
+        ok = bugle_tilecapture_write_tile(tiles_file, &tiles_header, tiles_changed[i], job->pixels);
+    if (ok)
+        return;
+
+fail:
+    bugle_log_printf("screenshot", "write", BUGLE_LOG_ERROR,
+                     "failed to write %s: %s", video_filename, strerror(errno));
+    fclose(tiles_file);
+    tiles_file = NULL;
+}
+
+static unsigned int screenshot_worker(void *arg)
+{
+    screenshot_job job;
+
+    for (;;)
+    {
+        bugle_thread_sem_wait(&encode_ready);
+        bugle_thread_lock_lock(&encode_lock);
+        if (encode_size == 0)
+        {
+            /* Each job posts once, so an empty queue means we were stopped */
+            bugle_thread_lock_unlock(&encode_lock);
+            break;
+        }
+        job = encode_jobs[encode_head];
+        encode_head = (encode_head + 1) % encode_queue;
+        encode_size--;
+        bugle_thread_lock_unlock(&encode_lock);
+
+        if (video)
+            tiles_write_job(&job);
+        else
+            screenshot_write_job(&job);
+        bugle_free(job.pixels);
+
+        bugle_thread_lock_lock(&encode_lock);
+        encode_written++;
+        bugle_thread_lock_unlock(&encode_lock);
+    }
+    return 0;
+}
+
+static void screenshot_workers_stop(void)
+{
+    long i;
+
+    if (!encode_workers)
+        return;
+    /* The workers drain the queue before they see the extra posts */
+    for (i = 0; i < encode_workers_running; i++)
+        bugle_thread_sem_post(&encode_ready);
+    for (i = 0; i < encode_workers_running; i++)
+        bugle_thread_join(encode_workers[i], NULL);
+    if (encode_dropped)
+        bugle_log_printf("screenshot", "shutdown", BUGLE_LOG_WARNING,
+                         "%lu of %lu frames were dropped because the encoders fell behind (try more threads or a larger queue)",
+                         encode_dropped, encode_dropped + encode_written);
+    bugle_free(encode_workers);
+    bugle_free(encode_jobs);
+    encode_workers = NULL;
+    encode_jobs = NULL;
+    encode_workers_running = 0;
+    bugle_thread_sem_destroy(&encode_ready);
+    bugle_thread_lock_destroy(&encode_lock);
+}
+
+static bugle_bool screenshot_workers_start(long threads)
+{
+    bugle_thread_lock_init(&encode_lock);
+    bugle_thread_sem_init(&encode_ready, 0);
+    encode_jobs = BUGLE_NMALLOC(encode_queue, screenshot_job);
+    encode_head = 0;
+    encode_size = 0;
+    encode_dropped = 0;
+    encode_written = 0;
+    encode_workers = BUGLE_NMALLOC(threads, bugle_thread_handle);
+    for (encode_workers_running = 0; encode_workers_running < threads; encode_workers_running++)
+        if (bugle_thread_create(&encode_workers[encode_workers_running], screenshot_worker, NULL) != 0)
+        {
+            bugle_log("screenshot", "initialise", BUGLE_LOG_ERROR,
+                      "failed to start an encoder thread");
+            screenshot_workers_stop();
+            return BUGLE_FALSE;
+        }
+    return BUGLE_TRUE;
+}
+
+/* Checks whether there is room for another job, counting a dropped frame
+ * if not. This thread is the only one that adds jobs, so if there is room
+ * now there will still be room after the readback.
+ */
+static bugle_bool encode_has_room(void)
+{
+    bugle_bool full;
+
+    bugle_thread_lock_lock(&encode_lock);
+    full = encode_size == (size_t) encode_queue;
+    if (full)
+        encode_dropped++;
+    bugle_thread_lock_unlock(&encode_lock);
+    return !full;
+}
+
+/* Copies a fetched RGB frame into a new job and hands it to the workers */
+static void encode_submit(screenshot_data *fetch)
+{
+    screenshot_job *job;
+    GLubyte *src, *dst;
+    size_t row;
+    int i;
+
+    if (fetch->width <= 0 || !map_screenshot(fetch))
+        return;
+
+    bugle_thread_lock_lock(&encode_lock);
+    job = &encode_jobs[(encode_head + encode_size) % encode_queue];
+    bugle_thread_lock_unlock(&encode_lock);
+
+    job->frame = fetch->frame;
+    job->time = fetch->time;
+    job->width = fetch->width;
+    job->height = fetch->height;
+    row = (size_t) fetch->width * 3;
+    job->pixels = bugle_malloc(row * fetch->height);
+    /* Flip to top-down order and remove the padding */
+    src = fetch->pixels + fetch->stride * (fetch->height - 1);
+    dst = job->pixels;
+    for (i = 0; i < fetch->height; i++)
+    {
+        memcpy(dst, src, row);
+        src -= fetch->stride;
+        dst += row;
+    }
+    unmap_screenshot(fetch);
+
+    bugle_thread_lock_lock(&encode_lock);
+    encode_size++;
+    bugle_thread_lock_unlock(&encode_lock);
+    bugle_thread_sem_post(&encode_ready);
+}
+
+static void screenshot_still(int frameno)
+{
+    screenshot_context ssctx;
     screenshot_data *fetch;
-    AVCodecContext *c;
-    size_t out_size;
-    int i, ret;
+
+    if (!encode_has_room()) return;
+    if (!screenshot_start(&ssctx)) return;
+    video_data[video_cur].frame = frameno;
+    do_screenshot(GL_RGB, -1, -1, BUGLE_FALSE, &fetch);
+    encode_submit(fetch);
+    screenshot_stop(&ssctx);
+}
+
+/*** Video ***/
+
+/* Decides how many times the frame about to be captured should be written
+ * to the video, to keep it at a constant frame rate, and records when it
+ * was captured. Returns BUGLE_FALSE if the frame should be dropped.
+ */
+static bugle_bool video_pace(void)
+{
     bugle_timespec tv;
-    double t = 0.0;
-    screenshot_context ssctx;
+    double t;
 
+    bugle_gettime(&tv);
+    t = tv.tv_sec + 1e-9 * tv.tv_nsec;
+    video_data[video_cur].time = t;
     if (!video_sample_all)
     {
-        bugle_gettime(&tv);
-        t = tv.tv_sec + 1e-9 * tv.tv_nsec;
         if (video_first) /* first frame */
             video_frame_time = t;
         else if (t < video_frame_time)
-            return; /* drop the frame because it is too soon */
+            return BUGLE_FALSE; /* drop the frame because it is too soon */
 
         /* Repeat frames to make up for low app framerate */
         video_data[video_cur].multiplicity = 0;
@@ -561,6 +1327,283 @@ static void screenshot_video(void)
     }
     else
         video_data[video_cur].multiplicity = 1;
+    return BUGLE_TRUE;
+}
+
+#if defined(BUGLE_PLATFORM_POSIX)
+
+#ifndef IOV_MAX
+# define IOV_MAX 16  /* The minimum that POSIX allows */
+#endif
+
+/* Writes out all the vectors, retrying after short writes. The vectors
+ * are modified.
+ */
+static bugle_bool video_writev(int fd, struct iovec *iov, int count)
+{
+    ssize_t written;
+
+    while (count > 0)
+    {
+        written = writev(fd, iov, count < IOV_MAX ? count : IOV_MAX);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            bugle_log_printf("screenshot", "video", BUGLE_LOG_ERROR,
+                             "write error: %s", strerror(errno));
+            return BUGLE_FALSE;
+        }
+        /* Skip over what was written */
+        while (count > 0 && (size_t) written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0)
+        {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return BUGLE_TRUE;
+}
+
+/* Writes a captured frame with the native writers. The pixels are written
+ * straight from where they were read back (usually a mapped PBO), with
+ * no copy unless they need to be converted on the CPU.
+ */
+static bugle_bool video_write_native(const screenshot_data *data)
+{
+    struct iovec *iov;
+    size_t row, size;
+    int i, r, count;
+    bugle_bool ret = BUGLE_TRUE;
+
+    if (video_frames_written == 0 && data->multiplicity > 0)
+    {
+        video_start_time = data->time;
+        if (video_writer == VIDEO_Y4M)
+        {
+            struct iovec header;
+
+            header.iov_base = bugle_asprintf("YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XYSCSS=420JPEG XCOLORRANGE=LIMITED\n",
+                                             data->width, data->height, (int) (1.0 / video_frame_step + 0.5));
+            header.iov_len = strlen(header.iov_base);
+            ret = video_writev(video_fd, &header, 1);
+            bugle_free(header.iov_base);
+            if (!ret) return BUGLE_FALSE;
+        }
+        if (video_timestamps)
+            fprintf(video_timestamps, "# %s %dx%d\n# frame seconds\n",
+                    video_writer == VIDEO_Y4M ? "yuv420p" : "rgb24",
+                    data->width, data->height);
+    }
+
+    if (video_writer == VIDEO_Y4M)
+    {
+        static char frame_header[] = "FRAME\n";
+        const GLubyte *yuv;
+
+        size = BUGLE_YUV_SIZE(data->width, data->height);
+        if (data->yuv)
+            yuv = data->pixels;
+        else
+        {
+            video_scratch = bugle_nrealloc(video_scratch, size, sizeof(GLubyte));
+            bugle_yuv_convert(data->pixels, data->width, data->height, data->stride, video_scratch);
+            yuv = video_scratch;
+        }
+        count = 2;
+        iov = BUGLE_NMALLOC(count, struct iovec);
+        for (r = 0; r < data->multiplicity && ret; r++)
+        {
+            iov[0].iov_base = frame_header;
+            iov[0].iov_len = strlen(frame_header);
+            iov[1].iov_base = (void *) yuv;
+            iov[1].iov_len = size;
+            ret = video_writev(video_fd, iov, count);
+        }
+    }
+    else
+    {
+        /* Flip to top-down order by writing the rows in reverse */
+        row = (size_t) data->width * 3;
+        count = data->height;
+        iov = BUGLE_NMALLOC(count, struct iovec);
+        for (r = 0; r < data->multiplicity && ret; r++)
+        {
+            for (i = 0; i < count; i++)
+            {
+                iov[i].iov_base = data->pixels + data->stride * (data->height - 1 - i);
+                iov[i].iov_len = row;
+            }
+            ret = video_writev(video_fd, iov, count);
+        }
+    }
+    bugle_free(iov);
+
+    if (ret && video_timestamps)
+        for (r = 0; r < data->multiplicity; r++)
+            fprintf(video_timestamps, "%lu %.6f\n",
+                    video_frames_written++, data->time - video_start_time);
+    else if (ret)
+        video_frames_written += data->multiplicity;
+    return ret;
+}
+
+static void screenshot_video_native(void)
+{
+    screenshot_data *fetch;
+    screenshot_context ssctx;
+    bugle_bool yuv;
+
+    if (!video_pace()) return;
+    if (!screenshot_start(&ssctx)) return;
+
+    yuv = video_writer == VIDEO_Y4M;
+    if (!video_first)
+        video_done = !do_screenshot(GL_RGB, video_data[0].width, video_data[0].height, yuv, &fetch);
+    else
+        do_screenshot(GL_RGB, -1, -1, yuv, &fetch);
+    video_first = BUGLE_FALSE;
+
+    if (fetch->width > 0 && map_screenshot(fetch))
+    {
+        if (!video_write_native(fetch))
+            video_done = BUGLE_TRUE;
+        unmap_screenshot(fetch);
+    }
+    screenshot_stop(&ssctx);
+}
+
+static bugle_bool video_native_initialise(void)
+{
+    video_fd = open(video_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (video_fd < 0)
+    {
+        bugle_log_printf("screenshot", "initialise", BUGLE_LOG_ERROR,
+                         "failed to open %s: %s", video_filename, strerror(errno));
+        return BUGLE_FALSE;
+    }
+    if (!video_timestamps_filename)
+        video_timestamps_filename = bugle_asprintf("%s.timestamps", video_filename);
+    if (video_timestamps_filename[0])
+    {
+        video_timestamps = fopen(video_timestamps_filename, "w");
+        if (!video_timestamps)
+            bugle_log_printf("screenshot", "initialise", BUGLE_LOG_WARNING,
+                             "failed to open %s: %s", video_timestamps_filename, strerror(errno));
+    }
+    video_frames_written = 0;
+    return BUGLE_TRUE;
+}
+
+static void video_native_shutdown(void)
+{
+    if (video_fd >= 0)
+    {
+        close(video_fd);
+        video_fd = -1;
+    }
+    if (video_timestamps)
+    {
+        fclose(video_timestamps);
+        video_timestamps = NULL;
+    }
+    bugle_free(video_scratch);
+    video_scratch = NULL;
+}
+
+#else /* !BUGLE_PLATFORM_POSIX */
+
+static void screenshot_video_native(void)
+{
+}
+
+static bugle_bool video_native_initialise(void)
+{
+    bugle_log("screenshot", "initialise", BUGLE_LOG_ERROR,
+              "the y4m and raw writers are not supported on this platform");
+    return BUGLE_FALSE;
+}
+
+static void video_native_shutdown(void)
+{
+}
+
+#endif /* !BUGLE_PLATFORM_POSIX */
+
+/* The tiles writer hashes and writes on an encoder thread, so all that
+ * happens here is the readback and a copy. A single thread is used
+ * because each frame is compared with the one before it.
+ */
+static void screenshot_video_tiles(void)
+{
+    screenshot_data *fetch;
+    screenshot_context ssctx;
+
+    if (!video_pace()) return;
+    if (!encode_has_room()) return;
+    if (!screenshot_start(&ssctx)) return;
+
+    if (!video_first)
+        video_done = !do_screenshot(GL_RGB, video_data[0].width, video_data[0].height, BUGLE_FALSE, &fetch);
+    else
+        do_screenshot(GL_RGB, -1, -1, BUGLE_FALSE, &fetch);
+    video_first = BUGLE_FALSE;
+    encode_submit(fetch);
+    screenshot_stop(&ssctx);
+}
+
+static bugle_bool video_tiles_initialise(void)
+{
+    if (tiles_size > BUGLE_TILECAPTURE_MAX_DIMENSION)
+    {
+        bugle_log_printf("screenshot", "initialise", BUGLE_LOG_ERROR,
+                         "tilesize may not be more than %d", BUGLE_TILECAPTURE_MAX_DIMENSION);
+        return BUGLE_FALSE;
+    }
+    tiles_file = fopen(video_filename, "wb");
+    if (!tiles_file)
+    {
+        bugle_log_printf("screenshot", "initialise", BUGLE_LOG_ERROR,
+                         "failed to open %s: %s", video_filename, strerror(errno));
+        return BUGLE_FALSE;
+    }
+    return screenshot_workers_start(1);
+}
+
+/* Must be called after the encoder thread has been stopped */
+static void video_tiles_shutdown(void)
+{
+    if (tiles_file)
+    {
+        if (fclose(tiles_file) != 0)
+            bugle_log_printf("screenshot", "write", BUGLE_LOG_ERROR,
+                             "failed to write %s: %s", video_filename, strerror(errno));
+        tiles_file = NULL;
+    }
+    bugle_free(tiles_hashes);
+    bugle_free(tiles_changed);
+    tiles_hashes = NULL;
+    tiles_changed = NULL;
+}
+
+#if HAVE_LAVC
+static void screenshot_video(void)
+{
+    screenshot_data *fetch;
+    AVCodecContext *c;
+    AVFrame *frame;
+    size_t out_size;
+    int i, ret;
+    int src_fmt;
+    bugle_bool yuv;
+    screenshot_context ssctx;
+
+    if (!video_pace()) return;
 
     /* We only do this here, because it is potentially expensive and if we
      * are rendering faster than capturing we don't want the hit if we're
@@ -568,10 +1611,13 @@ static void screenshot_video(void)
      */
     if (!screenshot_start(&ssctx)) return;
 
+    /* Converting on the GPU only helps if the codec wants the same format */
+    yuv = video_gpu_yuv
+        && (!video_context || video_stream->codec->pix_fmt == PIX_FMT_YUV420P);
     if (!video_first)
-        video_done = !do_screenshot(CAPTURE_GL_FMT, video_data[0].width, video_data[0].height, &fetch);
+        video_done = !do_screenshot(CAPTURE_GL_FMT, video_data[0].width, video_data[0].height, yuv, &fetch);
     else
-        do_screenshot(CAPTURE_GL_FMT, -1, -1, &fetch);
+        do_screenshot(CAPTURE_GL_FMT, -1, -1, yuv, &fetch);
     video_first = BUGLE_FALSE;
 
     if (fetch->width > 0)
@@ -584,26 +1630,43 @@ static void screenshot_video(void)
             screenshot_stop(&ssctx);
             return;
         }
-        video_raw->data[0] = fetch->pixels + fetch->stride * (fetch->height - 1);
-        video_raw->linesize[0] = -fetch->stride;
+        if (fetch->yuv)
+        {
+            src_fmt = PIX_FMT_YUV420P;
+            avpicture_fill((AVPicture *) video_raw, fetch->pixels, src_fmt,
+                           fetch->width, fetch->height);
+        }
+        else
+        {
+            src_fmt = CAPTURE_AV_FMT;
+            video_raw->data[0] = fetch->pixels + fetch->stride * (fetch->height - 1);
+            video_raw->linesize[0] = -fetch->stride;
+        }
+
+        if (src_fmt == c->pix_fmt)
+            frame = video_raw;
+        else
+        {
 #if HAVE_LIBSWSCALE
-        sws_context = sws_getCachedContext(sws_context,
-                                           fetch->width, fetch->height, CAPTURE_AV_FMT,
-                                           fetch->width, fetch->height, c->pix_fmt,
-                                           SWS_BILINEAR, NULL, NULL, NULL);
-        sws_scale(sws_context, (const uint8_t * const *) video_raw->data, video_raw->linesize,
-                  0, fetch->height, video_yuv->data, video_yuv->linesize);
+            sws_context = sws_getCachedContext(sws_context,
+                                               fetch->width, fetch->height, src_fmt,
+                                               fetch->width, fetch->height, c->pix_fmt,
+                                               SWS_BILINEAR, NULL, NULL, NULL);
+            sws_scale(sws_context, (const uint8_t * const *) video_raw->data, video_raw->linesize,
+                      0, fetch->height, video_yuv->data, video_yuv->linesize);
 #else
 
-        img_convert((AVPicture *) video_yuv, c->pix_fmt,
-                    (AVPicture *) video_raw, CAPTURE_AV_FMT,
-                    fetch->width, fetch->height);
+            img_convert((AVPicture *) video_yuv, c->pix_fmt,
+                        (AVPicture *) video_raw, src_fmt,
+                        fetch->width, fetch->height);
 #endif
+            frame = video_yuv;
+        }
         for (i = 0; i < fetch->multiplicity; i++)
         {
             out_size = avcodec_encode_video(video_stream->codec,
                                             video_buffer, video_buffer_size,
-                                            video_yuv);
+                                            frame);
             if (out_size != 0)
             {
                 AVPacket pkt;
@@ -656,28 +1719,6 @@ static void screenshot_video(void)
 
 #endif /* !HAVE_LAVC */
 
-static void screenshot_file(int frameno)
-{
-    char *fname;
-    FILE *out;
-    screenshot_context ssctx;
-
-    if (!screenshot_start(&ssctx)) return;
-    fname = interpolate_filename(video_filename, frameno);
-    out = fopen(fname, "wb");
-    bugle_free(fname);
-    if (!out)
-    {
-        perror("failed to open screenshot file");
-        screenshot_stop(&ssctx);
-        return;
-    }
-    screenshot_stream(out, BUGLE_FALSE);
-    if (fclose(out) != 0)
-        perror("write error");
-    screenshot_stop(&ssctx);
-}
-
 bugle_bool screenshot_callback(function_call *call, const callback_data *data)
 {
     /* FIXME: track the frameno in the context?
@@ -686,12 +1727,18 @@ bugle_bool screenshot_callback(function_call *call, const callback_data *data)
 
     if (video)
     {
-        if (!video_done)
+        if (video_done)
+            ;
+        else if (video_writer == VIDEO_ENCODER)
             screenshot_video();
+        else if (video_writer == VIDEO_TILES)
+            screenshot_video_tiles();
+        else
+            screenshot_video_native();
     }
-    else if (keypress_screenshot)
+    else if (still_sequence || keypress_screenshot)
     {
-        screenshot_file(frameno);
+        screenshot_still(frameno);
         keypress_screenshot = BUGLE_FALSE;
     }
     frameno++;
@@ -705,6 +1752,13 @@ static bugle_bool screenshot_initialise(filter_set *handle)
     char *cmdline;
 #endif
 
+    if (!(capture_scale > 0.0 && capture_scale <= 1.0))
+    {
+        bugle_log("screenshot", "initialise", BUGLE_LOG_ERROR,
+                  "scale must be greater than 0 and at most 1");
+        return BUGLE_FALSE;
+    }
+
     f = bugle_filter_new(handle, "screenshot");
     bugle_glwin_filter_catches_swap_buffers(f, BUGLE_FALSE, screenshot_callback);
     bugle_filter_order("screenshot", "invoke");
@@ -715,6 +1769,18 @@ static bugle_bool screenshot_initialise(filter_set *handle)
     if (video)
     {
         video_done = BUGLE_FALSE; /* becomes BUGLE_TRUE if we resize */
+        if (video_writer == VIDEO_TILES)
+        {
+            if (!video_filename)
+                video_filename = bugle_strdup("bugle.tiles");
+            return video_tiles_initialise();
+        }
+        if (video_writer != VIDEO_ENCODER)
+        {
+            if (!video_filename)
+                video_filename = bugle_strdup(video_writer == VIDEO_Y4M ? "bugle.y4m" : "bugle.rgb");
+            return video_native_initialise();
+        }
         if (!video_filename)
             video_filename = bugle_strdup("bugle.avi");
 #if !HAVE_LAVC
@@ -738,11 +1804,20 @@ static bugle_bool screenshot_initialise(filter_set *handle)
     }
     else
     {
+        const char *ext;
+
+        ext = still_format == SCREENSHOT_QOI ? "qoi" : "ppm";
         if (!video_filename)
-            video_filename = bugle_strdup("bugle.ppm");
-        video_lag = 1;
-        /* FIXME: should only intercept the key when enabled */
-        bugle_input_key_callback(&key_screenshot, NULL, bugle_input_key_callback_flag, &keypress_screenshot);
+            video_filename = bugle_asprintf(still_sequence ? "bugle%%04d.%s" : "bugle.%s", ext);
+        if (!still_sequence)
+        {
+            /* Keep the latency down, since the user is waiting for it */
+            video_lag = 1;
+            /* FIXME: should only intercept the key when enabled */
+            bugle_input_key_callback(&key_screenshot, NULL, bugle_input_key_callback_flag, &keypress_screenshot);
+        }
+        if (!screenshot_workers_start(encode_threads))
+            return BUGLE_FALSE;
     }
     return BUGLE_TRUE;
 }
@@ -761,7 +1836,11 @@ static void screenshot_shutdown(filter_set *handle)
         _pclose(video_pipe);
 #endif
     }
+    video_native_shutdown();
+    screenshot_workers_stop();
+    video_tiles_shutdown();
     if (video_codec) bugle_free(video_codec);
+    if (video_timestamps_filename) bugle_free(video_timestamps_filename);
 }
 
 void bugle_initialise_filter_library(void)
@@ -774,7 +1853,18 @@ void bugle_initialise_filter_library(void)
         { "bitrate", "video bitrate (bytes/s) [7.5MB/s]", FILTER_SET_VARIABLE_POSITIVE_INT, &video_bitrate, NULL },
         { "allframes", "capture every frame, ignoring framerate [no]", FILTER_SET_VARIABLE_BOOL, &video_sample_all, NULL },
         { "lag", "length of capture pipeline (set higher for better throughput) [1]", FILTER_SET_VARIABLE_POSITIVE_INT, &video_lag, NULL },
+        { "gpuyuv", "convert video frames to YUV on the GPU [no]", FILTER_SET_VARIABLE_BOOL, &video_gpu_yuv, NULL },
+        { "writer", "how to write video: encoder, y4m, raw or tiles [encoder]", FILTER_SET_VARIABLE_CUSTOM, NULL, screenshot_writer_set },
+        { "timestamps", "file to record frame times in with the y4m and raw writers [<filename>.timestamps]", FILTER_SET_VARIABLE_STRING, &video_timestamps_filename, NULL },
+        { "tilesize", "width and height of the tiles compared by the tiles writer [32]", FILTER_SET_VARIABLE_POSITIVE_INT, &tiles_size, NULL },
+        { "keyframe", "frames between keyframes written by the tiles writer [60]", FILTER_SET_VARIABLE_POSITIVE_INT, &tiles_keyframe, NULL },
+        { "crop", "region to capture, as \"x y width height\" from the top left [whole window]", FILTER_SET_VARIABLE_CUSTOM, NULL, screenshot_crop_set },
+        { "scale", "factor by which to shrink captures, between 0 and 1 [1]", FILTER_SET_VARIABLE_FLOAT, &capture_scale, NULL },
         { "key_screenshot", "key to take a screenshot [C-A-S-S]", FILTER_SET_VARIABLE_KEY, &key_screenshot, NULL },
+        { "format", "still image format: ppm or qoi [ppm]", FILTER_SET_VARIABLE_CUSTOM, NULL, screenshot_format_set },
+        { "sequence", "capture every frame as a still image [no]", FILTER_SET_VARIABLE_BOOL, &still_sequence, NULL },
+        { "threads", "number of threads encoding still images [2]", FILTER_SET_VARIABLE_POSITIVE_INT, &encode_threads, NULL },
+        { "queue", "number of frames that may wait for encoding [8]", FILTER_SET_VARIABLE_POSITIVE_INT, &encode_queue, NULL },
         { NULL, NULL, 0, NULL, NULL }
     };
 
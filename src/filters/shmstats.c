@@ -0,0 +1,253 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <bugle/bool.h>
+#include <bugle/string.h>
+#include <bugle/time.h>
+#include <bugle/glwin/glwin.h>
+#include <bugle/linkedlist.h>
+#include <bugle/stats.h>
+#include <bugle/math.h>
+#include <bugle/memory.h>
+#include <bugle/filters.h>
+#include <bugle/log.h>
+#include "common/statsshm.h"
+#include "platform/shm.h"
+#include "platform/threads.h"
+#include "platform/types.h"
+
+static linked_list shmstats_show;            /* actual stats */
+static linked_list shmstats_show_requested;  /* names in config file */
+static char *shmstats_name = NULL;
+static stats_signal_values shmstats_prev, shmstats_cur;
+static bugle_timespec shmstats_origin;
+
+static bugle_shm *shmstats_shm;
+static bugle_statsshm_header *shmstats_header;
+static double *shmstats_values;
+static double *shmstats_scratch;            /* values before publication */
+
+/* Callback to assign the "show" pseudo-variable */
+static bugle_bool shmstats_show_set(const struct filter_set_variable_info_s *var,
+                                    const char *text, const void *value)
+{
+    bugle_list_append(&shmstats_show_requested, bugle_strdup(text));
+    return BUGLE_TRUE;
+}
+
+static double time_elapsed(const bugle_timespec *old, const bugle_timespec *now)
+{
+    return (now->tv_sec - old->tv_sec) + 1e-9 * (now->tv_nsec - old->tv_nsec);
+}
+
+static bugle_bool shmstats_swap_buffers(function_call *call, const callback_data *data)
+{
+    linked_list_node *i;
+    stats_signal_values tmp;
+    double *v;
+
+    tmp = shmstats_prev;
+    shmstats_prev = shmstats_cur;
+    shmstats_cur = tmp;
+    bugle_stats_signal_values_gather(&shmstats_cur);
+    if (!shmstats_prev.allocated)
+    {
+        shmstats_origin = shmstats_cur.last_updated;
+        return BUGLE_TRUE;
+    }
+
+    /* Evaluate before starting the update, to keep the window in which
+     * readers have to retry as short as possible.
+     */
+    v = shmstats_scratch;
+    for (i = bugle_list_head(&shmstats_show); i; i = bugle_list_next(i))
+    {
+        stats_statistic *st = (stats_statistic *) bugle_list_data(i);
+        *v++ = bugle_stats_expression_evaluate(st->value, &shmstats_prev, &shmstats_cur);
+    }
+
+    bugle_statsshm_write_begin(shmstats_header);
+    memcpy(shmstats_values, shmstats_scratch, shmstats_header->count * sizeof(double));
+    shmstats_header->frame++;
+    shmstats_header->time = time_elapsed(&shmstats_origin, &shmstats_cur.last_updated);
+    bugle_statsshm_write_end(shmstats_header);
+    return BUGLE_TRUE;
+}
+
+/* Builds the descriptive part of the segment. The magic number is set
+ * last, so that a reader never sees a partly written header.
+ */
+static bugle_bool shmstats_create(void)
+{
+    linked_list_node *i;
+    stats_statistic *st;
+    bugle_statsshm_statistic *desc;
+    size_t count = 0, strings = 0, size, pos;
+    char *base;
+
+    for (i = bugle_list_head(&shmstats_show); i; i = bugle_list_next(i))
+    {
+        st = (stats_statistic *) bugle_list_data(i);
+        count++;
+        strings += strlen(st->name) + 1;
+        if (st->label)
+            strings += strlen(st->label) + 1;
+    }
+    pos = sizeof(bugle_statsshm_header) + count * sizeof(bugle_statsshm_statistic);
+    /* Round up so that the values are aligned */
+    size = (pos + strings + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+    size += count * sizeof(double);
+
+    shmstats_shm = bugle_shm_create(shmstats_name, size);
+    if (!shmstats_shm)
+    {
+        bugle_log_printf("shmstats", "initialise", BUGLE_LOG_ERROR,
+                         "cannot create shared memory segment %s: %s",
+                         shmstats_name, strerror(errno));
+        return BUGLE_FALSE;
+    }
+    base = (char *) bugle_shm_data(shmstats_shm);
+    shmstats_header = (bugle_statsshm_header *) base;
+    shmstats_header->version = BUGLE_STATSSHM_VERSION;
+    shmstats_header->size = size;
+    shmstats_header->count = count;
+    shmstats_header->statistics_offset = sizeof(bugle_statsshm_header);
+    shmstats_header->values_offset = size - count * sizeof(double);
+    shmstats_header->pid = bugle_getpid();
+    shmstats_header->state = BUGLE_STATSSHM_RUNNING;
+    shmstats_values = (double *) (base + shmstats_header->values_offset);
+
+    desc = (bugle_statsshm_statistic *) (base + shmstats_header->statistics_offset);
+    for (i = bugle_list_head(&shmstats_show); i; i = bugle_list_next(i), desc++)
+    {
+        st = (stats_statistic *) bugle_list_data(i);
+        desc->name_offset = pos;
+        strcpy(base + pos, st->name);
+        pos += strlen(st->name) + 1;
+        if (st->label)
+        {
+            desc->label_offset = pos;
+            strcpy(base + pos, st->label);
+            pos += strlen(st->label) + 1;
+        }
+        desc->precision = st->precision;
+    }
+    for (pos = 0; pos < count; pos++)
+        shmstats_values[pos] = bugle_nan();
+    shmstats_scratch = BUGLE_NMALLOC(count + 1, double);
+
+    bugle_atomic_barrier();
+    shmstats_header->magic = BUGLE_STATSSHM_MAGIC;
+    return BUGLE_TRUE;
+}
+
+static bugle_bool shmstats_initialise(filter_set *handle)
+{
+    filter *f;
+    linked_list_node *i, *j;
+    stats_statistic *st;
+
+    f = bugle_filter_new(handle, "shmstats");
+    bugle_glwin_filter_catches_swap_buffers(f, BUGLE_FALSE, shmstats_swap_buffers);
+
+    bugle_list_clear(&shmstats_show);
+    for (i = bugle_list_head(&shmstats_show_requested); i; i = bugle_list_next(i))
+    {
+        char *name;
+        name = (char *) bugle_list_data(i);
+        j = bugle_stats_statistic_find(name);
+        if (!j)
+        {
+            bugle_log_printf("shmstats", "initialise", BUGLE_LOG_ERROR,
+                             "statistic '%s' not found.", name);
+            bugle_stats_statistic_list();
+            return BUGLE_FALSE;
+        }
+        for (; j; j = bugle_list_next(j))
+        {
+            st = (stats_statistic *) bugle_list_data(j);
+            if (bugle_stats_expression_activate_signals(st->value))
+                bugle_list_append(&shmstats_show, st);
+            else
+            {
+                bugle_log_printf("shmstats", "initialise", BUGLE_LOG_ERROR,
+                                 "could not initialise statistic '%s'",
+                                 st->name);
+                return BUGLE_FALSE;
+            }
+            if (st->last) break;
+        }
+    }
+    bugle_list_clear(&shmstats_show_requested);
+    if (!shmstats_create())
+        return BUGLE_FALSE;
+
+    bugle_stats_signal_values_init(&shmstats_prev);
+    bugle_stats_signal_values_init(&shmstats_cur);
+    return BUGLE_TRUE;
+}
+
+static void shmstats_shutdown(filter_set *handle)
+{
+    if (shmstats_shm)
+    {
+        /* Readers that already have the segment mapped see this */
+        shmstats_header->state = BUGLE_STATSSHM_FINISHED;
+        bugle_shm_close(shmstats_shm);
+        shmstats_shm = NULL;
+    }
+    bugle_free(shmstats_scratch);
+    shmstats_scratch = NULL;
+    bugle_free(shmstats_name);
+    shmstats_name = NULL;
+    bugle_stats_signal_values_clear(&shmstats_prev);
+    bugle_stats_signal_values_clear(&shmstats_cur);
+    bugle_list_clear(&shmstats_show);
+}
+
+void bugle_initialise_filter_library(void)
+{
+    static const filter_set_variable_info shmstats_variables[] =
+    {
+        { "show", "repeat with each item to publish", FILTER_SET_VARIABLE_CUSTOM, NULL, shmstats_show_set },
+        { "name", "name of the shared memory segment [bugle-stats]", FILTER_SET_VARIABLE_STRING, &shmstats_name, NULL },
+        { NULL, NULL, 0, NULL, NULL }
+    };
+
+    static const filter_set_info shmstats_info =
+    {
+        "shmstats",
+        shmstats_initialise,
+        shmstats_shutdown,
+        NULL,
+        NULL,
+        shmstats_variables,
+        "publishes statistics in shared memory for bugle-statsmon"
+    };
+
+    bugle_filter_set_new(&shmstats_info);
+    bugle_filter_set_stats_logger("shmstats");
+    bugle_list_init(&shmstats_show_requested, bugle_free);
+    bugle_list_init(&shmstats_show, NULL);
+    shmstats_name = bugle_strdup("bugle-stats");
+}
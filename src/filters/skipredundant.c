@@ -0,0 +1,92 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Drops state changes that set the state to its current value, so that the
+ * driver never sees them. This changes what the application does, so it is
+ * only suitable for measuring how much the redundant calls cost; the
+ * correctness relies entirely on glshadow having an accurate picture of the
+ * state.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <bugle/bool.h>
+#include <bugle/stats.h>
+#include <bugle/filters.h>
+#include <bugle/log.h>
+#include <bugle/gl/glshadow.h>
+#include <budgie/reflect.h>
+#include "platform/threads.h"
+
+static stats_signal *skipredundant_signal;
+static bugle_thread_lock_t skipredundant_lock;
+static unsigned long skipredundant_skipped = 0;
+
+static bugle_bool skipredundant_callback(function_call *call, const callback_data *data)
+{
+    if (bugle_glshadow_classify(call) != BUGLE_GLSHADOW_REDUNDANT)
+        return BUGLE_TRUE;
+
+    bugle_stats_signal_add(skipredundant_signal, 1.0);
+    bugle_thread_lock_lock(&skipredundant_lock);
+    skipredundant_skipped++;
+    bugle_thread_lock_unlock(&skipredundant_lock);
+    return BUGLE_FALSE;
+}
+
+static bugle_bool skipredundant_initialise(filter_set *handle)
+{
+    filter *f;
+    budgie_function i;
+
+    f = bugle_filter_new(handle, "skipredundant");
+    for (i = 0; i < budgie_function_count(); i++)
+        if (bugle_glshadow_tracks(i))
+            bugle_filter_catches_function_id(f, i, BUGLE_FALSE, skipredundant_callback);
+    bugle_filter_order("skipredundant", "invoke");
+    /* Let the statistics see the calls that are dropped */
+    bugle_filter_order("stats_redundant", "skipredundant");
+
+    skipredundant_signal = bugle_stats_signal_new("skipredundant:calls", NULL, NULL);
+    bugle_thread_lock_init(&skipredundant_lock);
+    return BUGLE_TRUE;
+}
+
+static void skipredundant_shutdown(filter_set *handle)
+{
+    bugle_log_printf("skipredundant", "summary", BUGLE_LOG_INFO,
+                     "%lu redundant calls were skipped", skipredundant_skipped);
+    bugle_thread_lock_destroy(&skipredundant_lock);
+}
+
+void bugle_initialise_filter_library(void)
+{
+    static const filter_set_info skipredundant_info =
+    {
+        "skipredundant",
+        skipredundant_initialise,
+        skipredundant_shutdown,
+        NULL,
+        NULL,
+        NULL,
+        "skips calls that set state to its current value"
+    };
+
+    bugle_filter_set_new(&skipredundant_info);
+    bugle_filter_set_depends("skipredundant", "glshadow");
+}
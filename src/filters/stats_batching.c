@@ -0,0 +1,283 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Finds runs of consecutive draws that use the same state and primitive
+ * type, and which could thus in principle be merged into one draw. The
+ * state is compared using the fingerprint of the glshadow state, which
+ * is cheap because nothing needs to be queried. Vertex array setup and
+ * some other drawing state (matrices, stencil, polygon offset, samplers
+ * and uniform buffers) are not shadowed, so any call that changes them is
+ * taken to change the state.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <bugle/gl/glheaders.h>
+#include <stdio.h>
+#include <bugle/bool.h>
+#include <bugle/stats.h>
+#include <bugle/filters.h>
+#include <bugle/objects.h>
+#include <bugle/glwin/glwin.h>
+#include <bugle/glwin/trackcontext.h>
+#include <bugle/gl/glutils.h>
+#include <bugle/gl/gldisplaylist.h>
+#include <bugle/gl/glshadow.h>
+#include <budgie/reflect.h>
+
+/* Run lengths are counted in power-of-two buckets: 1, 2-3, 4-7 and so on,
+ * with the last bucket holding everything longer.
+ */
+#define STATS_BATCHING_BUCKETS 10
+
+typedef struct
+{
+    bugle_bool in_run;
+    unsigned long fingerprint;
+    unsigned long generation;
+    GLenum mode;
+    unsigned long length;
+
+    unsigned long next_generation;    /* bumped by calls that change unshadowed state */
+} stats_batching_context;
+
+static object_view stats_batching_view;
+static stats_signal *stats_batching_draws, *stats_batching_runs;
+static stats_signal *stats_batching_lengths[STATS_BATCHING_BUCKETS];
+
+/* Functions that change the vertex array setup */
+static const char * const stats_batching_vertex_functions[] =
+{
+    "glVertexAttribPointer",
+    "glVertexAttribIPointer",
+    "glVertexAttribLPointer",
+    "glEnableVertexAttribArray",
+    "glDisableVertexAttribArray",
+    "glVertexAttribDivisor",
+    "glBindVertexBuffer",
+    "glVertexAttribFormat",
+    "glVertexAttribIFormat",
+    "glVertexAttribBinding",
+    "glVertexBindingDivisor",
+    "glVertexPointer",
+    "glNormalPointer",
+    "glColorPointer",
+    "glSecondaryColorPointer",
+    "glIndexPointer",
+    "glTexCoordPointer",
+    "glFogCoordPointer",
+    "glEdgeFlagPointer",
+    "glInterleavedArrays",
+    "glEnableClientState",
+    "glDisableClientState",
+    "glPopClientAttrib",
+    NULL
+};
+
+/* Functions that change other drawing state that glshadow does not track */
+static const char * const stats_batching_state_functions[] =
+{
+    "glLoadIdentity",
+    "glLoadMatrixf",
+    "glLoadMatrixd",
+    "glMultMatrixf",
+    "glMultMatrixd",
+    "glLoadTransposeMatrixf",
+    "glLoadTransposeMatrixd",
+    "glMultTransposeMatrixf",
+    "glMultTransposeMatrixd",
+    "glRotatef",
+    "glRotated",
+    "glTranslatef",
+    "glTranslated",
+    "glScalef",
+    "glScaled",
+    "glFrustum",
+    "glOrtho",
+    "glPopMatrix",
+    "glStencilFunc",
+    "glStencilFuncSeparate",
+    "glStencilOp",
+    "glStencilOpSeparate",
+    "glStencilMask",
+    "glStencilMaskSeparate",
+    "glPolygonOffset",
+    "glPolygonMode",
+    "glTexParameteri",
+    "glTexParameteriv",
+    "glTexParameterf",
+    "glTexParameterfv",
+    "glBindSampler",
+    "glSamplerParameteri",
+    "glSamplerParameteriv",
+    "glSamplerParameterf",
+    "glSamplerParameterfv",
+    "glSamplerParameterIiv",
+    "glSamplerParameterIuiv",
+    "glUniformBlockBinding",
+    "glBindBufferBase",
+    "glBindBufferRange",
+    "glUniformSubroutinesuiv",
+    NULL
+};
+
+static void stats_batching_end_run(stats_batching_context *ctx)
+{
+    unsigned long length;
+    int bucket = 0;
+
+    if (!ctx->in_run)
+        return;
+    for (length = ctx->length; length > 1 && bucket < STATS_BATCHING_BUCKETS - 1; length >>= 1)
+        bucket++;
+    bugle_stats_signal_add(stats_batching_lengths[bucket], 1.0);
+    ctx->in_run = BUGLE_FALSE;
+}
+
+static void stats_batching_draw(GLenum mode)
+{
+    stats_batching_context *ctx;
+    unsigned long fingerprint;
+
+    if (bugle_displaylist_mode() == GL_COMPILE)
+        return;   /* Not drawn yet */
+    ctx = (stats_batching_context *) bugle_object_get_current_data(bugle_get_context_class(), stats_batching_view);
+    if (!ctx)
+        return;
+
+    bugle_stats_signal_add(stats_batching_draws, 1.0);
+    fingerprint = bugle_glshadow_fingerprint();
+    if (ctx->in_run
+        && fingerprint != 0
+        && fingerprint == ctx->fingerprint
+        && ctx->generation == ctx->next_generation
+        && mode == ctx->mode)
+    {
+        ctx->length++;
+        return;
+    }
+
+    stats_batching_end_run(ctx);
+    bugle_stats_signal_add(stats_batching_runs, 1.0);
+    ctx->in_run = BUGLE_TRUE;
+    ctx->fingerprint = fingerprint;
+    ctx->generation = ctx->next_generation;
+    ctx->mode = mode;
+    ctx->length = 1;
+    if (fingerprint == 0)
+        stats_batching_end_run(ctx);  /* Nothing can be merged with it */
+}
+
+static bugle_bool stats_batching_drawing(function_call *call, const callback_data *data)
+{
+    /* The first argument of every drawing function is the mode */
+    if (!bugle_gl_call_is_immediate(call))
+        stats_batching_draw(*(const GLenum *) call->generic.args[0]);
+    return BUGLE_TRUE;
+}
+
+#if BUGLE_GLTYPE_GL
+static bugle_bool stats_batching_glBegin(function_call *call, const callback_data *data)
+{
+    stats_batching_draw(*call->glBegin.arg0);
+    return BUGLE_TRUE;
+}
+#endif
+
+static bugle_bool stats_batching_untracked(function_call *call, const callback_data *data)
+{
+    stats_batching_context *ctx;
+
+    ctx = (stats_batching_context *) bugle_object_get_current_data(bugle_get_context_class(), stats_batching_view);
+    if (ctx)
+        ctx->next_generation++;
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_batching_swap_buffers(function_call *call, const callback_data *data)
+{
+    stats_batching_context *ctx;
+
+    /* Draws in different frames cannot be merged */
+    ctx = (stats_batching_context *) bugle_object_get_current_data(bugle_get_context_class(), stats_batching_view);
+    if (ctx)
+        stats_batching_end_run(ctx);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_batching_initialise(filter_set *handle)
+{
+    filter *f;
+    int i;
+
+    stats_batching_view = bugle_object_view_new(bugle_get_context_class(),
+                                                NULL,
+                                                NULL,
+                                                sizeof(stats_batching_context));
+
+    f = bugle_filter_new(handle, "stats_batching");
+    bugle_gl_filter_catches_drawing(f, BUGLE_FALSE, stats_batching_drawing);
+#if BUGLE_GLTYPE_GL
+    bugle_filter_catches(f, "glBegin", BUGLE_FALSE, stats_batching_glBegin);
+#endif
+    for (i = 0; stats_batching_vertex_functions[i]; i++)
+        if (budgie_function_id(stats_batching_vertex_functions[i]) != NULL_FUNCTION)
+            bugle_filter_catches(f, stats_batching_vertex_functions[i], BUGLE_FALSE, stats_batching_untracked);
+    for (i = 0; stats_batching_state_functions[i]; i++)
+        if (budgie_function_id(stats_batching_state_functions[i]) != NULL_FUNCTION)
+            bugle_filter_catches(f, stats_batching_state_functions[i], BUGLE_FALSE, stats_batching_untracked);
+    bugle_filter_order("stats_batching", "invoke");
+    bugle_filter_order("stats_batching", "stats");
+
+    f = bugle_filter_new(handle, "stats_batching_swap");
+    bugle_glwin_filter_catches_swap_buffers(f, BUGLE_FALSE, stats_batching_swap_buffers);
+    bugle_filter_order("stats_batching_swap", "invoke");
+    bugle_filter_order("stats_batching_swap", "stats");
+
+    stats_batching_draws = bugle_stats_signal_new("batching:draws", NULL, NULL);
+    stats_batching_runs = bugle_stats_signal_new("batching:runs", NULL, NULL);
+    for (i = 0; i < STATS_BATCHING_BUCKETS; i++)
+    {
+        char name[64];
+
+        sprintf(name, "batching:length:%lu", 1UL << i);
+        stats_batching_lengths[i] = bugle_stats_signal_new(name, NULL, NULL);
+    }
+    return BUGLE_TRUE;
+}
+
+void bugle_initialise_filter_library(void)
+{
+    static const filter_set_info stats_batching_info =
+    {
+        "stats_batching",
+        stats_batching_initialise,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        "stats module: draws that could be merged"
+    };
+
+    bugle_filter_set_new(&stats_batching_info);
+    bugle_filter_set_depends("stats_batching", "stats_basic");
+    bugle_filter_set_depends("stats_batching", "glshadow");
+    bugle_filter_set_depends("stats_batching", "trackcontext");
+    bugle_filter_set_depends("stats_batching", "gldisplaylist");
+    bugle_filter_set_stats_generator("stats_batching");
+}
@@ -1,5 +1,5 @@
 /*  BuGLe: an OpenGL debugging tool
- *  Copyright (C) 2004-2007, 2009  Bruce Merry
+ *  Copyright (C) 2004-2007, 2009, 2014  Bruce Merry
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -28,18 +28,226 @@
 #include <bugle/stats.h>
 #include <bugle/filters.h>
 #include <bugle/objects.h>
+#include <bugle/log.h>
+#include <bugle/linkedlist.h>
+#include <bugle/math.h>
+#include <bugle/glwin/glwin.h>
 #include <budgie/reflect.h>
+#include "platform/types.h"
+#include "platform/threads.h"
+
+/* Call times are also recorded in log-linear histograms: each power of two
+ * nanoseconds is split into HIST_SUB linear buckets, so that any recorded
+ * time is known to within 1/HIST_SUB of its value. Times of 2^HIST_MAX_EXPONENT
+ * nanoseconds (about 68 seconds) or more all go in the last bucket.
+ */
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXPONENT 36
+#define HIST_BUCKETS ((HIST_MAX_EXPONENT - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct
+{
+    unsigned long counts[HIST_BUCKETS];
+} stats_calltimes_histogram;
+
+/* Cumulative histograms for one thread, indexed by function and allocated
+ * the first time the function is called. Only the owning thread writes
+ * the counts, and other threads only read them with stats_calltimes_lock
+ * held, so the fast path needs no locking.
+ */
+typedef struct
+{
+    stats_calltimes_histogram **histograms;
+    linked_list_node *node;                 /* In stats_calltimes_shards */
+} stats_calltimes_shard;
+
+#define STATS_CALLTIMES_QUANTILES 4
+
+static const struct
+{
+    const char *name;
+    double quantile;
+} stats_calltimes_quantiles[STATS_CALLTIMES_QUANTILES] =
+{
+    { "p50", 0.5 },
+    { "p90", 0.9 },
+    { "p99", 0.99 },
+    { "max", 1.0 }
+};
+
+typedef struct
+{
+    stats_signal *quantiles[STATS_CALLTIMES_QUANTILES];
+    /* Cumulative counts at the last swap, or NULL if no quantile signal
+     * for the function is active.
+     */
+    stats_calltimes_histogram *previous;
+} stats_calltimes_function;
 
 static stats_signal **stats_calltimes_signals;
 static stats_signal *stats_calltimes_total;
+static stats_calltimes_function *stats_calltimes_functions;
 static object_view time_view;
 
+static bugle_bool stats_calltimes_histograms = BUGLE_TRUE;
+static bugle_bool stats_calltimes_dump = BUGLE_TRUE;
+
+static bugle_thread_lock_t stats_calltimes_lock;
+static bugle_thread_key_t stats_calltimes_shard_key;
+static linked_list stats_calltimes_shards;
+static stats_calltimes_shard stats_calltimes_retired;  /* From exited threads */
+static stats_calltimes_histogram stats_calltimes_scratch;
+
+/* Maps a time in nanoseconds to a histogram bucket */
+static size_t stats_calltimes_bucket(bugle_uint64_t ns)
+{
+    bugle_uint64_t x;
+    unsigned int e = 0;
+
+    if (ns < HIST_SUB)
+        return (size_t) ns;
+    if (ns >> HIST_MAX_EXPONENT)
+        return HIST_BUCKETS - 1;
+
+    /* Find the highest set bit */
+    x = ns;
+    if (x >> 32) { e += 32; x >>= 32; }
+    if (x >> 16) { e += 16; x >>= 16; }
+    if (x >> 8) { e += 8; x >>= 8; }
+    if (x >> 4) { e += 4; x >>= 4; }
+    if (x >> 2) { e += 2; x >>= 2; }
+    if (x >> 1) { e += 1; }
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB + (size_t) ((ns >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/* Returns the middle of a bucket, in seconds */
+static double stats_calltimes_bucket_value(size_t bucket)
+{
+    unsigned int e;
+    double width;
+
+    if (bucket < HIST_SUB)
+        return (bucket + 0.5) * 1e-9;
+    e = bucket / HIST_SUB + HIST_SUB_BITS - 1;
+    width = (double) ((bugle_uint64_t) 1 << (e - HIST_SUB_BITS));
+    return ((HIST_SUB + bucket % HIST_SUB) + 0.5) * width * 1e-9;
+}
+
+/* Returns the smallest bucket value such that at least a fraction q of the
+ * samples are no bigger, or NaN if there are no samples.
+ */
+static double stats_calltimes_quantile(const stats_calltimes_histogram *h, double q)
+{
+    unsigned long total = 0, rank, seen = 0;
+    size_t i;
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+        total += h->counts[i];
+    if (total == 0)
+        return bugle_nan();
+    rank = (unsigned long) (q * total);
+    if (rank < q * total || rank == 0)
+        rank++;
+    for (i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += h->counts[i];
+        if (seen >= rank)
+            break;
+    }
+    return stats_calltimes_bucket_value(i < HIST_BUCKETS ? i : HIST_BUCKETS - 1);
+}
+
+static void stats_calltimes_histogram_accumulate(stats_calltimes_histogram *out,
+                                                 const stats_calltimes_histogram *in)
+{
+    size_t i;
+
+    if (in)
+        for (i = 0; i < HIST_BUCKETS; i++)
+            out->counts[i] += in->counts[i];
+}
+
+/* Sums the histograms for one function over all threads into out.
+ * stats_calltimes_lock must be held.
+ */
+static void stats_calltimes_merge(budgie_function func, stats_calltimes_histogram *out)
+{
+    linked_list_node *i;
+    const stats_calltimes_shard *shard;
+
+    memset(out, 0, sizeof(*out));
+    stats_calltimes_histogram_accumulate(out, stats_calltimes_retired.histograms[func]);
+    for (i = bugle_list_head(&stats_calltimes_shards); i; i = bugle_list_next(i))
+    {
+        shard = (const stats_calltimes_shard *) bugle_list_data(i);
+        stats_calltimes_histogram_accumulate(out, shard->histograms[func]);
+    }
+}
+
+static void stats_calltimes_shard_free(stats_calltimes_shard *shard)
+{
+    budgie_function i;
+
+    for (i = 0; i < budgie_function_count(); i++)
+        if (shard->histograms[i])
+            bugle_free(shard->histograms[i]);
+    bugle_free(shard->histograms);
+}
+
+/* Thread destructor: folds the histograms into stats_calltimes_retired */
+static void stats_calltimes_shard_release(void *data)
+{
+    stats_calltimes_shard *shard;
+    budgie_function i;
+
+    shard = (stats_calltimes_shard *) data;
+    bugle_thread_lock_lock(&stats_calltimes_lock);
+    for (i = 0; i < budgie_function_count(); i++)
+        if (shard->histograms[i])
+        {
+            if (!stats_calltimes_retired.histograms[i])
+                stats_calltimes_retired.histograms[i] = BUGLE_ZALLOC(stats_calltimes_histogram);
+            stats_calltimes_histogram_accumulate(stats_calltimes_retired.histograms[i],
+                                                 shard->histograms[i]);
+        }
+    bugle_list_erase(&stats_calltimes_shards, shard->node);
+    bugle_thread_lock_unlock(&stats_calltimes_lock);
+
+    stats_calltimes_shard_free(shard);
+    bugle_free(shard);
+}
+
+static void stats_calltimes_record(budgie_function func, bugle_uint64_t ns)
+{
+    stats_calltimes_shard *shard;
+    stats_calltimes_histogram *h;
+
+    shard = (stats_calltimes_shard *) bugle_thread_getspecific(stats_calltimes_shard_key);
+    if (!shard)
+    {
+        shard = BUGLE_ZALLOC(stats_calltimes_shard);
+        shard->histograms = BUGLE_CALLOC(budgie_function_count(), stats_calltimes_histogram *);
+        bugle_thread_lock_lock(&stats_calltimes_lock);
+        shard->node = bugle_list_append(&stats_calltimes_shards, shard);
+        bugle_thread_lock_unlock(&stats_calltimes_lock);
+        bugle_thread_setspecific(stats_calltimes_shard_key, shard);
+    }
+    h = shard->histograms[func];
+    if (!h)
+    {
+        h = BUGLE_ZALLOC(stats_calltimes_histogram);
+        shard->histograms[func] = h;
+    }
+    h->counts[stats_calltimes_bucket(ns)]++;
+}
+
 static bugle_bool stats_calltimes_pre(function_call *call, const callback_data *data)
 {
     bugle_timespec *start;
 
     start = bugle_object_get_current_data(bugle_get_call_class(), time_view);
-    bugle_gettime(start);
+    bugle_gettime_fast(start);
     return BUGLE_TRUE;
 }
 
@@ -48,20 +256,111 @@ static bugle_bool stats_calltimes_post(function_call *call, const callback_data
     bugle_timespec *start;
     bugle_timespec end;
     double elapsed;
+    long ns;
 
-    bugle_gettime(&end);
+    bugle_gettime_fast(&end);
     start = bugle_object_get_current_data(bugle_get_call_class(), time_view);
     elapsed = (end.tv_sec  - start->tv_sec) + 1e-9 * (end.tv_nsec - start->tv_nsec);
 
     bugle_stats_signal_add(stats_calltimes_signals[call->generic.id], elapsed);
     bugle_stats_signal_add(stats_calltimes_total, elapsed);
+
+    if (stats_calltimes_histograms)
+    {
+        ns = end.tv_nsec - start->tv_nsec;
+        stats_calltimes_record(call->generic.id,
+                               elapsed > 0.0
+                               ? (bugle_uint64_t) (end.tv_sec - start->tv_sec) * 1000000000U + ns
+                               : 0);
+    }
+    return BUGLE_TRUE;
+}
+
+/* Updates the quantile signals with the calls made since the last swap */
+static bugle_bool stats_calltimes_swap_buffers(function_call *call, const callback_data *data)
+{
+    stats_calltimes_function *func;
+    budgie_function i;
+    size_t j;
+    unsigned long cur;
+
+    bugle_thread_lock_lock(&stats_calltimes_lock);
+    for (i = 0; i < budgie_function_count(); i++)
+    {
+        func = &stats_calltimes_functions[i];
+        if (!func->previous)
+            continue;
+        stats_calltimes_merge(i, &stats_calltimes_scratch);
+        for (j = 0; j < HIST_BUCKETS; j++)
+        {
+            cur = stats_calltimes_scratch.counts[j];
+            stats_calltimes_scratch.counts[j] = cur - func->previous->counts[j];
+            func->previous->counts[j] = cur;
+        }
+        for (j = 0; j < STATS_CALLTIMES_QUANTILES; j++)
+            bugle_stats_signal_update(func->quantiles[j],
+                                      stats_calltimes_quantile(&stats_calltimes_scratch,
+                                                               stats_calltimes_quantiles[j].quantile));
+    }
+    bugle_thread_lock_unlock(&stats_calltimes_lock);
     return BUGLE_TRUE;
 }
 
+/* Activation callback for the quantile signals */
+static bugle_bool stats_calltimes_quantile_activate(stats_signal *si)
+{
+    stats_calltimes_function *func;
+    budgie_function i;
+
+    if (!stats_calltimes_histograms)
+    {
+        bugle_log_printf("stats_calltimes", "activate", BUGLE_LOG_WARNING,
+                         "quantiles require stats_calltimes.histograms");
+        return BUGLE_FALSE;
+    }
+    func = (stats_calltimes_function *) si->user_data;
+    if (!func->previous)
+    {
+        i = func - stats_calltimes_functions;
+        func->previous = BUGLE_ZALLOC(stats_calltimes_histogram);
+        bugle_thread_lock_lock(&stats_calltimes_lock);
+        stats_calltimes_merge(i, func->previous);
+        bugle_thread_lock_unlock(&stats_calltimes_lock);
+    }
+    bugle_stats_signal_update(si, bugle_nan());
+    return BUGLE_TRUE;
+}
+
+/* Logs the cumulative quantiles for every function that was called */
+static void stats_calltimes_dump_histograms(void)
+{
+    budgie_function i;
+    size_t j;
+    unsigned long calls;
+
+    for (i = 0; i < budgie_function_count(); i++)
+    {
+        stats_calltimes_merge(i, &stats_calltimes_scratch);
+        calls = 0;
+        for (j = 0; j < HIST_BUCKETS; j++)
+            calls += stats_calltimes_scratch.counts[j];
+        if (calls == 0)
+            continue;
+        bugle_log_printf("stats_calltimes", "histogram", BUGLE_LOG_INFO,
+                         "%s: %lu calls, p50 %.3f us, p90 %.3f us, p99 %.3f us, max %.3f us",
+                         budgie_function_name(i), calls,
+                         1e6 * stats_calltimes_quantile(&stats_calltimes_scratch, 0.5),
+                         1e6 * stats_calltimes_quantile(&stats_calltimes_scratch, 0.9),
+                         1e6 * stats_calltimes_quantile(&stats_calltimes_scratch, 0.99),
+                         1e6 * stats_calltimes_quantile(&stats_calltimes_scratch, 1.0));
+    }
+}
+
 static bugle_bool stats_calltimes_initialise(filter_set *handle)
 {
     filter *f;
     int i;
+    size_t j;
 
     f = bugle_filter_new(handle, "stats_calltimes_pre");
     bugle_filter_catches_all(f, BUGLE_FALSE, stats_calltimes_pre);
@@ -72,18 +371,35 @@ static bugle_bool stats_calltimes_initialise(filter_set *handle)
     bugle_filter_catches_all(f, BUGLE_FALSE, stats_calltimes_post);
     bugle_filter_order("invoke", "stats_calltimes_post");
 
+    f = bugle_filter_new(handle, "stats_calltimes_swap");
+    bugle_glwin_filter_catches_swap_buffers(f, BUGLE_FALSE, stats_calltimes_swap_buffers);
+    bugle_filter_order("stats_calltimes_swap", "invoke");
+    bugle_filter_order("stats_calltimes_swap", "stats");
+
     /* Try to get this filter-set close to the calls */
     bugle_filter_order("stats_calls", "stats_calltimes_pre");
     bugle_filter_order("stats_basic", "stats_calltimes_pre");
     bugle_filter_order("stats_primitives", "stats_calltimes_pre");
 
     stats_calltimes_signals = BUGLE_NMALLOC(budgie_function_count(), stats_signal *);
+    stats_calltimes_functions = BUGLE_CALLOC(budgie_function_count(), stats_calltimes_function);
     for (i = 0; i < budgie_function_count(); i++)
     {
         char *name;
         name = bugle_asprintf("calltimes:%s", budgie_function_name(i));
         stats_calltimes_signals[i] = bugle_stats_signal_new(name, NULL, NULL);
         bugle_free(name);
+
+        for (j = 0; j < STATS_CALLTIMES_QUANTILES; j++)
+        {
+            name = bugle_asprintf("calltimes:%s:%s",
+                                  stats_calltimes_quantiles[j].name,
+                                  budgie_function_name(i));
+            stats_calltimes_functions[i].quantiles[j] =
+                bugle_stats_signal_new(name, &stats_calltimes_functions[i],
+                                       stats_calltimes_quantile_activate);
+            bugle_free(name);
+        }
     }
     stats_calltimes_total = bugle_stats_signal_new("calltimes:total", NULL, NULL);
 
@@ -92,16 +408,50 @@ static bugle_bool stats_calltimes_initialise(filter_set *handle)
                                       NULL,
                                       sizeof(bugle_timespec));
 
+    bugle_thread_lock_init(&stats_calltimes_lock);
+    bugle_thread_key_create(&stats_calltimes_shard_key, stats_calltimes_shard_release);
+    bugle_list_init(&stats_calltimes_shards, NULL);
+    stats_calltimes_retired.histograms = BUGLE_CALLOC(budgie_function_count(), stats_calltimes_histogram *);
     return BUGLE_TRUE;
 }
 
 static void stats_calltimes_shutdown(filter_set *handle)
 {
+    linked_list_node *i;
+    stats_calltimes_shard *shard;
+    budgie_function j;
+
+    bugle_thread_key_delete(stats_calltimes_shard_key);
+    bugle_thread_lock_lock(&stats_calltimes_lock);
+    if (stats_calltimes_dump)
+        stats_calltimes_dump_histograms();
+    for (i = bugle_list_head(&stats_calltimes_shards); i; i = bugle_list_next(i))
+    {
+        shard = (stats_calltimes_shard *) bugle_list_data(i);
+        stats_calltimes_shard_free(shard);
+        bugle_free(shard);
+    }
+    bugle_list_clear(&stats_calltimes_shards);
+    stats_calltimes_shard_free(&stats_calltimes_retired);
+    bugle_thread_lock_unlock(&stats_calltimes_lock);
+    bugle_thread_lock_destroy(&stats_calltimes_lock);
+
+    for (j = 0; j < budgie_function_count(); j++)
+        if (stats_calltimes_functions[j].previous)
+            bugle_free(stats_calltimes_functions[j].previous);
+    bugle_free(stats_calltimes_functions);
     bugle_free(stats_calltimes_signals);
 }
 
 void bugle_initialise_filter_library(void)
 {
+    static const filter_set_variable_info stats_calltimes_variables[] =
+    {
+        { "histograms", "record a histogram of times for each function [yes]", FILTER_SET_VARIABLE_BOOL, &stats_calltimes_histograms, NULL },
+        { "dump", "log the quantiles for each function at exit [yes]", FILTER_SET_VARIABLE_BOOL, &stats_calltimes_dump, NULL },
+        { NULL, NULL, 0, NULL, NULL }
+    };
+
     static const filter_set_info stats_calltimes_info =
     {
         "stats_calltimes",
@@ -109,7 +459,7 @@ void bugle_initialise_filter_library(void)
         stats_calltimes_shutdown,
         NULL,
         NULL,
-        NULL,
+        stats_calltimes_variables,
         "stats module: measure times of calls"
     };
 
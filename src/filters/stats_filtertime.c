@@ -0,0 +1,266 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Measures the time that each filter-set spends in its callbacks. Since
+ * the driver is only called by the invoke filter-set, its share is the
+ * time spent in the driver.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <bugle/bool.h>
+#include <bugle/memory.h>
+#include <bugle/string.h>
+#include <bugle/stats.h>
+#include <bugle/filters.h>
+#include <bugle/log.h>
+#include <bugle/linkedlist.h>
+#include <bugle/hashtable.h>
+#include "platform/threads.h"
+
+typedef struct
+{
+    const char *name;
+    size_t index;                   /* Into the per-thread totals */
+    stats_signal *time;
+    stats_signal *calls;
+} stats_filtertime_set;
+
+typedef struct
+{
+    unsigned long calls;
+    double time;
+} stats_filtertime_total;
+
+/* Totals for one thread, which only the owning thread writes. They are
+ * only needed for the summary at exit, since the signals keep their own
+ * per-thread accumulators.
+ */
+typedef struct
+{
+    stats_filtertime_total *totals;
+    linked_list_node *node;         /* In stats_filtertime_shards */
+} stats_filtertime_shard;
+
+static stats_filtertime_set *stats_filtertime_sets;
+static size_t stats_filtertime_count;
+static hashptr_table stats_filtertime_lookup;  /* filter_set * to stats_filtertime_set * */
+
+static bugle_bool stats_filtertime_dump = BUGLE_TRUE;
+
+static bugle_thread_lock_t stats_filtertime_lock;
+static bugle_thread_key_t stats_filtertime_shard_key;
+static linked_list stats_filtertime_shards;
+static stats_filtertime_total *stats_filtertime_retired;  /* From exited threads */
+
+static void stats_filtertime_accumulate(stats_filtertime_total *out, const stats_filtertime_total *in)
+{
+    size_t i;
+
+    for (i = 0; i < stats_filtertime_count; i++)
+    {
+        out[i].calls += in[i].calls;
+        out[i].time += in[i].time;
+    }
+}
+
+/* Thread destructor: folds the totals into stats_filtertime_retired */
+static void stats_filtertime_shard_release(void *data)
+{
+    stats_filtertime_shard *shard;
+
+    shard = (stats_filtertime_shard *) data;
+    bugle_thread_lock_lock(&stats_filtertime_lock);
+    stats_filtertime_accumulate(stats_filtertime_retired, shard->totals);
+    bugle_list_erase(&stats_filtertime_shards, shard->node);
+    bugle_thread_lock_unlock(&stats_filtertime_lock);
+
+    bugle_free(shard->totals);
+    bugle_free(shard);
+}
+
+static void stats_filtertime_profile(const filter *f, double elapsed)
+{
+    stats_filtertime_set *set;
+    stats_filtertime_shard *shard;
+
+    set = (stats_filtertime_set *) bugle_hashptr_get(&stats_filtertime_lookup, f->parent);
+    if (!set)
+        return;
+    bugle_stats_signal_add(set->time, elapsed);
+    bugle_stats_signal_add(set->calls, 1.0);
+
+    shard = (stats_filtertime_shard *) bugle_thread_getspecific(stats_filtertime_shard_key);
+    if (!shard)
+    {
+        shard = BUGLE_MALLOC(stats_filtertime_shard);
+        shard->totals = BUGLE_CALLOC(stats_filtertime_count, stats_filtertime_total);
+        bugle_thread_lock_lock(&stats_filtertime_lock);
+        shard->node = bugle_list_append(&stats_filtertime_shards, shard);
+        bugle_thread_lock_unlock(&stats_filtertime_lock);
+        bugle_thread_setspecific(stats_filtertime_shard_key, shard);
+    }
+    shard->totals[set->index].calls++;
+    shard->totals[set->index].time += elapsed;
+}
+
+static void stats_filtertime_count_set(filter_set *handle, void *arg)
+{
+    stats_filtertime_count++;
+}
+
+static void stats_filtertime_add_set(filter_set *handle, void *arg)
+{
+    size_t *next;
+    stats_filtertime_set *set;
+    char *name;
+
+    next = (size_t *) arg;
+    set = &stats_filtertime_sets[*next];
+    set->name = bugle_filter_set_get_name(handle);
+    set->index = *next;
+
+    name = bugle_asprintf("filtertime:%s", set->name);
+    set->time = bugle_stats_signal_new(name, NULL, NULL);
+    bugle_free(name);
+    name = bugle_asprintf("filtercalls:%s", set->name);
+    set->calls = bugle_stats_signal_new(name, NULL, NULL);
+    bugle_free(name);
+
+    bugle_hashptr_set(&stats_filtertime_lookup, handle, set);
+    ++*next;
+}
+
+static stats_filtertime_total *stats_filtertime_sort_totals;
+
+static int stats_filtertime_compare(const void *a, const void *b)
+{
+    double ta, tb;
+
+    ta = stats_filtertime_sort_totals[*(const size_t *) a].time;
+    tb = stats_filtertime_sort_totals[*(const size_t *) b].time;
+    return ta > tb ? -1 : ta < tb ? 1 : 0;
+}
+
+/* Logs the total time for each filter-set that ran, the slowest first.
+ * stats_filtertime_lock must be held.
+ */
+static void stats_filtertime_dump_totals(void)
+{
+    linked_list_node *i;
+    stats_filtertime_total *totals;
+    size_t *order;
+    size_t j;
+    double all = 0.0;
+
+    totals = BUGLE_CALLOC(stats_filtertime_count, stats_filtertime_total);
+    order = BUGLE_NMALLOC(stats_filtertime_count, size_t);
+    stats_filtertime_accumulate(totals, stats_filtertime_retired);
+    for (i = bugle_list_head(&stats_filtertime_shards); i; i = bugle_list_next(i))
+        stats_filtertime_accumulate(totals, ((stats_filtertime_shard *) bugle_list_data(i))->totals);
+    for (j = 0; j < stats_filtertime_count; j++)
+    {
+        order[j] = j;
+        all += totals[j].time;
+    }
+    stats_filtertime_sort_totals = totals;
+    qsort(order, stats_filtertime_count, sizeof(size_t), stats_filtertime_compare);
+
+    for (j = 0; j < stats_filtertime_count; j++)
+    {
+        const stats_filtertime_total *t = &totals[order[j]];
+        if (t->calls == 0)
+            continue;
+        bugle_log_printf("stats_filtertime", "summary", BUGLE_LOG_INFO,
+                         "%s: %lu calls, %.3f ms (%.1f%%), %.3f us per call",
+                         stats_filtertime_sets[order[j]].name, t->calls,
+                         1e3 * t->time, all > 0.0 ? 100.0 * t->time / all : 0.0,
+                         1e6 * t->time / t->calls);
+    }
+    bugle_free(order);
+    bugle_free(totals);
+}
+
+static bugle_bool stats_filtertime_initialise(filter_set *handle)
+{
+    size_t next = 0;
+
+    stats_filtertime_count = 0;
+    bugle_filter_set_foreach(stats_filtertime_count_set, NULL);
+    stats_filtertime_sets = BUGLE_NMALLOC(stats_filtertime_count, stats_filtertime_set);
+    bugle_hashptr_init(&stats_filtertime_lookup, NULL);
+    bugle_filter_set_foreach(stats_filtertime_add_set, &next);
+
+    bugle_thread_lock_init(&stats_filtertime_lock);
+    bugle_thread_key_create(&stats_filtertime_shard_key, stats_filtertime_shard_release);
+    bugle_list_init(&stats_filtertime_shards, NULL);
+    stats_filtertime_retired = BUGLE_CALLOC(stats_filtertime_count, stats_filtertime_total);
+
+    bugle_filters_set_profiler(stats_filtertime_profile);
+    return BUGLE_TRUE;
+}
+
+static void stats_filtertime_shutdown(filter_set *handle)
+{
+    linked_list_node *i;
+    stats_filtertime_shard *shard;
+
+    bugle_filters_set_profiler(NULL);
+    bugle_thread_key_delete(stats_filtertime_shard_key);
+    bugle_thread_lock_lock(&stats_filtertime_lock);
+    if (stats_filtertime_dump)
+        stats_filtertime_dump_totals();
+    for (i = bugle_list_head(&stats_filtertime_shards); i; i = bugle_list_next(i))
+    {
+        shard = (stats_filtertime_shard *) bugle_list_data(i);
+        bugle_free(shard->totals);
+        bugle_free(shard);
+    }
+    bugle_list_clear(&stats_filtertime_shards);
+    bugle_thread_lock_unlock(&stats_filtertime_lock);
+    bugle_thread_lock_destroy(&stats_filtertime_lock);
+
+    bugle_free(stats_filtertime_retired);
+    bugle_hashptr_clear(&stats_filtertime_lookup);
+    bugle_free(stats_filtertime_sets);
+}
+
+void bugle_initialise_filter_library(void)
+{
+    static const filter_set_variable_info stats_filtertime_variables[] =
+    {
+        { "dump", "log the time taken by each filter-set at exit [yes]", FILTER_SET_VARIABLE_BOOL, &stats_filtertime_dump, NULL },
+        { NULL, NULL, 0, NULL, NULL }
+    };
+
+    static const filter_set_info stats_filtertime_info =
+    {
+        "stats_filtertime",
+        stats_filtertime_initialise,
+        stats_filtertime_shutdown,
+        NULL,
+        NULL,
+        stats_filtertime_variables,
+        "stats module: measure the time taken by each filter-set"
+    };
+
+    bugle_filter_set_new(&stats_filtertime_info);
+    bugle_filter_set_stats_generator("stats_filtertime");
+}
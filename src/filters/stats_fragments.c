@@ -19,6 +19,7 @@
 # include <config.h>
 #endif
 #include <bugle/bool.h>
+#include <bugle/memory.h>
 #include <bugle/gl/glheaders.h>
 #include <bugle/glwin/glwin.h>
 #include <bugle/glwin/trackcontext.h>
@@ -30,13 +31,23 @@
 #include <bugle/log.h>
 #include <budgie/addresses.h>
 
+/* Reading a query result straight after the query ends would stall until
+ * the GPU finishes the frame, so each context has a ring of queries, one
+ * per frame. Results are collected once they are available, which is
+ * normally a frame or two later. If the GPU falls so far behind that the
+ * ring is full, the oldest result is waited for.
+ */
 typedef struct
 {
-    GLuint query;
+    GLuint *queries;
+    unsigned int depth;             /* Size of the ring, or 0 if not counting */
+    unsigned int oldest;            /* Oldest query awaiting its result */
+    unsigned int pending;           /* Queries awaiting results */
 } stats_fragments_struct;
 
-static stats_signal *stats_fragments_fragments;
+static stats_signal *stats_fragments_fragments, *stats_fragments_frames;
 static object_view stats_fragments_view;
+static long stats_fragments_depth = 3;
 
 static void stats_fragments_struct_init(const void *key, void *data)
 {
@@ -47,26 +58,63 @@ static void stats_fragments_struct_init(const void *key, void *data)
         && BUGLE_GL_HAS_EXTENSION(GL_ARB_occlusion_query)
         && bugle_gl_begin_internal_render())
     {
-        CALL(glGenQueriesARB)(1, &s->query);
-        if (s->query)
-            CALL(glBeginQueryARB)(GL_SAMPLES_PASSED_ARB, s->query);
+        s->queries = BUGLE_CALLOC(stats_fragments_depth, GLuint);
+        CALL(glGenQueriesARB)(stats_fragments_depth, s->queries);
+        if (s->queries[0])
+        {
+            s->depth = stats_fragments_depth;
+            CALL(glBeginQueryARB)(GL_SAMPLES_PASSED_ARB, s->queries[0]);
+        }
         bugle_gl_end_internal_render("stats_fragments_struct_initialise", BUGLE_TRUE);
     }
 }
 
+static void stats_fragments_struct_destroy(void *data)
+{
+    stats_fragments_struct *s;
+
+    /* The query objects are destroyed along with the context */
+    s = (stats_fragments_struct *) data;
+    if (s->queries)
+        bugle_free(s->queries);
+}
+
+/* Collects results for completed frames, oldest first. If wait is true,
+ * the oldest result is collected even if it means stalling.
+ */
+static void stats_fragments_harvest(stats_fragments_struct *s, bugle_bool wait)
+{
+    GLuint available, fragments;
+
+    while (s->pending > 0)
+    {
+        if (!wait)
+        {
+            CALL(glGetQueryObjectuivARB)(s->queries[s->oldest], GL_QUERY_RESULT_AVAILABLE_ARB, &available);
+            if (!available)
+                break;
+        }
+        CALL(glGetQueryObjectuivARB)(s->queries[s->oldest], GL_QUERY_RESULT_ARB, &fragments);
+        bugle_stats_signal_add(stats_fragments_fragments, fragments);
+        bugle_stats_signal_add(stats_fragments_frames, 1.0);
+        s->oldest = (s->oldest + 1) % s->depth;
+        s->pending--;
+        wait = BUGLE_FALSE;
+    }
+}
+
 static bugle_bool stats_fragments_swap_buffers(function_call *call, const callback_data *data)
 {
     stats_fragments_struct *s;
-    GLuint fragments;
 
     s = bugle_object_get_current_data(bugle_get_context_class(), stats_fragments_view);
     if (stats_fragments_fragments->active
-        && s && s->query && bugle_gl_begin_internal_render())
+        && s && s->depth && bugle_gl_begin_internal_render())
     {
         CALL(glEndQueryARB)(GL_SAMPLES_PASSED_ARB);
-        CALL(glGetQueryObjectuivARB)(s->query, GL_QUERY_RESULT_ARB, &fragments);
+        s->pending++;
+        stats_fragments_harvest(s, BUGLE_FALSE);
         bugle_gl_end_internal_render("stats_fragments_swap_buffers", BUGLE_TRUE);
-        bugle_stats_signal_add(stats_fragments_fragments, fragments);
     }
     return BUGLE_TRUE;
 }
@@ -77,9 +125,15 @@ static bugle_bool stats_fragments_post_swap_buffers(function_call *call, const c
 
     s = bugle_object_get_current_data(bugle_get_context_class(), stats_fragments_view);
     if (stats_fragments_fragments->active
-        && s && s->query && bugle_gl_begin_internal_render())
+        && s && s->depth && bugle_gl_begin_internal_render())
     {
-        CALL(glBeginQueryARB)(GL_SAMPLES_PASSED_ARB, s->query);
+        /* The query for the next frame can only be reused once its
+         * previous result has been read.
+         */
+        if (s->pending == s->depth)
+            stats_fragments_harvest(s, BUGLE_TRUE);
+        CALL(glBeginQueryARB)(GL_SAMPLES_PASSED_ARB,
+                              s->queries[(s->oldest + s->pending) % s->depth]);
         bugle_gl_end_internal_render("stats_fragments_post_swap_buffers", BUGLE_TRUE);
     }
     return BUGLE_TRUE;
@@ -91,13 +145,14 @@ static bugle_bool stats_fragments_query(function_call *call, const callback_data
 
     s = bugle_object_get_current_data(bugle_get_context_class(), stats_fragments_view);
     if (stats_fragments_fragments->active
-        && s->query)
+        && s && s->depth)
     {
         bugle_log_printf("stats_fragments", "query", BUGLE_LOG_NOTICE,
                          "Application is using occlusion queries; disabling fragment counting");
         CALL(glEndQueryARB)(GL_SAMPLES_PASSED_ARB);
-        CALL(glDeleteQueriesARB)(1, &s->query);
-        s->query = 0;
+        CALL(glDeleteQueriesARB)(s->depth, s->queries);
+        s->depth = 0;
+        s->pending = 0;
         stats_fragments_fragments->active = BUGLE_FALSE;
     }
     return BUGLE_TRUE;
@@ -109,7 +164,7 @@ static bugle_bool stats_fragments_initialise(filter_set *handle)
 
     stats_fragments_view = bugle_object_view_new(bugle_get_context_class(),
                                                  stats_fragments_struct_init,
-                                                 NULL,
+                                                 stats_fragments_struct_destroy,
                                                  sizeof(stats_fragments_struct));
 
     f = bugle_filter_new(handle, "stats_fragments");
@@ -124,11 +179,18 @@ static bugle_bool stats_fragments_initialise(filter_set *handle)
     bugle_filter_order("invoke", "stats_fragments_post");
 
     stats_fragments_fragments = bugle_stats_signal_new("fragments", NULL, NULL);
+    stats_fragments_frames = bugle_stats_signal_new("fragments:frames", NULL, NULL);
     return BUGLE_TRUE;
 }
 
 void bugle_initialise_filter_library(void)
 {
+    static const filter_set_variable_info stats_fragments_variables[] =
+    {
+        { "depth", "number of frames of queries in flight (set higher for less stalling) [3]", FILTER_SET_VARIABLE_POSITIVE_INT, &stats_fragments_depth, NULL },
+        { NULL, NULL, 0, NULL, NULL }
+    };
+
     static const filter_set_info stats_fragments_info =
     {
         "stats_fragments",
@@ -136,7 +198,7 @@ void bugle_initialise_filter_library(void)
         NULL,
         NULL,
         NULL,
-        NULL,
+        stats_fragments_variables,
         "stats module: fragments that pass the depth test"
     };
 
@@ -0,0 +1,432 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <string.h>
+#include <bugle/bool.h>
+#include <bugle/memory.h>
+#include <bugle/gl/glheaders.h>
+#include <bugle/glwin/glwin.h>
+#include <bugle/glwin/trackcontext.h>
+#include <bugle/gl/glutils.h>
+#include <bugle/gl/glsl.h>
+#include <bugle/gl/glfbo.h>
+#include <bugle/gl/glbeginend.h>
+#include <bugle/gl/gldisplaylist.h>
+#include <bugle/gl/glextensions.h>
+#include <bugle/stats.h>
+#include <bugle/filters.h>
+#include <bugle/objects.h>
+#include <bugle/log.h>
+#include <budgie/addresses.h>
+#include <budgie/reflect.h>
+#include "platform/types.h"
+
+/* Each draw call is bracketed by a GL_TIME_ELAPSED query. Reading a result
+ * straight away would stall until the GPU catches up, so the queries are
+ * kept in a FIFO and their results are collected at each buffer swap once
+ * they are available. Queries whose results have been read are returned to
+ * a pool and reused, so after the first few frames no query objects are
+ * created. A frame is reported once the results for all of its draws have
+ * been read.
+ *
+ * To keep the cost per draw down, glGetError is not used around the query.
+ * Instead glBeginQuery is only called when the tracked state says it will
+ * succeed: timer queries are supported, the query object is one of ours
+ * and has no query active on it, and neither the application nor this
+ * filter-set has a GL_TIME_ELAPSED query active.
+ */
+typedef struct
+{
+    GLuint query;
+    unsigned long frame;            /* Frame in which the draw was issued */
+    unsigned long draw;             /* Index of the draw within its frame */
+    budgie_function function;
+    GLuint program;
+    GLuint framebuffer;
+} stats_gputime_record;
+
+typedef struct
+{
+    stats_gputime_record record;
+    bugle_uint64_t elapsed;         /* Nanoseconds */
+} stats_gputime_top;
+
+typedef struct
+{
+    bugle_bool supported;           /* Timer queries are available */
+    bugle_bool app_timing;          /* Application successfully began a GL_TIME_ELAPSED query */
+    bugle_bool timing;              /* A query is active around the current draw */
+
+    /* Current program and draw framebuffer, which are only queried again
+     * after a call that may have changed them.
+     */
+    bugle_bool bindings_stale;
+    GLuint program;
+    GLuint framebuffer;
+
+    GLuint *pool;                   /* Query objects not in use */
+    size_t pool_size, pool_alloc;
+
+    stats_gputime_record *records;  /* Ring of queries awaiting results */
+    size_t records_head, records_size, records_alloc;
+
+    unsigned long frame;            /* Frame being issued */
+    unsigned long draw;             /* Draws issued so far in this frame */
+
+    unsigned long harvest_frame;    /* Oldest frame not yet reported */
+    bugle_uint64_t harvest_total;   /* Nanoseconds read so far for harvest_frame */
+    unsigned long harvest_draws;
+    stats_gputime_top *top;         /* Most expensive draws, most expensive first */
+    size_t top_size;
+} stats_gputime_struct;
+
+static stats_signal *stats_gputime_time, *stats_gputime_frames, *stats_gputime_draws;
+static object_view stats_gputime_view;
+static long stats_gputime_depth = 3;
+static long stats_gputime_top_count = 5;
+
+/* Functions that may change the current program or draw framebuffer */
+static const char * const stats_gputime_binding_functions[] =
+{
+    "glUseProgram",
+    "glUseProgramObjectARB",
+    "glBindFramebuffer",
+    "glBindFramebufferEXT",
+    "glDeleteFramebuffers",
+    "glDeleteFramebuffersEXT",
+    "glCallList",
+    "glCallLists",
+    NULL
+};
+
+static void stats_gputime_struct_init(const void *key, void *data)
+{
+    stats_gputime_struct *s;
+
+    s = (stats_gputime_struct *) data;
+    s->supported = BUGLE_GL_HAS_EXTENSION_GROUP(GL_ARB_timer_query);
+    s->bindings_stale = BUGLE_TRUE;
+    if (s->supported && stats_gputime_top_count > 0)
+        s->top = BUGLE_NMALLOC(stats_gputime_top_count, stats_gputime_top);
+}
+
+static void stats_gputime_struct_destroy(void *data)
+{
+    stats_gputime_struct *s;
+
+    /* The query objects are destroyed along with the context */
+    s = (stats_gputime_struct *) data;
+    bugle_free(s->pool);
+    bugle_free(s->records);
+    bugle_free(s->top);
+}
+
+static void stats_gputime_push(stats_gputime_struct *s, const stats_gputime_record *r)
+{
+    if (s->records_size == s->records_alloc)
+    {
+        size_t old_alloc, tail;
+
+        /* Grow the ring, and move the wrapped part up to keep it contiguous */
+        old_alloc = s->records_alloc;
+        s->records_alloc = old_alloc ? old_alloc * 2 : 64;
+        s->records = BUGLE_NREALLOC(s->records, s->records_alloc, stats_gputime_record);
+        tail = s->records_head + s->records_size - old_alloc;
+        if (s->records_head > 0)
+            memcpy(s->records + old_alloc, s->records, tail * sizeof(stats_gputime_record));
+    }
+    s->records[(s->records_head + s->records_size) % s->records_alloc] = *r;
+    s->records_size++;
+}
+
+static void stats_gputime_release(stats_gputime_struct *s, GLuint query)
+{
+    if (s->pool_size == s->pool_alloc)
+    {
+        s->pool_alloc = s->pool_alloc ? s->pool_alloc * 2 : 64;
+        s->pool = BUGLE_NREALLOC(s->pool, s->pool_alloc, GLuint);
+    }
+    s->pool[s->pool_size++] = query;
+}
+
+static void stats_gputime_rank(stats_gputime_struct *s, const stats_gputime_record *r,
+                               bugle_uint64_t elapsed)
+{
+    size_t i;
+
+    if (!s->top) return;
+    if (s->top_size == (size_t) stats_gputime_top_count)
+    {
+        if (elapsed <= s->top[s->top_size - 1].elapsed)
+            return;
+        s->top_size--;
+    }
+    for (i = s->top_size; i > 0 && s->top[i - 1].elapsed < elapsed; i--)
+        s->top[i] = s->top[i - 1];
+    s->top[i].record = *r;
+    s->top[i].elapsed = elapsed;
+    s->top_size++;
+}
+
+/* Reports the oldest unreported frame and starts on the next one */
+static void stats_gputime_finish_frame(stats_gputime_struct *s)
+{
+    size_t i;
+
+    bugle_stats_signal_add(stats_gputime_time, s->harvest_total * 1e-9);
+    bugle_stats_signal_add(stats_gputime_frames, 1.0);
+    bugle_stats_signal_add(stats_gputime_draws, s->harvest_draws);
+    if (s->top_size > 0)
+    {
+        bugle_log_printf("stats_gputime", "frame", BUGLE_LOG_INFO,
+                         "frame %lu: %.3f ms GPU in %lu draws",
+                         s->harvest_frame, s->harvest_total * 1e-6, s->harvest_draws);
+        for (i = 0; i < s->top_size; i++)
+        {
+            const stats_gputime_top *t = &s->top[i];
+            bugle_log_printf("stats_gputime", "frame", BUGLE_LOG_INFO,
+                             "  %.3f ms: draw %lu (%s), program %u, framebuffer %u",
+                             t->elapsed * 1e-6, t->record.draw,
+                             budgie_function_name(t->record.function),
+                             (unsigned int) t->record.program,
+                             (unsigned int) t->record.framebuffer);
+        }
+    }
+    s->harvest_frame++;
+    s->harvest_total = 0;
+    s->harvest_draws = 0;
+    s->top_size = 0;
+}
+
+/* Collects the results that are available, oldest first, and reports any
+ * frames that are complete. Results for frames before wait_frame are
+ * collected even if it means stalling.
+ */
+static void stats_gputime_harvest(stats_gputime_struct *s, unsigned long wait_frame)
+{
+    GLuint available;
+    GLuint64 elapsed;
+    stats_gputime_record *r;
+
+    while (s->records_size > 0)
+    {
+        r = &s->records[s->records_head];
+        if (r->frame >= wait_frame)
+        {
+            CALL(glGetQueryObjectuiv)(r->query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+        }
+        CALL(glGetQueryObjectui64v)(r->query, GL_QUERY_RESULT, &elapsed);
+
+        while (s->harvest_frame < r->frame)
+            stats_gputime_finish_frame(s);
+        s->harvest_total += elapsed;
+        s->harvest_draws++;
+        stats_gputime_rank(s, r, elapsed);
+
+        stats_gputime_release(s, r->query);
+        s->records_head = (s->records_head + 1) % s->records_alloc;
+        s->records_size--;
+    }
+
+    /* Frames with nothing left outstanding */
+    while (s->harvest_frame < s->frame
+           && (s->records_size == 0 || s->harvest_frame < s->records[s->records_head].frame))
+        stats_gputime_finish_frame(s);
+}
+
+static bugle_bool stats_gputime_draw(function_call *call, const callback_data *data)
+{
+    stats_gputime_struct *s;
+    GLuint query;
+
+    s = bugle_object_get_current_data(bugle_get_context_class(), stats_gputime_view);
+    /* Immediate mode vertices cannot be timed individually, queries cannot
+     * be nested, and queries issued while compiling a display list would
+     * end up in the list.
+     */
+    if (!s || !s->supported || s->app_timing
+        || bugle_gl_call_is_immediate(call)
+        || bugle_gl_in_begin_end()
+        || bugle_displaylist_mode() != GL_NONE)
+        return BUGLE_TRUE;
+
+    if (s->bindings_stale)
+    {
+        s->program = BUGLE_GL_HAS_EXTENSION_GROUP(GL_ARB_shader_objects)
+            ? bugle_gl_get_current_program() : 0;
+        s->framebuffer = BUGLE_GL_HAS_EXTENSION_GROUP(GL_EXT_framebuffer_object)
+            ? bugle_gl_get_draw_framebuffer_binding() : 0;
+        s->bindings_stale = BUGLE_FALSE;
+    }
+
+    if (s->pool_size > 0)
+        query = s->pool[--s->pool_size];
+    else
+    {
+        query = 0;
+        CALL(glGenQueries)(1, &query);
+    }
+
+    if (!query)
+        return BUGLE_TRUE;
+    CALL(glBeginQuery)(GL_TIME_ELAPSED, query);
+    s->timing = BUGLE_TRUE;
+    {
+        stats_gputime_record r;
+
+        r.query = query;
+        r.frame = s->frame;
+        r.draw = s->draw;
+        r.function = call->generic.id;
+        r.program = s->program;
+        r.framebuffer = s->framebuffer;
+        stats_gputime_push(s, &r);
+    }
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_gputime_bindings(function_call *call, const callback_data *data)
+{
+    stats_gputime_struct *s;
+
+    s = bugle_object_get_current_data(bugle_get_context_class(), stats_gputime_view);
+    if (s)
+        s->bindings_stale = BUGLE_TRUE;
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_gputime_post_draw(function_call *call, const callback_data *data)
+{
+    stats_gputime_struct *s;
+
+    s = bugle_object_get_current_data(bugle_get_context_class(), stats_gputime_view);
+    if (s && s->timing)
+    {
+        CALL(glEndQuery)(GL_TIME_ELAPSED);
+        s->timing = BUGLE_FALSE;
+    }
+    if (s && !bugle_gl_call_is_immediate(call))
+        s->draw++;
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_gputime_glBeginQuery(function_call *call, const callback_data *data)
+{
+    stats_gputime_struct *s;
+
+    /* A failed call (such as one inside glBegin/glEnd) leaves the state as it was */
+    s = bugle_object_get_current_data(bugle_get_context_class(), stats_gputime_view);
+    if (s && *call->glBeginQuery.arg0 == GL_TIME_ELAPSED
+        && bugle_gl_call_get_error(data->call_object) == GL_NO_ERROR)
+        s->app_timing = BUGLE_TRUE;
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_gputime_glEndQuery(function_call *call, const callback_data *data)
+{
+    stats_gputime_struct *s;
+
+    s = bugle_object_get_current_data(bugle_get_context_class(), stats_gputime_view);
+    if (s && *call->glEndQuery.arg0 == GL_TIME_ELAPSED
+        && bugle_gl_call_get_error(data->call_object) == GL_NO_ERROR)
+        s->app_timing = BUGLE_FALSE;
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_gputime_swap_buffers(function_call *call, const callback_data *data)
+{
+    stats_gputime_struct *s;
+
+    s = bugle_object_get_current_data(bugle_get_context_class(), stats_gputime_view);
+    if (s && s->supported && bugle_gl_begin_internal_render())
+    {
+        s->frame++;
+        s->draw = 0;
+        /* Only stall once more than depth frames are waiting */
+        stats_gputime_harvest(s, s->frame > (unsigned long) stats_gputime_depth
+                              ? s->frame - stats_gputime_depth : 0);
+        bugle_gl_end_internal_render("stats_gputime_swap_buffers", BUGLE_TRUE);
+    }
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_gputime_initialise(filter_set *handle)
+{
+    filter *f;
+    int i;
+
+    stats_gputime_view = bugle_object_view_new(bugle_get_context_class(),
+                                               stats_gputime_struct_init,
+                                               stats_gputime_struct_destroy,
+                                               sizeof(stats_gputime_struct));
+
+    f = bugle_filter_new(handle, "stats_gputime");
+    bugle_gl_filter_catches_drawing(f, BUGLE_FALSE, stats_gputime_draw);
+    for (i = 0; stats_gputime_binding_functions[i]; i++)
+        if (budgie_function_id(stats_gputime_binding_functions[i]) != NULL_FUNCTION)
+            bugle_filter_catches(f, stats_gputime_binding_functions[i], BUGLE_FALSE, stats_gputime_bindings);
+    bugle_glwin_filter_catches_swap_buffers(f, BUGLE_FALSE, stats_gputime_swap_buffers);
+    bugle_filter_order("stats_gputime", "invoke");
+    bugle_filter_order("stats_gputime", "stats");
+
+    f = bugle_filter_new(handle, "stats_gputime_post");
+    bugle_gl_filter_catches_drawing(f, BUGLE_FALSE, stats_gputime_post_draw);
+    bugle_filter_catches(f, "glBeginQuery", BUGLE_FALSE, stats_gputime_glBeginQuery);
+    bugle_filter_catches(f, "glEndQuery", BUGLE_FALSE, stats_gputime_glEndQuery);
+    bugle_filter_order("invoke", "stats_gputime_post");
+    bugle_gl_filter_post_renders("stats_gputime_post");
+    bugle_gl_filter_set_queries_error("stats_gputime");
+
+    stats_gputime_time = bugle_stats_signal_new("gputime", NULL, NULL);
+    stats_gputime_frames = bugle_stats_signal_new("gputime:frames", NULL, NULL);
+    stats_gputime_draws = bugle_stats_signal_new("gputime:draws", NULL, NULL);
+    return BUGLE_TRUE;
+}
+
+void bugle_initialise_filter_library(void)
+{
+    static const filter_set_variable_info stats_gputime_variables[] =
+    {
+        { "depth", "number of frames of queries in flight (set higher for less stalling) [3]", FILTER_SET_VARIABLE_POSITIVE_INT, &stats_gputime_depth, NULL },
+        { "top", "number of most expensive draws to log for each frame [5]", FILTER_SET_VARIABLE_UINT, &stats_gputime_top_count, NULL },
+        { NULL, NULL, 0, NULL, NULL }
+    };
+
+    static const filter_set_info stats_gputime_info =
+    {
+        "stats_gputime",
+        stats_gputime_initialise,
+        NULL,
+        NULL,
+        NULL,
+        stats_gputime_variables,
+        "stats module: GPU time spent on each draw call"
+    };
+
+    bugle_filter_set_new(&stats_gputime_info);
+    bugle_filter_set_depends("stats_gputime", "stats_basic");
+    bugle_filter_set_depends("stats_gputime", "glextensions");
+    bugle_filter_set_depends("stats_gputime", "gldisplaylist");
+    bugle_filter_set_depends("stats_gputime", "error");
+    bugle_gl_filter_set_renders("stats_gputime");
+    bugle_filter_set_stats_generator("stats_gputime");
+}
@@ -0,0 +1,68 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <bugle/bool.h>
+#include <bugle/log.h>
+#include <bugle/stats.h>
+#include <bugle/filters.h>
+#include <bugle/glwin/glwin.h>
+
+static stats_signal *stats_log_repeated, *stats_log_ratelimited;
+
+static bugle_bool stats_log_swap_buffers(function_call *call, const callback_data *data)
+{
+    unsigned long repeated, limited;
+
+    bugle_log_get_suppressed(&repeated, &limited);
+    bugle_stats_signal_update(stats_log_repeated, repeated);
+    bugle_stats_signal_update(stats_log_ratelimited, limited);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_log_initialise(filter_set *handle)
+{
+    filter *f;
+
+    f = bugle_filter_new(handle, "stats_log_swap");
+    bugle_glwin_filter_catches_swap_buffers(f, BUGLE_FALSE, stats_log_swap_buffers);
+    bugle_filter_order("stats_log_swap", "invoke");
+    bugle_filter_order("stats_log_swap", "stats");
+
+    stats_log_repeated = bugle_stats_signal_new("log:repeated", NULL, NULL);
+    stats_log_ratelimited = bugle_stats_signal_new("log:ratelimited", NULL, NULL);
+    return BUGLE_TRUE;
+}
+
+void bugle_initialise_filter_library(void)
+{
+    static const filter_set_info stats_log_info =
+    {
+        "stats_log",
+        stats_log_initialise,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        "stats module: suppressed log messages"
+    };
+
+    bugle_filter_set_new(&stats_log_info);
+    bugle_filter_set_stats_generator("stats_log");
+}
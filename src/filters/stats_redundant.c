@@ -0,0 +1,274 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Counts state changes that set the state to its current value. A call
+ * site is identified by the function and the index of the call within the
+ * frame, which is stable from frame to frame for most renderers, and the
+ * sites that are most often redundant are logged at exit.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <bugle/bool.h>
+#include <bugle/memory.h>
+#include <bugle/string.h>
+#include <bugle/stats.h>
+#include <bugle/filters.h>
+#include <bugle/objects.h>
+#include <bugle/log.h>
+#include <bugle/hashtable.h>
+#include <bugle/glwin/glwin.h>
+#include <bugle/glwin/trackcontext.h>
+#include <bugle/gl/glshadow.h>
+#include <budgie/reflect.h>
+#include "platform/threads.h"
+
+typedef struct
+{
+    unsigned long frame;
+    unsigned long call;             /* Index of the next call in the frame */
+} stats_redundant_position;
+
+typedef struct
+{
+    budgie_function function;
+    unsigned long call;
+    unsigned long count;
+    unsigned long first_frame, last_frame;
+} stats_redundant_site;
+
+static stats_signal **stats_redundant_signals;
+static stats_signal **stats_effective_signals;
+static stats_signal *stats_redundant_total, *stats_effective_total;
+static object_view stats_redundant_view;
+
+static long stats_redundant_top = 10;
+
+static bugle_thread_lock_t stats_redundant_lock;
+static hashptr_table stats_redundant_sites;   /* function to hashptr_table of sites by call */
+
+static void stats_redundant_record(budgie_function function, const stats_redundant_position *pos)
+{
+    hashptr_table *calls;
+    stats_redundant_site *site;
+    unsigned long call;
+
+    call = pos->call - 1;
+    bugle_thread_lock_lock(&stats_redundant_lock);
+    calls = (hashptr_table *) bugle_hashptr_get(&stats_redundant_sites, (void *) (size_t) (function + 1));
+    if (!calls)
+    {
+        calls = BUGLE_MALLOC(hashptr_table);
+        bugle_hashptr_init(calls, bugle_free);
+        bugle_hashptr_set(&stats_redundant_sites, (void *) (size_t) (function + 1), calls);
+    }
+    site = (stats_redundant_site *) bugle_hashptr_get(calls, (void *) (size_t) (call + 1));
+    if (!site)
+    {
+        site = BUGLE_ZALLOC(stats_redundant_site);
+        site->function = function;
+        site->call = call;
+        site->first_frame = pos->frame;
+        bugle_hashptr_set(calls, (void *) (size_t) (call + 1), site);
+    }
+    site->count++;
+    site->last_frame = pos->frame;
+    bugle_thread_lock_unlock(&stats_redundant_lock);
+}
+
+static bugle_bool stats_redundant_callback(function_call *call, const callback_data *data)
+{
+    stats_redundant_position *pos;
+
+    pos = (stats_redundant_position *) bugle_object_get_current_data(bugle_get_context_class(), stats_redundant_view);
+    if (pos)
+        pos->call++;
+
+    switch (bugle_glshadow_classify(call))
+    {
+    case BUGLE_GLSHADOW_REDUNDANT:
+        bugle_stats_signal_add(stats_redundant_signals[call->generic.id], 1.0);
+        bugle_stats_signal_add(stats_redundant_total, 1.0);
+        if (pos && stats_redundant_top > 0)
+            stats_redundant_record(call->generic.id, pos);
+        break;
+    case BUGLE_GLSHADOW_EFFECTIVE:
+        bugle_stats_signal_add(stats_effective_signals[call->generic.id], 1.0);
+        bugle_stats_signal_add(stats_effective_total, 1.0);
+        break;
+    case BUGLE_GLSHADOW_UNTRACKED:
+        break;
+    }
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_redundant_swap_buffers(function_call *call, const callback_data *data)
+{
+    stats_redundant_position *pos;
+
+    pos = (stats_redundant_position *) bugle_object_get_current_data(bugle_get_context_class(), stats_redundant_view);
+    if (pos)
+    {
+        pos->frame++;
+        pos->call = 0;
+    }
+    return BUGLE_TRUE;
+}
+
+static int stats_redundant_compare(const void *a, const void *b)
+{
+    const stats_redundant_site *sa, *sb;
+
+    sa = *(const stats_redundant_site * const *) a;
+    sb = *(const stats_redundant_site * const *) b;
+    if (sa->count != sb->count)
+        return sa->count > sb->count ? -1 : 1;
+    else if (sa->function != sb->function)
+        return sa->function < sb->function ? -1 : 1;
+    else
+        return sa->call < sb->call ? -1 : sa->call > sb->call;
+}
+
+/* Logs the sites that were most often redundant.
+ * stats_redundant_lock must be held.
+ */
+static void stats_redundant_dump_sites(void)
+{
+    const hashptr_table_entry *i, *j;
+    hashptr_table *calls;
+    stats_redundant_site **sites;
+    size_t count = 0, k;
+
+    for (i = bugle_hashptr_begin(&stats_redundant_sites); i; i = bugle_hashptr_next(&stats_redundant_sites, i))
+        count += ((hashptr_table *) i->value)->count;
+    if (count == 0)
+        return;
+
+    sites = BUGLE_NMALLOC(count, stats_redundant_site *);
+    k = 0;
+    for (i = bugle_hashptr_begin(&stats_redundant_sites); i; i = bugle_hashptr_next(&stats_redundant_sites, i))
+    {
+        calls = (hashptr_table *) i->value;
+        for (j = bugle_hashptr_begin(calls); j; j = bugle_hashptr_next(calls, j))
+            sites[k++] = (stats_redundant_site *) j->value;
+    }
+    qsort(sites, count, sizeof(stats_redundant_site *), stats_redundant_compare);
+
+    for (k = 0; k < count && k < (size_t) stats_redundant_top; k++)
+        bugle_log_printf("stats_redundant", "sites", BUGLE_LOG_INFO,
+                         "%s at call %lu of the frame: redundant %lu times (frames %lu to %lu)",
+                         budgie_function_name(sites[k]->function), sites[k]->call,
+                         sites[k]->count, sites[k]->first_frame, sites[k]->last_frame);
+    bugle_free(sites);
+}
+
+static void stats_redundant_calls_free(void *data)
+{
+    bugle_hashptr_clear((hashptr_table *) data);
+    bugle_free(data);
+}
+
+static bugle_bool stats_redundant_initialise(filter_set *handle)
+{
+    filter *f;
+    budgie_function i;
+
+    f = bugle_filter_new(handle, "stats_redundant");
+    if (stats_redundant_top > 0)
+    {
+        /* Needed to number the calls */
+        bugle_filter_catches_all(f, BUGLE_FALSE, stats_redundant_callback);
+    }
+    else
+    {
+        for (i = 0; i < budgie_function_count(); i++)
+            if (bugle_glshadow_tracks(i))
+                bugle_filter_catches_function_id(f, i, BUGLE_FALSE, stats_redundant_callback);
+    }
+    bugle_filter_order("stats_redundant", "invoke");
+    bugle_filter_order("stats_redundant", "stats");
+
+    f = bugle_filter_new(handle, "stats_redundant_swap");
+    bugle_glwin_filter_catches_swap_buffers(f, BUGLE_FALSE, stats_redundant_swap_buffers);
+    bugle_filter_order("stats_redundant_swap", "invoke");
+    bugle_filter_order("stats_redundant_swap", "stats");
+
+    stats_redundant_signals = BUGLE_CALLOC(budgie_function_count(), stats_signal *);
+    stats_effective_signals = BUGLE_CALLOC(budgie_function_count(), stats_signal *);
+    for (i = 0; i < budgie_function_count(); i++)
+        if (bugle_glshadow_tracks(i))
+        {
+            char *name;
+            name = bugle_asprintf("redundant:%s", budgie_function_name(i));
+            stats_redundant_signals[i] = bugle_stats_signal_new(name, NULL, NULL);
+            bugle_free(name);
+            name = bugle_asprintf("effective:%s", budgie_function_name(i));
+            stats_effective_signals[i] = bugle_stats_signal_new(name, NULL, NULL);
+            bugle_free(name);
+        }
+    stats_redundant_total = bugle_stats_signal_new("redundant:total", NULL, NULL);
+    stats_effective_total = bugle_stats_signal_new("effective:total", NULL, NULL);
+
+    stats_redundant_view = bugle_object_view_new(bugle_get_context_class(),
+                                                 NULL,
+                                                 NULL,
+                                                 sizeof(stats_redundant_position));
+    bugle_thread_lock_init(&stats_redundant_lock);
+    bugle_hashptr_init(&stats_redundant_sites, stats_redundant_calls_free);
+    return BUGLE_TRUE;
+}
+
+static void stats_redundant_shutdown(filter_set *handle)
+{
+    bugle_thread_lock_lock(&stats_redundant_lock);
+    if (stats_redundant_top > 0)
+        stats_redundant_dump_sites();
+    bugle_hashptr_clear(&stats_redundant_sites);
+    bugle_thread_lock_unlock(&stats_redundant_lock);
+    bugle_thread_lock_destroy(&stats_redundant_lock);
+
+    bugle_free(stats_redundant_signals);
+    bugle_free(stats_effective_signals);
+}
+
+void bugle_initialise_filter_library(void)
+{
+    static const filter_set_variable_info stats_redundant_variables[] =
+    {
+        { "top", "number of call sites to log at exit [10]", FILTER_SET_VARIABLE_UINT, &stats_redundant_top, NULL },
+        { NULL, NULL, 0, NULL, NULL }
+    };
+
+    static const filter_set_info stats_redundant_info =
+    {
+        "stats_redundant",
+        stats_redundant_initialise,
+        stats_redundant_shutdown,
+        NULL,
+        NULL,
+        stats_redundant_variables,
+        "stats module: count redundant state changes"
+    };
+
+    bugle_filter_set_new(&stats_redundant_info);
+    bugle_filter_set_stats_generator("stats_redundant");
+    bugle_filter_set_depends("stats_redundant", "glshadow");
+    bugle_filter_set_depends("stats_redundant", "trackcontext");
+}
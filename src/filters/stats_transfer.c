@@ -0,0 +1,497 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Measures the data moved to and from OpenGL by image and buffer transfers,
+ * and the time spent in the calls that move it. Image sizes are computed
+ * from the pixel-store state, so they include row padding. Writes through a
+ * mapped buffer are counted when the buffer is unmapped, since that is when
+ * the driver must deal with them.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <bugle/gl/glheaders.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <bugle/bool.h>
+#include <bugle/time.h>
+#include <bugle/hashtable.h>
+#include <bugle/glwin/trackcontext.h>
+#include <bugle/gl/glbeginend.h>
+#include <bugle/gl/gldisplaylist.h>
+#include <bugle/gl/glextensions.h>
+#include <bugle/gl/gldump.h>
+#include <bugle/gl/glutils.h>
+#include <bugle/stats.h>
+#include <bugle/filters.h>
+#include <bugle/objects.h>
+#include <budgie/types.h>
+#include <budgie/call.h>
+
+typedef enum
+{
+    STATS_TRANSFER_NONE,
+    STATS_TRANSFER_UPLOAD,
+    STATS_TRANSFER_READBACK,
+    STATS_TRANSFER_DIRECTIONS
+} stats_transfer_direction;
+
+typedef struct
+{
+    stats_signal *bytes;
+    stats_signal *client_bytes;
+    stats_signal *pbo_bytes;
+    stats_signal *time;
+} stats_transfer_signals;
+
+/* The transfer made by the current call */
+typedef struct
+{
+    stats_transfer_direction direction;
+    bugle_bool pbo;
+    double bytes;
+    bugle_timespec start;
+} stats_transfer_call;
+
+static object_view stats_transfer_call_view;
+static object_view stats_transfer_context_view;   /* hashptr_table of mapped sizes by buffer */
+static stats_transfer_signals stats_transfer_signals_dir[STATS_TRANSFER_DIRECTIONS];
+
+/* Records the transfer that the call is about to make, and starts timing it */
+static void stats_transfer_begin(stats_transfer_direction direction, bugle_bool pbo, double bytes)
+{
+    stats_transfer_call *t;
+
+    t = (stats_transfer_call *) bugle_object_get_current_data(bugle_get_call_class(), stats_transfer_call_view);
+    if (!t)
+        return;
+    t->direction = direction;
+    t->pbo = pbo;
+    t->bytes = bytes;
+    bugle_gettime_fast(&t->start);
+}
+
+static bugle_bool stats_transfer_post(function_call *call, const callback_data *data)
+{
+    stats_transfer_call *t;
+    const stats_transfer_signals *s;
+    bugle_timespec end;
+
+    t = (stats_transfer_call *) bugle_object_get_current_data(bugle_get_call_class(), stats_transfer_call_view);
+    if (!t || t->direction == STATS_TRANSFER_NONE)
+        return BUGLE_TRUE;
+    bugle_gettime_fast(&end);
+
+    s = &stats_transfer_signals_dir[t->direction];
+    bugle_stats_signal_add(s->bytes, t->bytes);
+    bugle_stats_signal_add(t->pbo ? s->pbo_bytes : s->client_bytes, t->bytes);
+    bugle_stats_signal_add(s->time, (end.tv_sec - t->start.tv_sec) + 1e-9 * (end.tv_nsec - t->start.tv_nsec));
+    return BUGLE_TRUE;
+}
+
+/* Whether a pixel buffer object is the source (unpack) or sink of pixels */
+static bugle_bool stats_transfer_pbo_bound(bugle_bool unpack)
+{
+    GLint binding = 0;
+
+#ifdef GL_EXT_pixel_buffer_object
+    if (BUGLE_GL_HAS_EXTENSION_GROUP(GL_EXT_pixel_buffer_object))
+        CALL(glGetIntegerv)(unpack ? GL_PIXEL_UNPACK_BUFFER_BINDING_EXT : GL_PIXEL_PACK_BUFFER_BINDING_EXT,
+                            &binding);
+#endif
+    return binding != 0;
+}
+
+/* Uploads are not made while they are being compiled into a display list,
+ * but readbacks are never compiled and so happen straight away. The
+ * queries are illegal inside glBegin/glEnd.
+ */
+static bugle_bool stats_transfer_image_allowed(bugle_bool unpack)
+{
+    return !bugle_gl_in_begin_end()
+        && (!unpack || bugle_displaylist_mode() != GL_COMPILE);
+}
+
+static void stats_transfer_image(GLsizei width, GLsizei height, GLsizei depth,
+                                 GLenum format, GLenum type, const GLvoid *pixels,
+                                 bugle_bool unpack)
+{
+    bugle_bool pbo;
+    double bytes;
+
+    if (!stats_transfer_image_allowed(unpack))
+        return;
+    pbo = stats_transfer_pbo_bound(unpack);
+    if (!pbo && !pixels)
+        return;    /* Only allocates storage */
+    bytes = (double) bugle_image_element_count(width, height, depth, format, type, unpack)
+        * bugle_gl_type_to_size(type);
+    stats_transfer_begin(unpack ? STATS_TRANSFER_UPLOAD : STATS_TRANSFER_READBACK, pbo, bytes);
+}
+
+static void stats_transfer_compressed(GLsizei size, const GLvoid *data)
+{
+    bugle_bool pbo;
+
+    if (!stats_transfer_image_allowed(BUGLE_TRUE))
+        return;
+    pbo = stats_transfer_pbo_bound(BUGLE_TRUE);
+    if (!pbo && !data)
+        return;
+    stats_transfer_begin(STATS_TRANSFER_UPLOAD, pbo, size);
+}
+
+static bugle_bool stats_transfer_glTexImage1D(function_call *call, const callback_data *data)
+{
+    stats_transfer_image(*call->glTexImage1D.arg3, 1, -1,
+                         *call->glTexImage1D.arg5, *call->glTexImage1D.arg6,
+                         *call->glTexImage1D.arg7, BUGLE_TRUE);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_transfer_glTexImage2D(function_call *call, const callback_data *data)
+{
+    stats_transfer_image(*call->glTexImage2D.arg3, *call->glTexImage2D.arg4, -1,
+                         *call->glTexImage2D.arg6, *call->glTexImage2D.arg7,
+                         *call->glTexImage2D.arg8, BUGLE_TRUE);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_transfer_glTexSubImage1D(function_call *call, const callback_data *data)
+{
+    stats_transfer_image(*call->glTexSubImage1D.arg3, 1, -1,
+                         *call->glTexSubImage1D.arg4, *call->glTexSubImage1D.arg5,
+                         *call->glTexSubImage1D.arg6, BUGLE_TRUE);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_transfer_glTexSubImage2D(function_call *call, const callback_data *data)
+{
+    stats_transfer_image(*call->glTexSubImage2D.arg4, *call->glTexSubImage2D.arg5, -1,
+                         *call->glTexSubImage2D.arg6, *call->glTexSubImage2D.arg7,
+                         *call->glTexSubImage2D.arg8, BUGLE_TRUE);
+    return BUGLE_TRUE;
+}
+
+#ifdef GL_VERSION_1_2
+static bugle_bool stats_transfer_glTexImage3D(function_call *call, const callback_data *data)
+{
+    stats_transfer_image(*call->glTexImage3D.arg3, *call->glTexImage3D.arg4, *call->glTexImage3D.arg5,
+                         *call->glTexImage3D.arg7, *call->glTexImage3D.arg8,
+                         *call->glTexImage3D.arg9, BUGLE_TRUE);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_transfer_glTexSubImage3D(function_call *call, const callback_data *data)
+{
+    stats_transfer_image(*call->glTexSubImage3D.arg5, *call->glTexSubImage3D.arg6, *call->glTexSubImage3D.arg7,
+                         *call->glTexSubImage3D.arg8, *call->glTexSubImage3D.arg9,
+                         *call->glTexSubImage3D.arg10, BUGLE_TRUE);
+    return BUGLE_TRUE;
+}
+#endif /* GL_VERSION_1_2 */
+
+#ifdef GL_VERSION_1_3
+static bugle_bool stats_transfer_glCompressedTexImage1D(function_call *call, const callback_data *data)
+{
+    stats_transfer_compressed(*call->glCompressedTexImage1D.arg5, *call->glCompressedTexImage1D.arg6);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_transfer_glCompressedTexImage2D(function_call *call, const callback_data *data)
+{
+    stats_transfer_compressed(*call->glCompressedTexImage2D.arg6, *call->glCompressedTexImage2D.arg7);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_transfer_glCompressedTexImage3D(function_call *call, const callback_data *data)
+{
+    stats_transfer_compressed(*call->glCompressedTexImage3D.arg7, *call->glCompressedTexImage3D.arg8);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_transfer_glCompressedTexSubImage1D(function_call *call, const callback_data *data)
+{
+    stats_transfer_compressed(*call->glCompressedTexSubImage1D.arg5, *call->glCompressedTexSubImage1D.arg6);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_transfer_glCompressedTexSubImage2D(function_call *call, const callback_data *data)
+{
+    stats_transfer_compressed(*call->glCompressedTexSubImage2D.arg7, *call->glCompressedTexSubImage2D.arg8);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_transfer_glCompressedTexSubImage3D(function_call *call, const callback_data *data)
+{
+    stats_transfer_compressed(*call->glCompressedTexSubImage3D.arg9, *call->glCompressedTexSubImage3D.arg10);
+    return BUGLE_TRUE;
+}
+#endif /* GL_VERSION_1_3 */
+
+static bugle_bool stats_transfer_glReadPixels(function_call *call, const callback_data *data)
+{
+    stats_transfer_image(*call->glReadPixels.arg2, *call->glReadPixels.arg3, -1,
+                         *call->glReadPixels.arg4, *call->glReadPixels.arg5,
+                         *call->glReadPixels.arg6, BUGLE_FALSE);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_transfer_glGetTexImage(function_call *call, const callback_data *data)
+{
+    GLenum type;
+
+    if (!stats_transfer_image_allowed(BUGLE_FALSE))
+        return BUGLE_TRUE;
+    type = *call->glGetTexImage.arg3;
+    stats_transfer_begin(STATS_TRANSFER_READBACK, stats_transfer_pbo_bound(BUGLE_FALSE),
+                         (double) bugle_texture_element_count(*call->glGetTexImage.arg0,
+                                                              *call->glGetTexImage.arg1,
+                                                              *call->glGetTexImage.arg2,
+                                                              type)
+                         * bugle_gl_type_to_size(type));
+    return BUGLE_TRUE;
+}
+
+#ifdef GL_VERSION_1_5
+static bugle_bool stats_transfer_glBufferData(function_call *call, const callback_data *data)
+{
+    if (*call->glBufferData.arg2)
+        stats_transfer_begin(STATS_TRANSFER_UPLOAD, BUGLE_FALSE, *call->glBufferData.arg1);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_transfer_glBufferSubData(function_call *call, const callback_data *data)
+{
+    stats_transfer_begin(STATS_TRANSFER_UPLOAD, BUGLE_FALSE, *call->glBufferSubData.arg2);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool stats_transfer_glGetBufferSubData(function_call *call, const callback_data *data)
+{
+    stats_transfer_begin(STATS_TRANSFER_READBACK, BUGLE_FALSE, *call->glGetBufferSubData.arg2);
+    return BUGLE_TRUE;
+}
+
+/* Returns the buffer bound to a target, or 0 if the target is unknown */
+static GLuint stats_transfer_buffer_bound(GLenum target)
+{
+    GLenum binding;
+    GLint buffer = 0;
+
+    switch (target)
+    {
+    case GL_ARRAY_BUFFER: binding = GL_ARRAY_BUFFER_BINDING; break;
+    case GL_ELEMENT_ARRAY_BUFFER: binding = GL_ELEMENT_ARRAY_BUFFER_BINDING; break;
+#ifdef GL_VERSION_2_1
+    case GL_PIXEL_PACK_BUFFER: binding = GL_PIXEL_PACK_BUFFER_BINDING; break;
+    case GL_PIXEL_UNPACK_BUFFER: binding = GL_PIXEL_UNPACK_BUFFER_BINDING; break;
+#endif
+#ifdef GL_VERSION_3_0
+    case GL_TRANSFORM_FEEDBACK_BUFFER: binding = GL_TRANSFORM_FEEDBACK_BUFFER_BINDING; break;
+#endif
+#ifdef GL_VERSION_3_1
+    case GL_UNIFORM_BUFFER: binding = GL_UNIFORM_BUFFER_BINDING; break;
+    /* These targets are their own binding queries */
+    case GL_COPY_READ_BUFFER: binding = GL_COPY_READ_BUFFER; break;
+    case GL_COPY_WRITE_BUFFER: binding = GL_COPY_WRITE_BUFFER; break;
+#endif
+#ifdef GL_VERSION_4_0
+    case GL_DRAW_INDIRECT_BUFFER: binding = GL_DRAW_INDIRECT_BUFFER_BINDING; break;
+#endif
+    default:
+        return 0;
+    }
+    CALL(glGetIntegerv)(binding, &buffer);
+    return buffer;
+}
+
+/* Remembers how much of a buffer may be written through a mapping */
+static void stats_transfer_mapped(GLenum target, GLsizeiptr size)
+{
+    hashptr_table *mapped;
+    GLuint buffer;
+
+    mapped = (hashptr_table *) bugle_object_get_current_data(bugle_get_context_class(), stats_transfer_context_view);
+    if (!mapped || size <= 0)
+        return;
+    buffer = stats_transfer_buffer_bound(target);
+    if (buffer)
+        bugle_hashptr_set(mapped, (void *) (size_t) buffer, (void *) (size_t) size);
+}
+
+static bugle_bool stats_transfer_glMapBuffer(function_call *call, const callback_data *data)
+{
+    GLint size = 0;
+
+    if (*call->glMapBuffer.retn == NULL || *call->glMapBuffer.arg1 == GL_READ_ONLY)
+        return BUGLE_TRUE;
+    CALL(glGetBufferParameteriv)(*call->glMapBuffer.arg0, GL_BUFFER_SIZE, &size);
+    stats_transfer_mapped(*call->glMapBuffer.arg0, size);
+    return BUGLE_TRUE;
+}
+
+#ifdef GL_ARB_map_buffer_range
+static bugle_bool stats_transfer_glMapBufferRange(function_call *call, const callback_data *data)
+{
+    if (*call->glMapBufferRange.retn == NULL || !(*call->glMapBufferRange.arg3 & GL_MAP_WRITE_BIT))
+        return BUGLE_TRUE;
+    stats_transfer_mapped(*call->glMapBufferRange.arg0, *call->glMapBufferRange.arg2);
+    return BUGLE_TRUE;
+}
+#endif
+
+static bugle_bool stats_transfer_glUnmapBuffer(function_call *call, const callback_data *data)
+{
+    hashptr_table *mapped;
+    GLuint buffer;
+    size_t size;
+
+    mapped = (hashptr_table *) bugle_object_get_current_data(bugle_get_context_class(), stats_transfer_context_view);
+    if (!mapped || bugle_gl_in_begin_end())
+        return BUGLE_TRUE;
+    buffer = stats_transfer_buffer_bound(*call->glUnmapBuffer.arg0);
+    size = (size_t) bugle_hashptr_get(mapped, (void *) (size_t) buffer);
+    if (size)
+    {
+        bugle_hashptr_remove(mapped, (void *) (size_t) buffer);
+        stats_transfer_begin(STATS_TRANSFER_UPLOAD, BUGLE_FALSE, size);
+    }
+    return BUGLE_TRUE;
+}
+#endif /* GL_VERSION_1_5 */
+
+static void stats_transfer_context_init(const void *key, void *data)
+{
+    bugle_hashptr_init((hashptr_table *) data, NULL);
+}
+
+static void stats_transfer_context_clear(void *data)
+{
+    bugle_hashptr_clear((hashptr_table *) data);
+}
+
+static void stats_transfer_signals_new(stats_transfer_signals *s, const char *prefix)
+{
+    char name[64];
+
+    sprintf(name, "%s:bytes", prefix);
+    s->bytes = bugle_stats_signal_new(name, NULL, NULL);
+    sprintf(name, "%s:client_bytes", prefix);
+    s->client_bytes = bugle_stats_signal_new(name, NULL, NULL);
+    sprintf(name, "%s:pbo_bytes", prefix);
+    s->pbo_bytes = bugle_stats_signal_new(name, NULL, NULL);
+    sprintf(name, "%s:time", prefix);
+    s->time = bugle_stats_signal_new(name, NULL, NULL);
+}
+
+static const struct
+{
+    const char *name;
+    filter_callback callback;
+} stats_transfer_functions[] =
+{
+    { "glTexImage1D", stats_transfer_glTexImage1D },
+    { "glTexImage2D", stats_transfer_glTexImage2D },
+    { "glTexSubImage1D", stats_transfer_glTexSubImage1D },
+    { "glTexSubImage2D", stats_transfer_glTexSubImage2D },
+#ifdef GL_VERSION_1_2
+    { "glTexImage3D", stats_transfer_glTexImage3D },
+    { "glTexSubImage3D", stats_transfer_glTexSubImage3D },
+#endif
+#ifdef GL_VERSION_1_3
+    { "glCompressedTexImage1D", stats_transfer_glCompressedTexImage1D },
+    { "glCompressedTexImage2D", stats_transfer_glCompressedTexImage2D },
+    { "glCompressedTexImage3D", stats_transfer_glCompressedTexImage3D },
+    { "glCompressedTexSubImage1D", stats_transfer_glCompressedTexSubImage1D },
+    { "glCompressedTexSubImage2D", stats_transfer_glCompressedTexSubImage2D },
+    { "glCompressedTexSubImage3D", stats_transfer_glCompressedTexSubImage3D },
+#endif
+    { "glReadPixels", stats_transfer_glReadPixels },
+    { "glGetTexImage", stats_transfer_glGetTexImage },
+#ifdef GL_VERSION_1_5
+    { "glBufferData", stats_transfer_glBufferData },
+    { "glBufferSubData", stats_transfer_glBufferSubData },
+    { "glGetBufferSubData", stats_transfer_glGetBufferSubData },
+    { "glUnmapBuffer", stats_transfer_glUnmapBuffer },
+#endif
+    { NULL, NULL }
+};
+
+static bugle_bool stats_transfer_initialise(filter_set *handle)
+{
+    filter *f;
+    int i;
+
+    stats_transfer_call_view = bugle_object_view_new(bugle_get_call_class(),
+                                                     NULL,
+                                                     NULL,
+                                                     sizeof(stats_transfer_call));
+    stats_transfer_context_view = bugle_object_view_new(bugle_get_context_class(),
+                                                        stats_transfer_context_init,
+                                                        stats_transfer_context_clear,
+                                                        sizeof(hashptr_table));
+
+    f = bugle_filter_new(handle, "stats_transfer");
+    for (i = 0; stats_transfer_functions[i].name; i++)
+        bugle_filter_catches(f, stats_transfer_functions[i].name, BUGLE_FALSE,
+                             stats_transfer_functions[i].callback);
+    bugle_filter_order("stats_transfer", "invoke");
+    bugle_filter_order("stats_transfer", "stats");
+
+    f = bugle_filter_new(handle, "stats_transfer_post");
+    for (i = 0; stats_transfer_functions[i].name; i++)
+        bugle_filter_catches(f, stats_transfer_functions[i].name, BUGLE_FALSE,
+                             stats_transfer_post);
+    bugle_filter_order("invoke", "stats_transfer_post");
+
+#ifdef GL_VERSION_1_5
+    f = bugle_filter_new(handle, "stats_transfer_map");
+    bugle_filter_catches(f, "glMapBuffer", BUGLE_FALSE, stats_transfer_glMapBuffer);
+#ifdef GL_ARB_map_buffer_range
+    bugle_filter_catches(f, "glMapBufferRange", BUGLE_FALSE, stats_transfer_glMapBufferRange);
+#endif
+    bugle_filter_order("invoke", "stats_transfer_map");
+    bugle_gl_filter_post_queries_begin_end("stats_transfer_map");
+#endif
+
+    stats_transfer_signals_new(&stats_transfer_signals_dir[STATS_TRANSFER_UPLOAD], "upload");
+    stats_transfer_signals_new(&stats_transfer_signals_dir[STATS_TRANSFER_READBACK], "readback");
+    return BUGLE_TRUE;
+}
+
+void bugle_initialise_filter_library(void)
+{
+    static const filter_set_info stats_transfer_info =
+    {
+        "stats_transfer",
+        stats_transfer_initialise,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        "stats module: upload and readback bandwidth"
+    };
+
+    bugle_filter_set_new(&stats_transfer_info);
+    bugle_filter_set_depends("stats_transfer", "stats_basic");
+    bugle_filter_set_depends("stats_transfer", "trackcontext");
+    bugle_filter_set_depends("stats_transfer", "gldisplaylist");
+    bugle_filter_set_depends("stats_transfer", "glbeginend");
+    bugle_filter_set_stats_generator("stats_transfer");
+}
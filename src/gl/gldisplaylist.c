@@ -49,7 +49,7 @@ typedef struct
 
 static void namespace_init(const void *key, void *data)
 {
-    bugle_hashptr_init((hashptr_table *) data, bugle_free);
+    bugle_hashptr_init((hashptr_table *) data, (void (*)(void *)) bugle_object_free);
 }
 
 static void namespace_clear(void *data)
@@ -130,6 +130,50 @@ static bugle_bool gldisplaylist_glEndList(function_call *call, const callback_da
     bugle_object_set_current(bugle_displaylist_class, NULL);
     return BUGLE_TRUE;
 }
+
+static bugle_bool gldisplaylist_glDeleteLists(function_call *call, const callback_data *data)
+{
+    GLuint first;
+    GLsizei range, i;
+    hashptr_table *objects;
+
+    first = *call->glDeleteLists.arg0;
+    range = *call->glDeleteLists.arg1;
+    if (range <= 0) return BUGLE_TRUE;
+
+    bugle_thread_lock_lock(&displaylist_lock);
+    objects = bugle_object_get_current_data(bugle_get_namespace_class(), namespace_view);
+    if (objects && objects->count > 0)
+    {
+        if ((size_t) range <= objects->count)
+        {
+            for (i = 0; i < range; i++)
+                bugle_hashptr_remove_int(objects, first + i);
+        }
+        else
+        {
+            /* The range may be huge, so walk the table instead. Removal
+             * moves entries around, so collect the names first.
+             */
+            const hashptr_table_entry *h;
+            GLuint *lists;
+            size_t count = 0, j;
+
+            lists = BUGLE_NMALLOC(objects->count, GLuint);
+            for (h = bugle_hashptr_begin(objects); h; h = bugle_hashptr_next(objects, h))
+            {
+                GLuint list = (GLuint) (size_t) h->key;
+                if (list >= first && list - first < (GLuint) range)
+                    lists[count++] = list;
+            }
+            for (j = 0; j < count; j++)
+                bugle_hashptr_remove_int(objects, lists[j]);
+            bugle_free(lists);
+        }
+    }
+    bugle_thread_lock_unlock(&displaylist_lock);
+    return BUGLE_TRUE;
+}
 #else /* !GL_VERSION_1_1 */
 GLenum bugle_displaylist_mode(void)
 {
@@ -155,6 +199,7 @@ static bugle_bool gldisplaylist_filter_set_initialise(filter_set *handle)
     bugle_filter_order("invoke", "gldisplaylist");
     bugle_filter_catches(f, "glNewList", BUGLE_TRUE, gldisplaylist_glNewList);
     bugle_filter_catches(f, "glEndList", BUGLE_TRUE, gldisplaylist_glEndList);
+    bugle_filter_catches(f, "glDeleteLists", BUGLE_TRUE, gldisplaylist_glDeleteLists);
 
     displaylist_view = bugle_object_view_new(bugle_displaylist_class,
                                              displaylist_struct_init,
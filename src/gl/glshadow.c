@@ -0,0 +1,1054 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Shadows the commonly set state, so that calls that set state to its
+ * current value can be detected. Nothing is ever queried from GL: state is
+ * unknown until a tracked call sets it, and calls that may change state
+ * behind our back (glPopAttrib, glCallList, deleting a bound object and so
+ * on) mark it as unknown again. Bindings and enables live in the context,
+ * while uniforms are part of the program and hence of the namespace.
+ * Calls that fail are ignored, which relies on the error filter-set to
+ * report the failure.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#include <string.h>
+#include <bugle/bool.h>
+#include <bugle/memory.h>
+#include <bugle/filters.h>
+#include <bugle/objects.h>
+#include <bugle/hashtable.h>
+#include <bugle/glwin/trackcontext.h>
+#include <bugle/gl/glheaders.h>
+#include <bugle/gl/glbeginend.h>
+#include <bugle/gl/gldisplaylist.h>
+#include <bugle/gl/glutils.h>
+#include <bugle/gl/glshadow.h>
+#include <budgie/call.h>
+#include <budgie/reflect.h>
+#include "platform/threads.h"
+
+#if BUGLE_GLTYPE_GL
+
+typedef enum
+{
+    GLSHADOW_CALL_NONE = 0,
+    GLSHADOW_CALL_USE_PROGRAM,
+    GLSHADOW_CALL_ACTIVE_TEXTURE,
+    GLSHADOW_CALL_BIND_VERTEX_ARRAY,
+    GLSHADOW_CALL_BIND_FRAMEBUFFER,
+    GLSHADOW_CALL_BLEND_FUNC,
+    GLSHADOW_CALL_BLEND_FUNC_SEPARATE,
+    GLSHADOW_CALL_BLEND_EQUATION,
+    GLSHADOW_CALL_BLEND_EQUATION_SEPARATE,
+    GLSHADOW_CALL_DEPTH_FUNC,
+    GLSHADOW_CALL_DEPTH_MASK,
+    GLSHADOW_CALL_CULL_FACE,
+    GLSHADOW_CALL_FRONT_FACE,
+    GLSHADOW_CALL_COLOR_MASK,
+    GLSHADOW_CALL_VIEWPORT,
+    GLSHADOW_CALL_SCISSOR,
+    GLSHADOW_CALL_ENABLE,
+    GLSHADOW_CALL_DISABLE,
+    GLSHADOW_CALL_BIND_BUFFER,
+    GLSHADOW_CALL_BIND_TEXTURE,
+    GLSHADOW_CALL_UNIFORM,
+    /* The rest are not tracked, but make some state unknown */
+    GLSHADOW_CALL_INVALIDATE_ALL,
+    GLSHADOW_CALL_INVALIDATE_TEXTURES,
+    GLSHADOW_CALL_INVALIDATE_BUFFERS,
+    GLSHADOW_CALL_INVALIDATE_FRAMEBUFFERS,
+    GLSHADOW_CALL_INVALIDATE_VERTEX_ARRAY,
+    GLSHADOW_CALL_INVALIDATE_CAPS,
+    GLSHADOW_CALL_INVALIDATE_BLEND,
+    GLSHADOW_CALL_INVALIDATE_COLOR_MASK,
+    GLSHADOW_CALL_INVALIDATE_VIEWPORT,
+    GLSHADOW_CALL_DELETE_PROGRAM,
+    GLSHADOW_CALL_PROGRAM_UNIFORM
+} glshadow_call;
+
+static const struct
+{
+    const char *name;
+    glshadow_call call;
+} glshadow_calls[] =
+{
+    { "glUseProgram", GLSHADOW_CALL_USE_PROGRAM },
+    { "glActiveTexture", GLSHADOW_CALL_ACTIVE_TEXTURE },
+    { "glBindVertexArray", GLSHADOW_CALL_BIND_VERTEX_ARRAY },
+    { "glBindFramebuffer", GLSHADOW_CALL_BIND_FRAMEBUFFER },
+    { "glBindFramebufferEXT", GLSHADOW_CALL_BIND_FRAMEBUFFER },
+    { "glBlendFunc", GLSHADOW_CALL_BLEND_FUNC },
+    { "glBlendFuncSeparate", GLSHADOW_CALL_BLEND_FUNC_SEPARATE },
+    { "glBlendEquation", GLSHADOW_CALL_BLEND_EQUATION },
+    { "glBlendEquationSeparate", GLSHADOW_CALL_BLEND_EQUATION_SEPARATE },
+    { "glDepthFunc", GLSHADOW_CALL_DEPTH_FUNC },
+    { "glDepthMask", GLSHADOW_CALL_DEPTH_MASK },
+    { "glCullFace", GLSHADOW_CALL_CULL_FACE },
+    { "glFrontFace", GLSHADOW_CALL_FRONT_FACE },
+    { "glColorMask", GLSHADOW_CALL_COLOR_MASK },
+    { "glViewport", GLSHADOW_CALL_VIEWPORT },
+    { "glScissor", GLSHADOW_CALL_SCISSOR },
+    { "glEnable", GLSHADOW_CALL_ENABLE },
+    { "glDisable", GLSHADOW_CALL_DISABLE },
+    { "glBindBuffer", GLSHADOW_CALL_BIND_BUFFER },
+    { "glBindTexture", GLSHADOW_CALL_BIND_TEXTURE },
+
+    { "glPopAttrib", GLSHADOW_CALL_INVALIDATE_ALL },
+    { "glPopClientAttrib", GLSHADOW_CALL_INVALIDATE_ALL },
+    { "glCallList", GLSHADOW_CALL_INVALIDATE_ALL },
+    { "glCallLists", GLSHADOW_CALL_INVALIDATE_ALL },
+    { "glDeleteTextures", GLSHADOW_CALL_INVALIDATE_TEXTURES },
+    { "glBindTextures", GLSHADOW_CALL_INVALIDATE_TEXTURES },
+    { "glBindTextureUnit", GLSHADOW_CALL_INVALIDATE_TEXTURES },
+    { "glBindMultiTextureEXT", GLSHADOW_CALL_INVALIDATE_TEXTURES },
+    { "glDeleteBuffers", GLSHADOW_CALL_INVALIDATE_BUFFERS },
+    { "glBindBufferBase", GLSHADOW_CALL_INVALIDATE_BUFFERS },
+    { "glBindBufferRange", GLSHADOW_CALL_INVALIDATE_BUFFERS },
+    { "glBindBuffersBase", GLSHADOW_CALL_INVALIDATE_BUFFERS },
+    { "glBindBuffersRange", GLSHADOW_CALL_INVALIDATE_BUFFERS },
+    { "glDeleteFramebuffers", GLSHADOW_CALL_INVALIDATE_FRAMEBUFFERS },
+    { "glDeleteFramebuffersEXT", GLSHADOW_CALL_INVALIDATE_FRAMEBUFFERS },
+    { "glDeleteVertexArrays", GLSHADOW_CALL_INVALIDATE_VERTEX_ARRAY },
+    { "glEnablei", GLSHADOW_CALL_INVALIDATE_CAPS },
+    { "glDisablei", GLSHADOW_CALL_INVALIDATE_CAPS },
+    { "glBlendFunci", GLSHADOW_CALL_INVALIDATE_BLEND },
+    { "glBlendFuncSeparatei", GLSHADOW_CALL_INVALIDATE_BLEND },
+    { "glBlendEquationi", GLSHADOW_CALL_INVALIDATE_BLEND },
+    { "glBlendEquationSeparatei", GLSHADOW_CALL_INVALIDATE_BLEND },
+    { "glColorMaski", GLSHADOW_CALL_INVALIDATE_COLOR_MASK },
+    { "glViewportArrayv", GLSHADOW_CALL_INVALIDATE_VIEWPORT },
+    { "glViewportIndexedf", GLSHADOW_CALL_INVALIDATE_VIEWPORT },
+    { "glViewportIndexedfv", GLSHADOW_CALL_INVALIDATE_VIEWPORT },
+    { "glScissorArrayv", GLSHADOW_CALL_INVALIDATE_VIEWPORT },
+    { "glScissorIndexed", GLSHADOW_CALL_INVALIDATE_VIEWPORT },
+    { "glScissorIndexedv", GLSHADOW_CALL_INVALIDATE_VIEWPORT },
+    { "glDeleteProgram", GLSHADOW_CALL_DELETE_PROGRAM },
+    { "glLinkProgram", GLSHADOW_CALL_DELETE_PROGRAM },
+    { NULL, GLSHADOW_CALL_NONE }
+};
+
+typedef enum
+{
+    GLSHADOW_UNIFORM_SCALAR,    /* Values passed as arguments */
+    GLSHADOW_UNIFORM_VECTOR,    /* Count and pointer */
+    GLSHADOW_UNIFORM_MATRIX     /* Count, transpose and pointer */
+} glshadow_uniform_kind;
+
+/* Uniforms are all 32-bit types, so values are compared as GLints. Only
+ * a single element is tracked: calls that set arrays are untracked.
+ */
+#define GLSHADOW_UNIFORM_WORDS 17
+
+static const struct
+{
+    const char *name;
+    glshadow_uniform_kind kind;
+    int words;
+} glshadow_uniforms[] =
+{
+    { "glUniform1f", GLSHADOW_UNIFORM_SCALAR, 1 },
+    { "glUniform2f", GLSHADOW_UNIFORM_SCALAR, 2 },
+    { "glUniform3f", GLSHADOW_UNIFORM_SCALAR, 3 },
+    { "glUniform4f", GLSHADOW_UNIFORM_SCALAR, 4 },
+    { "glUniform1i", GLSHADOW_UNIFORM_SCALAR, 1 },
+    { "glUniform2i", GLSHADOW_UNIFORM_SCALAR, 2 },
+    { "glUniform3i", GLSHADOW_UNIFORM_SCALAR, 3 },
+    { "glUniform4i", GLSHADOW_UNIFORM_SCALAR, 4 },
+    { "glUniform1ui", GLSHADOW_UNIFORM_SCALAR, 1 },
+    { "glUniform2ui", GLSHADOW_UNIFORM_SCALAR, 2 },
+    { "glUniform3ui", GLSHADOW_UNIFORM_SCALAR, 3 },
+    { "glUniform4ui", GLSHADOW_UNIFORM_SCALAR, 4 },
+    { "glUniform1fv", GLSHADOW_UNIFORM_VECTOR, 1 },
+    { "glUniform2fv", GLSHADOW_UNIFORM_VECTOR, 2 },
+    { "glUniform3fv", GLSHADOW_UNIFORM_VECTOR, 3 },
+    { "glUniform4fv", GLSHADOW_UNIFORM_VECTOR, 4 },
+    { "glUniform1iv", GLSHADOW_UNIFORM_VECTOR, 1 },
+    { "glUniform2iv", GLSHADOW_UNIFORM_VECTOR, 2 },
+    { "glUniform3iv", GLSHADOW_UNIFORM_VECTOR, 3 },
+    { "glUniform4iv", GLSHADOW_UNIFORM_VECTOR, 4 },
+    { "glUniform1uiv", GLSHADOW_UNIFORM_VECTOR, 1 },
+    { "glUniform2uiv", GLSHADOW_UNIFORM_VECTOR, 2 },
+    { "glUniform3uiv", GLSHADOW_UNIFORM_VECTOR, 3 },
+    { "glUniform4uiv", GLSHADOW_UNIFORM_VECTOR, 4 },
+    { "glUniformMatrix2fv", GLSHADOW_UNIFORM_MATRIX, 4 },
+    { "glUniformMatrix3fv", GLSHADOW_UNIFORM_MATRIX, 9 },
+    { "glUniformMatrix4fv", GLSHADOW_UNIFORM_MATRIX, 16 },
+    { NULL, GLSHADOW_UNIFORM_SCALAR, 0 }
+};
+
+static const GLenum glshadow_caps[] =
+{
+#ifdef GL_ALPHA_TEST
+    GL_ALPHA_TEST,
+#endif
+    GL_BLEND,
+#ifdef GL_COLOR_LOGIC_OP
+    GL_COLOR_LOGIC_OP,
+#endif
+    GL_CULL_FACE,
+#ifdef GL_DEPTH_CLAMP
+    GL_DEPTH_CLAMP,
+#endif
+    GL_DEPTH_TEST,
+    GL_DITHER,
+#ifdef GL_FOG
+    GL_FOG,
+#endif
+#ifdef GL_FRAMEBUFFER_SRGB
+    GL_FRAMEBUFFER_SRGB,
+#endif
+#ifdef GL_LIGHTING
+    GL_LIGHTING,
+#endif
+#ifdef GL_LINE_SMOOTH
+    GL_LINE_SMOOTH,
+#endif
+#ifdef GL_MULTISAMPLE
+    GL_MULTISAMPLE,
+#endif
+#ifdef GL_NORMALIZE
+    GL_NORMALIZE,
+#endif
+    GL_POLYGON_OFFSET_FILL,
+#ifdef GL_POLYGON_OFFSET_LINE
+    GL_POLYGON_OFFSET_LINE,
+#endif
+#ifdef GL_PRIMITIVE_RESTART
+    GL_PRIMITIVE_RESTART,
+#endif
+#ifdef GL_PROGRAM_POINT_SIZE
+    GL_PROGRAM_POINT_SIZE,
+#endif
+#ifdef GL_RASTERIZER_DISCARD
+    GL_RASTERIZER_DISCARD,
+#endif
+#ifdef GL_RESCALE_NORMAL
+    GL_RESCALE_NORMAL,
+#endif
+#ifdef GL_SAMPLE_ALPHA_TO_COVERAGE
+    GL_SAMPLE_ALPHA_TO_COVERAGE,
+#endif
+    GL_SCISSOR_TEST,
+    GL_STENCIL_TEST,
+#ifdef GL_TEXTURE_CUBE_MAP_SEAMLESS
+    GL_TEXTURE_CUBE_MAP_SEAMLESS,
+#endif
+};
+
+static const GLenum glshadow_buffer_targets[] =
+{
+    GL_ARRAY_BUFFER,
+    GL_ELEMENT_ARRAY_BUFFER,
+#ifdef GL_PIXEL_PACK_BUFFER
+    GL_PIXEL_PACK_BUFFER,
+    GL_PIXEL_UNPACK_BUFFER,
+#endif
+#ifdef GL_UNIFORM_BUFFER
+    GL_UNIFORM_BUFFER,
+#endif
+#ifdef GL_TEXTURE_BUFFER
+    GL_TEXTURE_BUFFER,
+#endif
+#ifdef GL_TRANSFORM_FEEDBACK_BUFFER
+    GL_TRANSFORM_FEEDBACK_BUFFER,
+#endif
+#ifdef GL_COPY_READ_BUFFER
+    GL_COPY_READ_BUFFER,
+    GL_COPY_WRITE_BUFFER,
+#endif
+#ifdef GL_DRAW_INDIRECT_BUFFER
+    GL_DRAW_INDIRECT_BUFFER,
+#endif
+#ifdef GL_ATOMIC_COUNTER_BUFFER
+    GL_ATOMIC_COUNTER_BUFFER,
+#endif
+#ifdef GL_SHADER_STORAGE_BUFFER
+    GL_SHADER_STORAGE_BUFFER,
+#endif
+#ifdef GL_DISPATCH_INDIRECT_BUFFER
+    GL_DISPATCH_INDIRECT_BUFFER,
+#endif
+#ifdef GL_QUERY_BUFFER
+    GL_QUERY_BUFFER,
+#endif
+};
+
+static const GLenum glshadow_texture_targets[] =
+{
+    GL_TEXTURE_1D,
+    GL_TEXTURE_2D,
+#ifdef GL_TEXTURE_3D
+    GL_TEXTURE_3D,
+#endif
+#ifdef GL_TEXTURE_CUBE_MAP
+    GL_TEXTURE_CUBE_MAP,
+#endif
+#ifdef GL_TEXTURE_RECTANGLE
+    GL_TEXTURE_RECTANGLE,
+#endif
+#ifdef GL_TEXTURE_1D_ARRAY
+    GL_TEXTURE_1D_ARRAY,
+    GL_TEXTURE_2D_ARRAY,
+#endif
+#ifdef GL_TEXTURE_CUBE_MAP_ARRAY
+    GL_TEXTURE_CUBE_MAP_ARRAY,
+#endif
+#ifdef GL_TEXTURE_BUFFER
+    GL_TEXTURE_BUFFER,
+#endif
+#ifdef GL_TEXTURE_2D_MULTISAMPLE
+    GL_TEXTURE_2D_MULTISAMPLE,
+    GL_TEXTURE_2D_MULTISAMPLE_ARRAY,
+#endif
+};
+
+#define GLSHADOW_CAPS (sizeof(glshadow_caps) / sizeof(glshadow_caps[0]))
+#define GLSHADOW_BUFFER_TARGETS (sizeof(glshadow_buffer_targets) / sizeof(glshadow_buffer_targets[0]))
+#define GLSHADOW_TEXTURE_TARGETS (sizeof(glshadow_texture_targets) / sizeof(glshadow_texture_targets[0]))
+/* Bindings on higher texture units are not tracked */
+#define GLSHADOW_TEXTURE_UNITS 32
+
+/* Indices of the shadowed state items */
+#define GLSHADOW_ITEM_PROGRAM 0
+#define GLSHADOW_ITEM_ACTIVE_TEXTURE 1
+#define GLSHADOW_ITEM_VERTEX_ARRAY 2
+#define GLSHADOW_ITEM_DRAW_FRAMEBUFFER 3
+#define GLSHADOW_ITEM_READ_FRAMEBUFFER 4
+#define GLSHADOW_ITEM_BLEND_FUNC 5
+#define GLSHADOW_ITEM_BLEND_EQUATION 6
+#define GLSHADOW_ITEM_DEPTH_FUNC 7
+#define GLSHADOW_ITEM_DEPTH_MASK 8
+#define GLSHADOW_ITEM_CULL_FACE 9
+#define GLSHADOW_ITEM_FRONT_FACE 10
+#define GLSHADOW_ITEM_COLOR_MASK 11
+#define GLSHADOW_ITEM_VIEWPORT 12
+#define GLSHADOW_ITEM_SCISSOR 13
+#define GLSHADOW_ITEM_CAPS 14
+#define GLSHADOW_ITEM_BUFFERS (GLSHADOW_ITEM_CAPS + GLSHADOW_CAPS)
+#define GLSHADOW_ITEM_TEXTURES (GLSHADOW_ITEM_BUFFERS + GLSHADOW_BUFFER_TARGETS)
+#define GLSHADOW_ITEM_COUNT (GLSHADOW_ITEM_TEXTURES + GLSHADOW_TEXTURE_UNITS * GLSHADOW_TEXTURE_TARGETS)
+
+typedef struct
+{
+    bugle_bool valid;
+    GLint value[4];
+} glshadow_item;
+
+typedef struct
+{
+    glshadow_item items[GLSHADOW_ITEM_COUNT];
+    unsigned long generation;   /* Changes when state becomes unknown or uniforms change */
+} glshadow_context;
+
+typedef struct
+{
+    int words;
+    GLint value[GLSHADOW_UNIFORM_WORDS];
+} glshadow_uniform;
+
+/* A description of the state that a call sets. Binding GL_FRAMEBUFFER
+ * sets two items to the same value, hence the second item.
+ */
+typedef struct
+{
+    int item, item2;            /* item2 is -1 if unused */
+    int count;
+    GLint value[4];
+} glshadow_change;
+
+static filter_set *glshadow_handle = NULL;
+static object_view glshadow_context_view;
+static object_view glshadow_namespace_view;   /* maps program to hashptr_table of uniforms */
+static bugle_thread_lock_t glshadow_lock;     /* Protects the uniforms */
+
+/* Indexed by group */
+static glshadow_call *glshadow_group_calls;
+static int *glshadow_group_uniforms;          /* Index into glshadow_uniforms, or -1 */
+
+static void glshadow_program_free(void *data)
+{
+    bugle_hashptr_clear((hashptr_table *) data);
+    bugle_free(data);
+}
+
+static void glshadow_namespace_init(const void *key, void *data)
+{
+    bugle_hashptr_init((hashptr_table *) data, glshadow_program_free);
+}
+
+static void glshadow_namespace_clear(void *data)
+{
+    bugle_hashptr_clear((hashptr_table *) data);
+}
+
+static void glshadow_invalidate_range(glshadow_context *ctx, size_t first, size_t count)
+{
+    size_t i;
+
+    for (i = first; i < first + count; i++)
+        ctx->items[i].valid = BUGLE_FALSE;
+    ctx->generation++;
+}
+
+static int glshadow_find(const GLenum *table, size_t count, GLenum value)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        if (table[i] == value)
+            return i;
+    return -1;
+}
+
+/* Determines the state set by a call, returning BUGLE_FALSE if it is not
+ * tracked. Uniforms are handled separately.
+ */
+static bugle_bool glshadow_describe(const glshadow_context *ctx, function_call *call,
+                                    glshadow_change *change)
+{
+    const glshadow_item *active;
+    int index, unit;
+
+    change->item2 = -1;
+    change->count = 1;
+    switch (glshadow_group_calls[call->generic.group])
+    {
+    case GLSHADOW_CALL_USE_PROGRAM:
+        change->item = GLSHADOW_ITEM_PROGRAM;
+        change->value[0] = *(const GLuint *) call->generic.args[0];
+        return BUGLE_TRUE;
+    case GLSHADOW_CALL_ACTIVE_TEXTURE:
+        change->item = GLSHADOW_ITEM_ACTIVE_TEXTURE;
+        change->value[0] = *(const GLenum *) call->generic.args[0];
+        return BUGLE_TRUE;
+    case GLSHADOW_CALL_BIND_VERTEX_ARRAY:
+        change->item = GLSHADOW_ITEM_VERTEX_ARRAY;
+        change->value[0] = *(const GLuint *) call->generic.args[0];
+        return BUGLE_TRUE;
+    case GLSHADOW_CALL_BIND_FRAMEBUFFER:
+        change->value[0] = *(const GLuint *) call->generic.args[1];
+        switch (*(const GLenum *) call->generic.args[0])
+        {
+        case GL_FRAMEBUFFER:
+            change->item = GLSHADOW_ITEM_DRAW_FRAMEBUFFER;
+            change->item2 = GLSHADOW_ITEM_READ_FRAMEBUFFER;
+            return BUGLE_TRUE;
+#ifdef GL_DRAW_FRAMEBUFFER
+        case GL_DRAW_FRAMEBUFFER:
+            change->item = GLSHADOW_ITEM_DRAW_FRAMEBUFFER;
+            return BUGLE_TRUE;
+        case GL_READ_FRAMEBUFFER:
+            change->item = GLSHADOW_ITEM_READ_FRAMEBUFFER;
+            return BUGLE_TRUE;
+#endif
+        default:
+            return BUGLE_FALSE;
+        }
+    case GLSHADOW_CALL_BLEND_FUNC:
+        change->item = GLSHADOW_ITEM_BLEND_FUNC;
+        change->count = 4;
+        change->value[0] = change->value[2] = *(const GLenum *) call->generic.args[0];
+        change->value[1] = change->value[3] = *(const GLenum *) call->generic.args[1];
+        return BUGLE_TRUE;
+    case GLSHADOW_CALL_BLEND_FUNC_SEPARATE:
+        change->item = GLSHADOW_ITEM_BLEND_FUNC;
+        change->count = 4;
+        for (index = 0; index < 4; index++)
+            change->value[index] = *(const GLenum *) call->generic.args[index];
+        return BUGLE_TRUE;
+    case GLSHADOW_CALL_BLEND_EQUATION:
+        change->item = GLSHADOW_ITEM_BLEND_EQUATION;
+        change->count = 2;
+        change->value[0] = change->value[1] = *(const GLenum *) call->generic.args[0];
+        return BUGLE_TRUE;
+    case GLSHADOW_CALL_BLEND_EQUATION_SEPARATE:
+        change->item = GLSHADOW_ITEM_BLEND_EQUATION;
+        change->count = 2;
+        change->value[0] = *(const GLenum *) call->generic.args[0];
+        change->value[1] = *(const GLenum *) call->generic.args[1];
+        return BUGLE_TRUE;
+    case GLSHADOW_CALL_DEPTH_FUNC:
+        change->item = GLSHADOW_ITEM_DEPTH_FUNC;
+        change->value[0] = *(const GLenum *) call->generic.args[0];
+        return BUGLE_TRUE;
+    case GLSHADOW_CALL_DEPTH_MASK:
+        change->item = GLSHADOW_ITEM_DEPTH_MASK;
+        change->value[0] = *(const GLboolean *) call->generic.args[0] != 0;
+        return BUGLE_TRUE;
+    case GLSHADOW_CALL_CULL_FACE:
+        change->item = GLSHADOW_ITEM_CULL_FACE;
+        change->value[0] = *(const GLenum *) call->generic.args[0];
+        return BUGLE_TRUE;
+    case GLSHADOW_CALL_FRONT_FACE:
+        change->item = GLSHADOW_ITEM_FRONT_FACE;
+        change->value[0] = *(const GLenum *) call->generic.args[0];
+        return BUGLE_TRUE;
+    case GLSHADOW_CALL_COLOR_MASK:
+        change->item = GLSHADOW_ITEM_COLOR_MASK;
+        change->count = 4;
+        for (index = 0; index < 4; index++)
+            change->value[index] = *(const GLboolean *) call->generic.args[index] != 0;
+        return BUGLE_TRUE;
+    case GLSHADOW_CALL_VIEWPORT:
+    case GLSHADOW_CALL_SCISSOR:
+        change->item = glshadow_group_calls[call->generic.group] == GLSHADOW_CALL_VIEWPORT
+            ? GLSHADOW_ITEM_VIEWPORT : GLSHADOW_ITEM_SCISSOR;
+        change->count = 4;
+        change->value[0] = *(const GLint *) call->generic.args[0];
+        change->value[1] = *(const GLint *) call->generic.args[1];
+        change->value[2] = *(const GLsizei *) call->generic.args[2];
+        change->value[3] = *(const GLsizei *) call->generic.args[3];
+        return BUGLE_TRUE;
+    case GLSHADOW_CALL_ENABLE:
+    case GLSHADOW_CALL_DISABLE:
+        index = glshadow_find(glshadow_caps, GLSHADOW_CAPS, *(const GLenum *) call->generic.args[0]);
+        if (index < 0)
+            return BUGLE_FALSE;
+        change->item = GLSHADOW_ITEM_CAPS + index;
+        change->value[0] = glshadow_group_calls[call->generic.group] == GLSHADOW_CALL_ENABLE;
+        return BUGLE_TRUE;
+    case GLSHADOW_CALL_BIND_BUFFER:
+        index = glshadow_find(glshadow_buffer_targets, GLSHADOW_BUFFER_TARGETS,
+                              *(const GLenum *) call->generic.args[0]);
+        if (index < 0)
+            return BUGLE_FALSE;
+        change->item = GLSHADOW_ITEM_BUFFERS + index;
+        change->value[0] = *(const GLuint *) call->generic.args[1];
+        return BUGLE_TRUE;
+    case GLSHADOW_CALL_BIND_TEXTURE:
+        /* The binding point depends on the active texture unit */
+        active = &ctx->items[GLSHADOW_ITEM_ACTIVE_TEXTURE];
+        if (!active->valid)
+            return BUGLE_FALSE;
+        unit = active->value[0] - GL_TEXTURE0;
+        index = glshadow_find(glshadow_texture_targets, GLSHADOW_TEXTURE_TARGETS,
+                              *(const GLenum *) call->generic.args[0]);
+        if (unit < 0 || unit >= GLSHADOW_TEXTURE_UNITS || index < 0)
+            return BUGLE_FALSE;
+        change->item = GLSHADOW_ITEM_TEXTURES + unit * GLSHADOW_TEXTURE_TARGETS + index;
+        change->value[0] = *(const GLuint *) call->generic.args[1];
+        return BUGLE_TRUE;
+    default:
+        return BUGLE_FALSE;
+    }
+}
+
+static bugle_bool glshadow_item_matches(const glshadow_item *item, const glshadow_change *change)
+{
+    return item->valid && memcmp(item->value, change->value, change->count * sizeof(GLint)) == 0;
+}
+
+static void glshadow_item_set(glshadow_item *item, const glshadow_change *change)
+{
+    item->valid = BUGLE_TRUE;
+    memcpy(item->value, change->value, change->count * sizeof(GLint));
+}
+
+/* Extracts the value set by a glUniform call and returns the location,
+ * or -1 if the call is not tracked.
+ */
+static GLint glshadow_uniform_describe(function_call *call, glshadow_uniform *uniform)
+{
+    int index, i;
+    GLint location;
+    const void *ptr;
+
+    index = glshadow_group_uniforms[call->generic.group];
+    location = *(const GLint *) call->generic.args[0];
+    if (index < 0 || location < 0)
+        return -1;
+
+    uniform->words = glshadow_uniforms[index].words;
+    switch (glshadow_uniforms[index].kind)
+    {
+    case GLSHADOW_UNIFORM_SCALAR:
+        for (i = 0; i < uniform->words; i++)
+            memcpy(&uniform->value[i], call->generic.args[i + 1], sizeof(GLint));
+        break;
+    case GLSHADOW_UNIFORM_VECTOR:
+    case GLSHADOW_UNIFORM_MATRIX:
+        if (*(const GLsizei *) call->generic.args[1] != 1)
+            return -1;
+        i = 1;
+        if (glshadow_uniforms[index].kind == GLSHADOW_UNIFORM_MATRIX)
+        {
+            /* Record the transpose flag as an extra word */
+            uniform->value[uniform->words++] = *(const GLboolean *) call->generic.args[2] != 0;
+            i++;
+        }
+        ptr = *(const void * const *) call->generic.args[i + 1];
+        if (!ptr)
+            return -1;
+        memcpy(uniform->value, ptr, glshadow_uniforms[index].words * sizeof(GLint));
+        break;
+    }
+    return location;
+}
+
+/* Finds the uniforms of a program. glshadow_lock must be held. */
+static hashptr_table *glshadow_program_uniforms(GLuint program, bugle_bool create)
+{
+    hashptr_table *programs, *uniforms;
+
+    programs = (hashptr_table *) bugle_object_get_current_data(bugle_get_namespace_class(), glshadow_namespace_view);
+    if (!programs)
+        return NULL;
+    uniforms = (hashptr_table *) bugle_hashptr_get(programs, (void *) (size_t) program);
+    if (!uniforms && create)
+    {
+        uniforms = BUGLE_MALLOC(hashptr_table);
+        bugle_hashptr_init(uniforms, bugle_free);
+        bugle_hashptr_set(programs, (void *) (size_t) program, uniforms);
+    }
+    return uniforms;
+}
+
+static void glshadow_program_forget(GLuint program)
+{
+    hashptr_table *programs;
+
+    bugle_thread_lock_lock(&glshadow_lock);
+    programs = (hashptr_table *) bugle_object_get_current_data(bugle_get_namespace_class(), glshadow_namespace_view);
+    if (programs)
+        bugle_hashptr_remove(programs, (void *) (size_t) program);
+    bugle_thread_lock_unlock(&glshadow_lock);
+}
+
+static void glshadow_uniforms_forget(void)
+{
+    hashptr_table *programs;
+
+    bugle_thread_lock_lock(&glshadow_lock);
+    programs = (hashptr_table *) bugle_object_get_current_data(bugle_get_namespace_class(), glshadow_namespace_view);
+    if (programs)
+        bugle_hashptr_clear(programs);
+    bugle_thread_lock_unlock(&glshadow_lock);
+}
+
+/* Returns the current context state if the call could change it, or NULL if
+ * there is no context or the call is being compiled into a display list or
+ * is inside glBegin/glEnd.
+ */
+static glshadow_context *glshadow_get_context(void)
+{
+    if (bugle_gl_in_begin_end() || bugle_displaylist_mode() != GL_NONE)
+        return NULL;
+    return (glshadow_context *) bugle_object_get_current_data(bugle_get_context_class(), glshadow_context_view);
+}
+
+bugle_bool bugle_glshadow_tracks(budgie_function f)
+{
+    budgie_group g;
+
+    if (!glshadow_group_calls || f == NULL_FUNCTION)
+        return BUGLE_FALSE;
+    g = budgie_function_group(f);
+    return glshadow_group_calls[g] != GLSHADOW_CALL_NONE
+        && glshadow_group_calls[g] < GLSHADOW_CALL_INVALIDATE_ALL;
+}
+
+void bugle_glshadow_invalidate(void)
+{
+    glshadow_context *ctx;
+
+    if (!glshadow_handle)
+        return;
+    ctx = (glshadow_context *) bugle_object_get_current_data(bugle_get_context_class(), glshadow_context_view);
+    if (ctx)
+        glshadow_invalidate_range(ctx, 0, GLSHADOW_ITEM_COUNT);
+    glshadow_uniforms_forget();
+}
+
+/* FNV-1a, one word at a time */
+static unsigned long glshadow_hash(unsigned long h, unsigned long value)
+{
+    return (h ^ value) * 16777619UL;
+}
+
+unsigned long bugle_glshadow_fingerprint(void)
+{
+    const glshadow_context *ctx;
+    unsigned long h = 2166136261UL;
+    size_t i;
+    int j, element;
+
+    ctx = glshadow_get_context();
+    if (!ctx)
+        return 0;
+    element = glshadow_find(glshadow_buffer_targets, GLSHADOW_BUFFER_TARGETS, GL_ELEMENT_ARRAY_BUFFER);
+    h = glshadow_hash(h, ctx->generation);
+    for (i = 0; i < GLSHADOW_ITEM_COUNT; i++)
+    {
+        /* Selectors and bindings that are only used to modify objects
+         * do not affect drawing.
+         */
+        if (i == GLSHADOW_ITEM_ACTIVE_TEXTURE
+            || i == GLSHADOW_ITEM_READ_FRAMEBUFFER
+            || (i >= GLSHADOW_ITEM_BUFFERS && i < GLSHADOW_ITEM_TEXTURES
+                && (int) (i - GLSHADOW_ITEM_BUFFERS) != element))
+            continue;
+        if (ctx->items[i].valid)
+            for (j = 0; j < 4; j++)
+                h = glshadow_hash(h, (unsigned long) ctx->items[i].value[j]);
+        else
+            h = glshadow_hash(h, ~0UL);
+    }
+    return h;
+}
+
+bugle_glshadow_status bugle_glshadow_classify(function_call *call)
+{
+    glshadow_context *ctx;
+    glshadow_change change;
+    glshadow_uniform uniform;
+    const glshadow_uniform *old;
+    const hashptr_table *uniforms;
+    GLint location;
+    bugle_glshadow_status status = BUGLE_GLSHADOW_UNTRACKED;
+
+    if (!bugle_glshadow_tracks(call->generic.id))
+        return BUGLE_GLSHADOW_UNTRACKED;
+    ctx = glshadow_get_context();
+    if (!ctx)
+        return BUGLE_GLSHADOW_UNTRACKED;
+
+    if (glshadow_group_calls[call->generic.group] == GLSHADOW_CALL_UNIFORM)
+    {
+        /* Uniforms apply to the current program */
+        if (!ctx->items[GLSHADOW_ITEM_PROGRAM].valid
+            || ctx->items[GLSHADOW_ITEM_PROGRAM].value[0] == 0)
+            return BUGLE_GLSHADOW_UNTRACKED;
+        location = glshadow_uniform_describe(call, &uniform);
+        if (location < 0)
+            return BUGLE_GLSHADOW_UNTRACKED;
+
+        bugle_thread_lock_lock(&glshadow_lock);
+        status = BUGLE_GLSHADOW_EFFECTIVE;
+        uniforms = glshadow_program_uniforms(ctx->items[GLSHADOW_ITEM_PROGRAM].value[0], BUGLE_FALSE);
+        if (uniforms)
+        {
+            old = (const glshadow_uniform *) bugle_hashptr_get(uniforms, (void *) (size_t) (location + 1));
+            if (old && old->words == uniform.words
+                && memcmp(old->value, uniform.value, uniform.words * sizeof(GLint)) == 0)
+                status = BUGLE_GLSHADOW_REDUNDANT;
+        }
+        bugle_thread_lock_unlock(&glshadow_lock);
+        return status;
+    }
+
+    if (!glshadow_describe(ctx, call, &change))
+        return BUGLE_GLSHADOW_UNTRACKED;
+    if (glshadow_item_matches(&ctx->items[change.item], &change)
+        && (change.item2 < 0 || glshadow_item_matches(&ctx->items[change.item2], &change)))
+        return BUGLE_GLSHADOW_REDUNDANT;
+    else
+        return BUGLE_GLSHADOW_EFFECTIVE;
+}
+
+static void glshadow_uniform_update(glshadow_context *ctx, function_call *call)
+{
+    glshadow_uniform uniform, *stored;
+    hashptr_table *uniforms;
+    GLint location;
+
+    if (!ctx->items[GLSHADOW_ITEM_PROGRAM].valid)
+    {
+        /* It could have been any program */
+        glshadow_uniforms_forget();
+        ctx->generation++;
+        return;
+    }
+    if (ctx->items[GLSHADOW_ITEM_PROGRAM].value[0] == 0)
+        return;
+    location = glshadow_uniform_describe(call, &uniform);
+    bugle_thread_lock_lock(&glshadow_lock);
+    uniforms = glshadow_program_uniforms(ctx->items[GLSHADOW_ITEM_PROGRAM].value[0], location >= 0);
+    if (uniforms)
+    {
+        if (location >= 0)
+        {
+            stored = (glshadow_uniform *) bugle_hashptr_get(uniforms, (void *) (size_t) (location + 1));
+            if (!stored)
+            {
+                stored = BUGLE_MALLOC(glshadow_uniform);
+                bugle_hashptr_set(uniforms, (void *) (size_t) (location + 1), stored);
+                ctx->generation++;
+            }
+            else if (stored->words != uniform.words
+                     || memcmp(stored->value, uniform.value, uniform.words * sizeof(GLint)) != 0)
+                ctx->generation++;
+            *stored = uniform;
+        }
+        else
+        {
+            /* An array or an unusual location: we cannot tell what changed */
+            bugle_hashptr_clear(uniforms);
+            ctx->generation++;
+        }
+    }
+    else
+        ctx->generation++;
+    bugle_thread_lock_unlock(&glshadow_lock);
+}
+
+/* Records the effect of a call once it has been made */
+static bugle_bool glshadow_update(function_call *call, const callback_data *data)
+{
+    glshadow_context *ctx;
+    glshadow_change change;
+    glshadow_call type;
+
+    ctx = (glshadow_context *) bugle_object_get_current_data(bugle_get_context_class(), glshadow_context_view);
+    if (!ctx)
+        return BUGLE_TRUE;
+    type = glshadow_group_calls[call->generic.group];
+    if (bugle_gl_in_begin_end())
+        return BUGLE_TRUE;   /* Illegal, so nothing changes */
+    switch (bugle_gl_call_get_error(data->call_object))
+    {
+    case GL_NO_ERROR:
+        break;
+    case GL_OUT_OF_MEMORY:
+        /* The state is undefined */
+        glshadow_invalidate_range(ctx, 0, GLSHADOW_ITEM_COUNT);
+        glshadow_uniforms_forget();
+        return BUGLE_TRUE;
+    default:
+        /* Calls that generate other errors have no effect */
+        return BUGLE_TRUE;
+    }
+    if (bugle_displaylist_mode() != GL_NONE && type < GLSHADOW_CALL_INVALIDATE_ALL)
+    {
+        /* Some commands are executed rather than compiled. Rather than
+         * keeping track of which, assume that the state is now unknown.
+         */
+        if (type == GLSHADOW_CALL_UNIFORM)
+        {
+            glshadow_uniforms_forget();
+            ctx->generation++;
+        }
+        else if (glshadow_describe(ctx, call, &change))
+        {
+            glshadow_invalidate_range(ctx, change.item, 1);
+            if (change.item2 >= 0)
+                glshadow_invalidate_range(ctx, change.item2, 1);
+            if (change.item == GLSHADOW_ITEM_VERTEX_ARRAY)
+                glshadow_invalidate_range(ctx, GLSHADOW_ITEM_BUFFERS, GLSHADOW_BUFFER_TARGETS);
+        }
+        else if (type == GLSHADOW_CALL_BIND_TEXTURE)
+            glshadow_invalidate_range(ctx, GLSHADOW_ITEM_TEXTURES, GLSHADOW_TEXTURE_UNITS * GLSHADOW_TEXTURE_TARGETS);
+        return BUGLE_TRUE;
+    }
+
+    switch (type)
+    {
+    case GLSHADOW_CALL_NONE:
+        break;
+    case GLSHADOW_CALL_UNIFORM:
+        glshadow_uniform_update(ctx, call);
+        break;
+    case GLSHADOW_CALL_INVALIDATE_ALL:
+        glshadow_invalidate_range(ctx, 0, GLSHADOW_ITEM_COUNT);
+        glshadow_uniforms_forget();
+        break;
+    case GLSHADOW_CALL_INVALIDATE_TEXTURES:
+        glshadow_invalidate_range(ctx, GLSHADOW_ITEM_TEXTURES, GLSHADOW_TEXTURE_UNITS * GLSHADOW_TEXTURE_TARGETS);
+        break;
+    case GLSHADOW_CALL_INVALIDATE_BUFFERS:
+        glshadow_invalidate_range(ctx, GLSHADOW_ITEM_BUFFERS, GLSHADOW_BUFFER_TARGETS);
+        break;
+    case GLSHADOW_CALL_INVALIDATE_FRAMEBUFFERS:
+        glshadow_invalidate_range(ctx, GLSHADOW_ITEM_DRAW_FRAMEBUFFER, 1);
+        glshadow_invalidate_range(ctx, GLSHADOW_ITEM_READ_FRAMEBUFFER, 1);
+        break;
+    case GLSHADOW_CALL_INVALIDATE_VERTEX_ARRAY:
+        glshadow_invalidate_range(ctx, GLSHADOW_ITEM_VERTEX_ARRAY, 1);
+        glshadow_invalidate_range(ctx, GLSHADOW_ITEM_BUFFERS, GLSHADOW_BUFFER_TARGETS);
+        break;
+    case GLSHADOW_CALL_INVALIDATE_CAPS:
+        glshadow_invalidate_range(ctx, GLSHADOW_ITEM_CAPS, GLSHADOW_CAPS);
+        break;
+    case GLSHADOW_CALL_INVALIDATE_BLEND:
+        glshadow_invalidate_range(ctx, GLSHADOW_ITEM_BLEND_FUNC, 1);
+        glshadow_invalidate_range(ctx, GLSHADOW_ITEM_BLEND_EQUATION, 1);
+        break;
+    case GLSHADOW_CALL_INVALIDATE_COLOR_MASK:
+        glshadow_invalidate_range(ctx, GLSHADOW_ITEM_COLOR_MASK, 1);
+        break;
+    case GLSHADOW_CALL_INVALIDATE_VIEWPORT:
+        glshadow_invalidate_range(ctx, GLSHADOW_ITEM_VIEWPORT, 1);
+        glshadow_invalidate_range(ctx, GLSHADOW_ITEM_SCISSOR, 1);
+        break;
+    case GLSHADOW_CALL_DELETE_PROGRAM:
+        ctx->generation++;
+        if (ctx->items[GLSHADOW_ITEM_PROGRAM].value[0] == (GLint) *(const GLuint *) call->generic.args[0])
+            glshadow_invalidate_range(ctx, GLSHADOW_ITEM_PROGRAM, 1);
+        glshadow_program_forget(*(const GLuint *) call->generic.args[0]);
+        break;
+    case GLSHADOW_CALL_PROGRAM_UNIFORM:
+        ctx->generation++;
+        glshadow_program_forget(*(const GLuint *) call->generic.args[0]);
+        break;
+    default:
+        if (glshadow_describe(ctx, call, &change))
+        {
+            /* The element array binding belongs to the vertex array object */
+            if (change.item == GLSHADOW_ITEM_VERTEX_ARRAY
+                && !glshadow_item_matches(&ctx->items[change.item], &change))
+                glshadow_invalidate_range(ctx, GLSHADOW_ITEM_BUFFERS, GLSHADOW_BUFFER_TARGETS);
+            glshadow_item_set(&ctx->items[change.item], &change);
+            if (change.item2 >= 0)
+                glshadow_item_set(&ctx->items[change.item2], &change);
+        }
+        else if (type == GLSHADOW_CALL_BIND_TEXTURE)
+        {
+            /* The texture unit is unknown, so any binding may have changed */
+            glshadow_invalidate_range(ctx, GLSHADOW_ITEM_TEXTURES, GLSHADOW_TEXTURE_UNITS * GLSHADOW_TEXTURE_TARGETS);
+        }
+        break;
+    }
+    return BUGLE_TRUE;
+}
+
+static void glshadow_context_init(const void *key, void *data)
+{
+    glshadow_invalidate_range((glshadow_context *) data, 0, GLSHADOW_ITEM_COUNT);
+}
+
+static bugle_bool glshadow_filter_set_initialise(filter_set *handle)
+{
+    filter *f;
+    budgie_function i;
+
+    glshadow_handle = handle;
+    f = bugle_filter_new(handle, "glshadow");
+    bugle_filter_order("invoke", "glshadow");
+    bugle_gl_filter_post_renders("glshadow");
+    bugle_gl_filter_set_queries_error("glshadow");
+    for (i = 0; i < budgie_function_count(); i++)
+    {
+        budgie_group g = budgie_function_group(i);
+        if (glshadow_group_calls[g] != GLSHADOW_CALL_NONE)
+            bugle_filter_catches_function_id(f, i, BUGLE_TRUE, glshadow_update);
+    }
+
+    glshadow_context_view = bugle_object_view_new(bugle_get_context_class(),
+                                                  glshadow_context_init,
+                                                  NULL,
+                                                  sizeof(glshadow_context));
+    glshadow_namespace_view = bugle_object_view_new(bugle_get_namespace_class(),
+                                                    glshadow_namespace_init,
+                                                    glshadow_namespace_clear,
+                                                    sizeof(hashptr_table));
+    return BUGLE_TRUE;
+}
+
+/* Builds the tables that map groups to the state that they set */
+static void glshadow_tables_initialise(void)
+{
+    budgie_function f;
+    budgie_group g;
+    const char *name;
+    int i;
+
+    glshadow_group_calls = BUGLE_CALLOC(budgie_group_count(), glshadow_call);
+    glshadow_group_uniforms = BUGLE_NMALLOC(budgie_group_count(), int);
+    for (i = 0; i < budgie_group_count(); i++)
+        glshadow_group_uniforms[i] = -1;
+
+    for (i = 0; glshadow_calls[i].name; i++)
+    {
+        f = budgie_function_id(glshadow_calls[i].name);
+        if (f != NULL_FUNCTION)
+            glshadow_group_calls[budgie_function_group(f)] = glshadow_calls[i].call;
+    }
+    for (i = 0; glshadow_uniforms[i].name; i++)
+    {
+        f = budgie_function_id(glshadow_uniforms[i].name);
+        if (f != NULL_FUNCTION)
+        {
+            g = budgie_function_group(f);
+            glshadow_group_calls[g] = GLSHADOW_CALL_UNIFORM;
+            glshadow_group_uniforms[g] = i;
+        }
+    }
+    /* There are too many of these to list */
+    for (f = 0; f < budgie_function_count(); f++)
+    {
+        name = budgie_function_name(f);
+        if (strncmp(name, "glProgramUniform", 16) == 0)
+            glshadow_group_calls[budgie_function_group(f)] = GLSHADOW_CALL_PROGRAM_UNIFORM;
+    }
+}
+
+#else /* !BUGLE_GLTYPE_GL */
+
+bugle_bool bugle_glshadow_tracks(budgie_function f)
+{
+    return BUGLE_FALSE;
+}
+
+void bugle_glshadow_invalidate(void)
+{
+}
+
+unsigned long bugle_glshadow_fingerprint(void)
+{
+    return 0;
+}
+
+bugle_glshadow_status bugle_glshadow_classify(function_call *call)
+{
+    return BUGLE_GLSHADOW_UNTRACKED;
+}
+
+static bugle_bool glshadow_filter_set_initialise(filter_set *handle)
+{
+    return BUGLE_TRUE;
+}
+
+#endif /* !BUGLE_GLTYPE_GL */
+
+void glshadow_initialise(void)
+{
+    static const filter_set_info glshadow_info =
+    {
+        "glshadow",
+        glshadow_filter_set_initialise,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL /* No documentation */
+    };
+
+#if BUGLE_GLTYPE_GL
+    bugle_thread_lock_init(&glshadow_lock);
+    glshadow_tables_initialise();
+#endif
+
+    bugle_filter_set_new(&glshadow_info);
+
+    bugle_filter_set_depends("glshadow", "trackcontext");
+    bugle_filter_set_depends("glshadow", "error");
+    bugle_filter_set_depends("glshadow", "glbeginend");
+    bugle_filter_set_depends("glshadow", "gldisplaylist");
+}
@@ -1,5 +1,5 @@
 /*  BuGLe: an OpenGL debugging tool
- *  Copyright (C) 2004-2007, 2009-2010, 2013  Bruce Merry
+ *  Copyright (C) 2004-2007, 2009-2010, 2013-2014  Bruce Merry
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -36,6 +36,7 @@
 #include "budgielib/defines.h"
 #include "common/protocol.h"
 #include "platform/types.h"
+#include "platform/shm.h"
 
 static bugle_io_reader *lib_in = NULL;
 static bugle_io_writer *lib_out = NULL;
@@ -404,7 +405,7 @@ static bugle_pid_t execute(void (*child_init)(void))
         case GLDB_PROGRAM_TYPE_LOCAL:
             prog_argv[0] = "sh";
             prog_argv[1] = "-c";
-            prog_argv[2] = bugle_asprintf("%s%s BUGLE_CHAIN=%s LD_PRELOAD=libbugle.so BUGLE_DEBUGGER=fd BUGLE_DEBUGGER_FD_IN=%d BUGLE_DEBUGGER_FD_OUT=%d exec %s",
+            prog_argv[2] = bugle_asprintf("%s%s BUGLE_CHAIN=%s LD_PRELOAD=libbugle.so BUGLE_DEBUGGER=fd BUGLE_DEBUGGER_FD_IN=%d BUGLE_DEBUGGER_FD_OUT=%d BUGLE_DEBUGGER_SHM=1 exec %s",
                                           display ? "DISPLAY=" : "", display ? display : "",
                                           chain ? chain : "",
                                           out_pipe[0], in_pipe[1], command);
@@ -425,6 +426,7 @@ static bugle_pid_t execute(void (*child_init)(void))
                         " -ex \"set env BUGLE_DEBUGGER fd\""
                         " -ex \"set env BUGLE_DEBUGGER_FD_IN %d\""
                         " -ex \"set env BUGLE_DEBUGGER_FD_OUT %d\""
+                        " -ex \"set env BUGLE_DEBUGGER_SHM 1\""
                         " --args %s",
                         display ? "set env DISPLAY" : "", display ? display : "",
                         chain ? "set env BUGLE_CHAIN" : "", chain ? chain : "",
@@ -581,6 +583,20 @@ static gldb_response *gldb_get_response_screenshot(bugle_uint32_t code, bugle_ui
     return (gldb_response *) r;
 }
 
+static gldb_response *gldb_get_response_preview(bugle_uint32_t code, bugle_uint32_t id)
+{
+    gldb_response_preview *r;
+
+    r = BUGLE_MALLOC(gldb_response_preview);
+    r->code = code;
+    r->id = id;
+    gldb_protocol_recv_code(lib_in, &r->frame);
+    gldb_protocol_recv_code(lib_in, &r->width);
+    gldb_protocol_recv_code(lib_in, &r->height);
+    gldb_protocol_recv_binary_string(lib_in, &r->length, &r->data);
+    return (gldb_response *) r;
+}
+
 /* Recursively retrieves a state tree */
 static gldb_state *state_get(void)
 {
@@ -723,6 +739,33 @@ static gldb_response *gldb_get_response_data_buffer(bugle_uint32_t code, bugle_u
     return (gldb_response *) r;
 }
 
+/* Retrieves a payload that the target left in shared memory. The name is
+ * removed straight away, so that the memory goes away with the last
+ * mapping. The caller owns the returned buffer, which is why it is copied
+ * out of the mapping; it is nul-terminated like a binary string.
+ */
+static char *gldb_get_payload_shm(const char *name, bugle_uint32_t length)
+{
+    bugle_shm *shm;
+    char *data;
+
+    data = BUGLE_NMALLOC(length + 1, char);
+    shm = bugle_shm_open(name);
+    bugle_shm_unlink(name);
+    if (!shm || bugle_shm_size(shm) < length)
+    {
+        fprintf(stderr, "Failed to map %s: %s\n", name,
+                shm ? "segment is too small" : strerror(errno));
+        memset(data, 0, length);
+    }
+    else
+        memcpy(data, bugle_shm_data(shm), length);
+    if (shm)
+        bugle_shm_close(shm);
+    data[length] = '\0';
+    return data;
+}
+
 static gldb_response *gldb_get_response_data(bugle_uint32_t code, bugle_uint32_t id)
 {
     bugle_uint32_t subtype;
@@ -730,7 +773,19 @@ static gldb_response *gldb_get_response_data(bugle_uint32_t code, bugle_uint32_t
     char *data;
 
     gldb_protocol_recv_code(lib_in, &subtype);
-    gldb_protocol_recv_binary_string(lib_in, &length, &data);
+    if (code == RESP_DATA_SHM)
+    {
+        char *name;
+
+        gldb_protocol_recv_string(lib_in, &name);
+        gldb_protocol_recv_code(lib_in, &length);
+        data = gldb_get_payload_shm(name, length);
+        bugle_free(name);
+        /* The rest of gldb need not know how the data arrived */
+        code = RESP_DATA;
+    }
+    else
+        gldb_protocol_recv_binary_string(lib_in, &length, &data);
     switch (subtype)
     {
     case REQ_DATA_TEXTURE:
@@ -769,7 +824,10 @@ gldb_response *gldb_get_response(void)
     case RESP_RUNNING: return gldb_get_response_running(code, id);
     case RESP_SCREENSHOT: return gldb_get_response_screenshot(code, id);
     case RESP_STATE_NODE_BEGIN_RAW: return gldb_get_response_state_tree(code, id);
-    case RESP_DATA: return gldb_get_response_data(code, id);
+    case RESP_DATA:
+    case RESP_DATA_SHM:
+        return gldb_get_response_data(code, id);
+    case RESP_PREVIEW: return gldb_get_response_preview(code, id);
     default:
         fprintf(stderr, "Unexpected response %#08x\n", code);
         return NULL;
@@ -802,6 +860,9 @@ void gldb_free_response(gldb_response *r)
     case RESP_DATA:
         bugle_free(((gldb_response_data *) r)->data);
         break;
+    case RESP_PREVIEW:
+        bugle_free(((gldb_response_preview *) r)->data);
+        break;
     }
     bugle_free(r);
 }
@@ -1066,6 +1127,17 @@ void gldb_send_async(bugle_uint32_t id)
     gldb_protocol_send_code(lib_out, id);
 }
 
+void gldb_send_preview(bugle_uint32_t id, bugle_uint32_t interval,
+                       bugle_uint32_t max_width, bugle_uint32_t max_height)
+{
+    assert(status != GLDB_STATUS_DEAD);
+    gldb_protocol_send_code(lib_out, REQ_PREVIEW);
+    gldb_protocol_send_code(lib_out, id);
+    gldb_protocol_send_code(lib_out, interval);
+    gldb_protocol_send_code(lib_out, max_width);
+    gldb_protocol_send_code(lib_out, max_height);
+}
+
 void gldb_send_state_tree(bugle_uint32_t id)
 {
     assert(status != GLDB_STATUS_DEAD);
@@ -1,5 +1,5 @@
 /*  BuGLe: an OpenGL debugging tool
- *  Copyright (C) 2004-2007, 2009-2010, 2013  Bruce Merry
+ *  Copyright (C) 2004-2007, 2009-2010, 2013-2014  Bruce Merry
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -159,6 +159,20 @@ typedef struct
     gldb_state *root;
 } gldb_response_state_tree;
 
+/* A frame of the live preview, as GL_RGB/GL_UNSIGNED_BYTE with rows packed
+ * bottom-up and no padding. The id is that of the subscribing request.
+ */
+typedef struct
+{
+    bugle_uint32_t code;
+    bugle_uint32_t id;
+    bugle_uint32_t frame;
+    bugle_uint32_t width;
+    bugle_uint32_t height;
+    char *data;
+    bugle_uint32_t length;
+} gldb_response_preview;
+
 typedef struct
 {
     bugle_uint32_t code;
@@ -260,6 +274,11 @@ void gldb_send_step(bugle_uint32_t id);
 void gldb_send_enable_disable(bugle_uint32_t id, const char *filterset, bugle_bool enable);
 void gldb_send_screenshot(bugle_uint32_t id);
 void gldb_send_async(bugle_uint32_t id);
+/* Asks for a preview of the window every interval frames, shrunk to fit
+ * the given size, while the program runs. An interval of 0 stops it.
+ */
+void gldb_send_preview(bugle_uint32_t id, bugle_uint32_t interval,
+                       bugle_uint32_t max_width, bugle_uint32_t max_height);
 void gldb_send_state_tree(bugle_uint32_t id);
 void gldb_send_data_texture(bugle_uint32_t id, GLuint tex_id, GLenum target,
                             GLenum face, GLint level, GLenum format,
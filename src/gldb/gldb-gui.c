@@ -1,5 +1,5 @@
 /*  BuGLe: an OpenGL debugging tool
- *  Copyright (C) 2004-2007, 2009-2010  Bruce Merry
+ *  Copyright (C) 2004-2007, 2009-2010, 2014  Bruce Merry
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -60,6 +60,14 @@ static linked_list response_handlers;
 static guint32 seq = 0;
 static GdkCursor *wait_cursor = NULL;
 
+/* The live preview is taken every PREVIEW_INTERVAL frames and shrunk to
+ * fit in PREVIEW_WIDTH x PREVIEW_HEIGHT, which keeps the cost to the
+ * program small.
+ */
+#define PREVIEW_INTERVAL 10
+#define PREVIEW_WIDTH 320
+#define PREVIEW_HEIGHT 240
+
 /* Callback functions for gldb-common.c */
 void gldb_error(const char *fmt, ...)
 {
@@ -211,6 +219,10 @@ typedef struct GldbWindow
     bugle_workqueue *queue;
     guint queue_watch;
 
+    GtkWidget *preview_window;
+    GtkWidget *preview_image;
+    guint32 preview_id;
+
     GPtrArray *panes;
 } GldbWindow;
 
@@ -410,6 +422,42 @@ static void notebook_switch_page(GtkNotebook *notebook,
     notebook_update((GldbWindow *) user_data, page_num);
 }
 
+static void preview_stop(GldbWindow *context)
+{
+    GtkAction *action;
+
+    action = gtk_action_group_get_action(context->live_actions, "Preview");
+    gtk_toggle_action_set_active(GTK_TOGGLE_ACTION(action), FALSE);
+}
+
+static void preview_update(GldbWindow *context, gldb_response_preview *r)
+{
+    GdkPixbuf *pixbuf;
+    guchar *pixels;
+    int rowstride;
+    guint32 y;
+    gchar *title;
+
+    if (!context->preview_window || r->id != context->preview_id
+        || r->width == 0 || r->height == 0
+        || r->length / 3 / r->width < r->height)
+        return;
+
+    /* The data are bottom-up, while the pixbuf is top-down */
+    pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, r->width, r->height);
+    pixels = gdk_pixbuf_get_pixels(pixbuf);
+    rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    for (y = 0; y < r->height; y++)
+        memcpy(pixels + (r->height - 1 - y) * rowstride,
+               r->data + y * r->width * 3, r->width * 3);
+    gtk_image_set_from_pixbuf(GTK_IMAGE(context->preview_image), pixbuf);
+    g_object_unref(pixbuf);
+
+    title = bugle_asprintf(_("Preview (frame %lu)"), (unsigned long) r->frame);
+    gtk_window_set_title(GTK_WINDOW(context->preview_window), title);
+    bugle_free(title);
+}
+
 static void child_exit_notify(GldbWindow *context)
 {
     if (context->queue)
@@ -422,6 +470,7 @@ static void child_exit_notify(GldbWindow *context)
     }
 
     gldb_notify_child_dead();
+    preview_stop(context);
 
     update_status_bar(context, _("Not running"));
     gtk_action_group_set_sensitive(context->running_actions, FALSE);
@@ -500,8 +549,14 @@ static gboolean response_callback(bugle_workqueue *queue, gpointer user_data)
                                             ((gldb_response_error *) r)->error);
             gtk_dialog_run(GTK_DIALOG(dialog));
             gtk_widget_destroy(dialog);
+            /* The target drops the subscription if the preview fails */
+            if (r->id == context->preview_id)
+                preview_stop(context);
         }
         break;
+    case RESP_PREVIEW:
+        preview_update(context, (gldb_response_preview *) r);
+        break;
     case RESP_RUNNING:
         update_status_bar(context, _("Running"));
         gtk_action_group_set_sensitive(context->running_actions, TRUE);
@@ -660,6 +715,49 @@ static void kill_action(GtkAction *action, gpointer user_data)
     gldb_send_quit(seq++);
 }
 
+static gboolean preview_delete_event(GtkWidget *widget, GdkEvent *event,
+                                     gpointer user_data)
+{
+    preview_stop((GldbWindow *) user_data);
+    return TRUE;
+}
+
+static void preview_action(GtkAction *action, gpointer user_data)
+{
+    GldbWindow *context;
+
+    context = (GldbWindow *) user_data;
+    if (gtk_toggle_action_get_active(GTK_TOGGLE_ACTION(action)))
+    {
+        if (!context->preview_window)
+        {
+            context->preview_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+            gtk_window_set_title(GTK_WINDOW(context->preview_window), _("Preview"));
+            gtk_window_set_transient_for(GTK_WINDOW(context->preview_window),
+                                         GTK_WINDOW(context->window));
+            context->preview_image = gtk_image_new();
+            gtk_widget_set_size_request(context->preview_image,
+                                        PREVIEW_WIDTH, PREVIEW_HEIGHT);
+            gtk_container_add(GTK_CONTAINER(context->preview_window),
+                              context->preview_image);
+            g_signal_connect(G_OBJECT(context->preview_window), "delete-event",
+                             G_CALLBACK(preview_delete_event), context);
+        }
+        gtk_image_set_from_pixbuf(GTK_IMAGE(context->preview_image), NULL);
+        gtk_widget_show_all(context->preview_window);
+        context->preview_id = seq++;
+        gldb_send_preview(context->preview_id, PREVIEW_INTERVAL,
+                          PREVIEW_WIDTH, PREVIEW_HEIGHT);
+    }
+    else
+    {
+        if (context->preview_window)
+            gtk_widget_hide(context->preview_window);
+        if (gldb_get_status() != GLDB_STATUS_DEAD)
+            gldb_send_preview(seq++, 0, 0, 0);
+    }
+}
+
 static void target_action(GtkAction *action, gpointer user_data)
 {
     GldbWindow *context;
@@ -753,6 +851,7 @@ static const gchar *ui_desc =
 "      <menuitem action='Step' />"
 "      <menuitem action='Kill' />"
 "      <separator />"
+"      <menuitem action='Preview' />"
 "      <menuitem action='AttachGDB' />"
 "    </menu>"
 #if HAVE_GTK2_6
@@ -796,6 +895,11 @@ static GtkActionEntry live_action_desc[] =
     { "AttachGDB", NULL, "Attach _GDB", NULL, NULL, G_CALLBACK(attach_gdb_action) }
 };
 
+static GtkToggleActionEntry live_toggle_action_desc[] =
+{
+    { "Preview", NULL, "Live _Preview", NULL, NULL, G_CALLBACK(preview_action), FALSE }
+};
+
 static GtkActionEntry dead_action_desc[] =
 {
     { "Run", NULL, "_Run", NULL, NULL, G_CALLBACK(run_action) }
@@ -818,6 +922,8 @@ static GtkUIManager *build_ui(GldbWindow *context)
     context->live_actions = gtk_action_group_new("LiveActions");
     gtk_action_group_add_actions(context->live_actions, live_action_desc,
                                  G_N_ELEMENTS(live_action_desc), context);
+    gtk_action_group_add_toggle_actions(context->live_actions, live_toggle_action_desc,
+                                        G_N_ELEMENTS(live_toggle_action_desc), context);
     context->dead_actions = gtk_action_group_new("DeadActions");
     gtk_action_group_add_actions(context->dead_actions, dead_action_desc,
                                  G_N_ELEMENTS(dead_action_desc), context);
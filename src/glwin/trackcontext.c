@@ -40,6 +40,15 @@
  * use of the context. However, some of the useful information is passed
  * as parameters to glXCreate[New]Context, so they are put in
  * a trackcontext_data struct in the initial_values hash.
+ *
+ * Namespace objects are keyed by a share group number rather than by the
+ * context, since the context that created the share group may be destroyed
+ * (and its address reused) while other contexts still use the namespace.
+ *
+ * Each thread caches the object for the context it last made current, to
+ * avoid taking context_mutex when an application switches back and forth.
+ * Destroying a context increments trackcontext_generation, which
+ * invalidates all the caches.
  */
 
 static object_class *bugle_context_class;
@@ -48,10 +57,14 @@ static hashptr_table context_objects, namespace_objects;
 static hashptr_table initial_values;
 static object_view trackcontext_view;
 static bugle_thread_lock_t context_mutex;
+static size_t trackcontext_next_share_group = 1;  /* Protected by context_mutex */
+static volatile bugle_atomic_t trackcontext_generation = 0;
+static bugle_thread_key_t trackcontext_cache_key;
 
 typedef struct
 {
     glwin_context root_context;  /* context that owns the namespace - possibly self */
+    size_t share_group;          /* key into namespace_objects */
     glwin_context aux_shared;
     glwin_context aux_unshared;
     glwin_context_create *create;
@@ -59,6 +72,19 @@ typedef struct
     GLuint font_texture;
 } trackcontext_data;
 
+typedef struct
+{
+    object *obj;
+    size_t refs;                 /* Number of context objects using it */
+} trackcontext_namespace;
+
+typedef struct
+{
+    glwin_context ctx;
+    object *obj;
+    bugle_atomic_t generation;
+} trackcontext_cache;
+
 /* FIXME-GLES */
 #if BUGLE_GLTYPE_GL
 /* Extracted from Unifont - see LICENSE for details. Each byte is one 8-pixel
@@ -269,6 +295,8 @@ bugle_bool bugle_glwin_newcontext(glwin_context_create *create)
     base->aux_shared = NULL;
     base->aux_unshared = NULL;
     base->create = create;
+    base->root_context = create->ctx;
+    base->share_group = 0;
     if (create->share)
     {
         up = (trackcontext_data *) bugle_hashptr_get(&initial_values, create->share);
@@ -276,11 +304,15 @@ bugle_bool bugle_glwin_newcontext(glwin_context_create *create)
         {
             bugle_log_printf("trackcontext", "newcontext", BUGLE_LOG_WARNING,
                              "share context %p unknown", (void *) create->share);
-            base->root_context = create->ctx;
         }
         else
+        {
             base->root_context = up->root_context;
+            base->share_group = up->share_group;
+        }
     }
+    if (base->share_group == 0)
+        base->share_group = trackcontext_next_share_group++;
 
     bugle_hashptr_set(&initial_values, create->ctx, base);
     bugle_thread_lock_unlock(&context_mutex);
@@ -298,11 +330,26 @@ static bugle_bool trackcontext_newcontext(function_call *call, const callback_da
     return BUGLE_TRUE;
 }
 
+static trackcontext_cache *trackcontext_get_cache(void)
+{
+    trackcontext_cache *cache;
+
+    cache = (trackcontext_cache *) bugle_thread_getspecific(trackcontext_cache_key);
+    if (cache == NULL)
+    {
+        cache = BUGLE_ZALLOC(trackcontext_cache);
+        bugle_thread_setspecific(trackcontext_cache_key, cache);
+    }
+    return cache;
+}
+
 static bugle_bool trackcontext_callback(function_call *call, const callback_data *data)
 {
     glwin_context ctx;
-    object *obj, *ns;
+    object *obj;
+    trackcontext_namespace *ns;
     trackcontext_data *initial, *view;
+    trackcontext_cache *cache;
 
     /* These calls may fail, so we must explicitly check for the
      * current context.
@@ -312,6 +359,14 @@ static bugle_bool trackcontext_callback(function_call *call, const callback_data
         bugle_object_set_current(bugle_context_class, NULL);
     else
     {
+        cache = trackcontext_get_cache();
+        if (cache->ctx == ctx && cache->obj != NULL
+            && cache->generation == bugle_atomic_get(&trackcontext_generation))
+        {
+            bugle_object_set_current(bugle_context_class, cache->obj);
+            return BUGLE_TRUE;
+        }
+
         bugle_thread_lock_lock(&context_mutex);
         obj = bugle_hashptr_get(&context_objects, ctx);
         if (!obj)
@@ -329,18 +384,29 @@ static bugle_bool trackcontext_callback(function_call *call, const callback_data
             {
                 view = bugle_object_get_data(obj, trackcontext_view);
                 *view = *initial;
-                ns = bugle_hashptr_get(&namespace_objects, view->root_context);
+                /* The context object now owns the creation parameters */
+                initial->create = NULL;
+                ns = bugle_hashptr_get_int(&namespace_objects, view->share_group);
                 if (!ns)
                 {
-                    ns = bugle_object_new(bugle_namespace_class, ctx, BUGLE_TRUE);
-                    bugle_hashptr_set(&namespace_objects, ctx, ns);
+                    ns = BUGLE_MALLOC(trackcontext_namespace);
+                    ns->obj = bugle_object_new(bugle_namespace_class, ctx, BUGLE_TRUE);
+                    ns->refs = 1;
+                    bugle_hashptr_set_int(&namespace_objects, view->share_group, ns);
                 }
                 else
-                    bugle_object_set_current(bugle_namespace_class, ns);
+                {
+                    ns->refs++;
+                    bugle_object_set_current(bugle_namespace_class, ns->obj);
+                }
             }
         }
         else
             bugle_object_set_current(bugle_context_class, obj);
+
+        cache->ctx = ctx;
+        cache->obj = obj;
+        cache->generation = bugle_atomic_get(&trackcontext_generation);
         bugle_thread_lock_unlock(&context_mutex);
     }
     return BUGLE_TRUE;
@@ -349,14 +415,53 @@ static bugle_bool trackcontext_callback(function_call *call, const callback_data
 static bugle_bool trackcontext_destroycontext(function_call *call, const callback_data *data)
 {
     glwin_context ctx;
+    object *obj;
+    trackcontext_data *view;
+    trackcontext_namespace *ns;
 
-    /* FIXME: leaks from namespace associations */
     ctx = bugle_glwin_get_context_destroy(call);
     if (ctx)
-        bugle_hashptr_set(&context_objects, ctx, NULL);
+    {
+        bugle_thread_lock_lock(&context_mutex);
+        obj = bugle_hashptr_get(&context_objects, ctx);
+        if (obj != NULL)
+        {
+            view = bugle_object_get_data(obj, trackcontext_view);
+            if (view->share_group != 0)
+            {
+                ns = bugle_hashptr_get_int(&namespace_objects, view->share_group);
+                if (ns != NULL && --ns->refs == 0)
+                    bugle_hashptr_remove_int(&namespace_objects, view->share_group);
+            }
+            bugle_hashptr_remove(&context_objects, ctx);
+        }
+        bugle_hashptr_remove(&initial_values, ctx);
+        /* Invalidate any cached pointers to the object */
+        bugle_atomic_add(&trackcontext_generation, 1);
+        bugle_thread_lock_unlock(&context_mutex);
+    }
     return BUGLE_TRUE;
 }
 
+static void trackcontext_initial_free(void *data)
+{
+    trackcontext_data *d;
+
+    d = (trackcontext_data *) data;
+    if (d->create)
+        bugle_glwin_context_create_free(d->create);
+    bugle_free(d);
+}
+
+static void trackcontext_namespace_free(void *data)
+{
+    trackcontext_namespace *ns;
+
+    ns = (trackcontext_namespace *) data;
+    bugle_object_free(ns->obj);
+    bugle_free(ns);
+}
+
 static void trackcontext_data_clear(void *data)
 {
     trackcontext_data *d;
@@ -393,8 +498,9 @@ static bugle_bool trackcontext_filter_set_initialise(filter_set *handle)
     bugle_context_class = bugle_object_class_new(NULL);
     bugle_namespace_class = bugle_object_class_new(bugle_context_class);
     bugle_hashptr_init(&context_objects, (void (*)(void *)) bugle_object_free);
-    bugle_hashptr_init(&namespace_objects, (void (*)(void *)) bugle_object_free);
-    bugle_hashptr_init(&initial_values, bugle_free);
+    bugle_hashptr_init(&namespace_objects, trackcontext_namespace_free);
+    bugle_hashptr_init(&initial_values, trackcontext_initial_free);
+    bugle_thread_key_create(&trackcontext_cache_key, bugle_free);
 
     f = bugle_filter_new(handle, "trackcontext");
     bugle_filter_order("invoke", "trackcontext");
@@ -416,8 +522,9 @@ static bugle_bool trackcontext_filter_set_initialise(filter_set *handle)
 
 static void trackcontext_filter_set_shutdown(filter_set *handle)
 {
-    bugle_hashptr_clear(&context_objects);
+    bugle_atomic_add(&trackcontext_generation, 1);
     bugle_hashptr_clear(&namespace_objects);
+    bugle_hashptr_clear(&context_objects);
     bugle_hashptr_clear(&initial_values);
     bugle_object_class_free(bugle_namespace_class);
     bugle_object_class_free(bugle_context_class);
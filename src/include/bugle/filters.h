@@ -1,5 +1,5 @@
 /*  BuGLe: an OpenGL debugging tool
- *  Copyright (C) 2004-2006, 2009  Bruce Merry
+ *  Copyright (C) 2004-2006, 2009, 2014  Bruce Merry
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -126,10 +126,22 @@ BUGLE_EXPORT_PRE void        bugle_filter_catches_function(filter *handle, const
 BUGLE_EXPORT_PRE void        bugle_filter_catches_function_id(filter *handle, budgie_function, bugle_bool inactive, filter_callback callback) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE void        bugle_filter_catches_all(filter *handle, bugle_bool inactive, filter_callback callback) BUGLE_EXPORT_POST;
 
+/* Profiling of the filters themselves. While a profiler is installed, it is
+ * called after every callback with the filter that owns the callback and
+ * the time it took in seconds, possibly from several threads at once. It
+ * should only be installed or removed while loading or unloading a
+ * filter-set. When no profiler is installed, no timing is done.
+ */
+typedef void (*filter_profiler)(const filter *f, double elapsed);
+BUGLE_EXPORT_PRE void        bugle_filters_set_profiler(filter_profiler profiler) BUGLE_EXPORT_POST;
+
 BUGLE_EXPORT_PRE object_class *bugle_get_call_class(void) BUGLE_EXPORT_POST;
 
 /* Other run-time functions */
 BUGLE_EXPORT_PRE filter_set *bugle_filter_set_get_handle(const char *name) BUGLE_EXPORT_POST;
+BUGLE_EXPORT_PRE const char *bugle_filter_set_get_name(const filter_set *handle) BUGLE_EXPORT_POST;
+/* Calls callback for every registered filter-set, whether or not it is loaded */
+BUGLE_EXPORT_PRE void        bugle_filter_set_foreach(void (*callback)(filter_set *handle, void *arg), void *arg) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE bugle_bool  bugle_filter_set_is_loaded(const filter_set *handle) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE bugle_bool  bugle_filter_set_is_active(const filter_set *handle) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE void *      bugle_filter_set_get_symbol(filter_set *handle, const char *name) BUGLE_EXPORT_POST;
@@ -0,0 +1,72 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BUGLE_GL_GLSHADOW_H
+#define BUGLE_GL_GLSHADOW_H
+
+#include <bugle/bool.h>
+#include <bugle/export.h>
+#include <budgie/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A shadow of the commonly set state of each context (bindings, enables,
+ * blend and depth state, viewport and the values of uniforms), which is
+ * updated after each call that sets it. State that is set in some way
+ * that is not tracked is marked as unknown.
+ */
+typedef enum
+{
+    BUGLE_GLSHADOW_UNTRACKED,   /* Does not set shadowed state */
+    BUGLE_GLSHADOW_EFFECTIVE,   /* Changes the state, or the old state is unknown */
+    BUGLE_GLSHADOW_REDUNDANT    /* Sets the state to its current value */
+} bugle_glshadow_status;
+
+/* True if the function may be classified as other than untracked */
+BUGLE_EXPORT_PRE bugle_bool bugle_glshadow_tracks(budgie_function f) BUGLE_EXPORT_POST;
+
+/* Compares a call against the shadowed state. This must be done before the
+ * call is invoked, and glshadow is required.
+ */
+BUGLE_EXPORT_PRE bugle_glshadow_status bugle_glshadow_classify(function_call *call) BUGLE_EXPORT_POST;
+
+/* Returns a hash of the shadowed state of the current context that affects
+ * drawing, including the uniforms of the current program. Equal
+ * fingerprints mean that the state is (almost certainly) the same: state
+ * that becomes unknown changes the fingerprint, even if it is later set
+ * back to the same value. Returns 0 when the state cannot be tracked.
+ */
+BUGLE_EXPORT_PRE unsigned long bugle_glshadow_fingerprint(void) BUGLE_EXPORT_POST;
+
+/* Marks all the shadowed state of the current context as unknown. This must
+ * be called by filter-sets that use CALL to change shadowed state without
+ * restoring it. Work done in the aux context does not need it, since the
+ * shadow belongs to the application's context, which is still current as
+ * far as trackcontext is concerned.
+ */
+BUGLE_EXPORT_PRE void bugle_glshadow_invalidate(void) BUGLE_EXPORT_POST;
+
+/* Used by the initialisation code */
+void glshadow_initialise(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !BUGLE_GL_GLSHADOW_H */
@@ -30,14 +30,15 @@ typedef struct
 {
     char *key;
     void *value;
+    size_t hash;                /* Cached hash of key */
 } hash_table_entry;
 
 typedef struct
 {
     hash_table_entry *entries;
-    size_t size;
+    size_t size;                /* Always 0 or a power of 2 */
     size_t count;
-    int size_index;
+    bugle_bool copy_keys;
     void (*destructor)(void *);
 } hash_table;
 
@@ -45,15 +46,25 @@ typedef struct
  * even if the value is NULL.
  */
 BUGLE_EXPORT_PRE void bugle_hash_init(hash_table *table, void (*destructor)(void *)) BUGLE_EXPORT_POST;
+/* Like bugle_hash_init, but the table stores the key pointers it is given
+ * rather than copies. The caller must keep each key valid until it is
+ * removed or the table is cleared.
+ */
+BUGLE_EXPORT_PRE void bugle_hash_init_nocopy(hash_table *table, void (*destructor)(void *)) BUGLE_EXPORT_POST;
+/* Makes room for count entries in total without further reallocation */
+BUGLE_EXPORT_PRE void bugle_hash_reserve(hash_table *table, size_t count) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE void bugle_hash_set(hash_table *table, const char *key, void *value) BUGLE_EXPORT_POST;
 /* Determines whether the key is present */
 BUGLE_EXPORT_PRE bugle_bool bugle_hash_count(const hash_table *table, const char *key) BUGLE_EXPORT_POST;
 /* Returns NULL if key absent OR if value is NULL */
 BUGLE_EXPORT_PRE void *bugle_hash_get(const hash_table *table, const char *key) BUGLE_EXPORT_POST;
+/* Removes the key (if present), calling the destructor on the value */
+BUGLE_EXPORT_PRE void bugle_hash_remove(hash_table *table, const char *key) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE void bugle_hash_clear(hash_table *table) BUGLE_EXPORT_POST;
 
 /* Walk the hash table. A walker loop looks like this:
  * for (h = bugle_hash_begin(&table); h; h = bugle_hash_next(&table, h))
+ * The table must not be modified during the walk.
  */
 BUGLE_EXPORT_PRE const hash_table_entry *bugle_hash_begin(hash_table *table) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE const hash_table_entry *bugle_hash_next(hash_table *table, const hash_table_entry *e) BUGLE_EXPORT_POST;
@@ -73,14 +84,17 @@ typedef struct
     hashptr_table_entry *entries;
     size_t size;
     size_t count;
-    int size_index;
     void (*destructor)(void *);
 } hashptr_table;
 
+/* NULL cannot be used as a key */
 BUGLE_EXPORT_PRE void bugle_hashptr_init(hashptr_table *table, void (*destructor)(void *)) BUGLE_EXPORT_POST;
+BUGLE_EXPORT_PRE void bugle_hashptr_reserve(hashptr_table *table, size_t count) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE void bugle_hashptr_set(hashptr_table *table, const void *key, void *value) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE bugle_bool bugle_hashptr_count(const hashptr_table *table, const void *key) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE void *bugle_hashptr_get(const hashptr_table *table, const void *key) BUGLE_EXPORT_POST;
+/* Removes the key (if present), calling the destructor on the value */
+BUGLE_EXPORT_PRE void bugle_hashptr_remove(hashptr_table *table, const void *key) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE void bugle_hashptr_clear(hashptr_table *table) BUGLE_EXPORT_POST;
 
 BUGLE_EXPORT_PRE const hashptr_table_entry *bugle_hashptr_begin(hashptr_table *table) BUGLE_EXPORT_POST;
@@ -96,6 +110,11 @@ static inline void *bugle_hashptr_get_int(hashptr_table *table, size_t key)
     return bugle_hashptr_get(table, (const void *) key);
 }
 
+static inline void bugle_hashptr_remove_int(hashptr_table *table, size_t key)
+{
+    bugle_hashptr_remove(table, (const void *) key);
+}
+
 #ifdef __cplusplus
 }
 #endif
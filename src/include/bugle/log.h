@@ -1,5 +1,5 @@
 /*  BuGLe: an OpenGL debugging tool
- *  Copyright (C) 2004-2007, 2009  Bruce Merry
+ *  Copyright (C) 2004-2007, 2009, 2014  Bruce Merry
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -26,6 +26,7 @@
 #define BUGLE_SRC_LOG_H
 
 #include <bugle/filters.h>
+#include <bugle/bool.h>
 #include <bugle/attributes.h>
 #include <bugle/export.h>
 
@@ -59,9 +60,22 @@ BUGLE_EXPORT_PRE void bugle_log_printf(const char *filterset, const char *event,
 BUGLE_EXPORT_PRE void bugle_log_callback(const char *filterset, const char *event, int severity,
                                          void (*callback)(void *arg, FILE *f), void *arg) BUGLE_EXPORT_POST;
 
+/* Retrieves the total number of messages that have been suppressed as
+ * duplicates and by rate limits.
+ */
+BUGLE_EXPORT_PRE void bugle_log_get_suppressed(unsigned long *repeated, unsigned long *limited) BUGLE_EXPORT_POST;
+
 /* Used internally by the initialisation code */
 void log_initialise(void);
 
+/* Limits the messages logged by a filter-set, to prevent floods. At most
+ * rate messages per second are logged for each event (0 for no limit), and
+ * if collapse is true, consecutive identical messages for an event are
+ * replaced by a count. This is called when each filter-set is loaded, with
+ * its log_rate and log_collapse options.
+ */
+void bugle_log_limit(const char *filterset, long rate, bugle_bool collapse);
+
 #ifdef __cplusplus
 }
 #endif
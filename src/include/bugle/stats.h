@@ -1,5 +1,5 @@
 /*  BuGLe: an OpenGL debugging tool
- *  Copyright (C) 2004-2006, 2009  Bruce Merry
+ *  Copyright (C) 2004-2006, 2009, 2014  Bruce Merry
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -31,7 +31,8 @@ typedef enum
 {
     STATS_EXPRESSION_NUMBER,
     STATS_EXPRESSION_OPERATION,
-    STATS_EXPRESSION_SIGNAL
+    STATS_EXPRESSION_SIGNAL,
+    STATS_EXPRESSION_WINDOW
 } stats_expression_type;
 
 typedef enum
@@ -45,33 +46,56 @@ typedef enum
     STATS_OPERATION_DELTA,
     STATS_OPERATION_AVERAGE,
     STATS_OPERATION_START,
-    STATS_OPERATION_END
+    STATS_OPERATION_END,
+    STATS_OPERATION_MIN,
+    STATS_OPERATION_MAX,
+    STATS_OPERATION_MEAN,
+    STATS_OPERATION_STDDEV,
+    STATS_OPERATION_PERCENTILE
 } stats_operation_type;
 
 /* An uninitialised signal has NaN as its value. This indicates to the
  * integrator that the last_updated field is invalid, and also means that
  * displaying the value makes it clear that no value exists.
+ *
+ * Increments made with bugle_stats_signal_add are accumulated in
+ * per-thread shards and only merged when the values are gathered, so
+ * the value field holds the last value set with bugle_stats_signal_update
+ * and add_base holds the shard total at that point. Only signals that are
+ * integrated (those used with a()) keep a timestamp and are updated
+ * centrally.
  */
 typedef struct stats_signal_s
 {
     double value;
     double integral;                /* value integrated over time */
+    double add_base;                /* shard total when value was set */
     bugle_timespec last_updated;
     int offset;                     /* for value tables */
+    bugle_bool integrate;           /* maintain the integral */
 
     bugle_bool active;
     void *user_data;
     bugle_bool (*activate)(struct stats_signal_s *);
 } stats_signal;
 
+/* The history of a windowed expression, which is private to stats.c */
+typedef struct stats_window_s stats_window;
+
+/* A windowed expression aggregates the values of its left child over the
+ * last few evaluations. Each evaluation adds a sample, unless its interval
+ * overlaps the interval of the previous sample (as happens when several
+ * loggers show the same statistic).
+ */
 typedef struct stats_expression_s
 {
     stats_expression_type type;
     stats_operation_type op;
-    double value;                       /* for number type */
+    double value;                       /* for number type, and the percentile for windows */
     char *signal_name;                  /* for signal types */
     stats_signal *signal;               /* for signal types */
-    struct stats_expression_s *left, *right;   /* for computations (right is NULL for uminus) */
+    struct stats_expression_s *left, *right;   /* for computations (right is NULL for uminus and windows) */
+    stats_window *window;               /* for window types */
 } stats_expression;
 
 typedef struct
@@ -97,6 +121,10 @@ typedef struct
 linked_list *stats_statistics_get_list(void);
 void statistics_initialise(void);
 void stats_statistic_free(stats_statistic *st);
+/* Creates the history for a windowed operation, covering length samples if
+ * seconds is BUGLE_FALSE, or length seconds otherwise.
+ */
+stats_window *stats_window_new(stats_operation_type op, double length, bugle_bool seconds);
 
 /*** Public API for generators ***/
 
@@ -107,10 +135,14 @@ void stats_statistic_free(stats_statistic *st);
  */
 BUGLE_EXPORT_PRE stats_signal *bugle_stats_signal_new(const char *name, void *user_data,
                                                       bugle_bool (*activate)(stats_signal *)) BUGLE_EXPORT_POST;
-/* Sets a new value, replacing any previous one */
+/* Sets a new value, replacing any previous one. This takes a lock, so it
+ * should not be used for high-frequency updates.
+ */
 BUGLE_EXPORT_PRE void bugle_stats_signal_update(stats_signal *si, double v) BUGLE_EXPORT_POST;
 
-/* Convenience for accumulating signals */
+/* Accumulates into a signal. This is cheap and may be called from any
+ * thread; increments are merged when the values are gathered.
+ */
 BUGLE_EXPORT_PRE void bugle_stats_signal_add(stats_signal *si, double dv) BUGLE_EXPORT_POST;
 
 BUGLE_EXPORT_PRE void bugle_filter_set_stats_generator(const char *name) BUGLE_EXPORT_POST;
@@ -36,4 +36,15 @@ typedef struct bugle_timespec_s
  */
 BUGLE_EXPORT_PRE int bugle_gettime(bugle_timespec *tv) BUGLE_EXPORT_POST;
 
+/* Like bugle_gettime, but cheaper where the platform has a stable cycle
+ * counter, which is calibrated against bugle_gettime on first use. The
+ * clocks share an origin but may drift apart slightly over long periods,
+ * so timestamps from the two should not be compared with each other.
+ * Otherwise, it is equivalent to bugle_gettime.
+ */
+BUGLE_EXPORT_PRE int bugle_gettime_fast(bugle_timespec *tv) BUGLE_EXPORT_POST;
+
+/* Describes the clock behind bugle_gettime_fast, for diagnostics */
+BUGLE_EXPORT_PRE const char *bugle_gettime_fast_source(void) BUGLE_EXPORT_POST;
+
 #endif /* !BUGLE_TIME_H */
@@ -28,6 +28,7 @@
 #include <bugle/gl/gldisplaylist.h>
 #include <bugle/gl/glbeginend.h>
 #include <bugle/gl/glextensions.h>
+#include <bugle/gl/glshadow.h>
 #include <bugle/filters.h>
 #include <bugle/input.h>
 #include <bugle/log.h>
@@ -191,6 +192,7 @@ static void initialise_core_filters(void)
     glbeginend_initialise();
     glextensions_initialise();
     globjects_initialise();
+    glshadow_initialise();
     log_initialise();
     statistics_initialise();
 }
@@ -23,12 +23,16 @@
 #include <bugle/memory.h>
 #include <bugle/string.h>
 #include <bugle/bool.h>
+#include <bugle/io.h>
+#include <bugle/time.h>
+#include <bugle/hashtable.h>
 #include "platform/threads.h"
 #include "platform/types.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <signal.h>
 #include <assert.h>
 
 #define LOG_DEFAULT_FORMAT "[%l] %f.%e: %m"
@@ -42,6 +46,10 @@ static char *log_format = LOG_DEFAULT_FORMAT;
 static bugle_bool log_flush = BUGLE_FALSE;
 static FILE *log_file = NULL;
 
+static bugle_bool log_async = BUGLE_FALSE;
+static long log_async_buffer = 64;
+static bugle_bool log_async_block = BUGLE_FALSE;
+
 enum
 {
     LOG_TARGET_STDOUT,
@@ -88,78 +96,1094 @@ static FILE *log_get_file(int target)
     }
 }
 
-/* Processes tokens from *format until it hits something it cannot
- * handle itself (i.e., %m). The return value indicates what was hit:
- * 0: all done
- * 1: %m (format is advanced past the %m)
+/*** Compiled formats ***/
+
+/* The format is compiled into a list of tokens when it is set, rather than
+ * being parsed for every message. The leading tokens that depend only on the
+ * filter-set and severity (which is most of the default format) are
+ * expanded once for each (filter-set, severity) pair and cached.
+ */
+
+#define LOG_PREFIX_CACHE_SIZE 64  /* Must be a power of 2 */
+
+typedef enum
+{
+    LOG_TOKEN_LITERAL,
+    LOG_TOKEN_LEVEL,
+    LOG_TOKEN_FILTERSET,
+    LOG_TOKEN_EVENT,
+    LOG_TOKEN_MESSAGE,
+    LOG_TOKEN_PID,
+    LOG_TOKEN_THREAD
+} log_token_type;
+
+typedef struct
+{
+    log_token_type type;
+    const char *text;           /* Only used for LOG_TOKEN_LITERAL */
+    size_t length;
+} log_token;
+
+typedef struct log_prefix_s
+{
+    struct log_prefix_s *next;  /* Chain of all prefixes for the format */
+    char *filterset;
+    int severity;
+    char *text;
+    size_t length;
+} log_prefix;
+
+typedef struct log_format_compiled_s
+{
+    struct log_format_compiled_s *next; /* Chain of retired formats */
+    const log_token *tokens;
+    size_t count;
+    size_t prefix_count;                /* Leading tokens that are cached */
+    char *text;                         /* Storage for literals */
+    log_prefix * volatile cache[LOG_PREFIX_CACHE_SIZE];
+    log_prefix *prefixes;               /* Protected by log_prefix_lock */
+} log_format_compiled;
+
+/* Used until the format is set, since errors in the config file are
+ * logged before the log filter-set is initialised. Must match
+ * LOG_DEFAULT_FORMAT.
  */
-static int log_next(FILE *f, const char **format, const char *filterset, const char *event, int severity)
+static const log_token log_default_tokens[] =
+{
+    { LOG_TOKEN_LITERAL, "[", 1 },
+    { LOG_TOKEN_LEVEL, NULL, 0 },
+    { LOG_TOKEN_LITERAL, "] ", 2 },
+    { LOG_TOKEN_FILTERSET, NULL, 0 },
+    { LOG_TOKEN_LITERAL, ".", 1 },
+    { LOG_TOKEN_EVENT, NULL, 0 },
+    { LOG_TOKEN_LITERAL, ": ", 2 },
+    { LOG_TOKEN_MESSAGE, NULL, 0 }
+};
+
+static log_format_compiled log_default_compiled =
+{
+    NULL,
+    log_default_tokens,
+    sizeof(log_default_tokens) / sizeof(log_default_tokens[0]),
+    5,
+    NULL
+};
+
+static log_format_compiled * volatile log_compiled = &log_default_compiled;
+static log_format_compiled *log_retired = NULL;
+static bugle_thread_lock_t log_prefix_lock;
+static bugle_thread_once_t log_prefix_once = BUGLE_THREAD_ONCE_INIT;
+
+static void log_prefix_initialise(void)
+{
+    bugle_thread_lock_init(&log_prefix_lock);
+}
+
+static log_format_compiled *log_format_compile(const char *format)
 {
-    while (**format)
+    log_format_compiled *compiled;
+    log_token *tokens;
+    size_t count = 0;
+    const char *p;
+    bugle_bool cacheable = BUGLE_FALSE;
+
+    compiled = BUGLE_ZALLOC(log_format_compiled);
+    compiled->text = bugle_strdup(format);
+    /* Each character produces at most one token */
+    tokens = BUGLE_NMALLOC(strlen(format) + 1, log_token);
+    p = compiled->text;
+    while (*p)
     {
-        if (**format == '%')
+        log_token_type type = LOG_TOKEN_LITERAL;
+        const char *text = p;
+
+        if (*p == '%')
         {
-            switch ((*format)[1])
+            p += 2;
+            switch (p[-1])
             {
-            case 'l': fputs(log_level_names[severity], f); break;
-            case 'f': fputs(filterset, f); break;
-            case 'e': fputs(event, f); break;
-            case 'm': *format += 2; return 1;
-            case 'p': fprintf(f, "%" BUGLE_PRIu64, (bugle_uint64_t) bugle_getpid()); break;
-            case 't': fprintf(f, "%" BUGLE_PRIu64, (bugle_uint64_t) bugle_thread_self()); break;
-            case '%': fputc('%', f); break;
+            case 'l': type = LOG_TOKEN_LEVEL; break;
+            case 'f': type = LOG_TOKEN_FILTERSET; break;
+            case 'e': type = LOG_TOKEN_EVENT; break;
+            case 'm': type = LOG_TOKEN_MESSAGE; break;
+            case 'p': type = LOG_TOKEN_PID; break;
+            case 't': type = LOG_TOKEN_THREAD; break;
+            case '%': text++; break;
             default: /* Unrecognised escape, treat it as literal */
-                fputc('%', f);
-                (*format)--;
+                p--;
+            }
+        }
+        else
+            p++;
+
+        if (type == LOG_TOKEN_LITERAL)
+        {
+            if (count > 0 && tokens[count - 1].type == LOG_TOKEN_LITERAL
+                && tokens[count - 1].text + tokens[count - 1].length == text)
+                tokens[count - 1].length++;
+            else
+            {
+                tokens[count].type = LOG_TOKEN_LITERAL;
+                tokens[count].text = text;
+                tokens[count].length = 1;
+                count++;
             }
-            *format += 2;
         }
         else
         {
-            fputc(**format, f);
-            (*format)++;
+            tokens[count].type = type;
+            tokens[count].text = NULL;
+            tokens[count].length = 0;
+            count++;
         }
     }
+
+    compiled->tokens = tokens;
+    compiled->count = count;
+    while (compiled->prefix_count < count)
+    {
+        log_token_type type = tokens[compiled->prefix_count].type;
+        if (type == LOG_TOKEN_LEVEL || type == LOG_TOKEN_FILTERSET)
+            cacheable = BUGLE_TRUE;
+        else if (type != LOG_TOKEN_LITERAL)
+            break;
+        compiled->prefix_count++;
+    }
+    /* Not worth caching a prefix that is purely literal */
+    if (!cacheable)
+        compiled->prefix_count = 0;
+    return compiled;
+}
+
+static void log_format_free(log_format_compiled *compiled)
+{
+    log_prefix *prefix, *next;
+
+    for (prefix = compiled->prefixes; prefix; prefix = next)
+    {
+        next = prefix->next;
+        bugle_free(prefix->filterset);
+        bugle_free(prefix->text);
+        bugle_free(prefix);
+    }
+    compiled->prefixes = NULL;
+    memset((void *) compiled->cache, 0, sizeof(compiled->cache));
+    if (compiled != &log_default_compiled)
+    {
+        bugle_free((log_token *) compiled->tokens);
+        bugle_free(compiled->text);
+        bugle_free(compiled);
+    }
+}
+
+static void log_format_replace(log_format_compiled *compiled)
+{
+    log_format_compiled *old;
+
+    bugle_thread_once(&log_prefix_once, log_prefix_initialise);
+    bugle_thread_lock_lock(&log_prefix_lock);
+    old = log_compiled;
+    bugle_atomic_barrier();
+    log_compiled = compiled;
+    /* Other threads may still be using the old format, so it is only freed
+     * at shutdown.
+     */
+    old->next = log_retired;
+    log_retired = old;
+    bugle_thread_lock_unlock(&log_prefix_lock);
+}
+
+static bugle_bool log_format_set(const filter_set_variable_info *var,
+                                 const char *text, const void *value)
+{
+    log_format_replace(log_format_compile(*(char * const *) value));
+    return BUGLE_TRUE;
+}
+
+/* Writes the tokens in [first, last) */
+static void log_write_tokens(FILE *f, const log_format_compiled *format, size_t first, size_t last,
+                             const char *filterset, const char *event, int severity,
+                             bugle_uint64_t thread)
+{
+    size_t i;
+
+    for (i = first; i < last; i++)
+    {
+        const log_token *token = &format->tokens[i];
+        switch (token->type)
+        {
+        case LOG_TOKEN_LITERAL: fwrite(token->text, 1, token->length, f); break;
+        case LOG_TOKEN_LEVEL: fputs(log_level_names[severity], f); break;
+        case LOG_TOKEN_FILTERSET: fputs(filterset, f); break;
+        case LOG_TOKEN_EVENT: fputs(event, f); break;
+        case LOG_TOKEN_PID: fprintf(f, "%" BUGLE_PRIu64, (bugle_uint64_t) bugle_getpid()); break;
+        case LOG_TOKEN_THREAD: fprintf(f, "%" BUGLE_PRIu64, thread); break;
+        case LOG_TOKEN_MESSAGE: assert(0); break;
+        }
+    }
+}
+
+static const log_prefix *log_prefix_get(log_format_compiled *format, const char *filterset, int severity)
+{
+    size_t slot;
+    log_prefix *prefix;
+    bugle_io_writer *writer;
+
+    slot = ((size_t) filterset / sizeof(void *) + (size_t) severity * 7) & (LOG_PREFIX_CACHE_SIZE - 1);
+    prefix = format->cache[slot];
+    if (prefix != NULL && prefix->severity == severity && strcmp(prefix->filterset, filterset) == 0)
+        return prefix;
+
+    bugle_thread_once(&log_prefix_once, log_prefix_initialise);
+    bugle_thread_lock_lock(&log_prefix_lock);
+    /* It may be present but have been evicted by a collision */
+    for (prefix = format->prefixes; prefix; prefix = prefix->next)
+        if (prefix->severity == severity && strcmp(prefix->filterset, filterset) == 0)
+            break;
+    if (prefix == NULL)
+    {
+        size_t i;
+
+        writer = bugle_io_writer_mem_new(64);
+        for (i = 0; i < format->prefix_count; i++)
+        {
+            const log_token *token = &format->tokens[i];
+            switch (token->type)
+            {
+            case LOG_TOKEN_LITERAL: bugle_io_write(token->text, 1, token->length, writer); break;
+            case LOG_TOKEN_LEVEL: bugle_io_puts(log_level_names[severity], writer); break;
+            case LOG_TOKEN_FILTERSET: bugle_io_puts(filterset, writer); break;
+            default: assert(0);
+            }
+        }
+        prefix = BUGLE_MALLOC(log_prefix);
+        prefix->filterset = bugle_strdup(filterset);
+        prefix->severity = severity;
+        prefix->length = bugle_io_writer_mem_size(writer);
+        prefix->text = bugle_strdup(bugle_io_writer_mem_get(writer));
+        bugle_io_writer_mem_release(writer);
+        bugle_io_writer_close(writer);
+        prefix->next = format->prefixes;
+        format->prefixes = prefix;
+    }
+    bugle_atomic_barrier();
+    format->cache[slot] = prefix;
+    bugle_thread_lock_unlock(&log_prefix_lock);
+    return prefix;
+}
+
+/* Writes tokens from *pos until it hits something it cannot handle itself
+ * (i.e., %m). The return value indicates what was hit:
+ * 0: all done
+ * 1: %m (*pos is advanced past the %m)
+ */
+static int log_next(FILE *f, log_format_compiled *format, size_t *pos,
+                    const char *filterset, const char *event, int severity,
+                    bugle_uint64_t thread)
+{
+    size_t end;
+
+    if (*pos == 0 && format->prefix_count > 0)
+    {
+        const log_prefix *prefix = log_prefix_get(format, filterset, severity);
+        fwrite(prefix->text, 1, prefix->length, f);
+        *pos = format->prefix_count;
+    }
+    for (end = *pos; end < format->count; end++)
+        if (format->tokens[end].type == LOG_TOKEN_MESSAGE)
+            break;
+    log_write_tokens(f, format, *pos, end, filterset, event, severity, thread);
+    if (end < format->count)
+    {
+        *pos = end + 1;
+        return 1;
+    }
+    *pos = end;
     fputc('\n', f);
     return 0;
 }
 
-void bugle_log_callback(const char *filterset, const char *event, int severity,
-                               void (*callback)(void *arg, FILE *f), void *arg)
+/* Returns true if any target will accept a message of this severity */
+static bugle_bool log_wanted(int severity)
 {
     int i;
 
+    for (i = 0; i < LOG_TARGET_COUNT; i++)
+        if (log_get_file(i) && severity < log_levels[i])
+            return BUGLE_TRUE;
+    return BUGLE_FALSE;
+}
+
+/* Writes a complete line with a preformatted message to one target */
+static void log_write_line(FILE *f, const char *filterset, const char *event, int severity,
+                           bugle_uint64_t thread, const char *message)
+{
+    log_format_compiled *format = log_compiled;
+    size_t pos = 0;
+    int special;
+
+    while ((special = log_next(f, format, &pos, filterset, event, severity, thread)) != 0)
+        switch (special)
+        {
+        case 1:
+            fputs(message, f);
+            break;
+        }
+}
+
+/*** Asynchronous logging ***/
+
+/* When the async option is set, each thread that logs is given its own ring
+ * buffer of records, and a writer thread drains them to the targets. The
+ * calling thread only formats the message itself; the line prefix is
+ * expanded by the writer thread.
+ *
+ * Only the owning thread advances the head of a ring, and only the thread
+ * holding log_async_owner (normally the writer thread) advances the tail, so
+ * the rings themselves need no locks. Each record carries a global sequence
+ * number, which the writer uses to merge the rings back into a single
+ * stream in the original order.
+ *
+ * log_async_rings_lock protects insertion into and removal from the list of
+ * rings. Traversal only happens while holding log_async_owner, and removal
+ * also requires log_async_owner, so traversal does not need the lock.
+ */
+
+#define LOG_ASYNC_ALIGN 8
+#define LOG_ASYNC_ROUND(x) (((x) + (LOG_ASYNC_ALIGN - 1)) & ~(size_t) (LOG_ASYNC_ALIGN - 1))
+#define LOG_ASYNC_HEADER_SIZE LOG_ASYNC_ROUND(sizeof(log_async_record))
+#define LOG_ASYNC_PAD (-1)
+/* Number of times to try to take log_async_owner from a signal handler
+ * before assuming that the owner has died.
+ */
+#define LOG_ASYNC_CRASH_SPINS 10000000
+
+typedef struct
+{
+    size_t size;                 /* Total bytes, including header and padding */
+    bugle_atomic_t seq;
+    int severity;                /* LOG_ASYNC_PAD for padding at the end of the ring */
+    size_t filterset_length;
+    size_t event_length;
+    size_t message_length;
+    /* Followed by NUL-terminated filterset, event and message strings */
+} log_async_record;
+
+typedef struct log_async_ring_s
+{
+    struct log_async_ring_s *next;
+    char *data;
+    size_t capacity;                    /* Always a power of 2 */
+    volatile bugle_atomic_t head;       /* Next byte to write */
+    volatile bugle_atomic_t tail;       /* Next byte to read */
+    volatile bugle_atomic_t dropped;    /* Messages discarded while full */
+    bugle_atomic_t dropped_reported;    /* Value of dropped last reported */
+    volatile bugle_atomic_t waiting;    /* Producer is blocked waiting for space */
+    volatile bugle_atomic_t dead;       /* Owning thread has exited */
+    bugle_thread_sem_t space;           /* Posted when waiting was set and space is freed */
+    bugle_uint64_t thread;
+    bugle_io_writer *scratch;           /* Used by the owner to format messages */
+} log_async_ring;
+
+static volatile bugle_bool log_async_running = BUGLE_FALSE;
+static volatile bugle_bool log_async_stopping = BUGLE_FALSE;
+static bugle_thread_handle log_async_thread;
+static bugle_thread_key_t log_async_key;
+static bugle_thread_lock_t log_async_rings_lock;
+static log_async_ring * volatile log_async_rings = NULL;
+static volatile bugle_atomic_t log_async_seq = 0;
+static volatile bugle_atomic_t log_async_owner = 0;
+static volatile bugle_atomic_t log_async_sleeping = 0;
+static bugle_thread_sem_t log_async_wakeup;
+
+static const int log_async_crash_signals[] =
+{
+    SIGSEGV,
+    SIGABRT,
+    SIGFPE,
+    SIGILL
+#ifdef SIGBUS
+    , SIGBUS
+#endif
+};
+#define LOG_ASYNC_CRASH_SIGNALS (sizeof(log_async_crash_signals) / sizeof(log_async_crash_signals[0]))
+static void (*log_async_old_handlers[LOG_ASYNC_CRASH_SIGNALS])(int);
+
+static void log_async_wake_writer(void)
+{
+    if (bugle_atomic_cas(&log_async_sleeping, 1, 0))
+        bugle_thread_sem_post(&log_async_wakeup);
+}
+
+static void log_async_ring_release(void *ring)
+{
+    /* The writer thread reclaims the memory once the ring is empty */
+    bugle_atomic_set(&((log_async_ring *) ring)->dead, 1);
+    log_async_wake_writer();
+}
+
+static log_async_ring *log_async_ring_get(void)
+{
+    log_async_ring *ring;
+
+    ring = (log_async_ring *) bugle_thread_getspecific(log_async_key);
+    if (ring == NULL)
+    {
+        size_t capacity = 1;
+
+        while (capacity < (size_t) log_async_buffer * 1024)
+            capacity *= 2;
+        ring = BUGLE_ZALLOC(log_async_ring);
+        ring->data = BUGLE_NMALLOC(capacity, char);
+        ring->capacity = capacity;
+        ring->thread = (bugle_uint64_t) bugle_thread_self();
+        ring->scratch = bugle_io_writer_mem_new(256);
+        bugle_thread_sem_init(&ring->space, 0);
+        bugle_thread_setspecific(log_async_key, ring);
+
+        bugle_thread_lock_lock(&log_async_rings_lock);
+        ring->next = log_async_rings;
+        bugle_atomic_barrier();
+        log_async_rings = ring;
+        bugle_thread_lock_unlock(&log_async_rings_lock);
+    }
+    return ring;
+}
+
+/* Advances the tail of a ring, waking the owner if it is waiting for space.
+ * Must only be called by the holder of log_async_owner.
+ */
+static void log_async_ring_consume(log_async_ring *ring, size_t bytes)
+{
+    bugle_atomic_set(&ring->tail, ring->tail + bytes);
+    if (bugle_atomic_cas(&ring->waiting, 1, 0))
+        bugle_thread_sem_post(&ring->space);
+}
+
+/* Blocks the owner of the ring until the consumer frees some space */
+static void log_async_ring_wait(log_async_ring *ring, bugle_atomic_t tail)
+{
+    bugle_atomic_set(&ring->waiting, 1);
+    if (bugle_atomic_get(&ring->tail) != tail || !log_async_running)
+    {
+        /* Space appeared while we were setting the flag. If the consumer
+         * already cleared it, it is also going to post the semaphore.
+         */
+        if (!bugle_atomic_cas(&ring->waiting, 1, 0))
+            bugle_thread_sem_wait(&ring->space);
+        return;
+    }
+    if (bugle_atomic_cas(&log_async_sleeping, 1, 0))
+        bugle_thread_sem_post(&log_async_wakeup);
+    bugle_thread_sem_wait(&ring->space);
+}
+
+/* Reserves space for a record of size bytes. On success, returns a pointer to
+ * the record and sets *consumed to the number of bytes that must be
+ * committed (which includes any padding at the end of the ring). Returns
+ * NULL if there is no space and the policy is to drop.
+ */
+static char *log_async_ring_reserve(log_async_ring *ring, size_t size, size_t *consumed)
+{
+    size_t mask = ring->capacity - 1;
+
+    for (;;)
+    {
+        bugle_atomic_t head = ring->head;
+        bugle_atomic_t tail = bugle_atomic_get(&ring->tail);
+        size_t pos = head & mask;
+        size_t skip = 0;
+
+        /* Records are never split across the end of the ring */
+        if (size > ring->capacity - pos)
+            skip = ring->capacity - pos;
+        if (ring->capacity - (size_t) (head - tail) >= skip + size)
+        {
+            if (skip >= LOG_ASYNC_HEADER_SIZE)
+            {
+                log_async_record *pad = (log_async_record *) (ring->data + pos);
+                pad->size = skip;
+                pad->severity = LOG_ASYNC_PAD;
+            }
+            *consumed = skip + size;
+            return ring->data + ((head + skip) & mask);
+        }
+        if (!log_async_block || !log_async_running)
+            return NULL;
+        log_async_ring_wait(ring, tail);
+    }
+}
+
+static void log_async_submit(const char *filterset, const char *event, int severity,
+                             const char *message, size_t message_length)
+{
+    log_async_ring *ring;
+    log_async_record *record;
+    size_t filterset_length, event_length, size, consumed;
+    char *ptr;
+
+    ring = log_async_ring_get();
+    filterset_length = strlen(filterset);
+    event_length = strlen(event);
+    size = LOG_ASYNC_HEADER_SIZE + filterset_length + event_length + 2;
+    if (size + 1 > ring->capacity / 2)
+    {
+        bugle_atomic_add(&ring->dropped, 1);
+        return;
+    }
+    /* Truncate messages that would take more than half the ring */
+    if (size + message_length + 1 > ring->capacity / 2)
+        message_length = ring->capacity / 2 - size - 1;
+    size = LOG_ASYNC_ROUND(size + message_length + 1);
+
+    ptr = log_async_ring_reserve(ring, size, &consumed);
+    if (ptr == NULL)
+    {
+        bugle_atomic_add(&ring->dropped, 1);
+        return;
+    }
+    record = (log_async_record *) ptr;
+    record->size = size;
+    record->severity = severity;
+    record->filterset_length = filterset_length;
+    record->event_length = event_length;
+    record->message_length = message_length;
+    ptr += LOG_ASYNC_HEADER_SIZE;
+    memcpy(ptr, filterset, filterset_length + 1);
+    ptr += filterset_length + 1;
+    memcpy(ptr, event, event_length + 1);
+    ptr += event_length + 1;
+    memcpy(ptr, message, message_length);
+    ptr[message_length] = '\0';
+
+    record->seq = bugle_atomic_add(&log_async_seq, 1);
+    bugle_atomic_set(&ring->head, ring->head + consumed);
+    log_async_wake_writer();
+}
+
+/* Returns the next record in the ring, skipping any padding, or NULL if the
+ * ring is empty. Must only be called by the holder of log_async_owner.
+ */
+static log_async_record *log_async_ring_peek(log_async_ring *ring)
+{
+    size_t mask = ring->capacity - 1;
+
+    for (;;)
+    {
+        bugle_atomic_t head = bugle_atomic_get(&ring->head);
+        size_t pos = ring->tail & mask;
+        log_async_record *record;
+
+        if (head == ring->tail)
+            return NULL;
+        if (ring->capacity - pos < LOG_ASYNC_HEADER_SIZE)
+        {
+            log_async_ring_consume(ring, ring->capacity - pos);
+            continue;
+        }
+        record = (log_async_record *) (ring->data + pos);
+        if (record->severity == LOG_ASYNC_PAD)
+        {
+            log_async_ring_consume(ring, record->size);
+            continue;
+        }
+        return record;
+    }
+}
+
+static void log_async_write_record(const log_async_ring *ring, const log_async_record *record)
+{
+    const char *filterset, *event, *message;
+    int i;
+
+    filterset = (const char *) record + LOG_ASYNC_HEADER_SIZE;
+    event = filterset + record->filterset_length + 1;
+    message = event + record->event_length + 1;
+    for (i = 0; i < LOG_TARGET_COUNT; i++)
+    {
+        FILE *f = log_get_file(i);
+        if (!f || record->severity >= log_levels[i]) continue;
+
+        bugle_flockfile(f);
+        log_write_line(f, filterset, event, record->severity, ring->thread, message);
+        bugle_funlockfile(f);
+    }
+}
+
+static void log_async_report_dropped(log_async_ring *ring)
+{
+    bugle_atomic_t dropped;
+    char message[128];
+    int i;
+
+    dropped = bugle_atomic_get(&ring->dropped);
+    if (dropped == ring->dropped_reported || !log_wanted(BUGLE_LOG_WARNING))
+        return;
+    bugle_snprintf(message, sizeof(message), "%lu messages dropped because the log buffer was full",
+                   (unsigned long) (dropped - ring->dropped_reported));
+    ring->dropped_reported = dropped;
+    for (i = 0; i < LOG_TARGET_COUNT; i++)
+    {
+        FILE *f = log_get_file(i);
+        if (!f || BUGLE_LOG_WARNING >= log_levels[i]) continue;
+
+        bugle_flockfile(f);
+        log_write_line(f, "log", "async", BUGLE_LOG_WARNING, ring->thread, message);
+        bugle_funlockfile(f);
+    }
+}
+
+/* Frees rings whose threads have exited and which have been drained. Must
+ * only be called by the holder of log_async_owner.
+ */
+static void log_async_reap(void)
+{
+    log_async_ring *ring, *prev = NULL, *next;
+
+    bugle_thread_lock_lock(&log_async_rings_lock);
+    for (ring = log_async_rings; ring; ring = next)
+    {
+        next = ring->next;
+        if (bugle_atomic_get(&ring->dead) && ring->head == ring->tail)
+        {
+            if (prev) prev->next = next;
+            else log_async_rings = next;
+            bugle_thread_sem_destroy(&ring->space);
+            bugle_io_writer_close(ring->scratch);
+            bugle_free(ring->data);
+            bugle_free(ring);
+        }
+        else
+            prev = ring;
+    }
+    bugle_thread_lock_unlock(&log_async_rings_lock);
+}
+
+/* Writes out everything that is currently in the rings. Must only be called
+ * by the holder of log_async_owner. Returns true if anything was written.
+ */
+static bugle_bool log_async_drain(bugle_bool reap)
+{
+    log_async_ring *ring, *best;
+    log_async_record *record, *best_record;
+    bugle_bool any = BUGLE_FALSE;
+    int i;
+
+    for (;;)
+    {
+        best = NULL;
+        best_record = NULL;
+        for (ring = log_async_rings; ring; ring = ring->next)
+        {
+            record = log_async_ring_peek(ring);
+            if (record != NULL
+                && (best == NULL || (long) (record->seq - best_record->seq) < 0))
+            {
+                best = ring;
+                best_record = record;
+            }
+        }
+        if (best == NULL)
+            break;
+        log_async_write_record(best, best_record);
+        log_async_ring_consume(best, best_record->size);
+        any = BUGLE_TRUE;
+    }
+
+    for (ring = log_async_rings; ring; ring = ring->next)
+        log_async_report_dropped(ring);
+    if (any && log_flush)
+        for (i = 0; i < LOG_TARGET_COUNT; i++)
+            if (log_get_file(i))
+                fflush(log_get_file(i));
+    if (reap)
+        log_async_reap();
+    return any;
+}
+
+static bugle_bool log_async_pending(void)
+{
+    log_async_ring *ring;
+
+    for (ring = log_async_rings; ring; ring = ring->next)
+        if (bugle_atomic_get(&ring->head) != ring->tail
+            || bugle_atomic_get(&ring->dead))
+            return BUGLE_TRUE;
+    return BUGLE_FALSE;
+}
+
+static unsigned int log_async_writer(void *arg)
+{
+    while (!log_async_stopping)
+    {
+        bugle_bool any;
+
+        while (!bugle_atomic_cas(&log_async_owner, 0, 1))
+            bugle_thread_sem_wait(&log_async_wakeup);
+        any = log_async_drain(BUGLE_TRUE);
+        if (!any)
+        {
+            /* Announce that we're going to sleep, then check again to
+             * avoid missing a record that was committed in between.
+             */
+            bugle_atomic_set(&log_async_sleeping, 1);
+            if (log_async_pending() && bugle_atomic_cas(&log_async_sleeping, 1, 0))
+            {
+                bugle_atomic_set(&log_async_owner, 0);
+                continue;
+            }
+        }
+        bugle_atomic_set(&log_async_owner, 0);
+        if (!any)
+            bugle_thread_sem_wait(&log_async_wakeup);
+    }
+    return 0;
+}
+
+/* Flushes whatever is in the rings after a fatal signal, then passes the
+ * signal on to whatever handler was installed before us. This is not
+ * strictly async-signal-safe, but the alternative is to lose the messages
+ * that are most likely to explain the crash.
+ */
+static void log_async_crash(int sig)
+{
+    size_t i;
+    long spins;
+
+    log_async_running = BUGLE_FALSE;
+    for (spins = 0; spins < LOG_ASYNC_CRASH_SPINS; spins++)
+        if (bugle_atomic_cas(&log_async_owner, 0, 1))
+            break;
+    log_async_drain(BUGLE_FALSE);
+    for (i = 0; i < LOG_TARGET_COUNT; i++)
+        if (log_get_file(i))
+            fflush(log_get_file(i));
+
+    for (i = 0; i < LOG_ASYNC_CRASH_SIGNALS; i++)
+        if (log_async_crash_signals[i] == sig)
+        {
+            signal(sig, log_async_old_handlers[i] == SIG_ERR ? SIG_DFL : log_async_old_handlers[i]);
+            break;
+        }
+    raise(sig);
+}
+
+static bugle_bool log_async_start(void)
+{
+    size_t i;
+
+    bugle_thread_key_create(&log_async_key, log_async_ring_release);
+    bugle_thread_lock_init(&log_async_rings_lock);
+    bugle_thread_sem_init(&log_async_wakeup, 0);
+    log_async_stopping = BUGLE_FALSE;
+    if (bugle_thread_create(&log_async_thread, log_async_writer, NULL) != 0)
+    {
+        fprintf(stderr, "failed to start the log writer thread\n");
+        bugle_thread_sem_destroy(&log_async_wakeup);
+        return BUGLE_FALSE;
+    }
+    for (i = 0; i < LOG_ASYNC_CRASH_SIGNALS; i++)
+        log_async_old_handlers[i] = signal(log_async_crash_signals[i], log_async_crash);
+    log_async_running = BUGLE_TRUE;
+    return BUGLE_TRUE;
+}
+
+static void log_async_stop(void)
+{
+    log_async_ring *ring;
+    size_t i;
+
+    log_async_running = BUGLE_FALSE;
+    for (i = 0; i < LOG_ASYNC_CRASH_SIGNALS; i++)
+        if (log_async_old_handlers[i] != SIG_ERR)
+            signal(log_async_crash_signals[i], log_async_old_handlers[i]);
+
+    log_async_stopping = BUGLE_TRUE;
+    bugle_thread_sem_post(&log_async_wakeup);
+    bugle_thread_join(log_async_thread, NULL);
+
+    /* The writer is gone, so we can take ownership directly. Release any
+     * producers that are still blocked on a full ring.
+     */
+    bugle_atomic_set(&log_async_owner, 1);
+    log_async_drain(BUGLE_TRUE);
+    for (ring = log_async_rings; ring; ring = ring->next)
+        if (bugle_atomic_cas(&ring->waiting, 1, 0))
+            bugle_thread_sem_post(&ring->space);
+    /* Rings belonging to live threads are deliberately leaked, since those
+     * threads may still hold pointers to them.
+     */
+}
+
+/*** Rate limiting ***/
+
+/* Every filter-set has log_rate and log_collapse options, which are passed
+ * to bugle_log_limit when it is loaded. The state is kept per (filter-set,
+ * event) pair.
+ * log_limits is only modified during initialisation, so it is read without
+ * a lock, but the per-event state is protected by log_limit_lock.
+ */
+
+typedef struct
+{
+    long rate;                  /* Messages per second per event, 0 for unlimited */
+    bugle_bool collapse;
+    hash_table events;          /* log_limit_event, keyed by event */
+} log_limit;
+
+typedef struct
+{
+    char *event;
+    int severity;               /* Severity of the last message */
+    char *last;                 /* Last message logged, if collapsing */
+    unsigned long repeats;      /* Copies of last that were suppressed */
+    time_t window;              /* Second in which count was measured */
+    long count;                 /* Messages logged in this window */
+    unsigned long limited;      /* Messages suppressed in this window */
+} log_limit_event;
+
+static hash_table log_limits;
+static bugle_bool log_limits_initialised = BUGLE_FALSE;
+static bugle_thread_lock_t log_limit_lock;
+static unsigned long log_suppressed_repeated = 0;
+static unsigned long log_suppressed_limited = 0;
+
+static void log_limit_event_free(void *data)
+{
+    log_limit_event *e = (log_limit_event *) data;
+
+    bugle_free(e->event);
+    if (e->last) bugle_free(e->last);
+    bugle_free(e);
+}
+
+static void log_limit_free(void *data)
+{
+    log_limit *limit = (log_limit *) data;
+
+    bugle_hash_clear(&limit->events);
+    bugle_free(limit);
+}
+
+void bugle_log_limit(const char *filterset, long rate, bugle_bool collapse)
+{
+    log_limit *limit;
+
+    if (rate <= 0 && !collapse)
+        return;
+    if (!log_limits_initialised)
+    {
+        bugle_hash_init(&log_limits, log_limit_free);
+        bugle_thread_lock_init(&log_limit_lock);
+        log_limits_initialised = BUGLE_TRUE;
+    }
+    limit = BUGLE_MALLOC(log_limit);
+    limit->rate = rate;
+    limit->collapse = collapse;
+    bugle_hash_init_nocopy(&limit->events, log_limit_event_free);
+    bugle_hash_set(&log_limits, filterset, limit);
+}
+
+void bugle_log_get_suppressed(unsigned long *repeated, unsigned long *limited)
+{
+    if (!log_limits_initialised)
+    {
+        *repeated = 0;
+        *limited = 0;
+        return;
+    }
+    bugle_thread_lock_lock(&log_limit_lock);
+    *repeated = log_suppressed_repeated;
+    *limited = log_suppressed_limited;
+    bugle_thread_lock_unlock(&log_limit_lock);
+}
+
+static log_limit *log_limit_find(const char *filterset)
+{
+    if (!log_limits_initialised || log_limits.count == 0)
+        return NULL;
+    return (log_limit *) bugle_hash_get(&log_limits, filterset);
+}
+
+static void log_message(const char *filterset, const char *event, int severity,
+                        const char *message, size_t length);
+
+static void log_limit_report_repeats(const char *filterset, log_limit_event *e)
+{
+    char message[64];
+
+    if (e->repeats > 0)
+    {
+        bugle_snprintf(message, sizeof(message), "last message repeated %lu times", e->repeats);
+        log_message(filterset, e->event, e->severity, message, strlen(message));
+        e->repeats = 0;
+    }
+}
+
+static void log_limit_report_limited(const char *filterset, log_limit_event *e)
+{
+    char message[64];
+
+    if (e->limited > 0)
+    {
+        bugle_snprintf(message, sizeof(message), "%lu messages suppressed by rate limit", e->limited);
+        log_message(filterset, e->event, e->severity, message, strlen(message));
+        e->limited = 0;
+    }
+}
+
+/* Returns true if the message should be logged */
+static bugle_bool log_limit_check(log_limit *limit, const char *filterset, const char *event,
+                                  int severity, const char *message)
+{
+    log_limit_event *e;
+    bugle_timespec now;
+    bugle_bool ret = BUGLE_TRUE;
+
+    bugle_thread_lock_lock(&log_limit_lock);
+    e = (log_limit_event *) bugle_hash_get(&limit->events, event);
+    if (e == NULL)
+    {
+        e = BUGLE_ZALLOC(log_limit_event);
+        e->event = bugle_strdup(event);
+        bugle_hash_set(&limit->events, e->event, e);
+    }
+
+    if (limit->collapse)
+    {
+        if (e->last != NULL && e->severity == severity && strcmp(e->last, message) == 0)
+        {
+            e->repeats++;
+            log_suppressed_repeated++;
+            bugle_thread_lock_unlock(&log_limit_lock);
+            return BUGLE_FALSE;
+        }
+        log_limit_report_repeats(filterset, e);
+        if (e->last) bugle_free(e->last);
+        e->last = bugle_strdup(message);
+    }
+
+    if (limit->rate > 0)
+    {
+        bugle_gettime_fast(&now);
+        if (now.tv_sec != e->window)
+        {
+            log_limit_report_limited(filterset, e);
+            e->window = now.tv_sec;
+            e->count = 0;
+        }
+        if (e->count >= limit->rate)
+        {
+            e->limited++;
+            log_suppressed_limited++;
+            ret = BUGLE_FALSE;
+        }
+        else
+            e->count++;
+    }
+    e->severity = severity;
+    bugle_thread_lock_unlock(&log_limit_lock);
+    return ret;
+}
+
+/* Reports anything still outstanding at shutdown */
+static void log_limit_shutdown(void)
+{
+    const hash_table_entry *h, *i;
+
+    if (!log_limits_initialised)
+        return;
+    for (h = bugle_hash_begin(&log_limits); h; h = bugle_hash_next(&log_limits, h))
+    {
+        log_limit *limit = (log_limit *) h->value;
+        for (i = bugle_hash_begin(&limit->events); i; i = bugle_hash_next(&limit->events, i))
+        {
+            log_limit_report_repeats(h->key, (log_limit_event *) i->value);
+            log_limit_report_limited(h->key, (log_limit_event *) i->value);
+        }
+    }
+    bugle_hash_clear(&log_limits);
+}
+
+/* Captures the output of a log callback as a string. Returns NULL on
+ * failure. This is a rarely-used interface, so rather than requiring memory
+ * streams we let the callback write to a temporary file.
+ */
+static char *log_callback_capture(void (*callback)(void *arg, FILE *f), void *arg, size_t *length)
+{
+    FILE *tmp;
+    long size;
+    char *message = NULL;
+
+    tmp = tmpfile();
+    if (tmp == NULL)
+        return NULL;
+    (*callback)(arg, tmp);
+    size = ftell(tmp);
+    if (size >= 0)
+    {
+        message = BUGLE_NMALLOC(size + 1, char);
+        rewind(tmp);
+        *length = fread(message, 1, size, tmp);
+        message[*length] = '\0';
+    }
+    fclose(tmp);
+    return message;
+}
+
+/* Writes a preformatted message, which has already been filtered by
+ * severity.
+ */
+static void log_message(const char *filterset, const char *event, int severity,
+                        const char *message, size_t length)
+{
+    int i;
+
+    if (log_async_running)
+    {
+        log_async_submit(filterset, event, severity, message, length);
+        return;
+    }
+
     for (i = 0; i < LOG_TARGET_COUNT; i++)
     {
-        const char *format;
-        int special;
         FILE *f = log_get_file(i);
         int level = log_levels[i];
 
         if (!f || severity >= level) continue;
 
         log_start(f);
-        format = log_format;
-        while ((special = log_next(f, &format, filterset, event, severity)) != 0)
-            switch (special)
-            {
-            case 1:
-                (*callback)(arg, f);
-                break;
-            }
+        log_write_line(f, filterset, event, severity,
+                       (bugle_uint64_t) bugle_thread_self(), message);
         log_end(f);
     }
 }
 
-void bugle_log_printf(const char *filterset, const char *event, int severity,
-                      const char *msg_format, ...)
+void bugle_log_callback(const char *filterset, const char *event, int severity,
+                               void (*callback)(void *arg, FILE *f), void *arg)
 {
     int i;
+    log_limit *limit;
+
+    if (!log_wanted(severity)) return;
+    limit = log_limit_find(filterset);
+    if (log_async_running || limit != NULL)
+    {
+        size_t length;
+        char *message = log_callback_capture(callback, arg, &length);
+        if (message != NULL)
+        {
+            if (limit == NULL || log_limit_check(limit, filterset, event, severity, message))
+                log_message(filterset, event, severity, message, length);
+            bugle_free(message);
+            return;
+        }
+    }
 
     for (i = 0; i < LOG_TARGET_COUNT; i++)
     {
-        va_list ap;
-        const char *format;
+        log_format_compiled *format = log_compiled;
+        size_t pos = 0;
         int special;
         FILE *f = log_get_file(i);
         int level = log_levels[i];
@@ -167,28 +1191,59 @@ void bugle_log_printf(const char *filterset, const char *event, int severity,
         if (!f || severity >= level) continue;
 
         log_start(f);
-        format = log_format;
-        while ((special = log_next(f, &format, filterset, event, severity)) != 0)
+        while ((special = log_next(f, format, &pos, filterset, event, severity,
+                                   (bugle_uint64_t) bugle_thread_self())) != 0)
             switch (special)
             {
             case 1:
-                va_start(ap, msg_format);
-                vfprintf(f, msg_format, ap);
-                va_end(ap);
+                (*callback)(arg, f);
                 break;
             }
         log_end(f);
     }
 }
 
-void bugle_log(const char *filterset, const char *event, int severity,
-               const char *message)
+void bugle_log_printf(const char *filterset, const char *event, int severity,
+                      const char *msg_format, ...)
 {
     int i;
+    log_limit *limit;
+
+    if (!log_wanted(severity)) return;
+    limit = log_limit_find(filterset);
+    if (limit != NULL)
+    {
+        va_list ap;
+        char *message;
+
+        va_start(ap, msg_format);
+        message = bugle_vasprintf(msg_format, ap);
+        va_end(ap);
+        if (log_limit_check(limit, filterset, event, severity, message))
+            log_message(filterset, event, severity, message, strlen(message));
+        bugle_free(message);
+        return;
+    }
+    if (log_async_running)
+    {
+        va_list ap;
+        log_async_ring *ring = log_async_ring_get();
+
+        bugle_io_writer_mem_clear(ring->scratch);
+        va_start(ap, msg_format);
+        bugle_io_vprintf(ring->scratch, msg_format, ap);
+        va_end(ap);
+        log_async_submit(filterset, event, severity,
+                         bugle_io_writer_mem_get(ring->scratch),
+                         bugle_io_writer_mem_size(ring->scratch));
+        return;
+    }
 
     for (i = 0; i < LOG_TARGET_COUNT; i++)
     {
-        const char *format;
+        va_list ap;
+        log_format_compiled *format = log_compiled;
+        size_t pos = 0;
         int special;
         FILE *f = log_get_file(i);
         int level = log_levels[i];
@@ -196,18 +1251,32 @@ void bugle_log(const char *filterset, const char *event, int severity,
         if (!f || severity >= level) continue;
 
         log_start(f);
-        format = log_format;
-        while ((special = log_next(f, &format, filterset, event, severity)) != 0)
+        while ((special = log_next(f, format, &pos, filterset, event, severity,
+                                   (bugle_uint64_t) bugle_thread_self())) != 0)
             switch (special)
             {
             case 1:
-                fputs(message, f);
+                va_start(ap, msg_format);
+                vfprintf(f, msg_format, ap);
+                va_end(ap);
                 break;
             }
         log_end(f);
     }
 }
 
+void bugle_log(const char *filterset, const char *event, int severity,
+               const char *message)
+{
+    log_limit *limit;
+
+    if (!log_wanted(severity)) return;
+    limit = log_limit_find(filterset);
+    if (limit != NULL && !log_limit_check(limit, filterset, event, severity, message))
+        return;
+    log_message(filterset, event, severity, message, strlen(message));
+}
+
 static void log_alloc_die(void)
 {
     bugle_log("core", "alloc", BUGLE_LOG_ERROR, "memory allocation failed");
@@ -225,6 +1294,8 @@ static bugle_bool log_filter_set_initialise(filter_set *handle)
             return BUGLE_FALSE;
         }
     }
+    if (log_async && !log_async_start())
+        return BUGLE_FALSE;
     bugle_set_alloc_die(log_alloc_die);
     return BUGLE_TRUE;
 }
@@ -232,12 +1303,24 @@ static bugle_bool log_filter_set_initialise(filter_set *handle)
 static void log_filter_set_shutdown(filter_set *handle)
 {
     bugle_set_alloc_die(NULL);
+    log_limit_shutdown();
+    if (log_async_running)
+        log_async_stop();
     if (log_filename)
     {
         if (log_file) fclose(log_file);
         bugle_free(log_filename);
     }
     bugle_free(log_format);
+    log_format = NULL;
+
+    log_format_replace(&log_default_compiled);
+    while (log_retired != NULL)
+    {
+        log_format_compiled *next = log_retired->next;
+        log_format_free(log_retired);
+        log_retired = next;
+    }
 }
 
 void log_initialise(void)
@@ -246,10 +1329,13 @@ void log_initialise(void)
     {
         { "filename", "filename of the log to write [none]", FILTER_SET_VARIABLE_STRING, &log_filename, NULL },
         { "flush", "flush log after every call [no]", FILTER_SET_VARIABLE_BOOL, &log_flush, NULL },
-        { "format", "template for log lines [[%l] %f.%e: %m]", FILTER_SET_VARIABLE_STRING, &log_format, NULL },
+        { "format", "template for log lines [[%l] %f.%e: %m]", FILTER_SET_VARIABLE_STRING, &log_format, log_format_set },
         { "file_level", "how much information to log to file [4] (0 is none, 5 is all)", FILTER_SET_VARIABLE_UINT, &log_levels[LOG_TARGET_FILE], NULL },
         { "stderr_level", "how much information to log to stderr [3]", FILTER_SET_VARIABLE_UINT, &log_levels[LOG_TARGET_STDERR], NULL },
         { "stdout_level", "how much information to log to stderr [0]", FILTER_SET_VARIABLE_UINT, &log_levels[LOG_TARGET_STDOUT], NULL },
+        { "async", "write the log from a background thread [no]", FILTER_SET_VARIABLE_BOOL, &log_async, NULL },
+        { "async_buffer", "per-thread buffer for asynchronous logging, in KiB [64]", FILTER_SET_VARIABLE_POSITIVE_INT, &log_async_buffer, NULL },
+        { "async_block", "wait for space instead of dropping messages when the buffer is full [no]", FILTER_SET_VARIABLE_BOOL, &log_async_block, NULL },
         { NULL, NULL, 0, NULL, NULL }
     };
 
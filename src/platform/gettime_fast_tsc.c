@@ -0,0 +1,209 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Fast clock based on the x86 time-stamp counter. It is only used if the
+ * CPU advertises an invariant TSC (constant rate, and not stopped in
+ * sleep states), the operating system has not rejected the TSC as a clock
+ * source, and two independent calibrations against bugle_gettime agree.
+ * In all other cases bugle_gettime is used directly.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <bugle/bool.h>
+#include <bugle/time.h>
+#include "platform/types.h"
+#include "platform/threads.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+# define BUGLE_HAVE_TSC 1
+#endif
+
+#if BUGLE_HAVE_TSC
+
+/* Length of each calibration run */
+#define TSC_CALIBRATE_NS 20000000L
+/* Maximum relative disagreement between the calibration runs */
+#define TSC_CALIBRATE_TOLERANCE 0.002
+
+static bugle_bool tsc_enabled = BUGLE_FALSE;
+static double tsc_seconds_per_tick;
+static bugle_uint64_t tsc_base;
+static time_t tsc_base_sec;
+static double tsc_base_frac;          /* Fractional seconds at tsc_base */
+static const char *tsc_source = "system clock";
+
+static inline bugle_uint64_t tsc_read(void)
+{
+    bugle_uint32_t lo, hi;
+
+    __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((bugle_uint64_t) hi << 32) | lo;
+}
+
+static void tsc_cpuid(bugle_uint32_t leaf, bugle_uint32_t regs[4])
+{
+#if defined(__i386__) && defined(__PIC__)
+    /* ebx is the PIC register, and may not be clobbered */
+    __asm__ __volatile__("movl %%ebx, %1\n\t"
+                         "cpuid\n\t"
+                         "xchgl %%ebx, %1"
+                         : "=a" (regs[0]), "=&r" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+                         : "0" (leaf), "2" (0));
+#else
+    __asm__ __volatile__("cpuid"
+                         : "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+                         : "0" (leaf), "2" (0));
+#endif
+}
+
+static bugle_bool tsc_invariant(void)
+{
+    bugle_uint32_t regs[4];
+
+    tsc_cpuid(0x80000000UL, regs);
+    if (regs[0] < 0x80000007UL)
+        return BUGLE_FALSE;
+    tsc_cpuid(0x80000007UL, regs);
+    return (regs[3] & (1UL << 8)) != 0;
+}
+
+/* Linux falls back to another clock source if it finds the TSC to be
+ * unreliable (e.g. unsynchronised between sockets), so follow its lead.
+ */
+static bugle_bool tsc_os_trusted(void)
+{
+#ifdef __linux__
+    FILE *f;
+    char source[32];
+    bugle_bool trusted = BUGLE_TRUE;
+
+    f = fopen("/sys/devices/system/clocksource/clocksource0/current_clocksource", "r");
+    if (f)
+    {
+        if (fgets(source, sizeof(source), f))
+            trusted = strncmp(source, "tsc", 3) == 0;
+        fclose(f);
+    }
+    return trusted;
+#else
+    return BUGLE_TRUE;
+#endif
+}
+
+static long tsc_elapsed_ns(const bugle_timespec *start, const bugle_timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec);
+}
+
+/* Measures the TSC rate over a short interval. Returns 0 on failure. */
+static double tsc_measure(void)
+{
+    bugle_timespec start, end;
+    bugle_uint64_t start_tsc, end_tsc;
+    long ns;
+
+    if (bugle_gettime(&start) != 0)
+        return 0.0;
+    start_tsc = tsc_read();
+    do
+    {
+        if (bugle_gettime(&end) != 0)
+            return 0.0;
+        ns = tsc_elapsed_ns(&start, &end);
+    } while (ns >= 0 && ns < TSC_CALIBRATE_NS);
+    end_tsc = tsc_read();
+    if (ns <= 0 || end_tsc <= start_tsc)
+        return 0.0;
+    return (double) ns / (double) (end_tsc - start_tsc);
+}
+
+static void tsc_initialise(void)
+{
+    double rate1, rate2;
+    bugle_timespec base;
+
+    if (!tsc_invariant() || !tsc_os_trusted())
+        return;
+
+    rate1 = tsc_measure();
+    rate2 = tsc_measure();
+    /* Accept anything from 10MHz to 100GHz */
+    if (rate1 < 0.01 || rate1 > 100.0 || rate2 < 0.01 || rate2 > 100.0)
+        return;
+    if (rate1 > rate2 * (1.0 + TSC_CALIBRATE_TOLERANCE)
+        || rate2 > rate1 * (1.0 + TSC_CALIBRATE_TOLERANCE))
+        return;
+
+    tsc_seconds_per_tick = 0.5e-9 * (rate1 + rate2);
+    if (bugle_gettime(&base) != 0)
+        return;
+    tsc_base = tsc_read();
+    tsc_base_sec = base.tv_sec;
+    tsc_base_frac = 1e-9 * base.tv_nsec;
+    tsc_enabled = BUGLE_TRUE;
+    tsc_source = "time-stamp counter";
+}
+
+/* Calibration takes tens of milliseconds, so it is only done on demand
+ * rather than when the library is loaded.
+ */
+static bugle_thread_once_t tsc_once = BUGLE_THREAD_ONCE_INIT;
+
+int bugle_gettime_fast(bugle_timespec *tv)
+{
+    bugle_uint64_t now;
+    double elapsed;
+    time_t whole;
+
+    bugle_thread_once(&tsc_once, tsc_initialise);
+    if (!tsc_enabled)
+        return bugle_gettime(tv);
+
+    now = tsc_read();
+    /* Counters on different cores may be very slightly out of step */
+    elapsed = tsc_base_frac;
+    if (now > tsc_base)
+        elapsed += (double) (now - tsc_base) * tsc_seconds_per_tick;
+    whole = (time_t) elapsed;
+    tv->tv_sec = tsc_base_sec + whole;
+    tv->tv_nsec = (long) ((elapsed - whole) * 1e9);
+    return 0;
+}
+
+const char *bugle_gettime_fast_source(void)
+{
+    bugle_thread_once(&tsc_once, tsc_initialise);
+    return tsc_source;
+}
+
+#else /* !BUGLE_HAVE_TSC */
+
+int bugle_gettime_fast(bugle_timespec *tv)
+{
+    return bugle_gettime(tv);
+}
+
+const char *bugle_gettime_fast_source(void)
+{
+    return "system clock";
+}
+
+#endif /* !BUGLE_HAVE_TSC */
@@ -111,6 +111,20 @@ typedef DWORD bugle_thread_id;
 
 #define bugle_getpid() (GetCurrentProcessId())
 
+/* LONG and unsigned long are both 32 bits on Windows, so the casts are
+ * harmless. Interlocked operations are full memory barriers.
+ */
+typedef unsigned long bugle_atomic_t;
+#define bugle_atomic_barrier() MemoryBarrier()
+#define bugle_atomic_add(ptr, value) \
+    ((bugle_atomic_t) InterlockedExchangeAdd((LONG volatile *) (ptr), (LONG) (value)) + (value))
+#define bugle_atomic_cas(ptr, oldval, newval) \
+    ((bugle_bool) (InterlockedCompareExchange((LONG volatile *) (ptr), (LONG) (newval), (LONG) (oldval)) == (LONG) (oldval)))
+#define bugle_atomic_get(ptr) \
+    ((bugle_atomic_t) InterlockedCompareExchange((LONG volatile *) (ptr), 0, 0))
+#define bugle_atomic_set(ptr, value) \
+    ((void) InterlockedExchange((LONG volatile *) (ptr), (LONG) (value)))
+
 #define bugle_flockfile(f) ((void) 0)
 #define bugle_funlockfile(f) ((void) 0)
 
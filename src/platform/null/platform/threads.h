@@ -63,6 +63,14 @@ typedef int bugle_thread_t;
 typedef int bugle_process_id;
 #define bugle_get_pid() (0)
 
+typedef unsigned long bugle_atomic_t;
+#define bugle_atomic_barrier() ((void) 0)
+#define bugle_atomic_add(ptr, value) (*(ptr) += (value))
+#define bugle_atomic_cas(ptr, oldval, newval) \
+    (*(ptr) == (oldval) ? (*(ptr) = (newval), 1) : 0)
+#define bugle_atomic_get(ptr) (*(ptr))
+#define bugle_atomic_set(ptr, value) ((void) (*(ptr) = (value)))
+
 #define bugle_flockfile(f) ((void) 0)
 #define bugle_funlockfile(f) ((void) 0)
 
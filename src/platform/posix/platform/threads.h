@@ -74,6 +74,32 @@ typedef pthread_t bugle_thread_id;
 
 #define bugle_getpid() (getpid())
 
+/* Atomic operations. These rely on the GCC __sync builtins, which are also
+ * provided by other compilers that target POSIX systems (e.g. clang, icc).
+ */
+typedef unsigned long bugle_atomic_t;
+#define bugle_atomic_barrier() __sync_synchronize()
+#define bugle_atomic_add(ptr, value) (__sync_add_and_fetch((ptr), (value)))
+#define bugle_atomic_cas(ptr, oldval, newval) \
+    ((bugle_bool) __sync_bool_compare_and_swap((ptr), (oldval), (newval)))
+
+static inline bugle_atomic_t bugle_atomic_get(volatile bugle_atomic_t *ptr)
+{
+    bugle_atomic_t value;
+
+    __sync_synchronize();
+    value = *ptr;
+    __sync_synchronize();
+    return value;
+}
+
+static inline void bugle_atomic_set(volatile bugle_atomic_t *ptr, bugle_atomic_t value)
+{
+    __sync_synchronize();
+    *ptr = value;
+    __sync_synchronize();
+}
+
 #if _POSIX_THREAD_SAFE_FUNCTIONS > 0
 # define bugle_flockfile(f) flockfile(f)
 # define bugle_funlockfile(f) funlockfile(f)
@@ -0,0 +1,75 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BUGLE_PLATFORM_SHM_H
+#define BUGLE_PLATFORM_SHM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <bugle/bool.h>
+#include <bugle/export.h>
+
+/* Named shared memory segments, which other processes on the same machine
+ * can map. Names follow the POSIX convention of a leading slash and no
+ * other slashes; a leading slash is added if missing.
+ */
+typedef struct bugle_shm_s bugle_shm;
+
+/* Creates a segment of the given size, zero-filled and mapped read-write,
+ * replacing any existing segment of the same name. Returns NULL on failure,
+ * with errno set.
+ */
+BUGLE_EXPORT_PRE bugle_shm *bugle_shm_create(const char *name, size_t size) BUGLE_EXPORT_POST;
+
+/* Like bugle_shm_create, but only processes of the same user may open the
+ * segment. Use this when the contents are not meant for other users.
+ */
+BUGLE_EXPORT_PRE bugle_shm *bugle_shm_create_private(const char *name, size_t size) BUGLE_EXPORT_POST;
+
+/* Maps an existing segment read-only. Returns NULL on failure, with errno
+ * set.
+ */
+BUGLE_EXPORT_PRE bugle_shm *bugle_shm_open(const char *name) BUGLE_EXPORT_POST;
+
+BUGLE_EXPORT_PRE void *bugle_shm_data(bugle_shm *shm) BUGLE_EXPORT_POST;
+BUGLE_EXPORT_PRE size_t bugle_shm_size(bugle_shm *shm) BUGLE_EXPORT_POST;
+
+/* Unmaps the segment. If it was created by bugle_shm_create, the name is
+ * also removed, although processes that have it mapped keep their view.
+ */
+BUGLE_EXPORT_PRE void bugle_shm_close(bugle_shm *shm) BUGLE_EXPORT_POST;
+
+/* Unmaps the segment but leaves the name in place, even if it was created
+ * by bugle_shm_create. This hands the segment over to another process,
+ * which is then responsible for removing the name.
+ */
+BUGLE_EXPORT_PRE void bugle_shm_release(bugle_shm *shm) BUGLE_EXPORT_POST;
+
+/* Removes a name, without affecting existing mappings. The memory is freed
+ * once the last mapping goes away. Returns BUGLE_FALSE on failure, with
+ * errno set.
+ */
+BUGLE_EXPORT_PRE bugle_bool bugle_shm_unlink(const char *name) BUGLE_EXPORT_POST;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !BUGLE_PLATFORM_SHM_H */
@@ -0,0 +1,65 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#include <errno.h>
+#include "platform/shm.h"
+
+bugle_shm *bugle_shm_create(const char *name, size_t size)
+{
+    errno = ENOSYS;
+    return NULL;
+}
+
+bugle_shm *bugle_shm_create_private(const char *name, size_t size)
+{
+    errno = ENOSYS;
+    return NULL;
+}
+
+bugle_shm *bugle_shm_open(const char *name)
+{
+    errno = ENOSYS;
+    return NULL;
+}
+
+void *bugle_shm_data(bugle_shm *shm)
+{
+    return NULL;
+}
+
+size_t bugle_shm_size(bugle_shm *shm)
+{
+    return 0;
+}
+
+void bugle_shm_close(bugle_shm *shm)
+{
+}
+
+void bugle_shm_release(bugle_shm *shm)
+{
+}
+
+bugle_bool bugle_shm_unlink(const char *name)
+{
+    errno = ENOSYS;
+    return BUGLE_FALSE;
+}
@@ -0,0 +1,185 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "platform_config.h"
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <bugle/bool.h>
+#include <bugle/memory.h>
+#include "platform/shm.h"
+
+struct bugle_shm_s
+{
+    char *name;
+    void *data;
+    size_t size;
+    bugle_bool owner;
+};
+
+static char *shm_name(const char *name)
+{
+    char *out;
+
+    out = BUGLE_NMALLOC(strlen(name) + 2, char);
+    if (name[0] == '/')
+        strcpy(out, name);
+    else
+    {
+        out[0] = '/';
+        strcpy(out + 1, name);
+    }
+    return out;
+}
+
+static bugle_shm *shm_create(const char *name, size_t size, mode_t mode)
+{
+    bugle_shm *shm;
+    int fd, save;
+
+    shm = BUGLE_MALLOC(bugle_shm);
+    shm->name = shm_name(name);
+    shm->size = size;
+    shm->owner = BUGLE_TRUE;
+
+    /* Remove any stale segment first, so that a reader still attached to
+     * it is not confused by a change in layout.
+     */
+    shm_unlink(shm->name);
+    fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL, mode);
+    if (fd < 0)
+        goto fail;
+    if (ftruncate(fd, size) != 0)
+    {
+        save = errno;
+        close(fd);
+        shm_unlink(shm->name);
+        errno = save;
+        goto fail;
+    }
+    shm->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    save = errno;
+    close(fd);
+    if (shm->data == MAP_FAILED)
+    {
+        shm_unlink(shm->name);
+        errno = save;
+        goto fail;
+    }
+    return shm;
+
+fail:
+    save = errno;
+    bugle_free(shm->name);
+    bugle_free(shm);
+    errno = save;
+    return NULL;
+}
+
+bugle_shm *bugle_shm_create(const char *name, size_t size)
+{
+    return shm_create(name, size, 0644);
+}
+
+bugle_shm *bugle_shm_create_private(const char *name, size_t size)
+{
+    return shm_create(name, size, 0600);
+}
+
+bugle_shm *bugle_shm_open(const char *name)
+{
+    bugle_shm *shm;
+    struct stat st;
+    int fd, save;
+
+    shm = BUGLE_MALLOC(bugle_shm);
+    shm->name = shm_name(name);
+    shm->owner = BUGLE_FALSE;
+    fd = shm_open(shm->name, O_RDONLY, 0);
+    if (fd < 0)
+        goto fail;
+    if (fstat(fd, &st) != 0)
+    {
+        save = errno;
+        close(fd);
+        errno = save;
+        goto fail;
+    }
+    shm->size = st.st_size;
+    shm->data = mmap(NULL, shm->size, PROT_READ, MAP_SHARED, fd, 0);
+    save = errno;
+    close(fd);
+    if (shm->data == MAP_FAILED)
+    {
+        errno = save;
+        goto fail;
+    }
+    return shm;
+
+fail:
+    save = errno;
+    bugle_free(shm->name);
+    bugle_free(shm);
+    errno = save;
+    return NULL;
+}
+
+void *bugle_shm_data(bugle_shm *shm)
+{
+    return shm->data;
+}
+
+size_t bugle_shm_size(bugle_shm *shm)
+{
+    return shm->size;
+}
+
+void bugle_shm_close(bugle_shm *shm)
+{
+    munmap(shm->data, shm->size);
+    if (shm->owner)
+        shm_unlink(shm->name);
+    bugle_free(shm->name);
+    bugle_free(shm);
+}
+
+void bugle_shm_release(bugle_shm *shm)
+{
+    shm->owner = BUGLE_FALSE;
+    bugle_shm_close(shm);
+}
+
+bugle_bool bugle_shm_unlink(const char *name)
+{
+    char *full;
+    int ret, save;
+
+    full = shm_name(name);
+    ret = shm_unlink(full);
+    save = errno;
+    bugle_free(full);
+    errno = save;
+    return ret == 0;
+}
@@ -1,5 +1,5 @@
 /*  BuGLe: an OpenGL debugging tool
- *  Copyright (C) 2004-2010  Bruce Merry
+ *  Copyright (C) 2004-2010, 2014  Bruce Merry
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -35,6 +35,7 @@
 #include "statsparse.h"
 #include <bugle/hashtable.h>
 #include <bugle/bool.h>
+#include "platform/threads.h"
 
 #define STATISTICSFILE "/.bugle/statistics"
 
@@ -43,7 +44,25 @@ extern int stats_yyparse(void);
 
 static hash_table stats_signals;
 static size_t stats_signals_num_active = 0;
-static linked_list stats_signals_active; /* Pointers into stats_signals */
+static size_t stats_signals_active_size = 0;
+static stats_signal **stats_signals_active = NULL; /* Indexed by offset */
+
+/* Per-thread totals for bugle_stats_signal_add, indexed by signal offset.
+ * Only the owning thread writes the totals. Reading them from another
+ * thread, growing the array and creating or retiring shards are done
+ * with stats_shards_lock held.
+ */
+typedef struct
+{
+    double *totals;
+    size_t size;
+    linked_list_node *node;                 /* In stats_shards */
+} stats_shard;
+
+static bugle_thread_lock_t stats_shards_lock;
+static bugle_thread_key_t stats_shard_key;
+static linked_list stats_shards;
+static stats_shard stats_shard_retired;     /* Totals from exited threads */
 
 /* Flat list of available statistics. Initially it is the statistics
  * specified in the file, but later rewritten to instantiate any generics.
@@ -61,6 +80,91 @@ static double time_elapsed(bugle_timespec *old, bugle_timespec *now)
     return (now->tv_sec - old->tv_sec) + 1e-9 * (now->tv_nsec - old->tv_nsec);
 }
 
+/* Extends the totals of a shard with zeros. stats_shards_lock must be
+ * held, unless the shard is not yet visible to other threads.
+ */
+static void stats_shard_grow(stats_shard *shard, size_t size)
+{
+    size_t i;
+
+    if (size <= shard->size)
+        return;
+    shard->totals = bugle_nrealloc(shard->totals, size, sizeof(double));
+    for (i = shard->size; i < size; i++)
+        shard->totals[i] = 0.0;
+    shard->size = size;
+}
+
+/* Thread destructor: folds the totals into stats_shard_retired */
+static void stats_shard_release(void *data)
+{
+    stats_shard *shard;
+    size_t i;
+
+    shard = (stats_shard *) data;
+    bugle_thread_lock_lock(&stats_shards_lock);
+    stats_shard_grow(&stats_shard_retired, shard->size);
+    for (i = 0; i < shard->size; i++)
+        stats_shard_retired.totals[i] += shard->totals[i];
+    bugle_list_erase(&stats_shards, shard->node);
+    bugle_thread_lock_unlock(&stats_shards_lock);
+
+    bugle_free(shard->totals);
+    bugle_free(shard);
+}
+
+static stats_shard *stats_shard_get(void)
+{
+    stats_shard *shard;
+
+    shard = (stats_shard *) bugle_thread_getspecific(stats_shard_key);
+    if (!shard)
+    {
+        shard = BUGLE_ZALLOC(stats_shard);
+        bugle_thread_lock_lock(&stats_shards_lock);
+        stats_shard_grow(shard, stats_signals_num_active);
+        shard->node = bugle_list_append(&stats_shards, shard);
+        bugle_thread_lock_unlock(&stats_shards_lock);
+        bugle_thread_setspecific(stats_shard_key, shard);
+    }
+    return shard;
+}
+
+/* Sums the increments to one signal across all threads.
+ * stats_shards_lock must be held.
+ */
+static double stats_shards_total(int offset)
+{
+    linked_list_node *i;
+    const stats_shard *shard;
+    double total = 0.0;
+
+    if (offset < 0)
+        return 0.0;
+    if ((size_t) offset < stats_shard_retired.size)
+        total += stats_shard_retired.totals[offset];
+    for (i = bugle_list_head(&stats_shards); i; i = bugle_list_next(i))
+    {
+        shard = (const stats_shard *) bugle_list_data(i);
+        if ((size_t) offset < shard->size)
+            total += shard->totals[offset];
+    }
+    return total;
+}
+
+/* Combines the last value set with the increments since then. Adding to
+ * an unset signal treats it as zero.
+ */
+static double stats_signal_merged(const stats_signal *si, double total)
+{
+    if (total == si->add_base)
+        return si->value;
+    else if (!bugle_isfinite(si->value))
+        return total - si->add_base;
+    else
+        return si->value + (total - si->add_base);
+}
+
 /* Finds the named signal object. If it does not exist, NULL is returned. */
 static stats_signal *stats_signal_get(const char *name)
 {
@@ -80,6 +184,7 @@ stats_signal *bugle_stats_signal_new(const char *name, void *user_data,
     si = BUGLE_ZALLOC(stats_signal);
     si->value = bugle_nan();
     si->integral = 0.0;
+    si->add_base = 0.0;
     si->offset = -1;
     si->user_data = user_data;
     si->activate = activate;
@@ -87,6 +192,217 @@ stats_signal *bugle_stats_signal_new(const char *name, void *user_data,
     return si;
 }
 
+/*** Windows ***/
+
+/* Upper bound on the samples kept for a window measured in seconds */
+#define STATS_WINDOW_MAX_SAMPLES 4096
+
+/* The samples are kept in a ring buffer indexed by sequence number modulo
+ * the capacity. Each operation keeps just enough extra state to update
+ * its result as samples arrive and expire: running sums for the mean and
+ * standard deviation, a monotonic queue of sequence numbers for the
+ * minimum and maximum, and a sorted copy of the samples for percentiles.
+ */
+struct stats_window_s
+{
+    stats_operation_type op;
+    double length;
+    bugle_bool seconds;
+
+    size_t capacity;
+    double *values;
+    bugle_timespec *times;              /* end of the interval of each sample */
+    unsigned long first, next;          /* sequence numbers of the oldest and next samples */
+    bugle_bool started;
+    bugle_timespec last_end;
+
+    double sum, sum_squares;            /* for mean and stddev */
+    unsigned long *queue;               /* for min and max */
+    unsigned long queue_first, queue_next;
+    double *sorted;                     /* for percentile */
+};
+
+stats_window *stats_window_new(stats_operation_type op, double length, bugle_bool seconds)
+{
+    stats_window *w;
+
+    w = BUGLE_ZALLOC(stats_window);
+    w->op = op;
+    w->length = length;
+    w->seconds = seconds;
+    if (seconds)
+        w->capacity = STATS_WINDOW_MAX_SAMPLES;
+    else
+        w->capacity = length >= 1.0 ? (size_t) length : 1;
+    w->values = BUGLE_NMALLOC(w->capacity, double);
+    w->times = BUGLE_NMALLOC(w->capacity, bugle_timespec);
+    switch (op)
+    {
+    case STATS_OPERATION_MIN:
+    case STATS_OPERATION_MAX:
+        w->queue = BUGLE_NMALLOC(w->capacity, unsigned long);
+        break;
+    case STATS_OPERATION_PERCENTILE:
+        w->sorted = BUGLE_NMALLOC(w->capacity, double);
+        break;
+    default:
+        break;
+    }
+    return w;
+}
+
+static void stats_window_free(stats_window *w)
+{
+    bugle_free(w->values);
+    bugle_free(w->times);
+    bugle_free(w->queue);
+    bugle_free(w->sorted);
+    bugle_free(w);
+}
+
+/* Finds the first element of the sorted samples that is not less than v */
+static size_t stats_window_sorted_find(const stats_window *w, double v)
+{
+    size_t lo = 0, hi = w->next - w->first, mid;
+
+    while (lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if (w->sorted[mid] < v)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Whether the queue should discard an older sample a in favour of b */
+static bugle_bool stats_window_dominated(const stats_window *w, double a, double b)
+{
+    return w->op == STATS_OPERATION_MIN ? a >= b : a <= b;
+}
+
+static void stats_window_expire(stats_window *w)
+{
+    double v;
+    size_t pos, count;
+
+    v = w->values[w->first % w->capacity];
+    count = w->next - w->first;
+    switch (w->op)
+    {
+    case STATS_OPERATION_MIN:
+    case STATS_OPERATION_MAX:
+        if (w->queue_first != w->queue_next && w->queue[w->queue_first % w->capacity] == w->first)
+            w->queue_first++;
+        break;
+    case STATS_OPERATION_MEAN:
+    case STATS_OPERATION_STDDEV:
+        w->sum -= v;
+        w->sum_squares -= v * v;
+        break;
+    case STATS_OPERATION_PERCENTILE:
+        pos = stats_window_sorted_find(w, v);
+        memmove(w->sorted + pos, w->sorted + pos + 1, (count - pos - 1) * sizeof(double));
+        break;
+    default:
+        break;
+    }
+    w->first++;
+}
+
+static void stats_window_add(stats_window *w, double v, const bugle_timespec *end)
+{
+    size_t pos, count;
+
+    if (w->next - w->first == w->capacity)
+        stats_window_expire(w);
+    count = w->next - w->first;
+    switch (w->op)
+    {
+    case STATS_OPERATION_MIN:
+    case STATS_OPERATION_MAX:
+        while (w->queue_first != w->queue_next
+               && stats_window_dominated(w, w->values[w->queue[(w->queue_next - 1) % w->capacity] % w->capacity], v))
+            w->queue_next--;
+        w->queue[w->queue_next % w->capacity] = w->next;
+        w->queue_next++;
+        break;
+    case STATS_OPERATION_MEAN:
+    case STATS_OPERATION_STDDEV:
+        w->sum += v;
+        w->sum_squares += v * v;
+        break;
+    case STATS_OPERATION_PERCENTILE:
+        pos = stats_window_sorted_find(w, v);
+        memmove(w->sorted + pos + 1, w->sorted + pos, (count - pos) * sizeof(double));
+        w->sorted[pos] = v;
+        break;
+    default:
+        break;
+    }
+    w->values[w->next % w->capacity] = v;
+    w->times[w->next % w->capacity] = *end;
+    w->next++;
+}
+
+/* Computes the aggregate over the current samples */
+static double stats_window_result(const stats_window *w, double percentile)
+{
+    size_t count, rank;
+    double mean, variance;
+
+    count = w->next - w->first;
+    if (count == 0)
+        return bugle_nan();
+    switch (w->op)
+    {
+    case STATS_OPERATION_MIN:
+    case STATS_OPERATION_MAX:
+        return w->values[w->queue[w->queue_first % w->capacity] % w->capacity];
+    case STATS_OPERATION_MEAN:
+        return w->sum / count;
+    case STATS_OPERATION_STDDEV:
+        mean = w->sum / count;
+        variance = w->sum_squares / count - mean * mean;
+        return variance > 0.0 ? sqrt(variance) : 0.0;
+    case STATS_OPERATION_PERCENTILE:
+        /* Nearest rank */
+        rank = (size_t) ceil(percentile / 100.0 * count);
+        if (rank < 1) rank = 1;
+        if (rank > count) rank = count;
+        return w->sorted[rank - 1];
+    default:
+        abort(); /* Should never be reached */
+    }
+    return 0.0;  /* Unreachable, but keeps compilers quiet */
+}
+
+static double stats_window_evaluate(const stats_expression *expr,
+                                    stats_signal_values *old_signals,
+                                    stats_signal_values *new_signals)
+{
+    stats_window *w;
+    double v;
+
+    w = expr->window;
+    v = bugle_stats_expression_evaluate(expr->left, old_signals, new_signals);
+    /* NaN samples (such as 0/0 in an idle interval) are left out */
+    if (!bugle_isnan(v)
+        && (!w->started || time_elapsed(&w->last_end, &old_signals->last_updated) >= 0.0))
+    {
+        stats_window_add(w, v, &new_signals->last_updated);
+        w->started = BUGLE_TRUE;
+        w->last_end = new_signals->last_updated;
+    }
+
+    if (w->seconds)
+        while (w->next != w->first
+               && time_elapsed(&w->times[w->first % w->capacity], &new_signals->last_updated) >= w->length)
+            stats_window_expire(w);
+    return stats_window_result(w, expr->value);
+}
+
 /* Evaluates the expression. If a signal is missing, the return is NaN. */
 double bugle_stats_expression_evaluate(const stats_expression *expr,
                                        stats_signal_values *old_signals,
@@ -131,34 +447,69 @@ double bugle_stats_expression_evaluate(const stats_expression *expr,
         default:
             abort(); /* Should never be reached */
         }
+    case STATS_EXPRESSION_WINDOW:
+        return stats_window_evaluate(expr, old_signals, new_signals);
     }
     abort(); /* Should never be reached */
     return 0.0;  /* Unreachable, but keeps compilers quiet */
 }
 
-void bugle_stats_signal_update(stats_signal *si, double v)
+/* Replaces the central value. stats_shards_lock must be held. */
+static void stats_signal_set(stats_signal *si, double v)
 {
     bugle_timespec now;
 
-    bugle_gettime(&now);
-    /* Integrate over time; a NaN indicates that this is the first time */
-    if (bugle_isfinite(si->value))
-        si->integral += time_elapsed(&si->last_updated, &now) * si->value;
+    if (si->integrate)
+    {
+        bugle_gettime_fast(&now);
+        /* Integrate over time; a NaN indicates that this is the first time */
+        if (bugle_isfinite(si->value))
+            si->integral += time_elapsed(&si->last_updated, &now) * si->value;
+        si->last_updated = now;
+    }
     si->value = v;
-    si->last_updated = now;
 }
 
-/* Convenience for accumulating signals */
+void bugle_stats_signal_update(stats_signal *si, double v)
+{
+    bugle_thread_lock_lock(&stats_shards_lock);
+    si->add_base = stats_shards_total(si->offset);
+    stats_signal_set(si, v);
+    bugle_thread_lock_unlock(&stats_shards_lock);
+}
+
 void bugle_stats_signal_add(stats_signal *si, double dv)
 {
-    if (!bugle_isfinite(si->value))
-        bugle_stats_signal_update(si, dv);
-    else
-        bugle_stats_signal_update(si, si->value + dv);
+    stats_shard *shard;
+
+    /* Nothing looks at inactive signals, and they are reset on activation */
+    if (si->offset < 0)
+        return;
+    if (si->integrate)
+    {
+        /* The integral needs the time of each change, so these are not
+         * sharded.
+         */
+        bugle_thread_lock_lock(&stats_shards_lock);
+        stats_signal_set(si, bugle_isfinite(si->value) ? si->value + dv : dv);
+        bugle_thread_lock_unlock(&stats_shards_lock);
+        return;
+    }
+
+    shard = stats_shard_get();
+    if ((size_t) si->offset >= shard->size)
+    {
+        bugle_thread_lock_lock(&stats_shards_lock);
+        stats_shard_grow(shard, stats_signals_num_active);
+        bugle_thread_lock_unlock(&stats_shards_lock);
+    }
+    shard->totals[si->offset] += dv;
 }
 
-static bugle_bool stats_signal_activate(stats_signal *si)
+static bugle_bool stats_signal_activate(stats_signal *si, bugle_bool integrate)
 {
+    double total;
+
     if (!si->active)
     {
         si->active = BUGLE_TRUE;
@@ -168,10 +519,33 @@ static bugle_bool stats_signal_activate(stats_signal *si)
             bugle_stats_signal_update(si, 0.0);
         if (si->active)
         {
-            si->offset = stats_signals_num_active++;
-            bugle_list_append(&stats_signals_active, si);
+            if (stats_signals_num_active == stats_signals_active_size)
+            {
+                stats_signals_active_size = stats_signals_active_size * 2 + 16;
+                stats_signals_active = BUGLE_NREALLOC(stats_signals_active,
+                                                      stats_signals_active_size,
+                                                      stats_signal *);
+            }
+            bugle_thread_lock_lock(&stats_shards_lock);
+            si->offset = stats_signals_num_active;
+            stats_signals_active[stats_signals_num_active++] = si;
+            si->add_base = stats_shards_total(si->offset);
+            bugle_thread_lock_unlock(&stats_shards_lock);
         }
     }
+    if (si->active && integrate && !si->integrate)
+    {
+        /* Fold the shards into the central value, which is then
+         * maintained directly.
+         */
+        bugle_thread_lock_lock(&stats_shards_lock);
+        total = stats_shards_total(si->offset);
+        si->value = stats_signal_merged(si, total);
+        si->add_base = total;
+        bugle_gettime_fast(&si->last_updated);
+        si->integrate = BUGLE_TRUE;
+        bugle_thread_lock_unlock(&stats_shards_lock);
+    }
     return si->active;
 }
 
@@ -195,34 +569,48 @@ void bugle_stats_signal_values_clear(stats_signal_values *sv)
 void bugle_stats_signal_values_gather(stats_signal_values *sv)
 {
     stats_signal *si;
+    const stats_shard *shard;
     linked_list_node *s;
-    size_t i;
+    size_t i, n;
 
-    bugle_gettime(&sv->last_updated);
+    bugle_gettime_fast(&sv->last_updated);
 
-    if (sv->allocated < stats_signals_num_active)
+    bugle_thread_lock_lock(&stats_shards_lock);
+    n = stats_signals_num_active;
+    if (sv->allocated < n)
     {
-        sv->allocated = stats_signals_num_active;
-        sv->values = bugle_nrealloc(sv->values, stats_signals_num_active, sizeof(stats_signal_value));
+        sv->allocated = n;
+        sv->values = bugle_nrealloc(sv->values, n, sizeof(stats_signal_value));
     }
-    /* Make sure that everything is initialised to an insane value (NaN) */
-    for (i = 0; i < stats_signals_num_active; i++)
-        sv->values[i].value = sv->values[i].integral = bugle_nan();
-    for (s = bugle_list_head(&stats_signals_active); s; s = bugle_list_next(s))
+
+    /* Sum the shards into the value fields, one shard at a time */
+    for (i = 0; i < n; i++)
+        sv->values[i].value = i < stats_shard_retired.size ? stats_shard_retired.totals[i] : 0.0;
+    for (s = bugle_list_head(&stats_shards); s; s = bugle_list_next(s))
+    {
+        shard = (const stats_shard *) bugle_list_data(s);
+        for (i = 0; i < n && i < shard->size; i++)
+            sv->values[i].value += shard->totals[i];
+    }
+
+    for (i = 0; i < n; i++)
     {
-        si = (stats_signal *) bugle_list_data(s);
-        if (si->active && si->offset >= 0)
+        si = stats_signals_active[i];
+        sv->values[i].value = stats_signal_merged(si, sv->values[i].value);
+        if (si->integrate)
         {
-            sv->values[si->offset].value = si->value;
-            sv->values[si->offset].integral = si->integral;
+            sv->values[i].integral = si->integral;
             /* Have to update the integral from when the signal was updated
              * until this instant. */
             if (bugle_isfinite(si->value))
-                sv->values[si->offset].integral +=
+                sv->values[i].integral +=
                     si->value * time_elapsed(&si->last_updated,
                                              &sv->last_updated);
         }
+        else
+            sv->values[i].integral = bugle_nan();
     }
+    bugle_thread_lock_unlock(&stats_shards_lock);
 }
 
 /* Calls the callback function for each signal sub-expression in the
@@ -247,6 +635,8 @@ static bugle_bool stats_expression_forall(stats_expression *expr, bugle_bool sho
         return ans;
     case STATS_EXPRESSION_SIGNAL:
         return callback(expr, arg);
+    case STATS_EXPRESSION_WINDOW:
+        return stats_expression_forall(expr->left, shortcut, callback, arg);
     }
     return BUGLE_FALSE;  /* should never be reached */
 }
@@ -262,7 +652,7 @@ static bugle_bool stats_expression_activate_signals1(stats_expression *expr, voi
                          expr->signal_name);
         return BUGLE_FALSE;
     }
-    return stats_signal_activate(expr->signal);
+    return stats_signal_activate(expr->signal, expr->op == STATS_OPERATION_AVERAGE);
 }
 
 /* Initialises and activates all signals that this expression depends on.
@@ -390,6 +780,10 @@ static stats_expression *stats_expression_instantiate(stats_expression *base, co
         n->signal = NULL;
         n->signal_name = pattern_replace(n->signal_name, rep);
         break;
+    case STATS_EXPRESSION_WINDOW:
+        n->left = stats_expression_instantiate(n->left, rep);
+        n->window = stats_window_new(base->window->op, base->window->length, base->window->seconds);
+        break;
     default: abort(); /* should never be reached */
     }
     return n;
@@ -409,6 +803,10 @@ static void stats_expression_free(stats_expression *expr)
     case STATS_EXPRESSION_SIGNAL:
         bugle_free(expr->signal_name);
         break;
+    case STATS_EXPRESSION_WINDOW:
+        stats_expression_free(expr->left);
+        stats_window_free(expr->window);
+        break;
     }
     bugle_free(expr);
 }
@@ -534,7 +932,9 @@ static bugle_bool stats_load_config(void)
 static bugle_bool stats_initialise(filter_set *handle)
 {
     bugle_hash_init(&stats_signals, bugle_free);
-    bugle_list_init(&stats_signals_active, NULL);
+    bugle_thread_lock_init(&stats_shards_lock);
+    bugle_thread_key_create(&stats_shard_key, stats_shard_release);
+    bugle_list_init(&stats_shards, NULL);
     bugle_hash_init(&stats_statistics_first, NULL);
     return BUGLE_TRUE;
 }
@@ -613,9 +1013,26 @@ static bugle_bool stats_ordering_initialise(filter_set *handle)
 
 static void stats_shutdown(filter_set *handle)
 {
+    linked_list_node *i;
+    stats_shard *shard;
+
     if (stats_statistics)
         bugle_list_clear(stats_statistics);
-    bugle_list_clear(&stats_signals_active);
+    bugle_thread_key_delete(stats_shard_key);
+    for (i = bugle_list_head(&stats_shards); i; i = bugle_list_next(i))
+    {
+        shard = (stats_shard *) bugle_list_data(i);
+        bugle_free(shard->totals);
+        bugle_free(shard);
+    }
+    bugle_list_clear(&stats_shards);
+    bugle_free(stats_shard_retired.totals);
+    stats_shard_retired.totals = NULL;
+    stats_shard_retired.size = 0;
+    bugle_thread_lock_destroy(&stats_shards_lock);
+    bugle_free(stats_signals_active);
+    stats_signals_active = NULL;
+    stats_signals_active_size = stats_signals_num_active = 0;
     bugle_hash_clear(&stats_signals);
     bugle_hash_clear(&stats_statistics_first);
 }
@@ -0,0 +1,245 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Displays or records the statistics published by the shmstats filter-set.
+ * It only maps the segment read-only, so it cannot disturb the target, and
+ * it can poll as often as desired.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <bugle/bool.h>
+#include <bugle/math.h>
+#include <bugle/memory.h>
+#include "common/statsshm.h"
+#include "platform/shm.h"
+#include "platform/types.h"
+
+static const char *statsmon_name = "bugle-stats";
+static double statsmon_interval = 1.0;
+static bugle_bool statsmon_record = BUGLE_FALSE;
+static long statsmon_samples = -1;
+
+static void statsmon_usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [-n name] [-i seconds] [-c count] [-r]\n"
+            "  -n name     name of the shared memory segment [bugle-stats]\n"
+            "  -i seconds  time between samples [1.0]\n"
+            "  -c count    stop after this many samples\n"
+            "  -r          record as CSV instead of displaying\n",
+            argv0);
+    exit(1);
+}
+
+static void statsmon_parse_args(int argc, char **argv)
+{
+    int i;
+    char *end;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-r") == 0)
+            statsmon_record = BUGLE_TRUE;
+        else if (i + 1 < argc && strcmp(argv[i], "-n") == 0)
+            statsmon_name = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-i") == 0)
+        {
+            statsmon_interval = strtod(argv[++i], &end);
+            if (*end || !(statsmon_interval > 0.0))
+                statsmon_usage(argv[0]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-c") == 0)
+        {
+            statsmon_samples = strtol(argv[++i], &end, 10);
+            if (*end || statsmon_samples <= 0)
+                statsmon_usage(argv[0]);
+        }
+        else
+            statsmon_usage(argv[0]);
+    }
+}
+
+static void statsmon_sleep(void)
+{
+    struct timespec ts;
+
+    ts.tv_sec = (time_t) statsmon_interval;
+    ts.tv_nsec = (long) ((statsmon_interval - ts.tv_sec) * 1e9);
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    {
+        /* Continue with the remaining time */
+    }
+}
+
+/* Maps the segment, waiting for the target to create it if necessary */
+static bugle_shm *statsmon_attach(void)
+{
+    bugle_shm *shm;
+    bugle_bool waiting = BUGLE_FALSE;
+
+    for (;;)
+    {
+        shm = bugle_shm_open(statsmon_name);
+        if (shm)
+        {
+            if (bugle_statsshm_valid(bugle_shm_data(shm), bugle_shm_size(shm)))
+                return shm;
+            bugle_shm_close(shm);
+        }
+        else if (errno != ENOENT)
+        {
+            fprintf(stderr, "Cannot open %s: %s\n", statsmon_name, strerror(errno));
+            exit(1);
+        }
+        if (!waiting)
+        {
+            fprintf(stderr, "Waiting for %s...\n", statsmon_name);
+            waiting = BUGLE_TRUE;
+        }
+        statsmon_sleep();
+    }
+}
+
+static const char *statsmon_string(const bugle_statsshm_header *header, bugle_uint32_t offset)
+{
+    if (offset == 0 || offset >= header->size)
+        return "";
+    return (const char *) header + offset;
+}
+
+static void statsmon_csv_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++)
+    {
+        if (*s == '"')
+            putchar('"');
+        putchar(*s);
+    }
+    putchar('"');
+}
+
+static void statsmon_print_header(const bugle_statsshm_header *header,
+                                  const bugle_statsshm_statistic *stats)
+{
+    bugle_uint32_t i;
+
+    if (statsmon_record)
+    {
+        fputs("frame,time", stdout);
+        for (i = 0; i < header->count; i++)
+        {
+            putchar(',');
+            statsmon_csv_string(statsmon_string(header, stats[i].name_offset));
+        }
+        putchar('\n');
+    }
+    else
+        printf("Attached to %s (process %lu, %lu statistics)\n",
+               statsmon_name, (unsigned long) header->pid, (unsigned long) header->count);
+}
+
+static void statsmon_print_sample(const bugle_statsshm_header *header,
+                                  const bugle_statsshm_statistic *stats,
+                                  const bugle_statsshm_snapshot *snapshot)
+{
+    bugle_uint32_t i;
+
+    if (statsmon_record)
+    {
+        printf("%" BUGLE_PRIu64 ",%.6f", snapshot->frame, snapshot->time);
+        for (i = 0; i < header->count; i++)
+        {
+            putchar(',');
+            if (bugle_isfinite(snapshot->values[i]))
+                printf("%.10g", snapshot->values[i]);
+        }
+        putchar('\n');
+    }
+    else
+    {
+        printf("\nframe %" BUGLE_PRIu64 " at %.3f s\n", snapshot->frame, snapshot->time);
+        for (i = 0; i < header->count; i++)
+        {
+            printf("  %-40s ", statsmon_string(header, stats[i].name_offset));
+            if (bugle_isfinite(snapshot->values[i]))
+                printf("%.*f", (int) stats[i].precision, snapshot->values[i]);
+            else
+                fputs("-", stdout);
+            printf(" %s\n", statsmon_string(header, stats[i].label_offset));
+        }
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    bugle_shm *shm;
+    const bugle_statsshm_header *header;
+    const bugle_statsshm_statistic *stats;
+    bugle_statsshm_snapshot snapshot;
+    bugle_uint64_t last_frame = 0;
+    long samples = 0;
+    bugle_bool finished;
+
+    statsmon_parse_args(argc, argv);
+    shm = statsmon_attach();
+    header = (const bugle_statsshm_header *) bugle_shm_data(shm);
+    stats = (const bugle_statsshm_statistic *) ((const char *) header + header->statistics_offset);
+    snapshot.values = BUGLE_NMALLOC(header->count + 1, double);
+
+    statsmon_print_header(header, stats);
+    for (;;)
+    {
+        finished = header->state == BUGLE_STATSSHM_FINISHED;
+        if (bugle_statsshm_read(header, &snapshot) && snapshot.frame != last_frame)
+        {
+            /* Only report frames that have not been seen already */
+            statsmon_print_sample(header, stats, &snapshot);
+            last_frame = snapshot.frame;
+            samples++;
+            if (statsmon_samples > 0 && samples >= statsmon_samples)
+                break;
+        }
+        else if (!finished && kill((pid_t) header->pid, 0) != 0 && errno == ESRCH)
+        {
+            /* Nothing new, because the target died without cleaning up */
+            fprintf(stderr, "The target has exited without finishing\n");
+            break;
+        }
+        if (finished)
+        {
+            if (!statsmon_record)
+                printf("\nThe target has finished\n");
+            break;
+        }
+        statsmon_sleep();
+    }
+
+    bugle_free(snapshot.values);
+    bugle_shm_close(shm);
+    return 0;
+}
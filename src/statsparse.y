@@ -1,6 +1,6 @@
 %{
 /*  BuGLe: an OpenGL debugging tool
- *  Copyright (C) 2004-2007  Bruce Merry
+ *  Copyright (C) 2004-2007, 2014  Bruce Merry
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -31,6 +31,7 @@
 #include <bugle/linkedlist.h>
 #include <bugle/log.h>
 #include <bugle/memory.h>
+#include <bugle/bool.h>
 
 int stats_yyerror(const char *msg);
 extern int stats_yylex(void);
@@ -70,6 +71,21 @@ static stats_expression *stats_expression_new_signal(stats_operation_type op, ch
     return expr;
 }
 
+static stats_expression *stats_expression_new_window(stats_operation_type op, stats_expression *left,
+                                                     double percentile, double length, bugle_bool seconds)
+{
+    stats_expression *expr;
+
+    expr = BUGLE_MALLOC(stats_expression);
+    expr->type = STATS_EXPRESSION_WINDOW;
+    expr->op = op;
+    expr->value = percentile;
+    expr->left = left;
+    expr->right = NULL;
+    expr->window = stats_window_new(op, length, seconds);
+    return expr;
+}
+
 static void stats_substitution_free(stats_substitution *sub)
 {
     bugle_free(sub->replacement);
@@ -118,6 +134,11 @@ linked_list *stats_statistics_get_list(void)
         linked_list list;
         stats_statistic *stat;
         stats_expression *expr;
+        struct
+        {
+                double length;
+                bugle_bool seconds;
+        } window;
 }
 
 %token <str> ST_STRING
@@ -126,6 +147,12 @@ linked_list *stats_statistics_get_list(void)
 %token <str> ST_LABEL
 %token <str> ST_MAX
 %token <str> ST_SUBSTITUTE
+%token <str> ST_MIN
+%token <str> ST_MEAN
+%token <str> ST_STDDEV
+%token <str> ST_PERCENTILE
+%token <str> ST_FRAMES
+%token <str> ST_SECONDS
 
 %left <str> '-' '+'
 %left <str> '*' '/'
@@ -135,6 +162,8 @@ linked_list *stats_statistics_get_list(void)
 %type <stat> statistic
 %type <expr> expr
 %type <expr> signalexpr
+%type <expr> windowexpr
+%type <window> window
 %type <stat> attributes
 
 %%
@@ -149,6 +178,7 @@ statistic: ST_STRING '=' expr '{' attributes '}'
 
 expr: ST_NUMBER                   { $$ = stats_expression_new_number($1); }
 	| signalexpr              { $$ = $1; }
+	| windowexpr              { $$ = $1; }
 	| expr '+' expr           { $$ = stats_expression_new_op(STATS_OPERATION_PLUS, $1, $3); }
 	| expr '-' expr           { $$ = stats_expression_new_op(STATS_OPERATION_MINUS, $1, $3); }
         | expr '*' expr           { $$ = stats_expression_new_op(STATS_OPERATION_TIMES, $1, $3); }
@@ -163,6 +193,43 @@ signalexpr: 'd' '(' ST_STRING ')' { $$ = stats_expression_new_signal(STATS_OPERA
         | 'e' '(' ST_STRING ')'   { $$ = stats_expression_new_signal(STATS_OPERATION_END, $3); }
 ;
 
+windowexpr: ST_MIN '(' expr ',' window ')'
+                                  { $$ = stats_expression_new_window(STATS_OPERATION_MIN, $3, 0.0, $5.length, $5.seconds); }
+        | ST_MAX '(' expr ',' window ')'
+                                  { $$ = stats_expression_new_window(STATS_OPERATION_MAX, $3, 0.0, $5.length, $5.seconds); }
+        | ST_MEAN '(' expr ',' window ')'
+                                  { $$ = stats_expression_new_window(STATS_OPERATION_MEAN, $3, 0.0, $5.length, $5.seconds); }
+        | ST_STDDEV '(' expr ',' window ')'
+                                  { $$ = stats_expression_new_window(STATS_OPERATION_STDDEV, $3, 0.0, $5.length, $5.seconds); }
+        | ST_PERCENTILE '(' expr ',' ST_NUMBER ',' window ')'
+                                  {
+                                      if ($5 < 0.0 || $5 > 100.0)
+                                      {
+                                          stats_yyerror("percentile must be between 0 and 100");
+                                          YYERROR;
+                                      }
+                                      $$ = stats_expression_new_window(STATS_OPERATION_PERCENTILE, $3, $5, $7.length, $7.seconds);
+                                  }
+;
+
+window: ST_NUMBER ST_FRAMES       {
+                                      if ($1 < 1.0)
+                                      {
+                                          stats_yyerror("window must be at least 1 frame");
+                                          YYERROR;
+                                      }
+                                      $$.length = $1; $$.seconds = BUGLE_FALSE;
+                                  }
+        | ST_NUMBER ST_SECONDS    {
+                                      if ($1 <= 0.0)
+                                      {
+                                          stats_yyerror("window must be longer than 0 seconds");
+                                          YYERROR;
+                                      }
+                                      $$.length = $1; $$.seconds = BUGLE_TRUE;
+                                  }
+;
+
 attributes: /* empty */           { $$ = stats_statistic_new(); }
         | attributes ST_PRECISION ST_NUMBER
                                   { $$ = $1; $$->precision = (int) $3; }
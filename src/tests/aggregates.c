@@ -0,0 +1,155 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Draws a known number of triangles in each frame, to test the windowed
+ * operators (min, max, mean, stddev and percentile) in the statistics.
+ * The frames are spaced out by busy-waiting, so that the windows measured
+ * in seconds hold a known number of samples. The state of the windows
+ * carries over from one test to the next.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <stdlib.h>
+#include <bugle/time.h>
+/* Required to compile GLUT under MinGW */
+#if defined(_WIN32) && !defined(_STDCALL_SUPPORTED)
+# define _STDCALL_SUPPORTED
+#endif
+#include <GL/glut.h>
+#include "test.h"
+
+/* Time between frames, in seconds. The statistics use a window of 0.75
+ * seconds, which thus holds three frames, with enough margin either side
+ * that a late frame does not change the result.
+ */
+#define AGGREGATES_INTERVAL 0.3
+
+typedef struct
+{
+    int triangles;
+    double interval;        /* time since the previous frame */
+    /* Expected statistics */
+    int min3, max3;         /* over 3 frames */
+    const char *mean4, *stddev4;
+    int percentile4;        /* 75th percentile, over 4 frames */
+    int max_time;           /* over 0.75 seconds */
+    const char *mean_time;
+} aggregates_frame;
+
+static bugle_timespec aggregates_last;
+
+static double time_elapsed(const bugle_timespec *start, const bugle_timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + 1e-9 * (end->tv_nsec - start->tv_nsec);
+}
+
+static void aggregates_swap(double interval)
+{
+    bugle_timespec now;
+
+    do
+    {
+        bugle_gettime(&now);
+    } while (time_elapsed(&aggregates_last, &now) < interval);
+    glutSwapBuffers();
+    bugle_gettime(&aggregates_last);
+}
+
+static void aggregates_run(const aggregates_frame *frames, size_t count)
+{
+    size_t i;
+    const aggregates_frame *f;
+
+    for (i = 0; i < count; i++)
+    {
+        f = &frames[i];
+        if (f->triangles > 0)
+            glDrawArrays(GL_TRIANGLES, 0, 3 * f->triangles);
+        aggregates_swap(f->interval);
+        test_log_printf("logstats\\.min triangles over 3 frames: %d triangles\n", f->min3);
+        test_log_printf("logstats\\.max triangles over 3 frames: %d triangles\n", f->max3);
+        test_log_printf("logstats\\.mean triangles over 4 frames: %s triangles\n", f->mean4);
+        test_log_printf("logstats\\.stddev of triangles over 4 frames: %s triangles\n", f->stddev4);
+        test_log_printf("logstats\\.75th percentile of triangles over 4 frames: %d triangles\n", f->percentile4);
+        test_log_printf("logstats\\.max triangles over 0\\.75 seconds: %d triangles\n", f->max_time);
+        test_log_printf("logstats\\.mean triangles over 0\\.75 seconds: %s triangles\n", f->mean_time);
+    }
+}
+
+/* The windows are not yet full, so they cover every frame so far */
+static void aggregates_test_filling(void)
+{
+    static const aggregates_frame frames[] =
+    {
+        { 4, AGGREGATES_INTERVAL, 4, 4, "4\\.00", "0\\.00", 4, 4, "4\\.00" },
+        { 1, AGGREGATES_INTERVAL, 1, 4, "2\\.50", "1\\.50", 4, 4, "2\\.50" },
+        { 3, AGGREGATES_INTERVAL, 1, 4, "2\\.67", "1\\.25", 4, 4, "2\\.67" }
+    };
+
+    aggregates_run(frames, sizeof(frames) / sizeof(frames[0]));
+}
+
+/* Old samples are evicted once the windows are full. The minimum and
+ * maximum are evicted while still the extreme, and a frame with no
+ * triangles is a sample like any other.
+ */
+static void aggregates_test_evict(void)
+{
+    static const aggregates_frame frames[] =
+    {
+        { 2, AGGREGATES_INTERVAL, 1, 3, "2\\.50", "1\\.12", 3, 3, "2\\.00" },
+        { 8, AGGREGATES_INTERVAL, 2, 8, "3\\.50", "2\\.69", 3, 8, "4\\.33" },
+        { 0, AGGREGATES_INTERVAL, 0, 8, "3\\.25", "2\\.95", 3, 8, "3\\.33" },
+        { 5, AGGREGATES_INTERVAL, 0, 8, "3\\.75", "3\\.03", 5, 8, "4\\.33" }
+    };
+
+    aggregates_run(frames, sizeof(frames) / sizeof(frames[0]));
+}
+
+/* After a pause, the windows in seconds hold only the newest samples, while
+ * those in frames are unaffected.
+ */
+static void aggregates_test_pause(void)
+{
+    static const aggregates_frame frames[] =
+    {
+        { 6, 5 * AGGREGATES_INTERVAL, 0, 6, "4\\.75", "2\\.95", 6, 6, "6\\.00" },
+        { 7, AGGREGATES_INTERVAL, 5, 7, "4\\.50", "2\\.69", 6, 7, "6\\.50" },
+        { 9, AGGREGATES_INTERVAL, 6, 9, "6\\.75", "1\\.48", 7, 9, "7\\.33" }
+    };
+
+    aggregates_run(frames, sizeof(frames) / sizeof(frames[0]));
+}
+
+/* No statistics are logged for the first frame, so it is done in the setup */
+static void aggregates_setup(void)
+{
+    glutSwapBuffers();
+    bugle_gettime(&aggregates_last);
+}
+
+void aggregates_suite_register(void)
+{
+    test_suite *ts = test_suite_new("aggregates", TEST_FLAG_LOG | TEST_FLAG_CONTEXT, aggregates_setup, NULL);
+    test_suite_add_test(ts, "filling", aggregates_test_filling);
+    test_suite_add_test(ts, "evict", aggregates_test_evict);
+    test_suite_add_test(ts, "pause", aggregates_test_pause);
+}
@@ -1,7 +1,7 @@
 #!/usr/bin/env python
 
 # BuGLe: an OpenGL debugging tool
-# Copyright (C) 2013 Bruce Merry
+# Copyright (C) 2013-2014 Bruce Merry
 #
 # This program is free software; you can redistribute it and/or modify
 # it under the terms of the GNU General Public License as published by
@@ -72,6 +72,8 @@ class SimpleSuite(TestSuite):
                 newenv['BUGLE_FILTER_DIR'] = args.filter_dir
             if args.filters:
                 newenv['BUGLE_FILTERS'] = args.filters
+            if args.statistics:
+                newenv['BUGLE_STATISTICS'] = args.statistics
             newenv['BUGLE_CHAIN'] = self.chain
         return newenv
 
@@ -171,19 +173,26 @@ class LogSuite(SimpleSuite):
 def make_suites(args):
     suites = [
         SimpleSuite('string'),
+        SimpleSuite('hashtable'),
         SimpleSuite('math'),
+        SimpleSuite('qoi'),
         SimpleSuite('threads'),
+        SimpleSuite('time'),
         SimpleSuite('errors'),
         SimpleSuite('interpose'),
         SimpleSuite('procaddress'),
+        SimpleSuite('yuv'),
+        LogSuite('aggregates', 'aggregates'),
         LogSuite('dlopen', 'trace'),
         LogSuite('draw_client', 'trace'),
         LogSuite('draw_vbo', 'trace'),
         LogSuite('extoverride', 'extoverride'),
+        LogSuite('gputime', 'gputime'),
         LogSuite('logdebug', 'logdebug'),
         LogSuite('pbo', 'trace'),
         LogSuite('pointers', 'checks'),
         LogSuite('queries', 'trace'),
+        LogSuite('redundant', 'redundant'),
         LogSuite('setstate', 'trace'),
         LogSuite('showextensions', 'showextensions'),
         LogSuite('texcomplete', 'checks'),
@@ -209,6 +218,7 @@ def parse_args():
     parser.add_argument('--library-path', help = 'Directory containing bugle library', metavar = 'PATH')
     parser.add_argument('--filter-dir', help = 'Directory containing filters', metavar = 'PATH')
     parser.add_argument('--filters', help = 'File containing filter config', metavar = 'FILE')
+    parser.add_argument('--statistics', help = 'File containing statistics config', metavar = 'FILE')
     parser.add_argument('--tester', help = 'Path to bugletest binary', metavar = 'FILE')
     parser.add_argument('--suite', help = 'Test suite to run', metavar = 'SUITE')
     parser.add_argument('--gdb', action = 'store_true', default = False, help = 'Start test suite inside gdb')
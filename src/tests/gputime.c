@@ -0,0 +1,146 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Makes draw calls for stats_gputime to time, to test which draws are timed
+ * and that the timer queries do not disturb the application's own queries
+ * and errors. Each test is one frame. glFinish is called before each swap,
+ * so that the results are available at the swap and every frame is reported
+ * straight away.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <stdlib.h>
+/* Required to compile GLUT under MinGW */
+#if defined(_WIN32) && !defined(_STDCALL_SUPPORTED)
+# define _STDCALL_SUPPORTED
+#endif
+#include <GL/glut.h>
+#include "test.h"
+
+static GLfloat gputime_vertices[9] =
+{
+    -1.0f, -1.0f, 0.0f,
+    1.0f, -1.0f, 0.0f,
+    0.0f, 1.0f, 0.0f
+};
+
+/* Returns BUGLE_FALSE and marks the test as skipped if there are no timer
+ * queries, in which case stats_gputime reports nothing.
+ */
+static bugle_bool gputime_supported(void)
+{
+    if (GLEW_VERSION_3_3 || GLEW_ARB_timer_query)
+        return BUGLE_TRUE;
+    test_skipped("GL 3.3 or ARB_timer_query required");
+    return BUGLE_FALSE;
+}
+
+static void gputime_draw(int count)
+{
+    int i;
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, gputime_vertices);
+    for (i = 0; i < count; i++)
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+/* Ends the frame and logs the statistics expected for it */
+static void gputime_frame(int draws)
+{
+    glFinish();
+    glutSwapBuffers();
+    test_log_printf("logstats\\.gputime draws per frame: %d draws/frame\n", draws);
+}
+
+static void gputime_test_draws(void)
+{
+    if (!gputime_supported())
+        return;
+    gputime_draw(3);
+    TEST_ASSERT(glGetError() == GL_NO_ERROR);
+    gputime_frame(3);
+}
+
+/* Draws inside the application's own query cannot be timed */
+static void gputime_test_app_query(void)
+{
+    GLuint query;
+    GLuint64 elapsed = 0;
+
+    if (!gputime_supported())
+        return;
+    glGenQueries(1, &query);
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    gputime_draw(2);
+    glEndQuery(GL_TIME_ELAPSED);
+    gputime_draw(1);
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+    TEST_ASSERT(elapsed > 0);
+    glDeleteQueries(1, &query);
+    TEST_ASSERT(glGetError() == GL_NO_ERROR);
+    gputime_frame(1);
+}
+
+/* A query that fails to begin does not stop draws being timed */
+static void gputime_test_failed_query(void)
+{
+    if (!gputime_supported())
+        return;
+    glBeginQuery(GL_TIME_ELAPSED, 0);
+    TEST_ASSERT(glGetError() == GL_INVALID_OPERATION);
+    gputime_draw(2);
+    TEST_ASSERT(glGetError() == GL_NO_ERROR);
+    gputime_frame(2);
+}
+
+/* The application must see its own errors, and only those */
+static void gputime_test_errors(void)
+{
+    if (!gputime_supported())
+        return;
+    glDepthFunc(GL_TEXTURE_2D);
+    gputime_draw(1);
+    TEST_ASSERT(glGetError() == GL_INVALID_ENUM);
+    glDrawArrays(GL_TRIANGLES, 0, -1);
+    TEST_ASSERT(glGetError() == GL_INVALID_VALUE);
+    TEST_ASSERT(glGetError() == GL_NO_ERROR);
+    gputime_frame(2);
+}
+
+/* GLUT may be using __stdcall instead of __cdecl, so we have to wrap it to
+ * use as a callback.
+ */
+static void wrap_swap_buffers(void)
+{
+    glutSwapBuffers();
+}
+
+void gputime_suite_register(void)
+{
+    /* glutSwapBuffers is used for setup since no statistics are logged for the first frame */
+    test_suite *ts = test_suite_new("gputime", TEST_FLAG_LOG | TEST_FLAG_CONTEXT, wrap_swap_buffers, NULL);
+    test_suite_add_test(ts, "draws", gputime_test_draws);
+    test_suite_add_test(ts, "app_query", gputime_test_app_query);
+    test_suite_add_test(ts, "failed_query", gputime_test_failed_query);
+    test_suite_add_test(ts, "errors", gputime_test_errors);
+}
@@ -0,0 +1,250 @@
+/* Times insertions, lookups and removals in the hash tables, and compares
+ * them against a copy of the previous implementation (prime sizes, a weak
+ * string hash and the raw pointer value as the pointer hash). The number of
+ * keys may be given on the command line. This test is not automated.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <bugle/bool.h>
+#include <bugle/memory.h>
+#include <bugle/string.h>
+#include <bugle/hashtable.h>
+#include <bugle/time.h>
+
+#define DEFAULT_KEYS 100000
+
+/* The old table, reduced to what is needed for the comparison. It has no
+ * removal, so the removal timings are only reported for the new table.
+ */
+typedef struct
+{
+    const void *key;
+    void *value;
+} old_entry;
+
+typedef struct
+{
+    size_t size, count;
+    old_entry *entries;
+} old_table;
+
+static size_t old_next_prime(size_t x)
+{
+    size_t i;
+    bugle_bool prime;
+
+    x |= 1;
+    do
+    {
+        x += 2;
+        prime = BUGLE_TRUE;
+        for (i = 3; i * i <= x; i += 2)
+            if (x % i == 0)
+            {
+                prime = BUGLE_FALSE;
+                break;
+            }
+    } while (!prime);
+    return x;
+}
+
+static size_t old_hash_str(const void *key)
+{
+    size_t h = 0;
+    const char *ch;
+
+    for (ch = (const char *) key; *ch; ch++)
+        h = (h + *ch) * 29;
+    return h;
+}
+
+static size_t old_hash_ptr(const void *key)
+{
+    return (const char *) key - (const char *) NULL;
+}
+
+static size_t old_find(const old_table *table, const void *key, bugle_bool str)
+{
+    size_t h;
+
+    h = (str ? old_hash_str(key) : old_hash_ptr(key)) % table->size;
+    while (table->entries[h].key
+           && (str ? strcmp((const char *) key, (const char *) table->entries[h].key) != 0
+               : table->entries[h].key != key))
+        if (++h == table->size) h = 0;
+    return h;
+}
+
+static void old_set(old_table *table, const void *key, void *value, bugle_bool str)
+{
+    size_t h, i;
+
+    if (table->count >= table->size / 2)
+    {
+        old_table big;
+
+        big.size = old_next_prime(table->size * 2);
+        big.count = table->count;
+        big.entries = BUGLE_CALLOC(big.size, old_entry);
+        for (i = 0; i < table->size; i++)
+            if (table->entries[i].key)
+                big.entries[old_find(&big, table->entries[i].key, str)] = table->entries[i];
+        bugle_free(table->entries);
+        *table = big;
+    }
+    h = old_find(table, key, str);
+    if (!table->entries[h].key)
+    {
+        table->entries[h].key = key;
+        table->count++;
+    }
+    table->entries[h].value = value;
+}
+
+static void *old_get(const old_table *table, const void *key, bugle_bool str)
+{
+    return table->entries[old_find(table, key, str)].value;
+}
+
+/* Fisher-Yates shuffle with a fixed LCG, so that runs are comparable */
+static void shuffle(size_t *order, size_t n)
+{
+    unsigned long seed = 12345;
+    size_t i, j, tmp;
+
+    for (i = 0; i < n; i++)
+        order[i] = i;
+    for (i = n - 1; i > 0; i--)
+    {
+        seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+        j = seed % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+}
+
+static bugle_timespec start_time;
+
+static void start(void)
+{
+    bugle_gettime(&start_time);
+}
+
+static void stop(const char *what, size_t keys)
+{
+    bugle_timespec now;
+    double elapsed;
+
+    bugle_gettime(&now);
+    elapsed = (now.tv_sec - start_time.tv_sec)
+        + 1e-9 * (now.tv_nsec - start_time.tv_nsec);
+    printf("%-28s %8.3f ms (%.1f ns/op)\n", what, elapsed * 1e3,
+           elapsed * 1e9 / keys);
+}
+
+int main(int argc, char **argv)
+{
+    size_t keys = DEFAULT_KEYS;
+    size_t i;
+    size_t *order;
+    size_t found = 0;
+    char **strings;
+    old_table old;
+    hash_table table;
+    hashptr_table ptable;
+
+    if (argc > 1)
+        keys = atol(argv[1]);
+    if (keys <= 0)
+    {
+        fprintf(stderr, "usage: %s [keys]\n", argv[0]);
+        return 1;
+    }
+
+    /* Lookups and removals are done in a random order, so that the
+     * identity hash of the old pointer table does not get an unfair
+     * advantage from sequential memory access.
+     */
+    order = BUGLE_NMALLOC(keys, size_t);
+    shuffle(order, keys);
+    strings = BUGLE_NMALLOC(keys, char *);
+    for (i = 0; i < keys; i++)
+        strings[i] = bugle_asprintf("glFunction%lu", (unsigned long) i);
+
+    /* Pointer keys are 16-byte aligned, like heap pointers */
+    old.size = 5;
+    old.count = 0;
+    old.entries = BUGLE_CALLOC(old.size, old_entry);
+    start();
+    for (i = 1; i <= keys; i++)
+        old_set(&old, (const void *) (i * 16), (void *) i, BUGLE_FALSE);
+    stop("old pointer insert", keys);
+    start();
+    for (i = 1; i <= keys; i++)
+        found += old_get(&old, (const void *) ((order[i - 1] + 1) * 16), BUGLE_FALSE) != NULL;
+    stop("old pointer lookup", keys);
+    bugle_free(old.entries);
+
+    bugle_hashptr_init(&ptable, NULL);
+    start();
+    for (i = 1; i <= keys; i++)
+        bugle_hashptr_set_int(&ptable, i * 16, (void *) i);
+    stop("new pointer insert", keys);
+    start();
+    for (i = 1; i <= keys; i++)
+        found += bugle_hashptr_get_int(&ptable, (order[i - 1] + 1) * 16) != NULL;
+    stop("new pointer lookup", keys);
+    start();
+    for (i = 1; i <= keys; i++)
+        bugle_hashptr_remove_int(&ptable, (order[i - 1] + 1) * 16);
+    stop("new pointer remove", keys);
+    bugle_hashptr_clear(&ptable);
+
+    old.size = 5;
+    old.count = 0;
+    old.entries = BUGLE_CALLOC(old.size, old_entry);
+    start();
+    for (i = 0; i < keys; i++)
+        old_set(&old, strings[i], (void *) (i + 1), BUGLE_TRUE);
+    stop("old string insert", keys);
+    start();
+    for (i = 0; i < keys; i++)
+        found += old_get(&old, strings[order[i]], BUGLE_TRUE) != NULL;
+    stop("old string lookup", keys);
+    bugle_free(old.entries);
+
+    bugle_hash_init_nocopy(&table, NULL);
+    start();
+    for (i = 0; i < keys; i++)
+        bugle_hash_set(&table, strings[i], (void *) (i + 1));
+    stop("new string insert", keys);
+    start();
+    for (i = 0; i < keys; i++)
+        found += bugle_hash_get(&table, strings[order[i]]) != NULL;
+    stop("new string lookup", keys);
+    start();
+    for (i = 0; i < keys; i++)
+        bugle_hash_remove(&table, strings[order[i]]);
+    stop("new string remove", keys);
+    bugle_hash_clear(&table);
+
+    if (found != 4 * keys)
+    {
+        fprintf(stderr, "lookups failed (%lu of %lu found)\n",
+                (unsigned long) found, (unsigned long) (4 * keys));
+        return 1;
+    }
+
+    for (i = 0; i < keys; i++)
+        bugle_free(strings[i]);
+    bugle_free(strings);
+    bugle_free(order);
+    return 0;
+}
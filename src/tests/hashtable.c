@@ -0,0 +1,177 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Validate the hash tables */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <bugle/hashtable.h>
+#include <bugle/string.h>
+#include <bugle/memory.h>
+#include <stddef.h>
+#include <string.h>
+#include "test.h"
+
+#define HASHTABLE_ENTRIES 1000
+
+static int hashtable_destroyed;
+
+static void hashtable_destructor(void *value)
+{
+    if (value != NULL)
+        hashtable_destroyed++;
+}
+
+static void hashtable_string(void)
+{
+    hash_table table;
+    char key[32];
+    size_t i;
+    bugle_bool ok = BUGLE_TRUE;
+
+    hashtable_destroyed = 0;
+    bugle_hash_init(&table, hashtable_destructor);
+    TEST_ASSERT(bugle_hash_get(&table, "missing") == NULL);
+    for (i = 1; i <= HASHTABLE_ENTRIES; i++)
+    {
+        bugle_snprintf(key, sizeof(key), "key%lu", (unsigned long) i);
+        bugle_hash_set(&table, key, (void *) i);
+    }
+    TEST_ASSERT(table.count == HASHTABLE_ENTRIES);
+    for (i = 1; i <= HASHTABLE_ENTRIES; i++)
+    {
+        bugle_snprintf(key, sizeof(key), "key%lu", (unsigned long) i);
+        if (bugle_hash_get(&table, key) != (void *) i)
+            ok = BUGLE_FALSE;
+    }
+    TEST_ASSERT(ok);
+
+    /* Replacing a value destroys the old one */
+    bugle_hash_set(&table, "key1", (void *) 1);
+    TEST_ASSERT(hashtable_destroyed == 1);
+    TEST_ASSERT(table.count == HASHTABLE_ENTRIES);
+
+    bugle_hash_clear(&table);
+    TEST_ASSERT(hashtable_destroyed == HASHTABLE_ENTRIES + 1);
+    TEST_ASSERT(table.count == 0);
+    TEST_ASSERT(bugle_hash_get(&table, "key1") == NULL);
+}
+
+/* Removes every second entry, and checks that the others are still found */
+static void hashtable_remove(void)
+{
+    hash_table table;
+    char key[32];
+    size_t i;
+    bugle_bool ok = BUGLE_TRUE;
+
+    hashtable_destroyed = 0;
+    bugle_hash_init(&table, hashtable_destructor);
+    for (i = 1; i <= HASHTABLE_ENTRIES; i++)
+    {
+        bugle_snprintf(key, sizeof(key), "key%lu", (unsigned long) i);
+        bugle_hash_set(&table, key, (void *) i);
+    }
+    for (i = 1; i <= HASHTABLE_ENTRIES; i += 2)
+    {
+        bugle_snprintf(key, sizeof(key), "key%lu", (unsigned long) i);
+        bugle_hash_remove(&table, key);
+    }
+    bugle_hash_remove(&table, "missing");
+    TEST_ASSERT(hashtable_destroyed == HASHTABLE_ENTRIES / 2);
+    TEST_ASSERT(table.count == HASHTABLE_ENTRIES / 2);
+    for (i = 1; i <= HASHTABLE_ENTRIES; i++)
+    {
+        bugle_snprintf(key, sizeof(key), "key%lu", (unsigned long) i);
+        if (bugle_hash_count(&table, key) != (i % 2 == 0))
+            ok = BUGLE_FALSE;
+        if (i % 2 == 0 && bugle_hash_get(&table, key) != (void *) i)
+            ok = BUGLE_FALSE;
+    }
+    TEST_ASSERT(ok);
+    bugle_hash_clear(&table);
+}
+
+static void hashtable_nocopy(void)
+{
+    hash_table table;
+    static const char *keys[] = { "alpha", "beta", "gamma" };
+    const hash_table_entry *h;
+    size_t i, count = 0;
+
+    bugle_hash_init_nocopy(&table, NULL);
+    for (i = 0; i < 3; i++)
+        bugle_hash_set(&table, keys[i], (void *) (i + 1));
+    for (h = bugle_hash_begin(&table); h; h = bugle_hash_next(&table, h))
+    {
+        TEST_ASSERT(h->key == keys[(size_t) h->value - 1]);
+        count++;
+    }
+    TEST_ASSERT(count == 3);
+    bugle_hash_clear(&table);
+}
+
+static void hashtable_reserve(void)
+{
+    hashptr_table table;
+    hashptr_table_entry *entries;
+    size_t i;
+
+    bugle_hashptr_init(&table, NULL);
+    bugle_hashptr_reserve(&table, HASHTABLE_ENTRIES);
+    entries = table.entries;
+    TEST_ASSERT(entries != NULL);
+    for (i = 1; i <= HASHTABLE_ENTRIES; i++)
+        bugle_hashptr_set_int(&table, i, (void *) i);
+    /* Should not have reallocated */
+    TEST_ASSERT(table.entries == entries);
+    bugle_hashptr_clear(&table);
+}
+
+static void hashtable_ptr(void)
+{
+    hashptr_table table;
+    size_t i;
+    bugle_bool ok = BUGLE_TRUE;
+
+    bugle_hashptr_init(&table, NULL);
+    /* Aligned keys, which clustered badly with the old hash */
+    for (i = 1; i <= HASHTABLE_ENTRIES; i++)
+        bugle_hashptr_set_int(&table, i * 64, (void *) i);
+    for (i = 1; i <= HASHTABLE_ENTRIES; i += 3)
+        bugle_hashptr_remove_int(&table, i * 64);
+    for (i = 1; i <= HASHTABLE_ENTRIES; i++)
+    {
+        void *expected = (i % 3 == 1) ? NULL : (void *) i;
+        if (bugle_hashptr_get_int(&table, i * 64) != expected)
+            ok = BUGLE_FALSE;
+    }
+    TEST_ASSERT(ok);
+    TEST_ASSERT(table.count == HASHTABLE_ENTRIES - (HASHTABLE_ENTRIES + 2) / 3);
+    bugle_hashptr_clear(&table);
+}
+
+void hashtable_suite_register(void)
+{
+    test_suite *ts = test_suite_new("hashtable", 0, NULL, NULL);
+    test_suite_add_test(ts, "string", hashtable_string);
+    test_suite_add_test(ts, "remove", hashtable_remove);
+    test_suite_add_test(ts, "nocopy", hashtable_nocopy);
+    test_suite_add_test(ts, "reserve", hashtable_reserve);
+    test_suite_add_test(ts, "ptr", hashtable_ptr);
+}
@@ -0,0 +1,60 @@
+/* Makes a large number of cheap GL calls and reports how long they took, to
+ * measure the throughput of the logging system. Run it under a chain that
+ * includes trace, and compare the results for different log options (e.g.
+ * log.format, log.async). The number of calls may be given on the command
+ * line. This test is not automated.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <GL/glew.h>
+/* Required to compile GLUT under MinGW */
+#if defined(_WIN32) && !defined(_STDCALL_SUPPORTED)
+# define _STDCALL_SUPPORTED
+#endif
+#include <GL/glut.h>
+
+#define DEFAULT_CALLS 100000
+
+int main(int argc, char **argv)
+{
+    long calls = DEFAULT_CALLS;
+    long i;
+    int start, elapsed;
+
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE);
+    glutInitWindowSize(300, 300);
+    glutCreateWindow("log benchmark");
+
+    glewInit();
+    if (argc > 1)
+        calls = atol(argv[1]);
+    if (calls <= 0)
+    {
+        fprintf(stderr, "usage: %s [calls]\n", argv[0]);
+        return 1;
+    }
+
+    /* Warm up, so that one-time setup in the logger is not counted */
+    for (i = 0; i < 100; i++)
+        glColor3f(0.0f, 0.0f, 0.0f);
+    glFinish();
+
+    start = glutGet(GLUT_ELAPSED_TIME);
+    for (i = 0; i < calls; i++)
+        glColor3f(1.0f, (float) (i & 255) / 255.0f, 0.0f);
+    glFinish();
+    elapsed = glutGet(GLUT_ELAPSED_TIME) - start;
+
+    printf("%ld calls in %d ms", calls, elapsed);
+    if (elapsed > 0)
+        printf(" (%.0f calls/s)", calls * 1000.0 / elapsed);
+    printf("\n");
+
+    glutSwapBuffers();
+    return 0;
+}
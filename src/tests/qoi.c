@@ -0,0 +1,348 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Tests the QOI encoder used for screenshots. Each image is encoded,
+ * checked against the expected chunks where those are known, and decoded
+ * again with a decoder written from the specification.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#include <string.h>
+#include <bugle/memory.h>
+#include "common/qoi.h"
+#include "test.h"
+
+static unsigned long qoi_get_uint32(const unsigned char *in)
+{
+    return ((unsigned long) in[0] << 24)
+        | ((unsigned long) in[1] << 16)
+        | ((unsigned long) in[2] << 8)
+        | (unsigned long) in[3];
+}
+
+/* Decodes an RGB image of the given size. Returns BUGLE_FALSE if the data
+ * are not a valid encoding of such an image.
+ */
+static bugle_bool qoi_decode(const unsigned char *in, size_t size,
+                             int width, int height, unsigned char *pixels)
+{
+    static const unsigned char end_marker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    unsigned char index[64][4];
+    unsigned char px[4];
+    size_t pos, i, n;
+    int run = 0, vg, h;
+
+    if (size < 22 || memcmp(in, "qoif", 4) != 0
+        || qoi_get_uint32(in + 4) != (unsigned long) width
+        || qoi_get_uint32(in + 8) != (unsigned long) height
+        || in[12] != 3 || in[13] > 1)
+        return BUGLE_FALSE;
+
+    memset(index, 0, sizeof(index));
+    px[0] = px[1] = px[2] = 0;
+    px[3] = 255;
+    pos = 14;
+    n = (size_t) width * height;
+    for (i = 0; i < n; i++)
+    {
+        if (run > 0)
+            run--;
+        else
+        {
+            if (pos >= size - 8)
+                return BUGLE_FALSE;
+            if (in[pos] == 0xfe)
+            {
+                if (pos + 4 > size - 8)
+                    return BUGLE_FALSE;
+                memcpy(px, in + pos + 1, 3);
+                pos += 4;
+            }
+            else if (in[pos] == 0xff)
+                return BUGLE_FALSE;    /* RGBA chunks are never needed */
+            else
+            {
+                switch (in[pos] & 0xc0)
+                {
+                case 0x00:
+                    memcpy(px, index[in[pos]], 4);
+                    break;
+                case 0x40:
+                    px[0] += ((in[pos] >> 4) & 3) - 2;
+                    px[1] += ((in[pos] >> 2) & 3) - 2;
+                    px[2] += (in[pos] & 3) - 2;
+                    break;
+                case 0x80:
+                    if (pos + 2 > size - 8)
+                        return BUGLE_FALSE;
+                    vg = (in[pos] & 0x3f) - 32;
+                    px[0] += vg - 8 + ((in[pos + 1] >> 4) & 0xf);
+                    px[1] += vg;
+                    px[2] += vg - 8 + (in[pos + 1] & 0xf);
+                    pos++;
+                    break;
+                default:
+                    run = in[pos] & 0x3f;
+                    break;
+                }
+                pos++;
+            }
+            h = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+            memcpy(index[h], px, 4);
+        }
+        if (px[3] != 255)
+            return BUGLE_FALSE;
+        memcpy(pixels + 3 * i, px, 3);
+    }
+    /* A run must not continue past the last pixel */
+    return run == 0 && pos == size - 8 && memcmp(in + pos, end_marker, 8) == 0;
+}
+
+/* Encodes and decodes an image, and checks the chunks against expected if
+ * it is not NULL.
+ */
+static void qoi_check(const unsigned char *pixels, int width, int height,
+                      const unsigned char *expected, size_t expected_size)
+{
+    unsigned char *encoded, *decoded;
+    size_t size;
+
+    encoded = BUGLE_NMALLOC(BUGLE_QOI_MAX_SIZE(width, height), unsigned char);
+    decoded = BUGLE_NMALLOC((size_t) width * height * 3 + 1, unsigned char);
+    size = bugle_qoi_encode(pixels, width, height, encoded);
+    TEST_ASSERT(size <= BUGLE_QOI_MAX_SIZE(width, height));
+    if (expected != NULL)
+    {
+        if (TEST_ASSERT(size == 14 + expected_size + 8))
+            TEST_ASSERT(memcmp(encoded + 14, expected, expected_size) == 0);
+    }
+    if (TEST_ASSERT(qoi_decode(encoded, size, width, height, decoded)))
+        TEST_ASSERT(memcmp(decoded, pixels, (size_t) width * height * 3) == 0);
+    bugle_free(encoded);
+    bugle_free(decoded);
+}
+
+/* Fills an image with a single colour */
+static unsigned char *qoi_solid(size_t n, int r, int g, int b)
+{
+    unsigned char *pixels;
+    size_t i;
+
+    pixels = BUGLE_NMALLOC(n * 3, unsigned char);
+    for (i = 0; i < n; i++)
+    {
+        pixels[3 * i] = r;
+        pixels[3 * i + 1] = g;
+        pixels[3 * i + 2] = b;
+    }
+    return pixels;
+}
+
+/* The first pixel is compared to opaque black, so a black image is all runs.
+ * Runs are limited to 62 pixels and must end at the last pixel.
+ */
+static void qoi_runs(void)
+{
+    static const int lengths[] = {1, 61, 62, 63, 124, 125, 200};
+    unsigned char expected[4];
+    unsigned char *pixels;
+    size_t i, j, chunks;
+
+    for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+    {
+        chunks = (lengths[i] + 61) / 62;
+        for (j = 0; j + 1 < chunks; j++)
+            expected[j] = 0xc0 | 61;
+        expected[chunks - 1] = 0xc0 | ((lengths[i] - 1) % 62);
+        pixels = qoi_solid(lengths[i], 0, 0, 0);
+        qoi_check(pixels, lengths[i], 1, expected, chunks);
+        bugle_free(pixels);
+    }
+}
+
+/* A run that is interrupted by a different colour */
+static void qoi_run_interrupted(void)
+{
+    static const unsigned char expected[] =
+    {
+        0xfe, 10, 20, 30,
+        0xc0 | 61, 0xc0 | 6,
+        0xfe, 200, 100, 50
+    };
+    unsigned char *pixels;
+
+    pixels = qoi_solid(71, 10, 20, 30);
+    pixels[210] = 200;
+    pixels[211] = 100;
+    pixels[212] = 50;
+    qoi_check(pixels, 71, 1, expected, sizeof(expected));
+    bugle_free(pixels);
+}
+
+static void qoi_index(void)
+{
+    static const unsigned char pixels[] =
+    {
+        10, 20, 30,
+        200, 100, 50,
+        10, 20, 30,
+        200, 100, 50,
+        10, 20, 30,
+        10, 20, 30
+    };
+    static const unsigned char expected[] =
+    {
+        0xfe, 10, 20, 30,
+        0xfe, 200, 100, 50,
+        9,
+        31,
+        9,
+        0xc0
+    };
+
+    qoi_check(pixels, 3, 2, expected, sizeof(expected));
+}
+
+/* Black has only been seen in a run, so it is not in the index. The
+ * unused index entries must not match it either.
+ */
+static void qoi_index_black(void)
+{
+    static const unsigned char pixels[] =
+    {
+        0, 0, 0,
+        0, 0, 0,
+        10, 20, 30,
+        0, 0, 0
+    };
+    static const unsigned char expected[] =
+    {
+        0xc0 | 1,
+        0xfe, 10, 20, 30,
+        0xfe, 0, 0, 0
+    };
+
+    qoi_check(pixels, 2, 2, expected, sizeof(expected));
+}
+
+/* Differences at the limits of the diff chunk, including wrapping around */
+static void qoi_diff(void)
+{
+    static const unsigned char pixels[] =
+    {
+        1, 254, 0,          /* +1, -2, 0 */
+        255, 252, 254,      /* -2, -2, -2 */
+        0, 253, 255,        /* +1, +1, +1 */
+        2, 253, 255,        /* +2: luma */
+        255, 253, 255       /* -3: luma */
+    };
+    static const unsigned char expected[] =
+    {
+        0x40 | (3 << 4) | (0 << 2) | 2,
+        0x40,
+        0x40 | (3 << 4) | (3 << 2) | 3,
+        0x80 | 32, (10 << 4) | 8,
+        0x80 | 32, (5 << 4) | 8
+    };
+
+    qoi_check(pixels, 5, 1, expected, sizeof(expected));
+}
+
+/* Differences at the limits of the luma chunk */
+static void qoi_luma(void)
+{
+    static const unsigned char pixels[] =
+    {
+        38, 31, 23,         /* vg = 31, vg_r = 7, vg_b = -8 */
+        254, 255, 254,      /* vg = -32, vg_r = -8, vg_b = 7 */
+        30, 31, 30,         /* vg = 32 */
+        38, 31, 30,         /* vg = 0, vg_r = 8 */
+        6, 255, 245         /* vg = -32, vg_b = -9 */
+    };
+    static const unsigned char expected[] =
+    {
+        0x80 | 63, (15 << 4) | 0,
+        0x80 | 0, (0 << 4) | 15,
+        0xfe, 30, 31, 30,
+        0xfe, 38, 31, 30,
+        0xfe, 6, 255, 245
+    };
+
+    qoi_check(pixels, 5, 1, expected, sizeof(expected));
+}
+
+/* A larger image with a mix of all the chunks */
+static void qoi_mixed(void)
+{
+    const int width = 67, height = 37;
+    unsigned char *pixels;
+    unsigned long seed = 1;
+    size_t i, n;
+    int c;
+
+    n = (size_t) width * height;
+    pixels = BUGLE_NMALLOC(n * 3, unsigned char);
+    for (i = 0; i < n; i++)
+    {
+        seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+        switch ((seed >> 16) % 5)
+        {
+        case 0:
+            /* Repeat the previous pixel */
+            if (i > 0)
+            {
+                memcpy(pixels + 3 * i, pixels + 3 * (i - 1), 3);
+                break;
+            }
+            /* Fall through */
+        case 1:
+            /* One of a few colours, to hit the index */
+            c = (seed >> 8) % 4;
+            pixels[3 * i] = c * 60;
+            pixels[3 * i + 1] = 255 - c * 60;
+            pixels[3 * i + 2] = c * 20;
+            break;
+        case 2:
+            /* A small or medium change from the previous pixel */
+            for (c = 0; c < 3; c++)
+                pixels[3 * i + c] = (i > 0 ? pixels[3 * (i - 1) + c] : 0)
+                    + (int) ((seed >> (4 * c)) % 24) - 12;
+            break;
+        default:
+            for (c = 0; c < 3; c++)
+                pixels[3 * i + c] = (seed >> (8 * c)) & 0xff;
+            break;
+        }
+    }
+    qoi_check(pixels, width, height, NULL, 0);
+    bugle_free(pixels);
+}
+
+void qoi_suite_register(void)
+{
+    test_suite *ts = test_suite_new("qoi", 0, NULL, NULL);
+    test_suite_add_test(ts, "runs", qoi_runs);
+    test_suite_add_test(ts, "run_interrupted", qoi_run_interrupted);
+    test_suite_add_test(ts, "index", qoi_index);
+    test_suite_add_test(ts, "index_black", qoi_index_black);
+    test_suite_add_test(ts, "diff", qoi_diff);
+    test_suite_add_test(ts, "luma", qoi_luma);
+    test_suite_add_test(ts, "mixed", qoi_mixed);
+}
@@ -0,0 +1,137 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Makes state changes that are redundant, effective or invalid, to test the
+ * classification done by glshadow, the counts from stats_redundant and the
+ * calls dropped by skipredundant. Each test is one frame, and the state
+ * carries over from one test to the next.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <stdlib.h>
+/* Required to compile GLUT under MinGW */
+#if defined(_WIN32) && !defined(_STDCALL_SUPPORTED)
+# define _STDCALL_SUPPORTED
+#endif
+#include <GL/glut.h>
+#include "test.h"
+
+/* Ends the frame and logs the statistics expected for it */
+static void redundant_frame(int redundant, int effective, int skipped)
+{
+    glutSwapBuffers();
+    test_log_printf("logstats\\.redundant calls per frame: %d redundant/frame\n", redundant);
+    test_log_printf("logstats\\.effective calls per frame: %d effective/frame\n", effective);
+    test_log_printf("logstats\\.skipped calls per frame: %d skipped/frame\n", skipped);
+}
+
+/* State is unknown until it is first set, so nothing is redundant */
+static void redundant_test_first(void)
+{
+    glDepthFunc(GL_LESS);
+    glDisable(GL_BLEND);
+    glViewport(0, 0, 300, 300);
+    redundant_frame(0, 3, 0);
+}
+
+static void redundant_test_repeat(void)
+{
+    glDepthFunc(GL_LESS);
+    glDisable(GL_BLEND);
+    glViewport(0, 0, 300, 300);
+    glDepthFunc(GL_LEQUAL);
+    glEnable(GL_BLEND);
+    glEnable(GL_BLEND);
+    glViewport(0, 0, 150, 300);
+    redundant_frame(4, 3, 4);
+}
+
+/* glBlendFunc and glBlendFuncSeparate share the same state */
+static void redundant_test_blend_func(void)
+{
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    if (GLEW_VERSION_1_4)
+    {
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                            GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                            GL_ONE, GL_ZERO);
+        redundant_frame(1, 2, 1);
+    }
+    else
+    {
+        test_skipped("GL 1.4 required");
+        redundant_frame(0, 1, 0);
+    }
+}
+
+/* glPopAttrib can change the state without telling us the new value */
+static void redundant_test_pop_attrib(void)
+{
+    glPushAttrib(GL_DEPTH_BUFFER_BIT);
+    glDepthFunc(GL_GREATER);
+    glPopAttrib();
+    glDepthFunc(GL_LEQUAL);
+    redundant_frame(0, 2, 0);
+}
+
+/* A call that fails leaves the state as it was, so repeating the last
+ * call that succeeded is still redundant.
+ */
+static void redundant_test_failed(void)
+{
+    glDepthFunc(GL_TEXTURE_2D);
+    TEST_ASSERT(glGetError() == GL_INVALID_ENUM);
+    glDepthFunc(GL_LEQUAL);
+    redundant_frame(1, 1, 1);
+}
+
+/* Skipping redundant calls must leave the state as the application set it */
+static void redundant_test_skipped(void)
+{
+    GLint func = 0;
+
+    glDepthFunc(GL_LEQUAL);
+    glGetIntegerv(GL_DEPTH_FUNC, &func);
+    TEST_ASSERT(func == GL_LEQUAL);
+    TEST_ASSERT(glIsEnabled(GL_BLEND));
+    redundant_frame(1, 0, 1);
+}
+
+/* GLUT may be using __stdcall instead of __cdecl, so we have to wrap it to
+ * use as a callback.
+ */
+static void wrap_swap_buffers(void)
+{
+    glutSwapBuffers();
+}
+
+void redundant_suite_register(void)
+{
+    /* glutSwapBuffers is used for setup since no statistics are logged for the first frame */
+    test_suite *ts = test_suite_new("redundant", TEST_FLAG_LOG | TEST_FLAG_CONTEXT, wrap_swap_buffers, NULL);
+    test_suite_add_test(ts, "first", redundant_test_first);
+    test_suite_add_test(ts, "repeat", redundant_test_repeat);
+    test_suite_add_test(ts, "blend_func", redundant_test_blend_func);
+    test_suite_add_test(ts, "pop_attrib", redundant_test_pop_attrib);
+    test_suite_add_test(ts, "failed", redundant_test_failed);
+    test_suite_add_test(ts, "skipped", redundant_test_skipped);
+}
@@ -1,5 +1,5 @@
 /*  BuGLe: an OpenGL debugging tool
- *  Copyright (C) 2009-2010, 2013  Bruce Merry
+ *  Copyright (C) 2009-2010, 2013-2014  Bruce Merry
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -61,6 +61,7 @@ static test_suite *last_suite = NULL;
 /* Whether we initialised GLUT */
 static int glut_initialised = 0;
 
+extern void aggregates_suite_register(void);
 #if BUGLE_GLWIN_GLX
 extern void arbcreatecontext_suite_register(void);
 extern void contextattribs_suite_register(void);
@@ -69,25 +70,32 @@ extern void dlopen_suite_register(void);
 extern void draw_suite_register(void);
 extern void errors_suite_register(void);
 extern void extoverride_suite_register(void);
+extern void gputime_suite_register(void);
 extern void interpose_suite_register(void);
 extern void logdebug_suite_register(void);
 extern void pbo_suite_register(void);
 extern void pointers_suite_register(void);
 extern void procaddress_suite_register(void);
 extern void queries_suite_register(void);
+extern void redundant_suite_register(void);
 extern void setstate_suite_register(void);
 extern void showextensions_suite_register(void);
 extern void texcomplete_suite_register(void);
 extern void triangles_suite_register(void);
+extern void yuv_suite_register(void);
 #endif
 
+extern void hashtable_suite_register(void);
 extern void math_suite_register(void);
+extern void qoi_suite_register(void);
 extern void string_suite_register(void);
 extern void threads_suite_register(void);
+extern void time_suite_register(void);
 
 static void (* const register_fns[])(void) =
 {
 #if TEST_GL
+    aggregates_suite_register,
 #if BUGLE_GLWIN_GLX
     arbcreatecontext_suite_register,
     contextattribs_suite_register,
@@ -96,20 +104,26 @@ static void (* const register_fns[])(void) =
     draw_suite_register,
     errors_suite_register,
     extoverride_suite_register,
+    gputime_suite_register,
     interpose_suite_register,
     logdebug_suite_register,
     pbo_suite_register,
     pointers_suite_register,
     procaddress_suite_register,
     queries_suite_register,
+    redundant_suite_register,
     setstate_suite_register,
     showextensions_suite_register,
     texcomplete_suite_register,
     triangles_suite_register,
+    yuv_suite_register,
 #endif /* TEST_GL */
     string_suite_register,
+    hashtable_suite_register,
     math_suite_register,
-    threads_suite_register
+    qoi_suite_register,
+    threads_suite_register,
+    time_suite_register
 };
 
 static void usage(void)
@@ -0,0 +1,90 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Validate the API porting layer time functions */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <bugle/time.h>
+#include <bugle/bool.h>
+#include <stddef.h>
+#include "test.h"
+
+/* Length of the interval used to check for drift, in seconds */
+#define DRIFT_INTERVAL 0.25
+/* Largest acceptable difference between the clocks over that interval */
+#define DRIFT_TOLERANCE 0.001
+
+static double time_elapsed(const bugle_timespec *start, const bugle_timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + 1e-9 * (end->tv_nsec - start->tv_nsec);
+}
+
+/* Checks that the fast clock never goes backwards */
+static void time_fast_monotonic(void)
+{
+    bugle_timespec prev, cur;
+    int i;
+    bugle_bool ok = BUGLE_TRUE;
+
+    TEST_ASSERT(bugle_gettime_fast(&prev) == 0);
+    for (i = 0; i < 100000; i++)
+    {
+        bugle_gettime_fast(&cur);
+        if (cur.tv_nsec < 0 || cur.tv_nsec >= 1000000000L
+            || time_elapsed(&prev, &cur) < 0.0)
+            ok = BUGLE_FALSE;
+        prev = cur;
+    }
+    TEST_ASSERT(ok);
+}
+
+/* Checks that the fast clock agrees with bugle_gettime, both in origin
+ * and in rate.
+ */
+static void time_fast_drift(void)
+{
+    bugle_timespec start, start_fast, end, end_fast;
+    double elapsed, elapsed_fast;
+
+    /* Make sure that calibration is done before the test starts */
+    bugle_gettime_fast(&start_fast);
+
+    bugle_gettime(&start);
+    bugle_gettime_fast(&start_fast);
+    TEST_ASSERT(time_elapsed(&start, &start_fast) < DRIFT_TOLERANCE);
+    TEST_ASSERT(time_elapsed(&start_fast, &start) < DRIFT_TOLERANCE);
+    do
+    {
+        bugle_gettime(&end);
+        elapsed = time_elapsed(&start, &end);
+    } while (elapsed < DRIFT_INTERVAL);
+    bugle_gettime_fast(&end_fast);
+    elapsed_fast = time_elapsed(&start_fast, &end_fast);
+
+    TEST_ASSERT(elapsed_fast - elapsed < DRIFT_TOLERANCE);
+    TEST_ASSERT(elapsed - elapsed_fast < DRIFT_TOLERANCE);
+    TEST_ASSERT(bugle_gettime_fast_source() != NULL);
+}
+
+void time_suite_register(void)
+{
+    test_suite *ts = test_suite_new("time", 0, NULL, NULL);
+    test_suite_add_test(ts, "fast_monotonic", time_fast_monotonic);
+    test_suite_add_test(ts, "fast_drift", time_fast_drift);
+}
@@ -0,0 +1,51 @@
+/* Measures the cost of reading the clocks used for statistics and logging,
+ * and reports which source the fast clock is using. The number of reads may
+ * be given on the command line. This test is not automated.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <bugle/time.h>
+
+#define DEFAULT_READS 10000000
+
+static double elapsed(const bugle_timespec *start, const bugle_timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + 1e-9 * (end->tv_nsec - start->tv_nsec);
+}
+
+static void bench(const char *name, int (*clock)(bugle_timespec *), long reads)
+{
+    bugle_timespec start, end, t;
+    long i;
+
+    /* Warm up, which also calibrates the fast clock */
+    clock(&t);
+
+    bugle_gettime(&start);
+    for (i = 0; i < reads; i++)
+        clock(&t);
+    bugle_gettime(&end);
+    printf("%-20s %.1f ns/read\n", name, elapsed(&start, &end) * 1e9 / reads);
+}
+
+int main(int argc, char **argv)
+{
+    long reads = DEFAULT_READS;
+
+    if (argc > 1)
+        reads = atol(argv[1]);
+    if (reads <= 0)
+    {
+        fprintf(stderr, "usage: %s [reads]\n", argv[0]);
+        return 1;
+    }
+
+    printf("fast clock source: %s\n", bugle_gettime_fast_source());
+    bench("bugle_gettime", bugle_gettime, reads);
+    bench("bugle_gettime_fast", bugle_gettime_fast, reads);
+    return 0;
+}
@@ -0,0 +1,204 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Runs the shaders that the screenshot filter-set uses to convert frames
+ * to YUV, in the same way as the filter-set, and compares the planes with
+ * those from the CPU conversion.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <GL/glew.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <bugle/memory.h>
+#include "common/yuv.h"
+#include "test.h"
+
+#define YUV_WIDTH 64
+#define YUV_HEIGHT 32
+
+static GLuint yuv_compile(GLenum type, const char *source)
+{
+    GLuint shader;
+    GLint status;
+
+    shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    TEST_ASSERT(status);
+    return shader;
+}
+
+static GLuint yuv_program(void)
+{
+    GLuint program, vs, fs;
+    GLint status;
+
+    vs = yuv_compile(GL_VERTEX_SHADER, bugle_yuv_vertex_source());
+    fs = yuv_compile(GL_FRAGMENT_SHADER, bugle_yuv_fragment_source());
+    program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    glLinkProgram(program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    TEST_ASSERT(status);
+    return program;
+}
+
+static void yuv_texture(GLuint texture, GLenum internal_format, int width, int height,
+                        GLenum filter, const GLvoid *pixels)
+{
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0,
+                 pixels ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+/* Bottom-up RGB with gradients, the extremes of each channel and some
+ * pseudo-random noise, so that neighbouring pixels differ.
+ */
+static void yuv_pattern(GLubyte *pixels)
+{
+    unsigned long seed = 1;
+    int x, y, c;
+    GLubyte *p = pixels;
+
+    for (y = 0; y < YUV_HEIGHT; y++)
+        for (x = 0; x < YUV_WIDTH; x++, p += 3)
+        {
+            seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+            if (y < 8)
+            {
+                p[0] = x * 4;
+                p[1] = y * 32;
+                p[2] = 255 - x * 4;
+            }
+            else if (y < 16)
+            {
+                /* Black, white and the primaries and secondaries */
+                c = (x / 8) & 7;
+                p[0] = (c & 1) ? 255 : 0;
+                p[1] = (c & 2) ? 255 : 0;
+                p[2] = (c & 4) ? 255 : 0;
+            }
+            else
+            {
+                p[0] = (seed >> 4) & 0xff;
+                p[1] = (seed >> 12) & 0xff;
+                p[2] = (seed >> 20) & 0xff;
+            }
+        }
+}
+
+static void yuv_compare(void)
+{
+    GLubyte *pixels, *expected, *actual, *offset;
+    GLuint program, source, planes[3], fbo;
+    size_t size, i;
+    int p, pw, ph, diff, max_diff = 0;
+
+    if (!GLEW_VERSION_2_0 || !GLEW_EXT_framebuffer_object)
+    {
+        test_skipped("GL 2.0 and EXT_framebuffer_object required");
+        return;
+    }
+
+    size = BUGLE_YUV_SIZE(YUV_WIDTH, YUV_HEIGHT);
+    pixels = BUGLE_NMALLOC(YUV_WIDTH * YUV_HEIGHT * 3, GLubyte);
+    expected = BUGLE_NMALLOC(size, GLubyte);
+    actual = BUGLE_NMALLOC(size, GLubyte);
+    yuv_pattern(pixels);
+    bugle_yuv_convert(pixels, YUV_WIDTH, YUV_HEIGHT, YUV_WIDTH * 3, expected);
+
+    program = yuv_program();
+    glGenTextures(1, &source);
+    glGenTextures(3, planes);
+    glGenFramebuffersEXT(1, &fbo);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    yuv_texture(source, GL_RGB8, YUV_WIDTH, YUV_HEIGHT, GL_LINEAR, pixels);
+    yuv_texture(planes[0], GL_RGBA8, YUV_WIDTH / 4, YUV_HEIGHT, GL_NEAREST, NULL);
+    yuv_texture(planes[1], GL_RGBA8, YUV_WIDTH / 8, YUV_HEIGHT / 2, GL_NEAREST, NULL);
+    yuv_texture(planes[2], GL_RGBA8, YUV_WIDTH / 8, YUV_HEIGHT / 2, GL_NEAREST, NULL);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source);
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "src"), 0);
+    glUniform2f(glGetUniformLocation(program, "size"), (GLfloat) YUV_WIDTH, (GLfloat) YUV_HEIGHT);
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
+    offset = actual;
+    for (p = 0; p < 3; p++)
+    {
+        pw = p ? YUV_WIDTH / 8 : YUV_WIDTH / 4;
+        ph = p ? YUV_HEIGHT / 2 : YUV_HEIGHT;
+        glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT,
+                                  GL_TEXTURE_2D, planes[p], 0);
+        if (!TEST_ASSERT(glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT) == GL_FRAMEBUFFER_COMPLETE_EXT))
+            break;
+        glViewport(0, 0, pw, ph);
+        glUniform4fv(glGetUniformLocation(program, "coeff"), 1, bugle_yuv_coefficients(p));
+        glUniform1f(glGetUniformLocation(program, "scale"), p ? 2.0f : 1.0f);
+        glBegin(GL_QUADS);
+        glVertex2f(-1.0f, -1.0f);
+        glVertex2f(1.0f, -1.0f);
+        glVertex2f(1.0f, 1.0f);
+        glVertex2f(-1.0f, 1.0f);
+        glEnd();
+        glReadPixels(0, 0, pw, ph, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+        offset += pw * ph * 4;
+    }
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+    glUseProgram(0);
+    TEST_ASSERT(glGetError() == GL_NO_ERROR);
+
+    /* The GPU works in floating point, so allow for rounding */
+    if (p == 3)
+    {
+        for (i = 0; i < size; i++)
+        {
+            diff = abs(actual[i] - expected[i]);
+            if (diff > max_diff)
+                max_diff = diff;
+        }
+        TEST_ASSERT(max_diff <= 1);
+    }
+
+    glDeleteFramebuffersEXT(1, &fbo);
+    glDeleteTextures(3, planes);
+    glDeleteTextures(1, &source);
+    glDeleteProgram(program);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    bugle_free(pixels);
+    bugle_free(expected);
+    bugle_free(actual);
+}
+
+void yuv_suite_register(void)
+{
+    test_suite *ts = test_suite_new("yuv", TEST_FLAG_CONTEXT, NULL, NULL);
+    test_suite_add_test(ts, "compare", yuv_compare);
+}
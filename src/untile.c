@@ -0,0 +1,177 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Reassembles the frames in a file written by the tiles writer of the
+ * screenshot filter-set, either as a sequence of PPM files or as a PPM
+ * stream on stdout that can be piped into a video encoder.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <bugle/bool.h>
+#include <bugle/memory.h>
+#include <bugle/string.h>
+#include "common/tilecapture.h"
+#include "platform/types.h"
+#if defined(BUGLE_PLATFORM_MSVCRT)
+# include <io.h>
+# include <fcntl.h>
+#endif
+
+static const char *untile_input = NULL;
+static const char *untile_pattern = NULL;
+static double untile_rate = 0.0;
+
+static void untile_usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [-o pattern] [-r fps] file\n"
+            "  -o pattern  write a PPM file per frame, replacing %%d with the frame number\n"
+            "              [write a PPM stream to standard output]\n"
+            "  -r fps      resample to a constant frame rate, repeating or dropping frames\n"
+            "              [one output frame per captured frame]\n",
+            argv0);
+    exit(1);
+}
+
+static void untile_parse_args(int argc, char **argv)
+{
+    int i;
+    char *end;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "-o") == 0)
+            untile_pattern = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+        {
+            untile_rate = strtod(argv[++i], &end);
+            if (*end || !(untile_rate > 0.0))
+                untile_usage(argv[0]);
+        }
+        else if (argv[i][0] != '-' && !untile_input)
+            untile_input = argv[i];
+        else
+            untile_usage(argv[0]);
+    }
+    if (!untile_input)
+        untile_usage(argv[0]);
+}
+
+static bugle_bool untile_write(const bugle_tilecapture_header *header,
+                               const unsigned char *image, unsigned long frame)
+{
+    FILE *out;
+    char *fname = NULL;
+    size_t size;
+    bugle_bool ok;
+
+    if (untile_pattern)
+    {
+        fname = bugle_asprintf(untile_pattern, (int) frame);
+        out = fopen(fname, "wb");
+        if (!out)
+        {
+            fprintf(stderr, "Failed to open %s: %s\n", fname, strerror(errno));
+            bugle_free(fname);
+            return BUGLE_FALSE;
+        }
+    }
+    else
+        out = stdout;
+
+    size = (size_t) header->width * header->height * 3;
+    ok = fprintf(out, "P6\n%lu %lu\n255\n",
+                 (unsigned long) header->width, (unsigned long) header->height) > 0
+        && fwrite(image, 1, size, out) == size;
+    if (untile_pattern)
+        ok = (fclose(out) == 0) && ok;
+    if (!ok)
+        fprintf(stderr, "Failed to write %s\n", fname ? fname : "frame");
+    bugle_free(fname);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in;
+    bugle_tilecapture_header header;
+    bugle_tilecapture_frame frame;
+    unsigned char *image, *shown = NULL;
+    size_t size;
+    unsigned long frames = 0, written = 0;
+    double next = 0.0;
+    bugle_bool ok = BUGLE_TRUE;
+
+    untile_parse_args(argc, argv);
+    in = fopen(untile_input, "rb");
+    if (!in)
+    {
+        fprintf(stderr, "Failed to open %s: %s\n", untile_input, strerror(errno));
+        return 1;
+    }
+    if (!bugle_tilecapture_read_header(in, &header))
+    {
+        fprintf(stderr, "%s is not a tile capture\n", untile_input);
+        fclose(in);
+        return 1;
+    }
+#if defined(BUGLE_PLATFORM_MSVCRT)
+    if (!untile_pattern)
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    size = (size_t) header.width * header.height * 3;
+    image = BUGLE_NMALLOC(size, unsigned char);
+    memset(image, 0, size);
+    if (untile_rate > 0.0)
+        shown = BUGLE_NMALLOC(size, unsigned char);
+    while (ok && bugle_tilecapture_read_frame(in, &header, &frame, image))
+    {
+        if (frames == 0 && !(frame.flags & BUGLE_TILECAPTURE_KEYFRAME))
+            fprintf(stderr, "Warning: the first frame is not a keyframe\n");
+        if (shown)
+        {
+            /* Output frames before this capture show the previous one */
+            if (frames > 0)
+                while (ok && next < frame.time * 1e-6)
+                {
+                    ok = untile_write(&header, shown, written++);
+                    next = written / untile_rate;
+                }
+            memcpy(shown, image, size);
+        }
+        else
+            ok = untile_write(&header, image, written++);
+        frames++;
+    }
+    /* There is nothing to say how long the last capture was shown for */
+    if (ok && shown && frames > 0)
+        ok = untile_write(&header, shown, written++);
+    if (ok && !feof(in))
+        fprintf(stderr, "Warning: %s is damaged after frame %lu\n", untile_input, frames);
+
+    fclose(in);
+    bugle_free(image);
+    bugle_free(shown);
+    return ok ? 0 : 1;
+}